@@ -298,13 +298,49 @@ namespace http {
         s << "<b>Routers:</b> " << i2p::data::netdb.GetNumRouters () << " ";
 		s << "<b>Floodfills:</b> " << i2p::data::netdb.GetNumFloodfills () << " ";
 		s << "<b>LeaseSets:</b> " << i2p::data::netdb.GetNumLeaseSets () << "<br>\r\n";
+		int numRouters = i2p::data::netdb.GetNumRouters ();
+		if (numRouters > 0)
+		{
+			size_t routersMemory = i2p::data::netdb.GetRouterInfosMemoryUsage ();
+			s << "<b>Routers memory:</b> " << routersMemory/1024 << " KiB, " << routersMemory/numRouters << " bytes per router<br>\r\n";
+		}
+		auto showMutex = [&s](const char * name, const i2p::util::MeasuredMutex& mutex)
+		{
+			s << name << " " << mutex.GetNumLocks () << " (" << mutex.GetNumContended () << " contended, "
+				<< mutex.GetWaitTime ()/1000 << " ms waited) ";
+		};
+		s << "<b>NetDb locks:</b> ";
+		showMutex ("routers", i2p::data::netdb.GetRouterInfosMutex ());
+		showMutex ("floodfills", i2p::data::netdb.GetFloodfillsMutex ());
+		showMutex ("leasesets", i2p::data::netdb.GetLeaseSetsMutex ());
+		s << "<b>Snapshots:</b> " << i2p::data::netdb.GetNumSnapshots () << "<br>\r\n";
+		s << "<b>Profiles:</b> " << i2p::data::GetNumProfiles () << "<br>\r\n";
+		auto elGamalPool = i2p::client::GetElGamalPool ();
+		if (elGamalPool)
+			s << "<b>ElGamal pool:</b> " << elGamalPool->GetQueueSize () << " queued, "
+			  << elGamalPool->GetNumCompleted () << " completed<br>\r\n";
 
 		size_t clientTunnelCount = i2p::tunnel::tunnels.CountOutboundTunnels();
 		clientTunnelCount += i2p::tunnel::tunnels.CountInboundTunnels();
 		size_t transitTunnelCount = i2p::tunnel::tunnels.CountTransitTunnels();
 
 		s << "<b>Client Tunnels:</b> " << std::to_string(clientTunnelCount) << " ";
-		s << "<b>Transit Tunnels:</b> " << std::to_string(transitTunnelCount) << "<br>\r\n<br>\r\n";
+		s << "<b>Transit Tunnels:</b> " << std::to_string(transitTunnelCount) << "<br>\r\n";
+		auto poolsStats = i2p::GetI2NPMessagePoolsStats ();
+		size_t inUseBytes = 0, allocatedBytes = 0;
+		for (const auto& it: poolsStats)
+		{
+			inUseBytes += it.numInUse*it.bufferSize;
+			allocatedBytes += it.numAllocated*it.bufferSize;
+		}
+		s << "<b>I2NP messages memory:</b> ";
+		ShowTraffic (s, inUseBytes);
+		s << " in use, ";
+		ShowTraffic (s, allocatedBytes);
+		s << " allocated (buffers in use/allocated:";
+		for (const auto& it: poolsStats)
+			s << " " << it.name << " " << it.numInUse << "/" << it.numAllocated;
+		s << ")<br>\r\n<br>\r\n";
 
         if(outputFormat==OutputFormatEnum::forWebConsole) {
             s << "<table><caption>Services</caption><tr><th>Service</th><th>State</th></tr>\r\n";
@@ -380,6 +416,11 @@ namespace http {
 		}
 		s << "<br>\r\n";
 		s << "<b>Tags</b><br>Incoming: <i>" << dest->GetNumIncomingTags () << "</i><br>";
+		s << "ElGamal: <i>" << dest->GetNumPendingElGamal () << "</i> pending, <i>" << dest->GetNumAsyncElGamal ()
+		  << "</i> done in worker, <i>" << dest->GetNumDroppedElGamal () << "</i> dropped<br>\r\n";
+		s << "Prepared in advance: ElGamal <i>" << dest->GetNumPreparedElGamalHits () << "</i> hits, <i>"
+		  << dest->GetNumPreparedElGamalMisses () << "</i> misses, tags <i>" << dest->GetNumPreparedTagsHits ()
+		  << "</i> hits, <i>" << dest->GetNumPreparedTagsMisses () << "</i> misses<br>\r\n";
 		if (!dest->GetSessions ().empty ()) {
 			s << "<div class='slide'><label for='slide-tags'>Outgoing:</label>\r\n<input type='checkbox' id='slide-tags'/>\r\n<p class='content'>\r\n";
 			for (const auto& it: dest->GetSessions ())
@@ -409,6 +450,7 @@ namespace http {
 			s << "<th>In</th>";
 			s << "<th>Buf</th>";
 			s << "<th>RTT</th>";
+			s << "<th>RTO</th>";
 			s << "<th>Window</th>";
 			s << "<th>Status</th>";
 			s << "</tr>\r\n";
@@ -424,7 +466,8 @@ namespace http {
 				s << "<td>" << it->GetReceiveQueueSize () << "</td>";
 				s << "<td>" << it->GetSendBufferSize () << "</td>";
 				s << "<td>" << it->GetRTT () << "</td>";
-				s << "<td>" << it->GetWindowSize () << "</td>";
+				s << "<td>" << it->GetRTO () << "</td>";
+				s << "<td>" << it->GetWindowSize () << " (" << it->GetCongestionControlName () << ")</td>";
 				s << "<td>" << (int)it->GetStatus () << "</td>";
 				s << "</tr>\r\n";
 			}
@@ -484,7 +527,14 @@ namespace http {
 	void ShowTunnels (std::stringstream& s)
 	{
 		s << "<b>Tunnels:</b><br>\r\n<br>\r\n";
-		s << "<b>Queue size:</b> " << i2p::tunnel::tunnels.GetQueueSize () << "<br>\r\n";
+		s << "<b>Queue size:</b> " << i2p::tunnel::tunnels.GetQueueSize () << " (dropped " << i2p::tunnel::tunnels.GetNumDroppedMsgs () << ")<br>\r\n";
+		for (auto& it: i2p::tunnel::tunnels.GetShards ())
+			s << "&nbsp;&nbsp;<b>Thread " << it->GetIndex () << ":</b> queue " << it->GetQueueSize ()
+				<< " (max " << it->GetMaxQueueSize () << "), " << it->GetNumProcessedMsgs () << " messages, "
+				<< it->GetNumDroppedMsgs () << " dropped<br>\r\n";
+		if (i2p::tunnel::tunnels.HasBuildPool ())
+			s << "<b>Pending build requests:</b> " << i2p::tunnel::tunnels.GetNumPendingBuildRequests ()
+				<< " (dropped " << i2p::tunnel::tunnels.GetNumDroppedBuildRequests () << ")<br>\r\n";
 
 		auto ExplPool = i2p::tunnel::tunnels.GetExploratoryPool ();
 
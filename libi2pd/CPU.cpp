@@ -10,6 +10,12 @@
 #ifndef bit_AVX
 #define bit_AVX (1 << 28)
 #endif
+#ifndef bit_SSE2
+#define bit_SSE2 (1 << 26)
+#endif
+#ifndef bit_AVX2
+#define bit_AVX2 (1 << 5)
+#endif
 
 
 namespace i2p
@@ -18,10 +24,12 @@ namespace cpu
 {
 	bool aesni = false;
 	bool avx = false;
+	bool sse2 = false;
+	bool avx2 = false;
 
 	void Detect()
 	{
-#if defined(__AES__) || defined(__AVX__)
+#if defined(__AES__) || defined(__AVX__) || defined(__SSE2__)
 
 #if defined(__x86_64__) || defined(__i386__)
 		int info[4];
@@ -34,7 +42,18 @@ namespace cpu
 #ifdef __AVX__
 			avx = info[2] & bit_AVX;  // AVX
 #endif  // __AVX__
+#ifdef __SSE2__
+			sse2 = info[3] & bit_SSE2;  // SSE2
+#endif  // __SSE2__
+		}
+#ifdef __SSE2__
+		// AVX2 code is compiled with target attribute, so checked without -mavx2
+		__cpuid(0, info[0], info[1], info[2], info[3]);
+		if (info[0] >= 0x00000007) {
+			__cpuid_count(0x00000007, 0, info[0], info[1], info[2], info[3]);
+			avx2 = info[1] & bit_AVX2;  // AVX2
 		}
+#endif  // __SSE2__
 #endif  // defined(__x86_64__) || defined(__i386__)
 
 #ifdef __AES__
@@ -49,7 +68,13 @@ namespace cpu
 			LogPrint(eLogInfo, "AVX enabled");
 		}
 #endif  // __AVX__
-#endif  // defined(__AES__) || defined(__AVX__)
+#ifdef __SSE2__
+		if(avx2)
+		{
+			LogPrint(eLogInfo, "AVX2 enabled");
+		}
+#endif  // __SSE2__
+#endif  // defined(__AES__) || defined(__AVX__) || defined(__SSE2__)
 	}
 }
 }
@@ -7,6 +7,8 @@ namespace cpu
 {
   extern bool aesni;
   extern bool avx;
+  extern bool sse2;
+  extern bool avx2;
 
   void Detect();
 }
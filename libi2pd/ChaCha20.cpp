@@ -1,4 +1,12 @@
 #include "ChaCha20.h"
+#include "CPU.h"
+#ifdef __SSE2__
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+// AVX2 code is compiled for its function only, i2p::cpu::avx2 protects CPUs without it
+#define CHACHA_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
 
 /**
    This code is licensed under the MCGSI Public License
@@ -103,6 +111,101 @@ void block(const State_t &input, Block_t & block, int rounds)
     block << x;
 
 }
+
+#ifdef __SSE2__
+// 4 or 8 blocks in parallel, vector i holds word i of every block
+#define CHACHA_QUARTERROUND(ADD, XOR, ROTL, a, b, c, d) \
+    x[a] = ADD(x[a], x[b]); x[d] = ROTL(XOR(x[d], x[a]), 16); \
+    x[c] = ADD(x[c], x[d]); x[b] = ROTL(XOR(x[b], x[c]), 12); \
+    x[a] = ADD(x[a], x[b]); x[d] = ROTL(XOR(x[d], x[a]),  8); \
+    x[c] = ADD(x[c], x[d]); x[b] = ROTL(XOR(x[b], x[c]),  7);
+
+#define CHACHA_DOUBLEROUND(ADD, XOR, ROTL) \
+    CHACHA_QUARTERROUND(ADD, XOR, ROTL, 0, 4,  8, 12) \
+    CHACHA_QUARTERROUND(ADD, XOR, ROTL, 1, 5,  9, 13) \
+    CHACHA_QUARTERROUND(ADD, XOR, ROTL, 2, 6, 10, 14) \
+    CHACHA_QUARTERROUND(ADD, XOR, ROTL, 3, 7, 11, 15) \
+    CHACHA_QUARTERROUND(ADD, XOR, ROTL, 0, 5, 10, 15) \
+    CHACHA_QUARTERROUND(ADD, XOR, ROTL, 1, 6, 11, 12) \
+    CHACHA_QUARTERROUND(ADD, XOR, ROTL, 2, 7,  8, 13) \
+    CHACHA_QUARTERROUND(ADD, XOR, ROTL, 3, 4,  9, 14)
+
+static inline void xor128(uint8_t * buf, __m128i v)
+{
+    _mm_storeu_si128((__m128i *)buf, _mm_xor_si128(_mm_loadu_si128((const __m128i *)buf), v));
+}
+#endif
+
+#ifdef __SSE2__
+#define CHACHA_ROTL128(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - n))
+
+/** xor 4 blocks (256 bytes) of buf with keystream */
+void blocks4(const State_t &input, uint8_t * buf, int rounds)
+{
+    __m128i x[16], orig[16];
+    int i;
+    for (i = 0; i < 16; i++)
+        orig[i] = _mm_set1_epi32(input.data[i]);
+    orig[12] = _mm_add_epi32(orig[12], _mm_set_epi32(3, 2, 1, 0));
+    for (i = 0; i < 16; i++)
+        x[i] = orig[i];
+
+    for (i = rounds; i > 0; i -= 2)
+    {
+        CHACHA_DOUBLEROUND(_mm_add_epi32, _mm_xor_si128, CHACHA_ROTL128)
+    }
+    for (i = 0; i < 16; i++)
+        x[i] = _mm_add_epi32(x[i], orig[i]);
+
+    // transpose words 4*i..4*i+3 of 4 blocks
+    for (i = 0; i < 16; i += 4)
+    {
+        __m128i t0 = _mm_unpacklo_epi32(x[i], x[i + 1]), t1 = _mm_unpacklo_epi32(x[i + 2], x[i + 3]),
+            t2 = _mm_unpackhi_epi32(x[i], x[i + 1]), t3 = _mm_unpackhi_epi32(x[i + 2], x[i + 3]);
+        xor128(buf + (i << 2), _mm_unpacklo_epi64(t0, t1));
+        xor128(buf + blocksize + (i << 2), _mm_unpackhi_epi64(t0, t1));
+        xor128(buf + 2*blocksize + (i << 2), _mm_unpacklo_epi64(t2, t3));
+        xor128(buf + 3*blocksize + (i << 2), _mm_unpackhi_epi64(t2, t3));
+    }
+}
+#endif
+
+#ifdef CHACHA_AVX2
+#define CHACHA_ROTL256(v, n) _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - n))
+
+/** xor 8 blocks (512 bytes) of buf with keystream */
+CHACHA_AVX2 void blocks8(const State_t &input, uint8_t * buf, int rounds)
+{
+    __m256i x[16], orig[16];
+    int i;
+    for (i = 0; i < 16; i++)
+        orig[i] = _mm256_set1_epi32(input.data[i]);
+    orig[12] = _mm256_add_epi32(orig[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    for (i = 0; i < 16; i++)
+        x[i] = orig[i];
+
+    for (i = rounds; i > 0; i -= 2)
+    {
+        CHACHA_DOUBLEROUND(_mm256_add_epi32, _mm256_xor_si256, CHACHA_ROTL256)
+    }
+    for (i = 0; i < 16; i++)
+        x[i] = _mm256_add_epi32(x[i], orig[i]);
+
+    // transpose within 128-bit lanes, low lane is blocks 0-3, high lane is blocks 4-7
+    for (i = 0; i < 16; i += 4)
+    {
+        __m256i t0 = _mm256_unpacklo_epi32(x[i], x[i + 1]), t1 = _mm256_unpacklo_epi32(x[i + 2], x[i + 3]),
+            t2 = _mm256_unpackhi_epi32(x[i], x[i + 1]), t3 = _mm256_unpackhi_epi32(x[i + 2], x[i + 3]);
+        __m256i b[4] = { _mm256_unpacklo_epi64(t0, t1), _mm256_unpackhi_epi64(t0, t1),
+            _mm256_unpacklo_epi64(t2, t3), _mm256_unpackhi_epi64(t2, t3) };
+        for (int j = 0; j < 4; j++)
+        {
+            xor128(buf + j*blocksize + (i << 2), _mm256_castsi256_si128(b[j]));
+            xor128(buf + (j + 4)*blocksize + (i << 2), _mm256_extracti128_si256(b[j], 1));
+        }
+    }
+}
+#endif
 } // namespace chacha
 
 
@@ -129,8 +232,29 @@ void chacha20(uint8_t * buf, size_t sz, const uint8_t * nonce, const uint8_t * k
     for (i = 0; i < 3; i++) 
         state.data[13 + i] = chacha::u8t32le(nonce + i * 4);
 
-    
-    for (i = 0; i < sz; i += chacha::blocksize) 
+
+    i = 0;
+#ifdef CHACHA_AVX2
+    if (i2p::cpu::avx2)
+    {
+        for (; i + 8*chacha::blocksize <= sz; i += 8*chacha::blocksize)
+        {
+            chacha::blocks8(state, buf + i, chacha::rounds);
+            state.data[12] += 8;
+        }
+    }
+#endif
+#ifdef __SSE2__
+    if (i2p::cpu::sse2)
+    {
+        for (; i + 4*chacha::blocksize <= sz; i += 4*chacha::blocksize)
+        {
+            chacha::blocks4(state, buf + i, chacha::rounds);
+            state.data[12] += 4;
+        }
+    }
+#endif
+    for (; i < sz; i += chacha::blocksize) 
     {
         chacha::block(state, block, chacha::rounds);
         state.data[12]++;
@@ -17,7 +17,7 @@ namespace crypto
   const std::size_t CHACHA20_KEY_BYTES = 32;
   const std::size_t CHACHA20_NOUNCE_BYTES = 12;
 
-  /** encrypt buf in place with chacha20 */
+  /** encrypt buf in place with chacha20, AEAD uses it with LEGACY_OPENSSL only, EVP_chacha20_poly1305 is faster */
   void chacha20(uint8_t * buf, size_t sz, const uint8_t * nonce, const uint8_t * key, uint32_t counter=1);
 
 }
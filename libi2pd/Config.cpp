@@ -74,6 +74,9 @@ namespace config {
 			("limits.ntcpsoft", value<uint16_t>()->default_value(0),          "Threshold to start probabalistic backoff with ntcp sessions (default: use system limit)")
 			("limits.ntcphard", value<uint16_t>()->default_value(0),          "Maximum number of ntcp sessions (default: use system limit)")
 			("limits.ntcpthreads", value<uint16_t>()->default_value(1),       "Maximum number of threads used by NTCP DH worker (default: 1)")
+			("limits.ssuthreads", value<uint16_t>()->default_value(1),        "Number of SSU threads, each with own SO_REUSEPORT socket (default: 1)")
+			("limits.tcpthreads", value<uint16_t>()->default_value(1),        "Number of threads running NTCP and NTCP2 sessions (default: 1)")
+			("limits.elgamalthreads", value<uint16_t>()->default_value(1),    "Number of threads doing ElGamal for local destinations, 0 - in destination's thread (default: 1)")
 		;
 
 		options_description httpserver("HTTP Server options");
@@ -231,6 +234,20 @@ namespace config {
 			("exploratory.outbound.quantity", value<int>()->default_value(3), "Exploratory outbound tunnels quantity")
 		;
 
+		options_description tunnels("Tunnels Options");
+		tunnels.add_options()
+			("tunnels.threads", value<int>()->default_value(1), "Number of threads handling tunnel data, sharded by tunnel ID (default: 1)")
+			("tunnels.buildthreads", value<int>()->default_value(1), "Number of threads decrypting tunnel build requests, 0 - tunnels thread (default: 1)")
+			("tunnels.buildqueue", value<int>()->default_value(256), "Max number of pending build requests, extra requests are dropped (default: 256)")
+		;
+
+		options_description netdb("NetDb Options");
+		netdb.add_options()
+			("netdb.threads", value<int>()->default_value(0), "Number of threads loading and verifying netDb at startup (default: 0 - number of CPU cores)")
+			("netdb.storage", value<std::string>()->default_value("files"), "RouterInfos storage: files - netDb directory, log - single netDb.log file (default: files)")
+			("netdb.compact", value<bool>()->default_value(false), "Drop properties and buffers of RouterInfos from memory when not needed (default: disabled)")
+		;
+
 		options_description ntcp2("NTCP2 Options");
 		ntcp2.add_options()
 			("ntcp2.enabled", value<bool>()->default_value(true), "Enable NTCP2 (default: enabled)")
@@ -255,6 +272,8 @@ namespace config {
 			.add(trust)
 			.add(websocket)
 			.add(exploratory)
+			.add(tunnels)
+			.add(netdb)
 			.add(ntcp2)
 		;
 	}
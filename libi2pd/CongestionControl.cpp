@@ -0,0 +1,292 @@
+#include <math.h>
+#include <algorithm>
+#include "Log.h"
+#include "CongestionControl.h"
+
+namespace i2p
+{
+namespace stream
+{
+	RTTEstimator::RTTEstimator ():
+		m_RTT (INITIAL_RTT), m_RTTVar (INITIAL_RTT/2), m_MinRTT (0), m_RTO (INITIAL_RTO), m_NumSamples (0)
+	{
+	}
+
+	void RTTEstimator::AddSample (int rtt)
+	{
+		if (rtt <= 0) rtt = 1;
+		if (!m_NumSamples)
+		{
+			m_RTT = rtt;
+			m_RTTVar = rtt/2;
+		}
+		else
+		{
+			// variation is updated with previous RTT
+			m_RTTVar = (3*m_RTTVar + abs (m_RTT - rtt))/4;
+			m_RTT = (7*m_RTT + rtt)/8;
+		}
+		if (!m_MinRTT || rtt < m_MinRTT) m_MinRTT = rtt;
+		m_NumSamples++;
+		UpdateRTO ();
+	}
+
+	void RTTEstimator::SetInitialRTT (int rtt)
+	{
+		if (m_NumSamples || rtt <= 0) return;
+		m_RTT = rtt;
+		m_RTTVar = rtt/2;
+		UpdateRTO ();
+	}
+
+	void RTTEstimator::UpdateRTO ()
+	{
+		m_RTO = m_RTT + std::max (RTO_GRANULARITY, 4*m_RTTVar);
+		if (m_RTO < MIN_RTO) m_RTO = MIN_RTO;
+		if (m_RTO > MAX_RTO) m_RTO = MAX_RTO;
+	}
+
+	CongestionControl::CongestionControl ():
+		m_WindowSize (MIN_WINDOW_SIZE), m_SSThresh (MAX_WINDOW_SIZE)
+	{
+	}
+
+	int CongestionControl::GetWindowSize () const
+	{
+		return m_WindowSize;
+	}
+
+	void CongestionControl::SetWindowSize (double windowSize)
+	{
+		if (windowSize < MIN_WINDOW_SIZE) windowSize = MIN_WINDOW_SIZE;
+		if (windowSize > MAX_WINDOW_SIZE) windowSize = MAX_WINDOW_SIZE;
+		m_WindowSize = windowSize;
+	}
+
+	void CongestionControl::OnLoss (uint64_t)
+	{
+		m_SSThresh = std::max (m_WindowSize/2, 2.0);
+		SetWindowSize (std::min (m_WindowSize, m_SSThresh)); // loss never grows window
+	}
+
+	void CongestionControl::OnTimeout (uint64_t)
+	{
+		m_SSThresh = std::max (m_WindowSize/2, 2.0);
+		SetWindowSize (MIN_WINDOW_SIZE);
+	}
+
+	void RenoCongestionControl::OnAck (int numAcked, int, uint64_t)
+	{
+		if (IsSlowStart ())
+			SetWindowSize (m_WindowSize + numAcked);
+		else
+			SetWindowSize (m_WindowSize + (double)numAcked/m_WindowSize); // one per window
+	}
+
+	const double CUBIC_C = 0.4; // messages/s^3
+	const double CUBIC_BETA = 0.7; // window after loss
+
+	CubicCongestionControl::CubicCongestionControl ():
+		m_WMax (0), m_K (0), m_WEst (0), m_EpochStart (0), m_MinRTT (0)
+	{
+	}
+
+	void CubicCongestionControl::OnAck (int numAcked, int rtt, uint64_t ts)
+	{
+		if (rtt > 0 && (!m_MinRTT || rtt < m_MinRTT)) m_MinRTT = rtt;
+		if (IsSlowStart ())
+		{
+			SetWindowSize (m_WindowSize + numAcked);
+			return;
+		}
+		if (!m_EpochStart)
+		{
+			// first ack after reduction
+			m_EpochStart = ts;
+			if (m_WindowSize < m_WMax)
+				m_K = cbrt ((m_WMax - m_WindowSize)/CUBIC_C);
+			else
+			{
+				m_K = 0;
+				m_WMax = m_WindowSize;
+			}
+			m_WEst = m_WindowSize;
+		}
+		double t = (ts - m_EpochStart + m_MinRTT)/1000.0; // window we should have in one RTT
+		double target = m_WMax + CUBIC_C*(t - m_K)*(t - m_K)*(t - m_K);
+		if (target > 1.5*m_WindowSize) target = 1.5*m_WindowSize;
+		double windowSize = m_WindowSize;
+		if (target > windowSize)
+			windowSize += (target - windowSize)*numAcked/windowSize;
+		else
+			windowSize += 0.01*numAcked/windowSize; // plateau around previous maximum
+		// not slower than Reno with same average window
+		m_WEst += 3*(1 - CUBIC_BETA)/(1 + CUBIC_BETA)*numAcked/m_WindowSize;
+		if (m_WEst > windowSize) windowSize = m_WEst;
+		SetWindowSize (windowSize);
+	}
+
+	void CubicCongestionControl::ResetEpoch ()
+	{
+		m_EpochStart = 0;
+		// fast convergence, release bandwidth for new streams if maximum dropped
+		if (m_WindowSize < m_WMax)
+			m_WMax = m_WindowSize*(1 + CUBIC_BETA)/2;
+		else
+			m_WMax = m_WindowSize;
+	}
+
+	void CubicCongestionControl::OnLoss (uint64_t)
+	{
+		ResetEpoch ();
+		SetWindowSize (m_WindowSize*CUBIC_BETA);
+		m_SSThresh = m_WindowSize;
+	}
+
+	void CubicCongestionControl::OnTimeout (uint64_t)
+	{
+		ResetEpoch ();
+		m_SSThresh = std::max (m_WindowSize*CUBIC_BETA, 2.0);
+		SetWindowSize (MIN_WINDOW_SIZE);
+	}
+
+	const double VEGAS_ALPHA = 2; // messages queued in tunnels
+	const double VEGAS_BETA = 4;
+	const double VEGAS_GAMMA = 1; // leave slow start
+
+	VegasCongestionControl::VegasCongestionControl ():
+		m_BaseRTT (0), m_RoundMinRTT (0), m_RoundEnd (0)
+	{
+	}
+
+	void VegasCongestionControl::OnAck (int numAcked, int rtt, uint64_t ts)
+	{
+		if (rtt > 0)
+		{
+			if (!m_BaseRTT || rtt < m_BaseRTT) m_BaseRTT = rtt;
+			if (!m_RoundMinRTT || rtt < m_RoundMinRTT) m_RoundMinRTT = rtt;
+		}
+		if (IsSlowStart ())
+			SetWindowSize (m_WindowSize + numAcked);
+		if (ts < m_RoundEnd || !m_RoundMinRTT) return;
+		// once per RTT, difference between expected and actual rate times base RTT
+		double diff = m_WindowSize*(m_RoundMinRTT - m_BaseRTT)/m_RoundMinRTT;
+		if (IsSlowStart ())
+		{
+			if (diff > VEGAS_GAMMA)
+			{
+				SetWindowSize (std::min (m_WindowSize, m_WindowSize*m_BaseRTT/m_RoundMinRTT + 1));
+				m_SSThresh = m_WindowSize;
+			}
+		}
+		else if (diff < VEGAS_ALPHA)
+			SetWindowSize (m_WindowSize + 1);
+		else if (diff > VEGAS_BETA)
+			SetWindowSize (m_WindowSize - 1);
+		m_RoundEnd = ts + m_RoundMinRTT;
+		m_RoundMinRTT = 0;
+	}
+
+	void VegasCongestionControl::OnTimeout (uint64_t ts)
+	{
+		CongestionControl::OnTimeout (ts);
+		m_BaseRTT = 0;
+		m_RoundMinRTT = 0;
+		m_RoundEnd = 0;
+	}
+
+	std::unique_ptr<CongestionControl> CreateCongestionControl (const std::string& name)
+	{
+		if (name == "reno")
+			return std::unique_ptr<CongestionControl>(new RenoCongestionControl ());
+		if (name == "vegas")
+			return std::unique_ptr<CongestionControl>(new VegasCongestionControl ());
+		if (name != "cubic")
+			LogPrint (eLogWarning, "Streaming: Unknown congestion control ", name, ", using ", DEFAULT_CONGESTION_CONTROL);
+		return std::unique_ptr<CongestionControl>(new CubicCongestionControl ());
+	}
+
+	SendWindow::SendWindow (std::unique_ptr<CongestionControl> congestionControl):
+		m_CongestionControl (std::move (congestionControl)), m_RTO (INITIAL_RTO), m_NumResendAttempts (0),
+		m_IsRecovering (false), m_RecoverySeqn (0), m_LossSeqn (0), m_NumAcked (0), m_RTTSample (0)
+	{
+	}
+
+	void SendWindow::StartAck ()
+	{
+		m_NumAcked = 0;
+		m_RTTSample = 0;
+	}
+
+	void SendWindow::Acked (const SentPacketInfo& packet, uint64_t ts)
+	{
+		m_NumAcked++;
+		if (!m_RTTSample && !packet.resent) // oldest, includes remote ack delay. Ambiguous if resent, Karn's algorithm
+		{
+			m_RTTSample = ts > packet.sendTime ? ts - packet.sendTime : 1;
+			m_RTTEstimator.AddSample (m_RTTSample);
+		}
+	}
+
+	bool SendWindow::NACKed (SentPacketInfo& packet, uint64_t ts)
+	{
+		// NACKs sent before resent packet could arrive don't count
+		if (ts < packet.sendTime + m_RTTEstimator.GetMinRTT ()) return false;
+		packet.numNACKs++;
+		return packet.numNACKs == FAST_RETRANSMIT_NUM_NACKS;
+	}
+
+	void SendWindow::FinishAck (uint32_t firstUnacked, uint32_t nextSeqn, bool lost, uint64_t ts)
+	{
+		if (m_NumAcked > 0)
+		{
+			m_NumResendAttempts = 0;
+			m_RTO = m_RTTEstimator.GetRTO ();
+			if (m_IsRecovering && firstUnacked >= m_RecoverySeqn)
+				m_IsRecovering = false;
+			if (!m_IsRecovering)
+				m_CongestionControl->OnAck (m_NumAcked, m_RTTSample, ts);
+		}
+		if (lost && !m_IsRecovering && firstUnacked >= m_LossSeqn)
+		{
+			// fast retransmit, window is reduced once for all lost before it's acked
+			StartRecovery (nextSeqn, nextSeqn);
+			m_CongestionControl->OnLoss (ts);
+		}
+	}
+
+	int SendWindow::Timeout (uint32_t firstResent, uint32_t nextSeqn, uint64_t ts)
+	{
+		m_NumResendAttempts++;
+		m_RTO *= 2;
+		if (m_RTO > MAX_RTO) m_RTO = MAX_RTO;
+		if (m_NumResendAttempts == 1)
+		{
+			// slow start again as soon as resent packet is acked
+			StartRecovery (firstResent + 1, nextSeqn);
+			m_CongestionControl->OnTimeout (ts);
+		}
+		return m_NumResendAttempts;
+	}
+
+	void SendWindow::StartRecovery (uint32_t recoverySeqn, uint32_t nextSeqn)
+	{
+		m_IsRecovering = true;
+		m_RecoverySeqn = recoverySeqn;
+		m_LossSeqn = nextSeqn;
+	}
+
+	void SendWindow::Resent (SentPacketInfo& packet, uint64_t ts)
+	{
+		packet.sendTime = ts;
+		packet.resent = true;
+		packet.numNACKs = 0;
+	}
+
+	void SendWindow::SetInitialRTT (int rtt)
+	{
+		m_RTTEstimator.SetInitialRTT (rtt);
+		m_RTO = m_RTTEstimator.GetRTO ();
+	}
+}
+}
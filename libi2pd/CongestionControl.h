@@ -0,0 +1,180 @@
+#ifndef CONGESTION_CONTROL_H__
+#define CONGESTION_CONTROL_H__
+
+#include <inttypes.h>
+#include <string>
+#include <memory>
+
+namespace i2p
+{
+namespace stream
+{
+	const int MIN_WINDOW_SIZE = 1; // in messages
+	const int MAX_WINDOW_SIZE = 128;
+	const int INITIAL_RTT = 8000; // in milliseconds
+	const int INITIAL_RTO = 9000; // in milliseconds
+	const int MIN_RTO = 200; // in milliseconds
+	const int MAX_RTO = 60000; // in milliseconds
+	const int RTO_GRANULARITY = 20; // in milliseconds, lower bound of 4*RTTVAR
+	const int FAST_RETRANSMIT_NUM_NACKS = 2; // packet is lost after that many NACKs
+
+	/** smoothed RTT and its variation as RFC 6298, RTO = SRTT + 4*RTTVAR */
+	class RTTEstimator
+	{
+		public:
+
+			RTTEstimator ();
+
+			void AddSample (int rtt); // in milliseconds, never for resent packets
+			void SetInitialRTT (int rtt); // of shared routing path, ignored after first sample
+
+			int GetRTT () const { return m_RTT; };
+			int GetRTTVar () const { return m_RTTVar; };
+			int GetMinRTT () const { return m_MinRTT; }; // 0 if no samples yet
+			int GetRTO () const { return m_RTO; };
+
+		private:
+
+			void UpdateRTO ();
+
+		private:
+
+			int m_RTT, m_RTTVar, m_MinRTT, m_RTO;
+			int m_NumSamples;
+	};
+
+	/** congestion window in messages. Stream calls OnLoss once per window and doesn't call OnAck during recovery */
+	class CongestionControl
+	{
+		public:
+
+			CongestionControl ();
+			virtual ~CongestionControl () {};
+
+			virtual const char * GetName () const = 0;
+			virtual void OnAck (int numAcked, int rtt, uint64_t ts) = 0; // rtt is 0 if not measured, ts in milliseconds
+			virtual void OnLoss (uint64_t ts); // NACKed enough times, multiplicative decrease
+			virtual void OnTimeout (uint64_t ts); // nothing acked within RTO, restart from slow start
+
+			int GetWindowSize () const;
+			bool IsSlowStart () const { return m_WindowSize < m_SSThresh; };
+
+		protected:
+
+			void SetWindowSize (double windowSize);
+
+		protected:
+
+			double m_WindowSize, m_SSThresh;
+	};
+
+	/** additive increase of one message per RTT, halving on loss */
+	class RenoCongestionControl: public CongestionControl
+	{
+		public:
+
+			const char * GetName () const { return "reno"; };
+			void OnAck (int numAcked, int rtt, uint64_t ts);
+	};
+
+	/** window is cubic function of time since last loss, independent of RTT, RFC 8312 */
+	class CubicCongestionControl: public CongestionControl
+	{
+		public:
+
+			CubicCongestionControl ();
+
+			const char * GetName () const { return "cubic"; };
+			void OnAck (int numAcked, int rtt, uint64_t ts);
+			void OnLoss (uint64_t ts);
+			void OnTimeout (uint64_t ts);
+
+		private:
+
+			void ResetEpoch ();
+
+		private:
+
+			double m_WMax, m_K, m_WEst; // window before reduction, seconds to reach it again, Reno-friendly estimate
+			uint64_t m_EpochStart;
+			int m_MinRTT;
+	};
+
+	/** delay based, keeps between ALPHA and BETA messages queued in tunnels as TCP Vegas */
+	class VegasCongestionControl: public CongestionControl
+	{
+		public:
+
+			VegasCongestionControl ();
+
+			const char * GetName () const { return "vegas"; };
+			void OnAck (int numAcked, int rtt, uint64_t ts);
+			void OnTimeout (uint64_t ts); // base RTT is measured again, stream might switch tunnels
+
+		private:
+
+			int m_BaseRTT, m_RoundMinRTT;
+			uint64_t m_RoundEnd;
+	};
+
+	const char DEFAULT_CONGESTION_CONTROL[] = "cubic";
+	std::unique_ptr<CongestionControl> CreateCongestionControl (const std::string& name); // reno, cubic or vegas, default if unknown
+
+	struct SentPacketInfo
+	{
+		uint64_t sendTime; // in milliseconds
+		bool resent; // no RTT sample from ack
+		int numNACKs; // since last send
+
+		SentPacketInfo (): sendTime (0), resent (false), numNACKs (0) {};
+	};
+
+	/** RTO, fast retransmit and recovery of sender, window is reduced once per loss until all sent before it are acked.
+	 * Window doesn't grow during fast recovery, but does after RTO once resent packet is acked */
+	class SendWindow
+	{
+		public:
+
+			SendWindow (std::unique_ptr<CongestionControl> congestionControl);
+
+			// ack, for packets up to ackThrough in order of seqn
+			void StartAck ();
+			void Acked (const SentPacketInfo& packet, uint64_t ts);
+			bool NACKed (SentPacketInfo& packet, uint64_t ts); // true if lost and must be resent
+			void FinishAck (uint32_t firstUnacked, uint32_t nextSeqn, bool lost, uint64_t ts); // firstUnacked is nextSeqn if nothing in flight
+			int GetNumAcked () const { return m_NumAcked; }; // by current ack
+
+			// resend timer
+			bool IsTimedOut (const SentPacketInfo& packet, uint64_t ts) const { return ts >= packet.sendTime + m_RTO; };
+			int Timeout (uint32_t firstResent, uint32_t nextSeqn, uint64_t ts); // after timed out packets are resent, returns number of attempts
+			void ResetRTO () { m_RTO = INITIAL_RTO; };
+
+			static void Resent (SentPacketInfo& packet, uint64_t ts);
+			void SetInitialRTT (int rtt); // of shared routing path
+
+			int GetWindowSize () const { return m_CongestionControl->GetWindowSize (); };
+			int GetRTT () const { return m_RTTEstimator.GetRTT (); };
+			int GetRTO () const { return m_RTO; };
+			int GetNumResendAttempts () const { return m_NumResendAttempts; };
+			bool IsRecovering () const { return m_IsRecovering; };
+			const RTTEstimator& GetRTTEstimator () const { return m_RTTEstimator; };
+			const CongestionControl& GetCongestionControl () const { return *m_CongestionControl; };
+
+		private:
+
+			void StartRecovery (uint32_t recoverySeqn, uint32_t nextSeqn);
+
+		private:
+
+			RTTEstimator m_RTTEstimator;
+			std::unique_ptr<CongestionControl> m_CongestionControl;
+			int m_RTO, m_NumResendAttempts;
+			bool m_IsRecovering;
+			uint32_t m_RecoverySeqn; // recovery ends once acked up to it
+			uint32_t m_LossSeqn; // losses of packets sent before don't reduce window again, RFC 6582
+			int m_NumAcked, m_RTTSample; // of current ack
+	};
+}
+}
+
+#endif
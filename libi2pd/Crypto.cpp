@@ -3,12 +3,14 @@
 #include <vector>
 #include <mutex>
 #include <memory>
+#include <thread>
 #include <openssl/dh.h>
 #include <openssl/md5.h>
 #include <openssl/crypto.h>
 #include "TunnelBase.h"
 #include <openssl/ssl.h>
 #include "Crypto.h"
+#include "ElGamal.h"
 #if LEGACY_OPENSSL
 #include "ChaCha20.h"
 #include "Poly1305.h"
@@ -17,6 +19,9 @@
 #endif
 #include "I2PEndian.h"
 #include "Log.h"
+#ifdef __AES__
+#include <wmmintrin.h>
+#endif
 
 namespace i2p
 {
@@ -150,85 +155,41 @@ namespace crypto
 // DH/ElGamal
 
 	const int ELGAMAL_SHORT_EXPONENT_NUM_BITS = 226;
-	const int ELGAMAL_SHORT_EXPONENT_NUM_BYTES = ELGAMAL_SHORT_EXPONENT_NUM_BITS/8+1;
 	const int ELGAMAL_FULL_EXPONENT_NUM_BITS = 2048;
-	const int ELGAMAL_FULL_EXPONENT_NUM_BYTES = ELGAMAL_FULL_EXPONENT_NUM_BITS/8;
 
 	#define elgp GetCryptoConstants ().elgp
 	#define elgg GetCryptoConstants ().elgg
 
-	static BN_MONT_CTX * g_MontCtx = nullptr;
-	static void PrecalculateElggTable (BIGNUM * table[][255], int len) // table is len's array of array of 255 bignums
-	{
-		if (len <= 0) return;
-		BN_CTX * ctx = BN_CTX_new ();
-		g_MontCtx = BN_MONT_CTX_new ();
-		BN_MONT_CTX_set (g_MontCtx, elgp, ctx);
-		auto montCtx = BN_MONT_CTX_new ();
-		BN_MONT_CTX_copy (montCtx, g_MontCtx);
-		for (int i = 0; i < len; i++)
-		{
-			table[i][0] = BN_new ();
-			if (!i)
-				BN_to_montgomery (table[0][0], elgg, montCtx, ctx);
-			else
-				BN_mod_mul_montgomery (table[i][0], table[i-1][254], table[i-1][0], montCtx, ctx);
-			for (int j = 1; j < 255; j++)
-			{
-				table[i][j] = BN_new ();
-				BN_mod_mul_montgomery (table[i][j], table[i][j-1], table[i][0], montCtx, ctx);
-			}
-		}
-		BN_MONT_CTX_free (montCtx);
-		BN_CTX_free (ctx);
-	}
+#if defined(__x86_64__)
+	const int ELGAMAL_EXPONENT_NUM_BITS = ELGAMAL_FULL_EXPONENT_NUM_BITS;
+#else
+	const int ELGAMAL_EXPONENT_NUM_BITS = ELGAMAL_SHORT_EXPONENT_NUM_BITS;
+#endif
 
-	static void DestroyElggTable (BIGNUM * table[][255], int len)
-	{
-		for (int i = 0; i < len; i++)
-			for (int j = 0; j < 255; j++)
-			{
-				BN_free (table[i][j]);
-				table[i][j] = nullptr;
-			}
-		BN_MONT_CTX_free (g_MontCtx);
-	}
+	static BN_MONT_CTX * g_MontCtx = nullptr; // for variable base
+	static ElGamalMontgomery * g_ElGamalMont = nullptr;
+	static ElGamalFixedBaseTable * g_ElggTable = nullptr;
+	static ElGamalKeyTables * g_ElGamalKeyTables = nullptr;
 
-	static BIGNUM * ElggPow (const uint8_t * exp, int len, BIGNUM * table[][255], BN_CTX * ctx)
-	// exp is in Big Endian
+	static void ElGamalModExp (BIGNUM * r, const BIGNUM * a, const BIGNUM * e, BN_CTX * ctx)
 	{
-		if (len <= 0) return nullptr;
-		auto montCtx = BN_MONT_CTX_new ();
-		BN_MONT_CTX_copy (montCtx, g_MontCtx);
-		BIGNUM * res = nullptr;
-		for (int i = 0; i < len; i++)
-		{
-			if (res)
-			{
-				if (exp[i])
-					BN_mod_mul_montgomery (res, res, table[len-1-i][exp[i]-1], montCtx, ctx);
-			}
-			else if (exp[i])
-				res = BN_dup (table[len-i-1][exp[i]-1]);
-		}
-		if (res)
-			BN_from_montgomery (res, res, montCtx, ctx);
-		BN_MONT_CTX_free (montCtx);
-		return res;
+		if (g_MontCtx)
+			BN_mod_exp_mont (r, a, e, elgp, ctx, g_MontCtx);
+		else
+			BN_mod_exp (r, a, e, elgp, ctx);
 	}
 
-	static BIGNUM * ElggPow (const BIGNUM * exp, BIGNUM * table[][255], BN_CTX * ctx)
+	static bool ElGamalTablePow (const ElGamalFixedBaseTable * table, const BIGNUM * exp, BIGNUM * r)
 	{
-		auto len = BN_num_bytes (exp);
-		uint8_t * buf = new uint8_t[len];
+		uint8_t buf[256];
+		int len = BN_num_bytes (exp);
+		if (!table || len > 256) return false;
 		BN_bn2bin (exp, buf);
-		auto ret = ElggPow (buf, len, table, ctx);
-		delete[] buf;
-		return ret;
+		if (!table->Pow (buf, len, buf)) return false;
+		BN_bin2bn (buf, 256, r);
+		return true;
 	}
 
-	static BIGNUM * (* g_ElggTable)[255] = nullptr;
-
 // DH
 
 	DHKeys::DHKeys ()
@@ -256,10 +217,14 @@ namespace crypto
 			priv_key = BN_new ();
 			BN_rand (priv_key, ELGAMAL_FULL_EXPONENT_NUM_BITS, 0, 1);
 #endif
-			auto ctx = BN_CTX_new ();
-			pub_key = ElggPow (priv_key, g_ElggTable, ctx);
+			pub_key = BN_new ();
+			if (!ElGamalTablePow (g_ElggTable, priv_key, pub_key))
+			{
+				auto ctx = BN_CTX_new ();
+				ElGamalModExp (pub_key, elgg, priv_key, ctx);
+				BN_CTX_free (ctx);
+			}
 			DH_set0_key (m_DH, pub_key, priv_key);
-			BN_CTX_free (ctx);
 		}
 		else
 		{
@@ -282,8 +247,8 @@ namespace crypto
 	void ElGamalEncrypt (const uint8_t * key, const uint8_t * data, uint8_t * encrypted, BN_CTX * ctx, bool zeroPadding)
 	{
 		BN_CTX_start (ctx);
-		// everything, but a, because a might come from table
 		BIGNUM * k = BN_CTX_get (ctx);
+		BIGNUM * a = BN_CTX_get (ctx);
 		BIGNUM * y = BN_CTX_get (ctx);
 		BIGNUM * b1 = BN_CTX_get (ctx);
 		BIGNUM * b = BN_CTX_get (ctx);
@@ -294,19 +259,16 @@ namespace crypto
 		BN_rand (k, ELGAMAL_SHORT_EXPONENT_NUM_BITS, -1, 1); // short exponent of 226 bits
 #endif
 		// calculate a
-		BIGNUM * a;
-		if (g_ElggTable)
-			a = ElggPow (k, g_ElggTable, ctx);
-		else
+		if (!ElGamalTablePow (g_ElggTable, k, a))
+			ElGamalModExp (a, elgg, k, ctx);
+		// calculate b1, table if key is used often
+		auto keyTable = g_ElGamalKeyTables ? g_ElGamalKeyTables->GetTable (key) : nullptr;
+		if (!ElGamalTablePow (keyTable.get (), k, b1))
 		{
-			a = BN_new ();
-			BN_mod_exp (a, elgg, k, elgp, ctx);
+			// restore y from key
+			BN_bin2bn (key, 256, y);
+			ElGamalModExp (b1, y, k, ctx);
 		}
-
-		// restore y from key
-		BN_bin2bn (key, 256, y);
-		// calculate b1
-		BN_mod_exp (b1, y, k, elgp, ctx);
 		// create m
 		uint8_t m[255];
 		m[0] = 0xFF;
@@ -328,7 +290,6 @@ namespace crypto
 			bn2buf (a, encrypted, 256);
 			bn2buf (b, encrypted + 256, 256);
 		}
-		BN_free (a);
 		BN_CTX_end (ctx);
 	}
 
@@ -342,14 +303,14 @@ namespace crypto
 		BN_bin2bn (zeroPadding ? encrypted + 1 : encrypted, 256, a);
 		BN_bin2bn (zeroPadding ? encrypted + 258 : encrypted + 256, 256, b);
 		// m = b*(a^x mod p) mod p
-		BN_mod_exp (x, a, x, elgp, ctx);
+		ElGamalModExp (x, a, x, ctx);
 		BN_mod_mul (b, b, x, elgp, ctx);
 		uint8_t m[255];
-		bn2buf (b, m, 255);
+		bool isValid = bn2buf (b, m, 255); // m doesn't fit if ciphertext is corrupted
 		BN_CTX_end (ctx);
 		uint8_t hash[32];
-		SHA256 (m + 33, 222, hash);
-		if (memcmp (m + 1, hash, 32))
+		if (isValid) SHA256 (m + 33, 222, hash);
+		if (!isValid || memcmp (m + 1, hash, 32))
 		{
 			LogPrint (eLogError, "ElGamal decrypt hash doesn't match");
 			return false;
@@ -370,10 +331,11 @@ namespace crypto
 		memset (priv, 0, numZeroBytes);
 		priv[numZeroBytes] &= 0x03;
 #endif
+		if (g_ElggTable && g_ElggTable->Pow (priv, 256, pub)) return;
 		BN_CTX * ctx = BN_CTX_new ();
 		BIGNUM * p = BN_new ();
 		BN_bin2bn (priv, 256, p);
-		BN_mod_exp (p, elgg, p, elgp, ctx);
+		ElGamalModExp (p, elgg, p, ctx);
 		bn2buf (p, pub, 256);
 		BN_free (p);
 		BN_CTX_free (ctx);
@@ -923,6 +885,57 @@ namespace crypto
 			Decrypt (1, (const ChipherBlock *)in, (ChipherBlock *)out);
 	}
 
+#ifdef __AES__
+	// independent blocks are processed together to hide aesenc/aesdec latency
+	static inline void EncryptAES256Block (const uint8_t * sched, __m128i& b)
+	{
+		b = _mm_xor_si128 (b, _mm_load_si128 ((const __m128i *)sched));
+		for (int round = 1; round < 14; round++)
+			b = _mm_aesenc_si128 (b, _mm_load_si128 ((const __m128i *)(sched + round*16)));
+		b = _mm_aesenclast_si128 (b, _mm_load_si128 ((const __m128i *)(sched + 224)));
+	}
+
+	static inline void EncryptAES256Blocks4 (const uint8_t * sched, __m128i * b)
+	{
+		__m128i key = _mm_load_si128 ((const __m128i *)sched);
+		__m128i b0 = _mm_xor_si128 (b[0], key), b1 = _mm_xor_si128 (b[1], key),
+			b2 = _mm_xor_si128 (b[2], key), b3 = _mm_xor_si128 (b[3], key);
+		for (int round = 1; round < 14; round++)
+		{
+			key = _mm_load_si128 ((const __m128i *)(sched + round*16));
+			b0 = _mm_aesenc_si128 (b0, key); b1 = _mm_aesenc_si128 (b1, key);
+			b2 = _mm_aesenc_si128 (b2, key); b3 = _mm_aesenc_si128 (b3, key);
+		}
+		key = _mm_load_si128 ((const __m128i *)(sched + 224));
+		b[0] = _mm_aesenclast_si128 (b0, key); b[1] = _mm_aesenclast_si128 (b1, key);
+		b[2] = _mm_aesenclast_si128 (b2, key); b[3] = _mm_aesenclast_si128 (b3, key);
+	}
+
+	static inline void DecryptAES256Block (const uint8_t * sched, __m128i& b)
+	{
+		b = _mm_xor_si128 (b, _mm_load_si128 ((const __m128i *)(sched + 224)));
+		for (int round = 13; round > 0; round--)
+			b = _mm_aesdec_si128 (b, _mm_load_si128 ((const __m128i *)(sched + round*16)));
+		b = _mm_aesdeclast_si128 (b, _mm_load_si128 ((const __m128i *)sched));
+	}
+
+	static inline void DecryptAES256Blocks4 (const uint8_t * sched, __m128i * b)
+	{
+		__m128i key = _mm_load_si128 ((const __m128i *)(sched + 224));
+		__m128i b0 = _mm_xor_si128 (b[0], key), b1 = _mm_xor_si128 (b[1], key),
+			b2 = _mm_xor_si128 (b[2], key), b3 = _mm_xor_si128 (b[3], key);
+		for (int round = 13; round > 0; round--)
+		{
+			key = _mm_load_si128 ((const __m128i *)(sched + round*16));
+			b0 = _mm_aesdec_si128 (b0, key); b1 = _mm_aesdec_si128 (b1, key);
+			b2 = _mm_aesdec_si128 (b2, key); b3 = _mm_aesdec_si128 (b3, key);
+		}
+		key = _mm_load_si128 ((const __m128i *)sched);
+		b[0] = _mm_aesdeclast_si128 (b0, key); b[1] = _mm_aesdeclast_si128 (b1, key);
+		b[2] = _mm_aesdeclast_si128 (b2, key); b[3] = _mm_aesdeclast_si128 (b3, key);
+	}
+#endif
+
 	void TunnelEncryption::Encrypt (const uint8_t * in, uint8_t * out)
 	{
 #ifdef __AES__
@@ -964,37 +977,83 @@ namespace crypto
 		}
 	}
 
+	void TunnelEncryption::Encrypt (size_t num, const uint8_t * const * in, uint8_t * const * out)
+	{
+		size_t i = 0;
+#ifdef __AES__
+		if(i2p::cpu::aesni)
+		{
+			// CBC encryption is serial within a message, interleave different messages instead
+			for (; i + TUNNEL_CRYPTO_NUM_STREAMS <= num; i += TUNNEL_CRYPTO_NUM_STREAMS)
+				EncryptAESNI4 (in + i, out + i);
+		}
+#endif
+		for (; i < num; i++)
+			Encrypt (in[i], out[i]);
+	}
+
+#ifdef __AES__
+	void TunnelEncryption::EncryptAESNI4 (const uint8_t * const * in, uint8_t * const * out)
+	{
+		const uint8_t * schedIV = m_IVEncryption.GetKeySchedule (), * schedLayer = m_LayerEncryption.ECB().GetKeySchedule ();
+		__m128i blocks[TUNNEL_CRYPTO_NUM_STREAMS], iv[TUNNEL_CRYPTO_NUM_STREAMS];
+		// encrypt IV
+		for (size_t i = 0; i < TUNNEL_CRYPTO_NUM_STREAMS; i++)
+			blocks[i] = _mm_loadu_si128 ((const __m128i *)in[i]);
+		EncryptAES256Blocks4 (schedIV, blocks);
+		for (size_t i = 0; i < TUNNEL_CRYPTO_NUM_STREAMS; i++) iv[i] = blocks[i];
+		// double IV encryption
+		EncryptAES256Blocks4 (schedIV, blocks);
+		for (size_t i = 0; i < TUNNEL_CRYPTO_NUM_STREAMS; i++)
+			_mm_storeu_si128 ((__m128i *)out[i], blocks[i]);
+		// encrypt data
+		for (size_t offset = 16; offset < i2p::tunnel::TUNNEL_DATA_MSG_SIZE - 4; offset += 16) // 63 blocks = 1008 bytes
+		{
+			for (size_t i = 0; i < TUNNEL_CRYPTO_NUM_STREAMS; i++)
+				blocks[i] = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *)(in[i] + offset)), iv[i]);
+			EncryptAES256Blocks4 (schedLayer, blocks);
+			for (size_t i = 0; i < TUNNEL_CRYPTO_NUM_STREAMS; i++)
+			{
+				_mm_storeu_si128 ((__m128i *)(out[i] + offset), blocks[i]);
+				iv[i] = blocks[i];
+			}
+		}
+	}
+#endif
+
 	void TunnelDecryption::Decrypt (const uint8_t * in, uint8_t * out)
 	{
 #ifdef __AES__
 		if(i2p::cpu::aesni)
 		{
-			__asm__
-				(
-					// decrypt IV
-					"movups	(%[in]), %%xmm0 \n"
-					DecryptAES256(sched_iv)
-					"movaps %%xmm0, %%xmm1 \n"
-					// double IV encryption
-					DecryptAES256(sched_iv)
-					"movups %%xmm0, (%[out]) \n"
-					// decrypt data, IV is xmm1
-					"1: \n"
-					"add $16, %[in] \n"
-					"add $16, %[out] \n"
-					"movups	(%[in]), %%xmm0 \n"
-					"movaps %%xmm0, %%xmm2 \n"
-					DecryptAES256(sched_l)
-					"pxor %%xmm1, %%xmm0 \n"
-					"movups	%%xmm0, (%[out]) \n"
-					"movaps %%xmm2, %%xmm1 \n"
-					"dec %[num] \n"
-					"jnz 1b \n"
-					:
-					: [sched_iv]"r"(m_IVDecryption.GetKeySchedule ()), [sched_l]"r"(m_LayerDecryption.ECB().GetKeySchedule ()),
-						[in]"r"(in), [out]"r"(out), [num]"r"(63) // 63 blocks = 1008 bytes
-					: "%xmm0", "%xmm1", "%xmm2", "cc", "memory"
-					);
+			const uint8_t * schedLayer = m_LayerDecryption.ECB().GetKeySchedule ();
+			// decrypt IV
+			__m128i iv = _mm_loadu_si128 ((const __m128i *)in);
+			DecryptAES256Block (m_IVDecryption.GetKeySchedule (), iv);
+			// double IV encryption
+			__m128i doubleIV = iv;
+			DecryptAES256Block (m_IVDecryption.GetKeySchedule (), doubleIV);
+			_mm_storeu_si128 ((__m128i *)out, doubleIV);
+			// decrypt data, CBC decryption of different blocks is independent
+			__m128i blocks[TUNNEL_CRYPTO_NUM_STREAMS], cipher[TUNNEL_CRYPTO_NUM_STREAMS];
+			size_t offset = 16, end = i2p::tunnel::TUNNEL_DATA_MSG_SIZE - 4; // 63 blocks = 1008 bytes
+			for (; offset + TUNNEL_CRYPTO_NUM_STREAMS*16 <= end; offset += TUNNEL_CRYPTO_NUM_STREAMS*16)
+			{
+				for (size_t i = 0; i < TUNNEL_CRYPTO_NUM_STREAMS; i++)
+					blocks[i] = cipher[i] = _mm_loadu_si128 ((const __m128i *)(in + offset + i*16));
+				DecryptAES256Blocks4 (schedLayer, blocks);
+				_mm_storeu_si128 ((__m128i *)(out + offset), _mm_xor_si128 (blocks[0], iv));
+				for (size_t i = 1; i < TUNNEL_CRYPTO_NUM_STREAMS; i++)
+					_mm_storeu_si128 ((__m128i *)(out + offset + i*16), _mm_xor_si128 (blocks[i], cipher[i - 1]));
+				iv = cipher[TUNNEL_CRYPTO_NUM_STREAMS - 1];
+			}
+			for (; offset < end; offset += 16)
+			{
+				blocks[0] = cipher[0] = _mm_loadu_si128 ((const __m128i *)(in + offset));
+				DecryptAES256Block (schedLayer, blocks[0]);
+				_mm_storeu_si128 ((__m128i *)(out + offset), _mm_xor_si128 (blocks[0], iv));
+				iv = cipher[0];
+			}
 		}
 		else
 #endif
@@ -1014,6 +1073,8 @@ namespace crypto
 		if (encrypt && len < msgLen + 16) return false;
 		bool ret = true;
 #if LEGACY_OPENSSL
+		// no EVP_chacha20_poly1305, use our chacha20 and Poly1305.
+		// with newer OpenSSL EVP is as fast for short messages and about 3 times faster for long
 		// generate one time poly key
 		uint8_t polyKey[64];
 		memset(polyKey, 0, sizeof(polyKey));
@@ -1124,31 +1185,28 @@ namespace crypto
 		for (int i = 0; i < numLocks; i++)
 			m_OpenSSLMutexes.emplace_back (new std::mutex);
 		CRYPTO_set_locking_callback (OpensslLockingCallback);*/
+		BN_CTX * ctx = BN_CTX_new ();
+		g_MontCtx = BN_MONT_CTX_new ();
+		BN_MONT_CTX_set (g_MontCtx, elgp, ctx);
+		BN_CTX_free (ctx);
 		if (precomputation)
 		{
-#if defined(__x86_64__)
-			g_ElggTable = new BIGNUM * [ELGAMAL_FULL_EXPONENT_NUM_BYTES][255];
-			PrecalculateElggTable (g_ElggTable, ELGAMAL_FULL_EXPONENT_NUM_BYTES);
-#else
-			g_ElggTable = new BIGNUM * [ELGAMAL_SHORT_EXPONENT_NUM_BYTES][255];
-			PrecalculateElggTable (g_ElggTable, ELGAMAL_SHORT_EXPONENT_NUM_BYTES);
-#endif
+			g_ElGamalMont = new ElGamalMontgomery (elgp);
+			g_ElggTable = new ElGamalFixedBaseTable (*g_ElGamalMont, 8, ELGAMAL_EXPONENT_NUM_BITS);
+			uint8_t g[256];
+			bn2buf (elgg, g, 256);
+			int numThreads = std::thread::hardware_concurrency ();
+			g_ElggTable->Precompute (g, numThreads > 0 ? numThreads : 1);
+			g_ElGamalKeyTables = new ElGamalKeyTables (*g_ElGamalMont, ELGAMAL_EXPONENT_NUM_BITS);
 		}
 	}
 
 	void TerminateCrypto ()
 	{
-		if (g_ElggTable)
-		{
-			DestroyElggTable (g_ElggTable,
-#if defined(__x86_64__)
-				ELGAMAL_FULL_EXPONENT_NUM_BYTES
-#else
-				ELGAMAL_SHORT_EXPONENT_NUM_BYTES
-#endif
-			);
-			delete[] g_ElggTable; g_ElggTable = nullptr;
-		}
+		delete g_ElGamalKeyTables; g_ElGamalKeyTables = nullptr;
+		delete g_ElggTable; g_ElggTable = nullptr;
+		delete g_ElGamalMont; g_ElGamalMont = nullptr;
+		BN_MONT_CTX_free (g_MontCtx); g_MontCtx = nullptr;
 /*		CRYPTO_set_locking_callback (nullptr);
 		m_OpenSSLMutexes.clear ();*/
 	}
@@ -215,6 +215,8 @@ namespace crypto
 			ECBDecryption m_ECBDecryption;
 	};
 
+	const size_t TUNNEL_CRYPTO_NUM_STREAMS = 4; // AES blocks in flight for tunnel messages
+
 	class TunnelEncryption // with double IV encryption
 	{
 		public:
@@ -226,6 +228,13 @@ namespace crypto
 			}
 
 			void Encrypt (const uint8_t * in, uint8_t * out); // 1024 bytes (16 IV + 1008 data)
+			void Encrypt (size_t num, const uint8_t * const * in, uint8_t * const * out); // num independent messages
+
+		private:
+
+#ifdef __AES__
+			void EncryptAESNI4 (const uint8_t * const * in, uint8_t * const * out); // 4 messages interleaved
+#endif
 
 		private:
 
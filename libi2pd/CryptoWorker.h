@@ -7,6 +7,8 @@
 #include <thread>
 #include <vector>
 #include <memory>
+#include <functional>
+#include <atomic>
 
 namespace i2p
 {
@@ -24,6 +26,7 @@ namespace worker
 		ThreadPool(int workers)
 		{
 			stop = false;
+			numCompleted = 0;
 			if(workers > 0)
 			{
 				while(workers--)
@@ -41,7 +44,8 @@ namespace worker
 									this->jobs.pop_front();
 								}
 								ResultFunc result = job.second();
-								job.first->GetService().post(result);
+								if (result) job.first->GetService().post(result);
+								numCompleted++;
 							}
 					});
 				}
@@ -58,6 +62,14 @@ namespace worker
 			condition.notify_one();
 		}
 
+		size_t GetQueueSize()
+		{
+			lock_t lock(queue_mutex);
+			return jobs.size();
+		}
+
+		uint64_t GetNumCompleted() const { return numCompleted; }
+
 		~ThreadPool()
 		{
 			{
@@ -73,6 +85,7 @@ namespace worker
 		mtx_t queue_mutex;
 		cond_t condition;
 		bool stop;
+		std::atomic<uint64_t> numCompleted;
 	};
 }
 }
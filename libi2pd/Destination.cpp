@@ -13,6 +13,24 @@ namespace i2p
 {
 namespace client
 {
+	static std::shared_ptr<ElGamalPool> g_ElGamalPool;
+
+	void StartElGamalPool (int numThreads)
+	{
+		if (numThreads > 0 && !GetElGamalPool ())
+			std::atomic_store (&g_ElGamalPool, std::make_shared<ElGamalPool> (numThreads));
+	}
+
+	void StopElGamalPool ()
+	{
+		std::atomic_store (&g_ElGamalPool, std::shared_ptr<ElGamalPool> ()); // waits for queued work
+	}
+
+	std::shared_ptr<ElGamalPool> GetElGamalPool ()
+	{
+		return std::atomic_load (&g_ElGamalPool);
+	}
+
 	LeaseSetDestination::LeaseSetDestination (bool isPublic, const std::map<std::string, std::string> * params):
 		m_IsRunning (false), m_Thread (nullptr), m_IsPublic (isPublic),
 		m_PublishReplyToken (0), m_LastSubmissionTime (0), m_PublishConfirmationTimer (m_Service),
@@ -272,6 +290,20 @@ namespace client
 		return m_LeaseSet;
 	}
 
+	bool LeaseSetDestination::PostElGamalWork (ElGamalWork work)
+	{
+		auto pool = GetElGamalPool ();
+		if (!pool || !m_IsRunning) return false;
+		pool->Offer (ElGamalPool::Job (shared_from_this (), [work]()
+			{
+				BN_CTX * ctx = BN_CTX_new (); // cheap comparing to ElGamal itself
+				auto result = work (ctx);
+				BN_CTX_free (ctx);
+				return result;
+			}));
+		return true;
+	}
+
 	void LeaseSetDestination::SetLeaseSet (i2p::data::LocalLeaseSet * newLeaseSet)
 	{
 		{
@@ -766,6 +798,7 @@ namespace client
 
 	ClientDestination::ClientDestination (const i2p::data::PrivateKeys& keys, bool isPublic, const std::map<std::string, std::string> * params):
 		LeaseSetDestination (isPublic, params), m_Keys (keys), m_StreamingAckDelay (DEFAULT_INITIAL_ACK_DELAY),
+		m_StreamingCongestionControl (i2p::stream::DEFAULT_CONGESTION_CONTROL),
 		m_DatagramDestination (nullptr), m_RefCounter (0),
 		m_ReadyChecker(GetService())
 	{
@@ -784,6 +817,9 @@ namespace client
 			auto it = params->find (I2CP_PARAM_STREAMING_INITIAL_ACK_DELAY);
 			if (it != params->end ())
 				m_StreamingAckDelay = std::stoi(it->second);
+			it = params->find (I2CP_PARAM_STREAMING_CONGESTION_CONTROL);
+			if (it != params->end ())
+				m_StreamingCongestionControl = it->second;
 		}
 	}
 
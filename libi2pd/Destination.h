@@ -20,6 +20,7 @@
 #include "NetDb.hpp"
 #include "Streaming.h"
 #include "Datagram.h"
+#include "CryptoWorker.h"
 
 namespace i2p
 {
@@ -62,6 +63,7 @@ namespace client
 	// streaming
 	const char I2CP_PARAM_STREAMING_INITIAL_ACK_DELAY[] = "i2p.streaming.initialAckDelay";
 	const int DEFAULT_INITIAL_ACK_DELAY = 200; // milliseconds
+	const char I2CP_PARAM_STREAMING_CONGESTION_CONTROL[] = "i2p.streaming.congestionControl"; // reno, cubic or vegas
 
 	typedef std::function<void (std::shared_ptr<i2p::stream::Stream> stream)> StreamRequestComplete;
 
@@ -122,6 +124,7 @@ namespace client
 		protected:
 
 			void SetLeaseSet (i2p::data::LocalLeaseSet * newLeaseSet);
+			bool PostElGamalWork (ElGamalWork work);
 			virtual void CleanupDestination () {}; // additional clean up in derived classes
 			// I2CP
 			virtual void HandleDataMessage (const uint8_t * buf, size_t len) = 0;
@@ -173,6 +176,12 @@ namespace client
 			const decltype(m_RemoteLeaseSets)& GetLeaseSets () const { return m_RemoteLeaseSets; };
 	};
 
+	/** threads doing ElGamal for all local destinations, so destination's thread doesn't wait for it */
+	typedef i2p::worker::ThreadPool<LeaseSetDestination> ElGamalPool;
+	void StartElGamalPool (int numThreads); // 0 - ElGamal in destination's thread
+	void StopElGamalPool (); // after destinations are stopped
+	std::shared_ptr<ElGamalPool> GetElGamalPool (); // nullptr if not started
+
 	class ClientDestination: public LeaseSetDestination
 	{
 		public:
@@ -209,6 +218,7 @@ namespace client
 			bool IsAcceptingStreams () const;
 			void AcceptOnce (const i2p::stream::StreamingDestination::Acceptor& acceptor);
 			int GetStreamingAckDelay () const { return m_StreamingAckDelay; }
+			const std::string& GetStreamingCongestionControl () const { return m_StreamingCongestionControl; }
 
 			// datagram
       i2p::datagram::DatagramDestination * GetDatagramDestination () const { return m_DatagramDestination; };
@@ -241,6 +251,7 @@ namespace client
 			std::shared_ptr<i2p::crypto::CryptoKeyDecryptor> m_Decryptor;
 
 			int m_StreamingAckDelay;
+			std::string m_StreamingCongestionControl;
 			std::shared_ptr<i2p::stream::StreamingDestination> m_StreamingDestination; // default
 			std::map<uint16_t, std::shared_ptr<i2p::stream::StreamingDestination> > m_StreamingDestinationsByPorts;
 			i2p::datagram::DatagramDestination * m_DatagramDestination;
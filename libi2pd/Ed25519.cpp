@@ -1,3 +1,4 @@
+#include <vector>
 #include <openssl/sha.h>
 #include "Log.h"
 #include "Crypto.h"
@@ -7,6 +8,454 @@ namespace i2p
 {
 namespace crypto
 {
+#if ED25519_FE51
+	// radix 2^51 arithmetic, based on ref10 and curve25519-donna-64bit
+	// everything here is for public data only, nothing is constant time
+	namespace curve25519
+	{
+		__extension__ typedef unsigned __int128 uint128_t;
+		const uint64_t MASK51 = 0x7ffffffffffff;
+
+		struct PointP2 { EDDSAFieldElement X, Y, Z; }; // projective
+		struct PointP1P1 { EDDSAFieldElement X, Y, Z, T; }; // completed, ((X:Z),(Y:T))
+		struct PointCached { EDDSAFieldElement YPlusX, YMinusX, Z, T2d; };
+
+		static inline uint64_t load64 (const uint8_t * s)
+		{
+			uint64_t r = 0;
+			for (int i = 7; i >= 0; i--) r = (r << 8) | s[i];
+			return r;
+		}
+
+		static inline void store64 (uint8_t * s, uint64_t v)
+		{
+			for (int i = 0; i < 8; i++) { s[i] = v & 0xFF; v >>= 8; }
+		}
+
+		static inline void fe_copy (EDDSAFieldElement h, const EDDSAFieldElement f)
+		{
+			memcpy (h, f, sizeof (EDDSAFieldElement));
+		}
+
+		static inline void fe_zero (EDDSAFieldElement h)
+		{
+			h[0] = 0; h[1] = 0; h[2] = 0; h[3] = 0; h[4] = 0;
+		}
+
+		static inline void fe_one (EDDSAFieldElement h)
+		{
+			h[0] = 1; h[1] = 0; h[2] = 0; h[3] = 0; h[4] = 0;
+		}
+
+		static inline void fe_carry (EDDSAFieldElement h)
+		{
+			uint64_t c;
+			c = h[0] >> 51; h[0] &= MASK51; h[1] += c;
+			c = h[1] >> 51; h[1] &= MASK51; h[2] += c;
+			c = h[2] >> 51; h[2] &= MASK51; h[3] += c;
+			c = h[3] >> 51; h[3] &= MASK51; h[4] += c;
+			c = h[4] >> 51; h[4] &= MASK51; h[0] += c*19;
+		}
+
+		static void fe_frombytes (EDDSAFieldElement h, const uint8_t * s) // highest bit ignored
+		{
+			uint64_t w0 = load64 (s), w1 = load64 (s + 8), w2 = load64 (s + 16), w3 = load64 (s + 24);
+			h[0] = w0 & MASK51;
+			h[1] = ((w0 >> 51) | (w1 << 13)) & MASK51;
+			h[2] = ((w1 >> 38) | (w2 << 26)) & MASK51;
+			h[3] = ((w2 >> 25) | (w3 << 39)) & MASK51;
+			h[4] = (w3 >> 12) & MASK51;
+		}
+
+		static void fe_tobytes (uint8_t * s, const EDDSAFieldElement f) // fully reduced
+		{
+			EDDSAFieldElement h;
+			fe_copy (h, f);
+			fe_carry (h); fe_carry (h);
+			// h < 2^255 + 2^13, subtract p if h >= p
+			uint64_t q = (h[0] + 19) >> 51;
+			q = (h[1] + q) >> 51; q = (h[2] + q) >> 51; q = (h[3] + q) >> 51; q = (h[4] + q) >> 51;
+			h[0] += 19*q;
+			h[1] += h[0] >> 51; h[0] &= MASK51;
+			h[2] += h[1] >> 51; h[1] &= MASK51;
+			h[3] += h[2] >> 51; h[2] &= MASK51;
+			h[4] += h[3] >> 51; h[3] &= MASK51;
+			h[4] &= MASK51; // drop 2^255
+			store64 (s, h[0] | (h[1] << 51));
+			store64 (s + 8, (h[1] >> 13) | (h[2] << 38));
+			store64 (s + 16, (h[2] >> 26) | (h[3] << 25));
+			store64 (s + 24, (h[3] >> 39) | (h[4] << 12));
+		}
+
+		static inline void fe_add (EDDSAFieldElement h, const EDDSAFieldElement f, const EDDSAFieldElement g)
+		{
+			for (int i = 0; i < 5; i++) h[i] = f[i] + g[i];
+			fe_carry (h);
+		}
+
+		static inline void fe_sub (EDDSAFieldElement h, const EDDSAFieldElement f, const EDDSAFieldElement g)
+		{
+			// add 4*p to stay positive
+			h[0] = f[0] + 0x1fffffffffffb4 - g[0];
+			h[1] = f[1] + 0x1ffffffffffffc - g[1];
+			h[2] = f[2] + 0x1ffffffffffffc - g[2];
+			h[3] = f[3] + 0x1ffffffffffffc - g[3];
+			h[4] = f[4] + 0x1ffffffffffffc - g[4];
+			fe_carry (h);
+		}
+
+		static inline void fe_neg (EDDSAFieldElement h, const EDDSAFieldElement f)
+		{
+			EDDSAFieldElement zero;
+			fe_zero (zero);
+			fe_sub (h, zero, f);
+		}
+
+		static inline void fe_reduce128 (EDDSAFieldElement h, uint128_t r0, uint128_t r1, uint128_t r2, uint128_t r3, uint128_t r4)
+		{
+			uint64_t c;
+			c = (uint64_t)(r0 >> 51); h[0] = (uint64_t)r0 & MASK51; r1 += c;
+			c = (uint64_t)(r1 >> 51); h[1] = (uint64_t)r1 & MASK51; r2 += c;
+			c = (uint64_t)(r2 >> 51); h[2] = (uint64_t)r2 & MASK51; r3 += c;
+			c = (uint64_t)(r3 >> 51); h[3] = (uint64_t)r3 & MASK51; r4 += c;
+			c = (uint64_t)(r4 >> 51); h[4] = (uint64_t)r4 & MASK51;
+			h[0] += c*19;
+			h[1] += h[0] >> 51; h[0] &= MASK51;
+		}
+
+		static void fe_mul (EDDSAFieldElement h, const EDDSAFieldElement f, const EDDSAFieldElement g)
+		{
+			uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+			uint64_t g0 = g[0], g1 = g[1], g2 = g[2], g3 = g[3], g4 = g[4];
+			uint64_t g1_19 = 19*g1, g2_19 = 19*g2, g3_19 = 19*g3, g4_19 = 19*g4;
+			uint128_t r0 = (uint128_t)f0*g0 + (uint128_t)f1*g4_19 + (uint128_t)f2*g3_19 + (uint128_t)f3*g2_19 + (uint128_t)f4*g1_19;
+			uint128_t r1 = (uint128_t)f0*g1 + (uint128_t)f1*g0 + (uint128_t)f2*g4_19 + (uint128_t)f3*g3_19 + (uint128_t)f4*g2_19;
+			uint128_t r2 = (uint128_t)f0*g2 + (uint128_t)f1*g1 + (uint128_t)f2*g0 + (uint128_t)f3*g4_19 + (uint128_t)f4*g3_19;
+			uint128_t r3 = (uint128_t)f0*g3 + (uint128_t)f1*g2 + (uint128_t)f2*g1 + (uint128_t)f3*g0 + (uint128_t)f4*g4_19;
+			uint128_t r4 = (uint128_t)f0*g4 + (uint128_t)f1*g3 + (uint128_t)f2*g2 + (uint128_t)f3*g1 + (uint128_t)f4*g0;
+			fe_reduce128 (h, r0, r1, r2, r3, r4);
+		}
+
+		static void fe_sq (EDDSAFieldElement h, const EDDSAFieldElement f)
+		{
+			uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+			uint64_t f0_2 = 2*f0, f1_2 = 2*f1, f3_19 = 19*f3, f4_19 = 19*f4;
+			uint128_t r0 = (uint128_t)f0*f0 + (uint128_t)f1_2*f4_19 + (uint128_t)(2*f2)*f3_19;
+			uint128_t r1 = (uint128_t)f0_2*f1 + (uint128_t)(2*f2)*f4_19 + (uint128_t)f3*f3_19;
+			uint128_t r2 = (uint128_t)f0_2*f2 + (uint128_t)f1*f1 + (uint128_t)(2*f3)*f4_19;
+			uint128_t r3 = (uint128_t)f0_2*f3 + (uint128_t)f1_2*f2 + (uint128_t)f4*f4_19;
+			uint128_t r4 = (uint128_t)f0_2*f4 + (uint128_t)f1_2*f3 + (uint128_t)f2*f2;
+			fe_reduce128 (h, r0, r1, r2, r3, r4);
+		}
+
+		static void fe_sqn (EDDSAFieldElement h, const EDDSAFieldElement f, int n)
+		{
+			fe_sq (h, f);
+			for (int i = 1; i < n; i++) fe_sq (h, h);
+		}
+
+		// z^(2^250-1) and z^11
+		static void fe_pow2501 (EDDSAFieldElement out, EDDSAFieldElement z11, const EDDSAFieldElement z)
+		{
+			EDDSAFieldElement t0, t1, t2;
+			fe_sq (t0, z); // 2
+			fe_sqn (t1, t0, 2); // 8
+			fe_mul (t1, t1, z); // 9
+			fe_mul (z11, t0, t1); // 11
+			fe_sq (t0, z11); // 22
+			fe_mul (t0, t0, t1); // 2^5 - 1
+			fe_sqn (t1, t0, 5); fe_mul (t0, t1, t0); // 2^10 - 1
+			fe_sqn (t1, t0, 10); fe_mul (t1, t1, t0); // 2^20 - 1
+			fe_sqn (t2, t1, 20); fe_mul (t1, t2, t1); // 2^40 - 1
+			fe_sqn (t1, t1, 10); fe_mul (t0, t1, t0); // 2^50 - 1
+			fe_sqn (t1, t0, 50); fe_mul (t1, t1, t0); // 2^100 - 1
+			fe_sqn (t2, t1, 100); fe_mul (t1, t2, t1); // 2^200 - 1
+			fe_sqn (t1, t1, 50); fe_mul (out, t1, t0); // 2^250 - 1
+		}
+
+		static void fe_invert (EDDSAFieldElement out, const EDDSAFieldElement z) // z^(p-2)
+		{
+			EDDSAFieldElement t, z11;
+			fe_pow2501 (t, z11, z);
+			fe_sqn (t, t, 5); // 2^255 - 32
+			fe_mul (out, t, z11); // 2^255 - 21
+		}
+
+		static void fe_pow22523 (EDDSAFieldElement out, const EDDSAFieldElement z) // z^((p-5)/8)
+		{
+			EDDSAFieldElement t, z11;
+			fe_pow2501 (t, z11, z);
+			fe_sqn (t, t, 2); // 2^252 - 4
+			fe_mul (out, t, z); // 2^252 - 3
+		}
+
+		static bool fe_iszero (const EDDSAFieldElement f)
+		{
+			uint8_t s[32], r = 0;
+			fe_tobytes (s, f);
+			for (int i = 0; i < 32; i++) r |= s[i];
+			return !r;
+		}
+
+		static bool fe_isnegative (const EDDSAFieldElement f)
+		{
+			uint8_t s[32];
+			fe_tobytes (s, f);
+			return s[0] & 1;
+		}
+
+		static void p1p1_to_p2 (PointP2& r, const PointP1P1& p)
+		{
+			fe_mul (r.X, p.X, p.T);
+			fe_mul (r.Y, p.Y, p.Z);
+			fe_mul (r.Z, p.Z, p.T);
+		}
+
+		static void p1p1_to_p3 (EDDSAPoint51& r, const PointP1P1& p)
+		{
+			fe_mul (r.X, p.X, p.T);
+			fe_mul (r.Y, p.Y, p.Z);
+			fe_mul (r.Z, p.Z, p.T);
+			fe_mul (r.T, p.X, p.Y);
+		}
+
+		static void p3_to_cached (PointCached& r, const EDDSAPoint51& p, const EDDSAFieldElement d2)
+		{
+			fe_add (r.YPlusX, p.Y, p.X);
+			fe_sub (r.YMinusX, p.Y, p.X);
+			fe_copy (r.Z, p.Z);
+			fe_mul (r.T2d, p.T, d2);
+		}
+
+		static void p2_dbl (PointP1P1& r, const EDDSAFieldElement X, const EDDSAFieldElement Y, const EDDSAFieldElement Z)
+		{
+			EDDSAFieldElement t0;
+			fe_sq (r.X, X);
+			fe_sq (r.Z, Y);
+			fe_sq (r.T, Z); fe_add (r.T, r.T, r.T);
+			fe_add (r.Y, X, Y);
+			fe_sq (t0, r.Y);
+			fe_add (r.Y, r.Z, r.X);
+			fe_sub (r.Z, r.Z, r.X);
+			fe_sub (r.X, t0, r.Y);
+			fe_sub (r.T, r.T, r.Z);
+		}
+
+		static void add (PointP1P1& r, const EDDSAPoint51& p, const PointCached& q, bool sub)
+		{
+			EDDSAFieldElement t0;
+			fe_add (r.X, p.Y, p.X);
+			fe_sub (r.Y, p.Y, p.X);
+			fe_mul (r.Z, r.X, sub ? q.YMinusX : q.YPlusX);
+			fe_mul (r.Y, r.Y, sub ? q.YPlusX : q.YMinusX);
+			fe_mul (r.T, q.T2d, p.T);
+			fe_mul (r.X, p.Z, q.Z);
+			fe_add (t0, r.X, r.X);
+			fe_sub (r.X, r.Z, r.Y);
+			fe_add (r.Y, r.Z, r.Y);
+			if (sub)
+			{
+				fe_sub (r.Z, t0, r.T);
+				fe_add (r.T, t0, r.T);
+			}
+			else
+			{
+				fe_add (r.Z, t0, r.T);
+				fe_sub (r.T, t0, r.T);
+			}
+		}
+
+		static void madd (PointP1P1& r, const EDDSAPoint51& p, const EDDSAPrecomputedPoint& q, bool sub)
+		{
+			EDDSAFieldElement t0;
+			fe_add (r.X, p.Y, p.X);
+			fe_sub (r.Y, p.Y, p.X);
+			fe_mul (r.Z, r.X, sub ? q.yMinusX : q.yPlusX);
+			fe_mul (r.Y, r.Y, sub ? q.yPlusX : q.yMinusX);
+			fe_mul (r.T, q.xy2d, p.T);
+			fe_add (t0, p.Z, p.Z);
+			fe_sub (r.X, r.Z, r.Y);
+			fe_add (r.Y, r.Z, r.Y);
+			if (sub)
+			{
+				fe_sub (r.Z, t0, r.T);
+				fe_add (r.T, t0, r.T);
+			}
+			else
+			{
+				fe_add (r.Z, t0, r.T);
+				fe_sub (r.T, t0, r.T);
+			}
+		}
+
+		static void p3_dbl (EDDSAPoint51& r, const EDDSAPoint51& p)
+		{
+			PointP1P1 t;
+			p2_dbl (t, p.X, p.Y, p.Z);
+			p1p1_to_p3 (r, t);
+		}
+
+		static void p3_add (EDDSAPoint51& r, const EDDSAPoint51& p, const PointCached& q, bool sub = false)
+		{
+			PointP1P1 t;
+			add (t, p, q, sub);
+			p1p1_to_p3 (r, t);
+		}
+
+		static void p3_to_precomputed (EDDSAPrecomputedPoint& r, const EDDSAPoint51& p, const EDDSAFieldElement d2)
+		{
+			EDDSAFieldElement zi, x, y;
+			fe_invert (zi, p.Z);
+			fe_mul (x, p.X, zi);
+			fe_mul (y, p.Y, zi);
+			fe_add (r.yPlusX, y, x);
+			fe_sub (r.yMinusX, y, x);
+			fe_mul (r.xy2d, x, y);
+			fe_mul (r.xy2d, r.xy2d, d2);
+		}
+
+		static void tobytes (uint8_t * s, const EDDSAFieldElement X, const EDDSAFieldElement Y, const EDDSAFieldElement Z)
+		{
+			EDDSAFieldElement zi, x, y;
+			fe_invert (zi, Z);
+			fe_mul (x, X, zi);
+			fe_mul (y, Y, zi);
+			fe_tobytes (s, y);
+			s[31] ^= fe_isnegative (x) << 7;
+		}
+
+		// decode and negate, -(x,y)
+		static bool frombytes_negate (EDDSAPoint51& h, const uint8_t * s, const EDDSAFieldElement d, const EDDSAFieldElement sqrtm1)
+		{
+			EDDSAFieldElement u, v, v3, vxx, check;
+			fe_frombytes (h.Y, s);
+			fe_one (h.Z);
+			fe_sq (u, h.Y);
+			fe_mul (v, u, d);
+			fe_sub (u, u, h.Z); // u = y^2 - 1
+			fe_add (v, v, h.Z); // v = d*y^2 + 1
+			fe_sq (v3, v);
+			fe_mul (v3, v3, v); // v^3
+			fe_sq (h.X, v3);
+			fe_mul (h.X, h.X, v);
+			fe_mul (h.X, h.X, u); // u*v^7
+			fe_pow22523 (h.X, h.X); // (u*v^7)^((q-5)/8)
+			fe_mul (h.X, h.X, v3);
+			fe_mul (h.X, h.X, u); // x = u*v^3*(u*v^7)^((q-5)/8)
+			fe_sq (vxx, h.X);
+			fe_mul (vxx, vxx, v);
+			fe_sub (check, vxx, u); // v*x^2 - u
+			if (!fe_iszero (check))
+			{
+				fe_add (check, vxx, u); // v*x^2 + u
+				if (!fe_iszero (check)) return false; // not on curve
+				fe_mul (h.X, h.X, sqrtm1);
+			}
+			if (fe_isnegative (h.X) == (bool)(s[31] >> 7))
+				fe_neg (h.X, h.X);
+			fe_mul (h.T, h.X, h.Y);
+			return true;
+		}
+
+		// signed digits in [-(2^(w-1)-1), 2^(w-1)-1], all odd, at least w positions apart
+		static void slide (int8_t * r, const uint8_t * a, int w)
+		{
+			const int max = (1 << (w - 1)) - 1;
+			for (int i = 0; i < 256; i++)
+				r[i] = 1 & (a[i >> 3] >> (i & 7));
+			for (int i = 0; i < 256; i++)
+				if (r[i])
+				{
+					for (int b = 1; b <= w + 1 && i + b < 256; b++)
+					{
+						if (r[i + b])
+						{
+							if (r[i] + (r[i + b] << b) <= max)
+							{
+								r[i] += r[i + b] << b; r[i + b] = 0;
+							}
+							else if (r[i] - (r[i + b] << b) >= -max)
+							{
+								r[i] -= r[i + b] << b;
+								for (int k = i + b; k < 256; k++)
+								{
+									if (!r[k])
+									{
+										r[k] = 1;
+										break;
+									}
+									r[k] = 0;
+								}
+							}
+							else
+								break;
+						}
+					}
+				}
+		}
+
+		// odd multiples 1*p, 3*p, ... 15*p for window of 5 bits
+		static void precompute (PointCached * ai, const EDDSAPoint51& p, const EDDSAFieldElement d2)
+		{
+			EDDSAPoint51 p2, t;
+			p3_to_cached (ai[0], p, d2);
+			p3_dbl (p2, p);
+			for (int i = 0; i < 7; i++)
+			{
+				p3_add (t, p2, ai[i]);
+				p3_to_cached (ai[i + 1], t, d2);
+			}
+		}
+
+		// scalars modulo l = 2^252 + 27742317777372353535851937790883648493, 4 64-bits words
+		const uint64_t L[4] = { 0x5812631a5cf5d3ed, 0x14def9dea2f79cd6, 0, 0x1000000000000000 };
+
+		static inline bool sc_geq_l (const uint64_t * r)
+		{
+			for (int i = 3; i >= 0; i--)
+				if (r[i] != L[i]) return r[i] > L[i];
+			return true;
+		}
+
+		static inline void sc_sub_l (uint64_t * r)
+		{
+			uint64_t borrow = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				uint128_t d = (uint128_t)r[i] - L[i] - borrow;
+				r[i] = (uint64_t)d;
+				borrow = (uint64_t)(d >> 64) & 1;
+			}
+		}
+
+		static bool sc_iscanonical (const uint8_t * s) // s < l
+		{
+			uint64_t r[4];
+			for (int i = 0; i < 4; i++) r[i] = load64 (s + i*8);
+			return !sc_geq_l (r);
+		}
+
+		static void sc_reduce (uint64_t * r, const uint8_t * buf, size_t len) // buf is little endian
+		{
+			r[0] = 0; r[1] = 0; r[2] = 0; r[3] = 0;
+			for (int i = len*8 - 1; i >= 0; i--)
+			{
+				// r = 2*r + bit, r < l < 2^253 never overflows
+				r[3] = (r[3] << 1) | (r[2] >> 63);
+				r[2] = (r[2] << 1) | (r[1] >> 63);
+				r[1] = (r[1] << 1) | (r[0] >> 63);
+				r[0] = (r[0] << 1) | ((buf[i >> 3] >> (i & 7)) & 1);
+				if (sc_geq_l (r)) sc_sub_l (r);
+			}
+		}
+
+		static void sc_tobytes (uint8_t * s, const uint64_t * a)
+		{
+			for (int i = 0; i < 4; i++) store64 (s + i*8, a[i]);
+		}
+	}
+#endif
+
 	Ed25519::Ed25519 ()
 	{
 		BN_CTX * ctx = BN_CTX_new ();
@@ -64,6 +513,31 @@ namespace crypto
 				Bi256Carry = Sum (Bi256Carry, Bi256[i][0], ctx);
 		}
 
+#if ED25519_FE51
+		// field constants and odd multiples of B for radix 2^51 arithmetic
+		uint8_t buf[32];
+		tmp = BN_new ();
+		BN_nnmod (tmp, d, q, ctx);
+		EncodeBN (tmp, buf, 32); curve25519::fe_frombytes (m_D, buf);
+		curve25519::fe_add (m_D2, m_D, m_D);
+		BN_nnmod (tmp, I, q, ctx);
+		EncodeBN (tmp, buf, 32); curve25519::fe_frombytes (m_SqrtM1, buf);
+		BN_free (tmp);
+		EDDSAPoint51 B, B2, Bi;
+		EncodeBN (Bi256[0][0].x, buf, 32); curve25519::fe_frombytes (B.X, buf);
+		EncodeBN (Bi256[0][0].y, buf, 32); curve25519::fe_frombytes (B.Y, buf);
+		curve25519::fe_one (B.Z);
+		curve25519::fe_mul (B.T, B.X, B.Y);
+		curve25519::p3_dbl (B2, B);
+		curve25519::PointCached B2Cached;
+		curve25519::p3_to_cached (B2Cached, B2, m_D2);
+		Bi = B;
+		for (int i = 0; i < 64; i++)
+		{
+			curve25519::p3_to_precomputed (m_BiOdd[i], Bi, m_D2);
+			curve25519::p3_add (Bi, Bi, B2Cached);
+		}
+#endif
 		BN_CTX_free (ctx);
 	}
 
@@ -74,6 +548,12 @@ namespace crypto
 		for (int i = 0; i < 32; i++)
 			for (int j = 0; j < 128; j++)
 				Bi256[i][j] = other.Bi256[i][j];
+#if ED25519_FE51
+		memcpy (m_D, other.m_D, sizeof (m_D));
+		memcpy (m_D2, other.m_D2, sizeof (m_D2));
+		memcpy (m_SqrtM1, other.m_SqrtM1, sizeof (m_SqrtM1));
+		memcpy (m_BiOdd, other.m_BiOdd, sizeof (m_BiOdd));
+#endif
 	}
 
 	Ed25519::~Ed25519 ()
@@ -103,6 +583,14 @@ namespace crypto
 
 	bool Ed25519::Verify (const EDDSAPoint& publicKey, const uint8_t * digest, const uint8_t * signature) const
 	{
+		BIGNUM * s = DecodeBN<32> (signature + EDDSA25519_SIGNATURE_LENGTH/2);
+		bool isCanonical = BN_cmp (s, l) < 0; // RFC 8032 5.1.7, same as radix 2^51 Verify
+		BN_free (s);
+		if (!isCanonical)
+		{
+			LogPrint (eLogError, "25519 signature S is too large");
+			return false;
+		}
 		BN_CTX * ctx = BN_CTX_new ();
 		BIGNUM * h = DecodeBN<64> (digest);
 		// signature 0..31 - R, 32..63 - S
@@ -121,6 +609,68 @@ namespace crypto
 		return passed;
 	}
 
+#if ED25519_FE51
+	bool Ed25519::DecodePublicKey (const uint8_t * buf, EDDSAPoint51& publicKey) const
+	{
+		if (!curve25519::frombytes_negate (publicKey, buf, m_D, m_SqrtM1))
+		{
+			LogPrint (eLogError, "Decoded point is not on 25519");
+			return false;
+		}
+		return true;
+	}
+
+	bool Ed25519::Verify (const EDDSAPoint51& publicKey, const uint8_t * digest, const uint8_t * signature) const
+	{
+		// signature 0..31 - R, 32..63 - S
+		// B*S = R + PK*h => R = B*S - PK*h, publicKey is -PK
+		// we don't decode R, but encode (B*S - PK*h)
+		const uint8_t * S = signature + EDDSA25519_SIGNATURE_LENGTH/2;
+		if (!curve25519::sc_iscanonical (S))
+		{
+			LogPrint (eLogError, "25519 signature S is too large");
+			return false;
+		}
+		uint64_t h[4];
+		uint8_t hs[32];
+		curve25519::sc_reduce (h, digest, 64); // public key is multiple of B, but B%l = 0
+		curve25519::sc_tobytes (hs, h);
+		int8_t hSlide[256], sSlide[256];
+		curve25519::slide (hSlide, hs, 5);
+		curve25519::slide (sSlide, S, 8);
+		curve25519::PointCached PKi[8];
+		curve25519::precompute (PKi, publicKey, m_D2);
+
+		int i = 255;
+		while (i >= 0 && !hSlide[i] && !sSlide[i]) i--;
+		curve25519::PointP2 r;
+		curve25519::fe_zero (r.X); curve25519::fe_one (r.Y); curve25519::fe_one (r.Z);
+		curve25519::PointP1P1 t;
+		EDDSAPoint51 u;
+		for (; i >= 0; i--)
+		{
+			curve25519::p2_dbl (t, r.X, r.Y, r.Z);
+			if (hSlide[i])
+			{
+				curve25519::p1p1_to_p3 (u, t);
+				curve25519::add (t, u, PKi[(hSlide[i] > 0 ? hSlide[i] : -hSlide[i])/2], hSlide[i] < 0);
+			}
+			if (sSlide[i])
+			{
+				curve25519::p1p1_to_p3 (u, t);
+				curve25519::madd (t, u, m_BiOdd[(sSlide[i] > 0 ? sSlide[i] : -sSlide[i])/2], sSlide[i] < 0);
+			}
+			curve25519::p1p1_to_p2 (r, t);
+		}
+		uint8_t diff[32];
+		curve25519::tobytes (diff, r.X, r.Y, r.Z); // Bs - PKh encoded
+		bool passed = !memcmp (signature, diff, 32); // R
+		if (!passed)
+			LogPrint (eLogError, "25519 signature verification failed");
+		return passed;
+	}
+#endif
+
 	void Ed25519::Sign (const uint8_t * expandedPrivateKey, const uint8_t * publicKeyEncoded, const uint8_t * buf, size_t len,
 		uint8_t * signature) const
 	{
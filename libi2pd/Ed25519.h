@@ -61,6 +61,23 @@ namespace crypto
 		}
 	};
 
+#if defined(__SIZEOF_INT128__)
+	#define ED25519_FE51 1 // 64x64->128 multiplication is available
+#else
+	#define ED25519_FE51 0
+#endif
+
+	typedef uint64_t EDDSAFieldElement[5]; // radix 2^51, little endian
+	struct EDDSAPoint51 // extended coordinates
+	{
+		EDDSAFieldElement X, Y, Z, T;
+	};
+
+	struct EDDSAPrecomputedPoint // affine, (y+x, y-x, 2*d*x*y)
+	{
+		EDDSAFieldElement yPlusX, yMinusX, xy2d;
+	};
+
 	const size_t EDDSA25519_PUBLIC_KEY_LENGTH = 32;
 	const size_t EDDSA25519_SIGNATURE_LENGTH = 64;
 	const size_t EDDSA25519_PRIVATE_KEY_LENGTH = 32;
@@ -79,6 +96,10 @@ namespace crypto
 			void ScalarMulB (const  uint8_t * e, uint8_t * buf, BN_CTX * ctx) const;
 
 			bool Verify (const EDDSAPoint& publicKey, const uint8_t * digest, const uint8_t * signature) const;
+#if ED25519_FE51
+			bool DecodePublicKey (const uint8_t * buf, EDDSAPoint51& publicKey) const; // stored negated
+			bool Verify (const EDDSAPoint51& publicKey, const uint8_t * digest, const uint8_t * signature) const;
+#endif
 			void Sign (const uint8_t * expandedPrivateKey, const uint8_t * publicKeyEncoded, const uint8_t * buf, size_t len, uint8_t * signature) const;
 
 			static void ExpandPrivateKey (const uint8_t * key, uint8_t * expandedKey); // key - 32 bytes, expandedKey - 64 bytes
@@ -112,6 +133,10 @@ namespace crypto
 			// if j > 128 we use 256 - j and carry 1 to next byte
 			// Bi256[0][0] = B, base point
 			EDDSAPoint Bi256Carry; // Bi256[32][0]
+#if ED25519_FE51
+			EDDSAFieldElement m_D, m_D2, m_SqrtM1; // d, 2*d, sqrt(-1)
+			EDDSAPrecomputedPoint m_BiOdd[64]; // (2*i+1)*B, for sliding window of 8 bits
+#endif
 	};		
 
 	std::unique_ptr<Ed25519>& GetEd25519 ();
@@ -0,0 +1,343 @@
+#include <string.h>
+#include <functional>
+#include "Crypto.h"
+#include "ElGamal.h"
+
+namespace i2p
+{
+namespace crypto
+{
+	static void BytesToLimbs (const uint8_t * buf, ElGamalLimb * limbs) // 256 bytes big endian
+	{
+		for (int i = 0; i < ELGAMAL_NUM_LIMBS; i++)
+		{
+			const uint8_t * p = buf + 256 - (i + 1)*sizeof (ElGamalLimb);
+			ElGamalLimb l = 0;
+			for (size_t j = 0; j < sizeof (ElGamalLimb); j++)
+				l = (l << 8) | p[j];
+			limbs[i] = l;
+		}
+	}
+
+	static void LimbsToBytes (const ElGamalLimb * limbs, uint8_t * buf)
+	{
+		for (int i = 0; i < ELGAMAL_NUM_LIMBS; i++)
+		{
+			uint8_t * p = buf + 256 - (i + 1)*sizeof (ElGamalLimb);
+			ElGamalLimb l = limbs[i];
+			for (int j = sizeof (ElGamalLimb) - 1; j >= 0; j--)
+			{
+				p[j] = l;
+				l >>= 8;
+			}
+		}
+	}
+
+	static void BNToLimbs (const BIGNUM * bn, ElGamalLimb * limbs)
+	{
+		uint8_t buf[256];
+		bn2buf (bn, buf, 256);
+		BytesToLimbs (buf, limbs);
+	}
+
+	ElGamalMontgomery::ElGamalMontgomery (const BIGNUM * p)
+	{
+		BNToLimbs (p, m_P.limbs);
+		// Newton's iteration, number of correct low bits doubles each time
+		ElGamalLimb inv = m_P.limbs[0];
+		for (int i = 0; i < 6; i++)
+			inv *= 2 - m_P.limbs[0]*inv;
+		m_N0 = -inv;
+		BN_CTX * ctx = BN_CTX_new ();
+		BIGNUM * r = BN_new ();
+		BN_set_bit (r, 4096);
+		BN_mod (r, r, p, ctx);
+		BNToLimbs (r, m_R2.limbs);
+		BN_zero (r);
+		BN_set_bit (r, 2048);
+		BN_mod (r, r, p, ctx);
+		BNToLimbs (r, m_One.limbs);
+		BN_free (r);
+		BN_CTX_free (ctx);
+	}
+
+	void ElGamalMontgomery::Mul (ElGamalNumber& r, const ElGamalNumber& a, const ElGamalNumber& b) const
+	{
+		// coarsely integrated operand scanning, multiplication and reduction in one pass
+		const int n = ELGAMAL_NUM_LIMBS;
+		const int bits = ELGAMAL_LIMB_NUM_BITS;
+		ElGamalLimb t[n + 1];
+		memset (t, 0, sizeof (t));
+		for (int i = 0; i < n; i++)
+		{
+			ElGamalLimb bi = b.limbs[i];
+			ElGamalDoubleLimb c1 = (ElGamalDoubleLimb)a.limbs[0]*bi + t[0];
+			ElGamalLimb m = (ElGamalLimb)c1*m_N0; // lowest limb of t + m*p is zero
+			ElGamalDoubleLimb c2 = (ElGamalDoubleLimb)m*m_P.limbs[0] + (ElGamalLimb)c1;
+			for (int j = 1; j < n; j++)
+			{
+				c1 = (ElGamalDoubleLimb)a.limbs[j]*bi + t[j] + (c1 >> bits);
+				c2 = (ElGamalDoubleLimb)m*m_P.limbs[j] + (ElGamalLimb)c1 + (c2 >> bits);
+				t[j - 1] = (ElGamalLimb)c2; // shifted by one limb
+			}
+			c1 = (ElGamalDoubleLimb)t[n] + (c1 >> bits);
+			c2 = (ElGamalDoubleLimb)(ElGamalLimb)c1 + (c2 >> bits);
+			t[n - 1] = (ElGamalLimb)c2;
+			t[n] = (ElGamalLimb)(c1 >> bits) + (ElGamalLimb)(c2 >> bits);
+		}
+		// t < 2p, subtract p if t >= p
+		bool subtract = t[n] != 0;
+		if (!subtract)
+		{
+			subtract = true; // if equal
+			for (int i = n - 1; i >= 0; i--)
+				if (t[i] != m_P.limbs[i])
+				{
+					subtract = t[i] > m_P.limbs[i];
+					break;
+				}
+		}
+		if (subtract)
+		{
+			ElGamalLimb borrow = 0;
+			for (int i = 0; i < n; i++)
+			{
+				ElGamalDoubleLimb d = (ElGamalDoubleLimb)t[i] - m_P.limbs[i] - borrow;
+				r.limbs[i] = (ElGamalLimb)d;
+				borrow = (d >> ELGAMAL_LIMB_NUM_BITS) ? 1 : 0;
+			}
+		}
+		else
+			memcpy (r.limbs, t, sizeof (r.limbs));
+	}
+
+	void ElGamalMontgomery::FromBytes (ElGamalNumber& r, const uint8_t * buf) const
+	{
+		ElGamalNumber a;
+		BytesToLimbs (buf, a.limbs);
+		Mul (r, a, m_R2);
+	}
+
+	void ElGamalMontgomery::ToBytes (const ElGamalNumber& a, uint8_t * buf) const
+	{
+		ElGamalNumber one, r;
+		memset (one.limbs, 0, sizeof (one.limbs));
+		one.limbs[0] = 1;
+		Mul (r, a, one);
+		LimbsToBytes (r.limbs, buf);
+	}
+
+	ElGamalFixedBaseTable::ElGamalFixedBaseTable (const ElGamalMontgomery& mont, int windowBits, int maxExpBits):
+		m_Mont (mont), m_WindowBits (windowBits), m_NumWindows ((maxExpBits + windowBits - 1)/windowBits),
+		m_NumDigits ((1 << windowBits) - 1), m_Table (m_NumWindows*m_NumDigits)
+	{
+	}
+
+	void ElGamalFixedBaseTable::Precompute (const uint8_t * base, int numThreads)
+	{
+		if (!m_NumWindows) return;
+		// first column is base^(2^(w*i)), squarings
+		m_Mont.FromBytes (m_Table[0], base);
+		for (int i = 1; i < m_NumWindows; i++)
+		{
+			auto& b = m_Table[i*m_NumDigits];
+			b = m_Table[(i - 1)*m_NumDigits];
+			for (int j = 0; j < m_WindowBits; j++)
+				m_Mont.Mul (b, b, b);
+		}
+		// rows are independent
+		if (numThreads > m_NumWindows) numThreads = m_NumWindows;
+		if (numThreads > 1)
+		{
+			std::vector<std::thread> threads;
+			int numRows = (m_NumWindows + numThreads - 1)/numThreads;
+			for (int i = 0; i < m_NumWindows; i += numRows)
+				threads.emplace_back (&ElGamalFixedBaseTable::PrecomputeRows, this, i, std::min (i + numRows, m_NumWindows));
+			for (auto& it: threads) it.join ();
+		}
+		else
+			PrecomputeRows (0, m_NumWindows);
+	}
+
+	void ElGamalFixedBaseTable::PrecomputeRows (int first, int last)
+	{
+		for (int i = first; i < last; i++)
+		{
+			auto row = m_Table.data () + i*m_NumDigits;
+			for (int j = 1; j < m_NumDigits; j++)
+				m_Mont.Mul (row[j], row[j - 1], row[0]);
+		}
+	}
+
+	bool ElGamalFixedBaseTable::Pow (const uint8_t * exp, int len, uint8_t * result) const
+	{
+		while (len > 0 && !exp[0]) { exp++; len--; } // leading zeros
+		int numWindows = (len*8 + m_WindowBits - 1)/m_WindowBits;
+		if (numWindows > m_NumWindows)
+		{
+			// might be zero bits in last window only
+			int numBits = (len - 1)*8;
+			for (uint8_t b = exp[0]; b; b >>= 1) numBits++;
+			numWindows = (numBits + m_WindowBits - 1)/m_WindowBits;
+			if (numWindows > m_NumWindows) return false;
+		}
+		int mask = m_NumDigits;
+		const ElGamalNumber * res = &m_Mont.GetOne ();
+		ElGamalNumber r;
+		for (int i = 0; i < numWindows; i++)
+		{
+			int bit = i*m_WindowBits;
+			int digit = (exp[len - 1 - bit/8] >> (bit % 8)) & mask;
+			if (digit)
+			{
+				m_Mont.Mul (r, *res, m_Table[i*m_NumDigits + digit - 1]);
+				res = &r;
+			}
+		}
+		m_Mont.ToBytes (*res, result);
+		return true;
+	}
+
+	ElGamalKeyTables::ElGamalKeyTables (const ElGamalMontgomery& mont, int maxExpBits):
+		m_Mont (mont), m_MaxExpBits (maxExpBits), m_NumUses (0), m_NumHits (0),
+		m_IsRunning (false), m_IsBuildRequested (false), m_Thread (nullptr)
+	{
+	}
+
+	ElGamalKeyTables::~ElGamalKeyTables ()
+	{
+		if (m_Thread)
+		{
+			{
+				std::unique_lock<std::mutex> l(m_KeysMutex);
+				m_IsRunning = false;
+				m_BuildCondition.notify_one ();
+			}
+			m_Thread->join ();
+			delete m_Thread;
+			m_Thread = nullptr;
+		}
+	}
+
+	std::shared_ptr<const ElGamalFixedBaseTable> ElGamalKeyTables::GetTable (const uint8_t * key)
+	{
+		i2p::data::Tag<32> id (key);
+		std::unique_lock<std::mutex> l(m_KeysMutex);
+		m_NumUses++;
+		auto it = m_Keys.find (id);
+		if (it == m_Keys.end ())
+		{
+			if (m_Keys.size () >= ELGAMAL_MAX_NUM_TRACKED_KEYS)
+			{
+				// start counting again, keep keys with tables
+				for (auto it1 = m_Keys.begin (); it1 != m_Keys.end ();)
+					if (!it1->second.table && !it1->second.isBuilding)
+						it1 = m_Keys.erase (it1);
+					else
+						++it1;
+			}
+			Key k;
+			memcpy (k.key, key, 256);
+			k.numUses = 0; k.numTableUses = 0; k.lastUse = 0; k.isBuilding = false;
+			it = m_Keys.emplace (id, k).first;
+		}
+		else if (memcmp (it->second.key, key, 256))
+			return nullptr; // different key with same beginning
+		auto& k = it->second;
+		k.numUses++;
+		k.lastUse = m_NumUses;
+		if (k.table)
+		{
+			m_NumHits++;
+			k.numTableUses++;
+			return k.table;
+		}
+		if (k.numUses < ELGAMAL_KEY_TABLE_MIN_NUM_USES || k.isBuilding || m_IsBuildRequested) return nullptr;
+		if (CountTables () >= ELGAMAL_MAX_NUM_KEY_TABLES && !FindEvictable ())
+		{
+			k.numUses = 0; // existing tables haven't paid off yet, try later
+			return nullptr;
+		}
+		k.isBuilding = true;
+		m_BuildKey = id;
+		m_IsBuildRequested = true;
+		if (!m_Thread)
+		{
+			m_IsRunning = true;
+			m_Thread = new std::thread (std::bind (&ElGamalKeyTables::Run, this));
+		}
+		m_BuildCondition.notify_one ();
+		return nullptr;
+	}
+
+	void ElGamalKeyTables::Run ()
+	{
+		std::unique_lock<std::mutex> l(m_KeysMutex);
+		while (m_IsRunning)
+		{
+			if (!m_IsBuildRequested)
+			{
+				m_BuildCondition.wait (l);
+				continue;
+			}
+			auto it = m_Keys.find (m_BuildKey); // never erased while building
+			uint8_t key[256];
+			memcpy (key, it->second.key, 256);
+			l.unlock ();
+			auto table = std::make_shared<ElGamalFixedBaseTable> (m_Mont, ELGAMAL_KEY_TABLE_WINDOW_BITS, m_MaxExpBits);
+			table->Precompute (key);
+			l.lock ();
+			it = m_Keys.find (m_BuildKey);
+			auto& k = it->second;
+			if (CountTables () >= ELGAMAL_MAX_NUM_KEY_TABLES)
+			{
+				auto evicted = FindEvictable ();
+				if (evicted)
+				{
+					evicted->table = nullptr;
+					evicted->numUses = 0;
+				}
+				else
+				{
+					table = nullptr;
+					k.numUses = 0;
+				}
+			}
+			k.table = table;
+			k.numTableUses = 0;
+			k.isBuilding = false;
+			m_IsBuildRequested = false;
+		}
+	}
+
+	size_t ElGamalKeyTables::GetNumTables () const
+	{
+		std::unique_lock<std::mutex> l(m_KeysMutex);
+		return CountTables ();
+	}
+
+	uint64_t ElGamalKeyTables::GetNumHits () const
+	{
+		std::unique_lock<std::mutex> l(m_KeysMutex);
+		return m_NumHits;
+	}
+
+	size_t ElGamalKeyTables::CountTables () const
+	{
+		size_t num = 0;
+		for (const auto& it: m_Keys)
+			if (it.second.table) num++;
+		return num;
+	}
+
+	ElGamalKeyTables::Key * ElGamalKeyTables::FindEvictable ()
+	{
+		Key * oldest = nullptr;
+		for (auto& it: m_Keys)
+			if (it.second.table && it.second.numTableUses >= ELGAMAL_KEY_TABLE_PAYBACK_NUM_USES &&
+				(!oldest || it.second.lastUse < oldest->lastUse))
+				oldest = &it.second;
+		return oldest;
+	}
+}
+}
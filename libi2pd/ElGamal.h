@@ -0,0 +1,126 @@
+#ifndef ELGAMAL_H__
+#define ELGAMAL_H__
+
+#include <inttypes.h>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <openssl/bn.h>
+#include "Tag.h"
+
+namespace i2p
+{
+namespace crypto
+{
+#if defined(__SIZEOF_INT128__)
+	typedef uint64_t ElGamalLimb;
+	__extension__ typedef unsigned __int128 ElGamalDoubleLimb;
+#else
+	typedef uint32_t ElGamalLimb;
+	typedef uint64_t ElGamalDoubleLimb;
+#endif
+	const int ELGAMAL_LIMB_NUM_BITS = sizeof (ElGamalLimb)*8;
+	const int ELGAMAL_NUM_LIMBS = 2048/ELGAMAL_LIMB_NUM_BITS;
+
+	/** number modulo 2048 bits ElGamal prime in Montgomery form, least significant limb first */
+	struct ElGamalNumber
+	{
+		ElGamalLimb limbs[ELGAMAL_NUM_LIMBS];
+	};
+
+	/** Montgomery arithmetic modulo ElGamal prime, R = 2^2048 */
+	class ElGamalMontgomery
+	{
+		public:
+
+			ElGamalMontgomery (const BIGNUM * p);
+
+			void Mul (ElGamalNumber& r, const ElGamalNumber& a, const ElGamalNumber& b) const; // r = a*b/R mod p
+			void FromBytes (ElGamalNumber& r, const uint8_t * buf) const; // 256 bytes big endian, converted to Montgomery form
+			void ToBytes (const ElGamalNumber& a, uint8_t * buf) const; // 256 bytes big endian, converted from Montgomery form
+			const ElGamalNumber& GetOne () const { return m_One; }; // R mod p
+
+		private:
+
+			ElGamalNumber m_P, m_R2, m_One; // p, R^2 mod p, R mod p
+			ElGamalLimb m_N0; // -1/p mod 2^ELGAMAL_LIMB_NUM_BITS
+	};
+
+	/** base^(d*2^(w*i)) for every window i of exponent and digit d = 1..2^w-1 of w bits in one array.
+	 * Exponentiation is one multiplication per nonzero digit, no squarings */
+	class ElGamalFixedBaseTable
+	{
+		public:
+
+			ElGamalFixedBaseTable (const ElGamalMontgomery& mont, int windowBits, int maxExpBits); // window of 1, 2, 4 or 8 bits
+			void Precompute (const uint8_t * base, int numThreads = 1); // base is 256 bytes big endian, rows are split between threads
+			bool Pow (const uint8_t * exp, int len, uint8_t * result) const; // exp and result big endian, result is 256 bytes, false if exp is too long
+
+			size_t GetSize () const { return m_Table.size ()*sizeof (ElGamalNumber); }; // in bytes
+
+		private:
+
+			void PrecomputeRows (int first, int last);
+
+		private:
+
+			const ElGamalMontgomery& m_Mont;
+			int m_WindowBits, m_NumWindows, m_NumDigits;
+			std::vector<ElGamalNumber> m_Table; // m_NumWindows rows of m_NumDigits
+	};
+
+	const int ELGAMAL_KEY_TABLE_WINDOW_BITS = 4; // about 2M for full exponent
+	const int ELGAMAL_KEY_TABLE_MIN_NUM_USES = 8; // table is built for public key used that many times
+	const int ELGAMAL_KEY_TABLE_PAYBACK_NUM_USES = 8; // building costs about 4 BN_mod_exp, table is kept for that many uses at least
+	const size_t ELGAMAL_MAX_NUM_KEY_TABLES = 4;
+	const size_t ELGAMAL_MAX_NUM_TRACKED_KEYS = 256;
+
+	/** tables of public keys used for encryption often, such as remote destinations of garlic sessions.
+	 * Tables are built one by one in own thread, a key is encrypted without table until its table is ready */
+	class ElGamalKeyTables
+	{
+		public:
+
+			ElGamalKeyTables (const ElGamalMontgomery& mont, int maxExpBits);
+			~ElGamalKeyTables ();
+
+			std::shared_ptr<const ElGamalFixedBaseTable> GetTable (const uint8_t * key); // nullptr if not used often enough or not built yet, thread safe
+
+			size_t GetNumTables () const;
+			uint64_t GetNumHits () const;
+
+		private:
+
+			struct Key
+			{
+				uint8_t key[256];
+				int numUses, numTableUses;
+				uint64_t lastUse;
+				bool isBuilding;
+				std::shared_ptr<const ElGamalFixedBaseTable> table;
+			};
+
+			void Run ();
+			size_t CountTables () const;
+			Key * FindEvictable (); // least recently used of tables used ELGAMAL_KEY_TABLE_PAYBACK_NUM_USES times, nullptr if none
+
+		private:
+
+			const ElGamalMontgomery& m_Mont;
+			int m_MaxExpBits;
+			mutable std::mutex m_KeysMutex;
+			std::map<i2p::data::Tag<32>, Key> m_Keys; // first 32 bytes of public key -> key
+			uint64_t m_NumUses, m_NumHits;
+
+			bool m_IsRunning, m_IsBuildRequested;
+			i2p::data::Tag<32> m_BuildKey;
+			std::condition_variable m_BuildCondition;
+			std::thread * m_Thread; // started with first table
+	};
+}
+}
+
+#endif
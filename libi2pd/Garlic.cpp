@@ -21,7 +21,8 @@ namespace garlic
 	    std::shared_ptr<const i2p::data::RoutingDestination> destination, int numTags, bool attachLeaseSet):
 		m_Owner (owner), m_Destination (destination), m_NumTags (numTags),
 		m_LeaseSetUpdateStatus (attachLeaseSet ? eLeaseSetUpdated : eLeaseSetDoNotSend),
-		m_LeaseSetUpdateMsgID (0)
+		m_LeaseSetUpdateMsgID (0), m_NumPreparingElGamal (0), m_NumPreparingTags (0),
+		m_SendRate (0), m_SendRateUpdateTime (i2p::util::GetMillisecondsSinceEpoch ()), m_NumSent (0)
 	{
 		// create new session tags and session key
 		RAND_bytes (m_SessionKey, 32);
@@ -29,7 +30,8 @@ namespace garlic
 	}
 
 	GarlicRoutingSession::GarlicRoutingSession (const uint8_t * sessionKey, const SessionTag& sessionTag):
-		m_Owner (nullptr), m_NumTags (1), m_LeaseSetUpdateStatus (eLeaseSetDoNotSend), m_LeaseSetUpdateMsgID (0)
+		m_Owner (nullptr), m_NumTags (1), m_LeaseSetUpdateStatus (eLeaseSetDoNotSend), m_LeaseSetUpdateMsgID (0),
+		m_NumPreparingElGamal (0), m_NumPreparingTags (0), m_SendRate (0), m_SendRateUpdateTime (0), m_NumSent (0)
 	{
 		memcpy (m_SessionKey, sessionKey, 32);
 		m_Encryption.SetKey (m_SessionKey);
@@ -70,9 +72,22 @@ namespace garlic
 	{
 		auto tags = new UnconfirmedTags (m_NumTags);
 		tags->tagsCreationTime = i2p::util::GetSecondsSinceEpoch ();
+		std::shared_ptr<PreparedTags> prepared;
+		{
+			std::unique_lock<std::mutex> l(m_PreparedMutex);
+			if (!m_PreparedTags.empty ())
+			{
+				prepared = m_PreparedTags.front ();
+				m_PreparedTags.pop_front ();
+			}
+		}
+		if (m_Owner) m_Owner->CountPreparedTags (prepared != nullptr);
 		for (int i = 0; i < m_NumTags; i++)
 		{
-			RAND_bytes (tags->sessionTags[i], 32);
+			if (prepared)
+				memcpy (tags->sessionTags[i], prepared->data () + i*32, 32);
+			else
+				RAND_bytes (tags->sessionTags[i], 32);
 			tags->sessionTags[i].creationTime = tags->tagsCreationTime;
 		}
 		return tags;
@@ -147,9 +162,107 @@ namespace garlic
 		return ret;
 	}
 
+	void GarlicRoutingSession::UpdateSendRate ()
+	{
+		m_NumSent++;
+		auto ts = i2p::util::GetMillisecondsSinceEpoch ();
+		if (ts >= m_SendRateUpdateTime + 1000)
+		{
+			double rate = m_NumSent*1000.0/(ts - m_SendRateUpdateTime);
+			m_SendRate = (m_SendRate + rate)/2; // smoothed, goes down after pause
+			m_SendRateUpdateTime = ts;
+			m_NumSent = 0;
+		}
+	}
+
+	int GarlicRoutingSession::GetNumToPrepare (int max) const
+	{
+		// at least one for next message, more if sent faster than tags get confirmed
+		int num = (int)(std::max (m_SendRate, (double)m_NumSent)*GARLIC_PREPARATION_INTERVAL/1000) + 1;
+		return std::min (num, max);
+	}
+
+	void GarlicRoutingSession::Prepare ()
+	{
+		if (!m_Owner || !m_Destination) return;
+		// LeaseSet and floodfill requests are one-shot, nothing to prepare for
+		if (m_LeaseSetUpdateStatus == eLeaseSetDoNotSend) return;
+		// leave half of backlog for incoming messages
+		if (m_Owner->GetNumPendingElGamal () >= GARLIC_MAX_PENDING_ELGAMAL/2) return;
+		int numTagsLeft = m_SessionTags.size ();
+		// ElGamal is used only after confirmed tags run out
+		int numElGamal = GetNumToPrepare (GARLIC_MAX_PREPARED_ELGAMAL) - numTagsLeft;
+		// new tags are created once confirmed tags fall to 2/3, for every message until confirmed
+		int numTags = 0;
+		if (m_NumTags > 0)
+		{
+			int numBeforeNewTags = numTagsLeft - m_NumTags*2/3;
+			numTags = GetNumToPrepare (GARLIC_MAX_PREPARED_TAGS + std::max (numBeforeNewTags, 0)) - std::max (numBeforeNewTags, 0);
+		}
+		if (numElGamal <= 0 && numTags <= 0) return;
+		{
+			std::unique_lock<std::mutex> l(m_PreparedMutex);
+			numElGamal -= (int)m_PreparedElGamal.size () + m_NumPreparingElGamal;
+			numTags -= (int)m_PreparedTags.size () + m_NumPreparingTags;
+			if (numElGamal < 0) numElGamal = 0;
+			if (numTags < 0) numTags = 0;
+			if (!numElGamal && !numTags) return;
+			m_NumPreparingElGamal += numElGamal;
+			m_NumPreparingTags += numTags;
+		}
+		auto s = shared_from_this ();
+		auto destination = m_Destination;
+		int tagsLen = m_NumTags*32;
+		if (!m_Owner->SubmitElGamalWork ([s, destination, numElGamal, numTags, tagsLen](BN_CTX * ctx)->std::function<void ()>
+			{
+				auto elGamals = std::make_shared<std::vector<std::shared_ptr<PreparedElGamalBlock> > > ();
+				for (int i = 0; i < numElGamal; i++)
+				{
+					auto prepared = std::make_shared<PreparedElGamalBlock> ();
+					ElGamalBlock elGamal;
+					memcpy (elGamal.sessionKey, s->m_SessionKey, 32);
+					RAND_bytes (elGamal.preIV, 32); // Pre-IV
+					SHA256(elGamal.preIV, 32, prepared->iv);
+					destination->Encrypt ((uint8_t *)&elGamal, prepared->encrypted, ctx);
+					elGamals->push_back (prepared);
+				}
+				auto tags = std::make_shared<std::vector<std::shared_ptr<PreparedTags> > > ();
+				for (int i = 0; i < numTags; i++)
+				{
+					auto prepared = std::make_shared<PreparedTags> (tagsLen);
+					RAND_bytes (prepared->data (), tagsLen);
+					tags->push_back (prepared);
+				}
+				return [s, elGamals, tags, numElGamal, numTags]()
+					{
+						std::unique_lock<std::mutex> l(s->m_PreparedMutex);
+						s->m_PreparedElGamal.insert (s->m_PreparedElGamal.end (), elGamals->begin (), elGamals->end ());
+						s->m_PreparedTags.insert (s->m_PreparedTags.end (), tags->begin (), tags->end ());
+						s->m_NumPreparingElGamal -= numElGamal;
+						s->m_NumPreparingTags -= numTags;
+					};
+			}))
+		{
+			std::unique_lock<std::mutex> l(m_PreparedMutex);
+			m_NumPreparingElGamal -= numElGamal;
+			m_NumPreparingTags -= numTags;
+		}
+	}
+
 	std::shared_ptr<I2NPMessage> GarlicRoutingSession::WrapSingleMessage (std::shared_ptr<const I2NPMessage> msg)
 	{
-		auto m = NewI2NPMessage ();
+		// length, ElGamal block, AES block header and padding, garlic header and trailer, clove of msg
+		size_t maxLen = 4 + 514 + 54 + 16 + (msg ? msg->GetLength () + 48 : 0);
+		if (m_Owner)
+		{
+			maxLen += m_NumTags*32 + 256; // new tags and DeliveryStatus clove
+			if (m_LeaseSetUpdateStatus == eLeaseSetUpdated || m_LeaseSetUpdateStatus == eLeaseSetSubmitted)
+			{
+				auto leaseSet = m_Owner->GetLeaseSet ();
+				if (leaseSet) maxLen += leaseSet->GetBufferLen () + 128; // DatabaseStore clove
+			}
+		}
+		auto m = NewI2NPMessage (maxLen);
 		m->Align (12); // in order to get buf aligned to 16 (12 + 4)
 		size_t len = 0;
 		uint8_t * buf = m->GetPayload () + 4; // 4 bytes for length
@@ -182,16 +295,35 @@ namespace garlic
 				LogPrint (eLogError, "Garlic: Can't use ElGamal for unknown destination");
 				return nullptr;
 			}
-			// create ElGamal block
-			ElGamalBlock elGamal;
-			memcpy (elGamal.sessionKey, m_SessionKey, 32);
-			RAND_bytes (elGamal.preIV, 32); // Pre-IV
-			uint8_t iv[32]; // IV is first 16 bytes
-			SHA256(elGamal.preIV, 32, iv);
-			BN_CTX * ctx = BN_CTX_new ();
-			m_Destination->Encrypt ((uint8_t *)&elGamal, buf, ctx);
-			BN_CTX_free (ctx);
-			m_Encryption.SetIV (iv);
+			std::shared_ptr<PreparedElGamalBlock> prepared;
+			{
+				std::unique_lock<std::mutex> l(m_PreparedMutex);
+				if (!m_PreparedElGamal.empty ())
+				{
+					prepared = m_PreparedElGamal.front ();
+					m_PreparedElGamal.pop_front ();
+				}
+			}
+			if (m_Owner) m_Owner->CountPreparedElGamal (prepared != nullptr);
+			if (prepared)
+			{
+				// encrypted by ElGamal pool
+				memcpy (buf, prepared->encrypted, 514);
+				m_Encryption.SetIV (prepared->iv);
+			}
+			else
+			{
+				// create ElGamal block
+				ElGamalBlock elGamal;
+				memcpy (elGamal.sessionKey, m_SessionKey, 32);
+				RAND_bytes (elGamal.preIV, 32); // Pre-IV
+				uint8_t iv[32]; // IV is first 16 bytes
+				SHA256(elGamal.preIV, 32, iv);
+				BN_CTX * ctx = BN_CTX_new ();
+				m_Destination->Encrypt ((uint8_t *)&elGamal, buf, ctx);
+				BN_CTX_free (ctx);
+				m_Encryption.SetIV (iv);
+			}
 			buf += 514;
 			len += 514;
 		}
@@ -210,6 +342,11 @@ namespace garlic
 		htobe32buf (m->GetPayload (), len);
 		m->len += len + 4;
 		m->FillI2NPMessageHeader (eI2NPGarlic);
+		if (m_Owner)
+		{
+			UpdateSendRate ();
+			Prepare (); // for next messages, until tags are confirmed or after they expire
+		}
 		return m;
 	}
 
@@ -392,7 +529,10 @@ namespace garlic
 		return size;
 	}
 
-	GarlicDestination::GarlicDestination (): m_NumTags (32) // 32 tags by default
+	GarlicDestination::GarlicDestination (): m_NumTags (32), // 32 tags by default
+		m_NumPendingElGamal (0), m_NumAsyncElGamal (0), m_NumDroppedElGamal (0),
+		m_NumPreparedElGamalHits (0), m_NumPreparedElGamalMisses (0),
+		m_NumPreparedTagsHits (0), m_NumPreparedTagsMisses (0)
 	{
 		m_Ctx = BN_CTX_new ();
 	}
@@ -406,14 +546,15 @@ namespace garlic
 	{
 		m_Sessions.clear ();
 		m_DeliveryStatusSessions.clear ();
-		m_Tags.clear ();
+		m_Tags.Clear ();
+		m_HeldMessages.clear ();
 	}
 	void GarlicDestination::AddSessionKey (const uint8_t * key, const uint8_t * tag)
 	{
 		if (key)
 		{
 			uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
-			m_Tags[SessionTag(tag, ts)] = std::make_shared<AESDecryption>(key);
+			m_Tags.AddTags (tag, 1, std::make_shared<AESDecryption>(key), ts);
 		}
 	}
 
@@ -433,41 +574,128 @@ namespace garlic
 			return;
 		}
 		buf += 4; // length
-		auto it = m_Tags.find (SessionTag(buf));
-		if (it != m_Tags.end ())
+		if (HandleTaggedMessage (buf, length, msg->from)) return;
+		// tag not found. Use ElGamal
+		if (length < 514)
 		{
-			// tag found. Use AES
-			auto decryption = it->second;
-			m_Tags.erase (it); // tag might be used only once
-			if (length >= 32)
-			{
-				uint8_t iv[32]; // IV is first 16 bytes
-				SHA256(buf, 32, iv);
-				decryption->SetIV (iv);
-				decryption->Decrypt (buf + 32, length - 32, buf + 32);
-				HandleAESBlock (buf + 32, length - 32, decryption, msg->from);
-			}
+			if (m_NumPendingElGamal > 0)
+				HoldMessage (msg); // tag might be in ElGamal pool
 			else
-				LogPrint (eLogWarning, "Garlic: message length ", length, " is less than 32 bytes");
+				LogPrint (eLogError, "Garlic: Failed to decrypt message");
+			return;
 		}
-		else
+		if (m_NumPendingElGamal >= GARLIC_MAX_PENDING_ELGAMAL)
 		{
-			// tag not found. Use ElGamal
-			ElGamalBlock elGamal;
-			if (length >= 514 && Decrypt (buf, (uint8_t *)&elGamal, m_Ctx))
+			// too many new sessions at once
+			m_NumDroppedElGamal++;
+			LogPrint (eLogWarning, "Garlic: ", m_NumPendingElGamal, " ElGamal operations pending, message dropped");
+			return;
+		}
+		if (SubmitElGamalWork ([msg, this](BN_CTX * ctx)->std::function<void ()>
 			{
-				auto decryption = std::make_shared<AESDecryption>(elGamal.sessionKey);
-				uint8_t iv[32]; // IV is first 16 bytes
-				SHA256(elGamal.preIV, 32, iv);
-				decryption->SetIV (iv);
-				decryption->Decrypt(buf + 514, length - 514, buf + 514);
-				HandleAESBlock (buf + 514, length - 514, decryption, msg->from);
-			}
+				auto elGamal = std::make_shared<ElGamalBlock> ();
+				bool decrypted = Decrypt (msg->GetPayload () + 4, (uint8_t *)elGamal.get (), ctx);
+				return [msg, elGamal, decrypted, this]()
+					{
+						HandleElGamalDecrypted (msg, decrypted ? elGamal.get () : nullptr);
+					};
+			}))
+			return; // continues in HandleElGamalDecrypted
+		ElGamalBlock elGamal;
+		HandleElGamalDecrypted (msg, Decrypt (buf, (uint8_t *)&elGamal, m_Ctx) ? &elGamal : nullptr);
+	}
+
+	bool GarlicDestination::HandleTaggedMessage (uint8_t * buf, uint32_t length, std::shared_ptr<i2p::tunnel::InboundTunnel> from)
+	{
+		auto decryption = m_Tags.UseTag (buf); // tag might be used only once
+		if (!decryption) return false;
+		// tag found. Use AES
+		if (length >= 32)
+		{
+			uint8_t iv[32]; // IV is first 16 bytes
+			SHA256(buf, 32, iv);
+			decryption->SetIV (iv);
+			decryption->Decrypt (buf + 32, length - 32, buf + 32);
+			HandleAESBlock (buf + 32, length - 32, decryption, from);
+		}
+		else
+			LogPrint (eLogWarning, "Garlic: message length ", length, " is less than 32 bytes");
+		return true;
+	}
+
+	void GarlicDestination::HandleElGamalDecrypted (std::shared_ptr<I2NPMessage> msg, const ElGamalBlock * elGamal)
+	{
+		uint8_t * buf = msg->GetPayload ();
+		uint32_t length = bufbe32toh (buf);
+		buf += 4; // length
+		if (elGamal)
+		{
+			auto decryption = std::make_shared<AESDecryption>(elGamal->sessionKey);
+			uint8_t iv[32]; // IV is first 16 bytes
+			SHA256(elGamal->preIV, 32, iv);
+			decryption->SetIV (iv);
+			decryption->Decrypt(buf + 514, length - 514, buf + 514);
+			HandleAESBlock (buf + 514, length - 514, decryption, msg->from);
+		}
+		else if (!HandleTaggedMessage (buf, length, msg->from)) // tag might arrive while in ElGamal pool
+		{
+			if (m_NumPendingElGamal > 0)
+				HoldMessage (msg);
+			else
+				LogPrint (eLogError, "Garlic: Failed to decrypt message");
+		}
+		HandleHeldMessages ();
+	}
+
+	void GarlicDestination::HoldMessage (std::shared_ptr<I2NPMessage> msg)
+	{
+		if ((int)m_HeldMessages.size () >= GARLIC_MAX_HELD_MESSAGES)
+		{
+			LogPrint (eLogError, "Garlic: Failed to decrypt message, too many messages with unknown tag");
+			m_HeldMessages.pop_front ();
+		}
+		m_HeldMessages.push_back (std::make_pair (msg, i2p::util::GetSecondsSinceEpoch ()));
+	}
+
+	void GarlicDestination::HandleHeldMessages ()
+	{
+		if (m_HeldMessages.empty ()) return;
+		uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
+		bool isPending = m_NumPendingElGamal > 0;
+		decltype(m_HeldMessages) held;
+		held.swap (m_HeldMessages); // handling of a message might hold another one
+		for (auto& it: held)
+		{
+			uint8_t * buf = it.first->GetPayload ();
+			if (HandleTaggedMessage (buf + 4, bufbe32toh (buf), it.first->from)) continue;
+			if (isPending && ts < it.second + GARLIC_HELD_MESSAGE_TIMEOUT)
+				m_HeldMessages.push_back (it);
 			else
 				LogPrint (eLogError, "Garlic: Failed to decrypt message");
 		}
 	}
 
+	bool GarlicDestination::SubmitElGamalWork (ElGamalWork work)
+	{
+		if (m_NumPendingElGamal.fetch_add (1) >= GARLIC_MAX_PENDING_ELGAMAL)
+		{
+			m_NumPendingElGamal--; // backlog is full
+			return false;
+		}
+		bool submitted = PostElGamalWork ([this, work](BN_CTX * ctx)->std::function<void ()>
+			{
+				auto result = work (ctx);
+				return [this, result]()
+					{
+						m_NumPendingElGamal--;
+						m_NumAsyncElGamal++;
+						result ();
+					};
+			});
+		if (!submitted) m_NumPendingElGamal--;
+		return submitted;
+	}
+
 	void GarlicDestination::HandleAESBlock (uint8_t * buf, size_t len, std::shared_ptr<AESDecryption> decryption,
 		std::shared_ptr<i2p::tunnel::InboundTunnel> from)
 	{
@@ -480,9 +708,7 @@ namespace garlic
 				LogPrint (eLogError, "Garlic: Tag count ", tagCount, " exceeds length ", len);
 				return ;
 			}
-			uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
-			for (int i = 0; i < tagCount; i++)
-				m_Tags[SessionTag(buf + i*32, ts)] = decryption;
+			m_Tags.AddTags (buf, tagCount, decryption, i2p::util::GetSecondsSinceEpoch ());
 		}
 		buf += tagCount*32;
 		len -= tagCount*32;
@@ -659,17 +885,7 @@ namespace garlic
 	{
 		// incoming
 		uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
-		int numExpiredTags = 0;
-		for (auto it = m_Tags.begin (); it != m_Tags.end ();)
-		{
-			if (ts > it->first.creationTime + INCOMING_TAGS_EXPIRATION_TIMEOUT)
-			{
-				numExpiredTags++;
-				it = m_Tags.erase (it);
-			}
-			else
-				++it;
-		}
+		auto numExpiredTags = m_Tags.ExpireTags (ts);
 		if (numExpiredTags > 0)
 			LogPrint (eLogDebug, "Garlic: ", numExpiredTags, " tags expired for ", GetIdentHash().ToBase64 ());
 
@@ -753,21 +969,21 @@ namespace garlic
 
 	void GarlicDestination::SaveTags ()
 	{
-		if (m_Tags.empty ()) return;
+		if (m_Tags.IsEmpty ()) return;
 		std::string ident = GetIdentHash().ToBase32();
 		std::string path  = i2p::fs::DataDirPath("tags", (ident + ".tags"));
 		std::ofstream f (path, std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
 		uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
 		// 4 bytes timestamp, 32 bytes tag, 32 bytes key
-		for (auto it: m_Tags)
-		{
-			if (ts < it.first.creationTime + INCOMING_TAGS_EXPIRATION_TIMEOUT)
+		m_Tags.VisitTags ([&f, ts](const SessionTag& tag, const AESDecryption& decryption)
 			{
-				f.write ((char *)&it.first.creationTime, 4);
-				f.write ((char *)it.first.data (), 32);
-				f.write ((char *)it.second->GetKey ().data (), 32);
-			}
-		}
+				if (ts < tag.creationTime + INCOMING_TAGS_EXPIRATION_TIMEOUT)
+				{
+					f.write ((char *)&tag.creationTime, 4);
+					f.write ((char *)tag.data (), 32);
+					f.write ((char *)decryption.GetKey ().data (), 32);
+				}
+			});
 	}
 
 	void GarlicDestination::LoadTags ()
@@ -781,32 +997,25 @@ namespace garlic
 			std::ifstream f (path, std::ifstream::binary);
 			if (f)
 			{
-				std::map<i2p::crypto::AESKey, std::shared_ptr<AESDecryption> > keys;
 				// 4 bytes timestamp, 32 bytes tag, 32 bytes key
 				while (!f.eof ())
 				{
 					uint32_t t;
 					uint8_t tag[32], key[32];
 					f.read ((char *)&t, 4); if (f.eof ()) break;
-					if (ts < t + INCOMING_TAGS_EXPIRATION_TIMEOUT)
+					if (ts >= t + INCOMING_TAGS_EXPIRATION_TIMEOUT)
 					{
-						f.read ((char *)tag, 32);
-						f.read ((char *)key, 32);
-					}
-					else
 						f.seekg (64, std::ios::cur); // skip
+						continue;
+					}
+					f.read ((char *)tag, 32);
+					f.read ((char *)key, 32);
 					if (f.eof ()) break;
 
-					std::shared_ptr<AESDecryption> decryption;
-					auto it = keys.find (key);
-					if (it != keys.end ())
-						decryption = it->second;
-					else
-						decryption = std::make_shared<AESDecryption>(key);
-					m_Tags.insert (std::make_pair (SessionTag (tag, ts), decryption));
+					m_Tags.AddTags (tag, 1, std::make_shared<AESDecryption>(key), t); // tags of same key share it
 				}
-				if (!m_Tags.empty ())
-					LogPrint (eLogInfo, m_Tags.size (), " loaded for ", ident);
+				if (!m_Tags.IsEmpty ())
+					LogPrint (eLogInfo, m_Tags.GetNumTags (), " loaded for ", ident);
 			}
 		}
 		i2p::fs::Remove (path);
@@ -4,15 +4,19 @@
 #include <inttypes.h>
 #include <map>
 #include <list>
+#include <deque>
+#include <vector>
 #include <string>
-#include <thread>
 #include <mutex>
+#include <atomic>
+#include <functional>
 #include <memory>
 #include "Crypto.h"
 #include "I2NPProtocol.h"
 #include "LeaseSet.h"
 #include "Queue.h"
 #include "Identity.h"
+#include "GarlicTags.h"
 
 namespace i2p
 {
@@ -39,41 +43,17 @@ namespace garlic
 		uint8_t padding[158];
 	};
 
-	const int INCOMING_TAGS_EXPIRATION_TIMEOUT = 960; // 16 minutes
 	const int OUTGOING_TAGS_EXPIRATION_TIMEOUT = 720; // 12 minutes
 	const int OUTGOING_TAGS_CONFIRMATION_TIMEOUT = 10; // 10 seconds
 	const int LEASET_CONFIRMATION_TIMEOUT = 4000; // in milliseconds
 	const int ROUTING_PATH_EXPIRATION_TIMEOUT = 30; // 30 seconds
 	const int ROUTING_PATH_MAX_NUM_TIMES_USED = 100; // how many times might be used
-
-	struct SessionTag: public i2p::data::Tag<32>
-	{
-		SessionTag (const uint8_t * buf, uint32_t ts = 0): Tag<32>(buf), creationTime (ts) {};
-		SessionTag () = default;
-		SessionTag (const SessionTag& ) = default;
-		SessionTag& operator= (const SessionTag& ) = default;
-#ifndef _WIN32
-		SessionTag (SessionTag&& ) = default;
-		SessionTag& operator= (SessionTag&& ) = default;
-#endif
-		uint32_t creationTime; // seconds since epoch
-	};
-
-	// AESDecryption is associated with session tags and store key
-	class AESDecryption: public i2p::crypto::CBCDecryption
-	{
-		public:
-
-			AESDecryption (const uint8_t * key): m_Key (key)
-			{
-				SetKey (key);
-			}
-			const i2p::crypto::AESKey& GetKey () const { return m_Key; };
-
-		private:
-
-			i2p::crypto::AESKey m_Key;
-	};
+	const int GARLIC_MAX_PENDING_ELGAMAL = 32; // per destination, incoming ElGamal messages above are dropped
+	const int GARLIC_MAX_HELD_MESSAGES = 64; // per destination, messages with unknown tag waiting for pending ElGamal
+	const int GARLIC_HELD_MESSAGE_TIMEOUT = 10; // in seconds
+	const int GARLIC_MAX_PREPARED_ELGAMAL = 8; // per session, ElGamal blocks encrypted in advance
+	const int GARLIC_MAX_PREPARED_TAGS = 4; // per session, sets of tags generated in advance
+	const int GARLIC_PREPARATION_INTERVAL = 2000; // in milliseconds, enough is prepared for messages sent during this time
 
 	struct GarlicRoutingPath
 	{
@@ -105,6 +85,13 @@ namespace garlic
 				uint32_t tagsCreationTime;
 			};
 
+			struct PreparedElGamalBlock
+			{
+				uint8_t encrypted[514];
+				uint8_t iv[32]; // IV is first 16 bytes
+			};
+			typedef std::vector<uint8_t> PreparedTags; // 32 bytes per tag
+
 		public:
 
 			GarlicRoutingSession (GarlicDestination * owner, std::shared_ptr<const i2p::data::RoutingDestination> destination,
@@ -139,6 +126,9 @@ namespace garlic
 
 			void TagsConfirmed (uint32_t msgID);
 			UnconfirmedTags * GenerateSessionTags ();
+			void UpdateSendRate ();
+			int GetNumToPrepare (int max) const; // by send rate
+			void Prepare (); // ElGamal blocks and tags for next messages in ElGamal pool
 
 		private:
 
@@ -156,6 +146,15 @@ namespace garlic
 
 			i2p::crypto::CBCEncryption m_Encryption;
 
+			// prepared in background
+			std::mutex m_PreparedMutex;
+			std::deque<std::shared_ptr<PreparedElGamalBlock> > m_PreparedElGamal;
+			std::deque<std::shared_ptr<PreparedTags> > m_PreparedTags;
+			int m_NumPreparingElGamal, m_NumPreparingTags; // submitted to worker
+			double m_SendRate; // messages per second
+			uint64_t m_SendRateUpdateTime; // in milliseconds
+			int m_NumSent; // since last update
+
 			std::shared_ptr<GarlicRoutingPath> m_SharedRoutingPath;
 
 		public:
@@ -169,6 +168,8 @@ namespace garlic
 	{
 		public:
 
+			typedef std::function<std::function<void ()> (BN_CTX * ctx)> ElGamalWork; // returns handler of result
+
 			GarlicDestination ();
 			~GarlicDestination ();
 
@@ -183,6 +184,9 @@ namespace garlic
 			void AddSessionKey (const uint8_t * key, const uint8_t * tag); // one tag
 			virtual bool SubmitSessionKey (const uint8_t * key, const uint8_t * tag); // from different thread
 			void DeliveryStatusSent (GarlicRoutingSessionPtr session, uint32_t msgID);
+			bool SubmitElGamalWork (ElGamalWork work); // false if can't be done asynchronously or backlog is full
+			void CountPreparedElGamal (bool hit) { if (hit) m_NumPreparedElGamalHits++; else m_NumPreparedElGamalMisses++; };
+			void CountPreparedTags (bool hit) { if (hit) m_NumPreparedTagsHits++; else m_NumPreparedTagsMisses++; };
 
 			virtual void ProcessGarlicMessage (std::shared_ptr<I2NPMessage> msg);
 			virtual void ProcessDeliveryStatusMessage (std::shared_ptr<I2NPMessage> msg);
@@ -200,8 +204,15 @@ namespace garlic
 			void SaveTags ();
 			void LoadTags ();
 
+			// run work in ElGamal pool and handler of result in destination's thread, false if not supported
+			virtual bool PostElGamalWork (ElGamalWork) { return false; };
+
 		private:
 
+			bool HandleTaggedMessage (uint8_t * buf, uint32_t length, std::shared_ptr<i2p::tunnel::InboundTunnel> from); // false if tag not found
+			void HandleElGamalDecrypted (std::shared_ptr<I2NPMessage> msg, const ElGamalBlock * elGamal); // nullptr if failed
+			void HoldMessage (std::shared_ptr<I2NPMessage> msg); // until pending ElGamal brings its tag
+			void HandleHeldMessages ();
 			void HandleAESBlock (uint8_t * buf, size_t len, std::shared_ptr<AESDecryption> decryption,
 				std::shared_ptr<i2p::tunnel::InboundTunnel> from);
 			void HandleGarlicPayload (uint8_t * buf, size_t len, std::shared_ptr<i2p::tunnel::InboundTunnel> from);
@@ -214,7 +225,14 @@ namespace garlic
 			std::mutex m_SessionsMutex;
 			std::map<i2p::data::IdentHash, GarlicRoutingSessionPtr> m_Sessions;
 			// incoming
-			std::map<SessionTag, std::shared_ptr<AESDecryption> > m_Tags;
+			IncomingSessionTags m_Tags;
+			// ElGamal in worker
+			std::atomic<int> m_NumPendingElGamal;
+			std::atomic<uint64_t> m_NumAsyncElGamal, m_NumDroppedElGamal;
+			std::deque<std::pair<std::shared_ptr<I2NPMessage>, uint32_t> > m_HeldMessages; // with receive time
+			// outgoing messages sent with ElGamal blocks and tags prepared in advance or not
+			std::atomic<uint64_t> m_NumPreparedElGamalHits, m_NumPreparedElGamalMisses,
+				m_NumPreparedTagsHits, m_NumPreparedTagsMisses;
 			// DeliveryStatus
 			std::mutex m_DeliveryStatusSessionsMutex;
 			std::map<uint32_t, GarlicRoutingSessionPtr> m_DeliveryStatusSessions; // msgID -> session
@@ -222,7 +240,14 @@ namespace garlic
 		public:
 
 			// for HTTP only
-			size_t GetNumIncomingTags () const { return m_Tags.size (); }
+			size_t GetNumIncomingTags () const { return m_Tags.GetNumTags (); }
+			int GetNumPendingElGamal () const { return m_NumPendingElGamal; };
+			uint64_t GetNumAsyncElGamal () const { return m_NumAsyncElGamal; };
+			uint64_t GetNumDroppedElGamal () const { return m_NumDroppedElGamal; };
+			uint64_t GetNumPreparedElGamalHits () const { return m_NumPreparedElGamalHits; };
+			uint64_t GetNumPreparedElGamalMisses () const { return m_NumPreparedElGamalMisses; };
+			uint64_t GetNumPreparedTagsHits () const { return m_NumPreparedTagsHits; };
+			uint64_t GetNumPreparedTagsMisses () const { return m_NumPreparedTagsMisses; };
 			const decltype(m_Sessions)& GetSessions () const { return m_Sessions; };
 	};
 
@@ -0,0 +1,185 @@
+#include "GarlicTags.h"
+
+namespace i2p
+{
+namespace garlic
+{
+	IncomingSessionTags::IncomingSessionTags ():
+		m_Table (INCOMING_TAGS_MIN_TABLE_SIZE), m_NumTags (0),
+		m_Wheel (INCOMING_TAGS_WHEEL_SIZE), m_NextSlot (0)
+	{
+	}
+
+	void IncomingSessionTags::AddTags (const uint8_t * tags, int num, std::shared_ptr<AESDecryption> decryption, uint32_t ts)
+	{
+		if (num <= 0 || !decryption) return;
+		if ((m_NumTags + num)*2 > m_Table.size ()) // keep load factor below 1/2
+		{
+			auto size = m_Table.size ();
+			while ((m_NumTags + num)*2 > size) size <<= 1;
+			Resize (size);
+		}
+		auto key = GetKey (decryption);
+		for (int i = 0; i < num; i++)
+		{
+			SessionTag tag (tags + i*32, ts);
+			m_Keys[key].numTags++; // before old key is released, might be the same
+			auto index = Find (tag);
+			if (index < m_Table.size ())
+			{
+				// same tag again, replace
+				ReleaseKey (m_Table[index].key);
+				m_Table[index].tag = tag;
+				m_Table[index].key = key;
+			}
+			else
+			{
+				Insert (tag, key);
+				m_NumTags++;
+			}
+			AddToWheel (tag, ts);
+		}
+	}
+
+	std::shared_ptr<AESDecryption> IncomingSessionTags::UseTag (const uint8_t * tag)
+	{
+		auto index = Find (tag);
+		if (index >= m_Table.size ()) return nullptr;
+		auto decryption = m_Keys[m_Table[index].key].decryption;
+		Erase (index);
+		return decryption;
+	}
+
+	size_t IncomingSessionTags::ExpireTags (uint32_t ts)
+	{
+		if (!m_NextSlot || ts < INCOMING_TAGS_EXPIRATION_TIMEOUT) return 0;
+		// every tag of slot s is expired if ts >= (s + 1)*granularity + timeout
+		uint64_t endSlot = (ts - INCOMING_TAGS_EXPIRATION_TIMEOUT)/INCOMING_TAGS_WHEEL_GRANULARITY;
+		if (endSlot > m_NextSlot + INCOMING_TAGS_WHEEL_SIZE)
+			m_NextSlot = endSlot - INCOMING_TAGS_WHEEL_SIZE; // clock jumped forward, visit every bucket once
+		size_t numExpired = 0;
+		std::vector<i2p::data::Tag<32> > bucket;
+		for (; m_NextSlot < endSlot; m_NextSlot++)
+		{
+			bucket.swap (m_Wheel[m_NextSlot % INCOMING_TAGS_WHEEL_SIZE]);
+			for (const auto& tag: bucket)
+			{
+				auto index = Find (tag);
+				if (index >= m_Table.size ()) continue; // used already
+				auto creationTime = m_Table[index].tag.creationTime;
+				if (ts > creationTime + INCOMING_TAGS_EXPIRATION_TIMEOUT)
+				{
+					Erase (index);
+					numExpired++;
+				}
+				else
+					AddToWheel (tag, creationTime); // added again later or clock went back
+			}
+			bucket.clear ();
+		}
+		// shrink if mostly empty
+		auto size = m_Table.size ();
+		while (size > INCOMING_TAGS_MIN_TABLE_SIZE && m_NumTags*8 < size) size >>= 1;
+		if (size < m_Table.size ()) Resize (size);
+		return numExpired;
+	}
+
+	void IncomingSessionTags::Clear ()
+	{
+		m_Table.clear ();
+		m_Table.resize (INCOMING_TAGS_MIN_TABLE_SIZE);
+		m_NumTags = 0;
+		m_Keys.clear ();
+		m_FreeKeys.clear ();
+		m_KeysIndex.clear ();
+		for (auto& it: m_Wheel) it.clear ();
+		m_NextSlot = 0;
+	}
+
+	size_t IncomingSessionTags::Find (const uint8_t * tag) const
+	{
+		auto mask = m_Table.size () - 1;
+		for (auto i = GetIndex (GetHash (tag)); m_Table[i].key != EMPTY; i = (i + 1) & mask)
+			if (!memcmp (m_Table[i].tag.data (), tag, 32)) return i;
+		return m_Table.size ();
+	}
+
+	void IncomingSessionTags::Insert (const SessionTag& tag, uint32_t key)
+	{
+		auto mask = m_Table.size () - 1;
+		auto i = GetIndex (GetHash (tag));
+		while (m_Table[i].key != EMPTY) i = (i + 1) & mask;
+		m_Table[i].tag = tag;
+		m_Table[i].key = key;
+	}
+
+	void IncomingSessionTags::Erase (size_t index)
+	{
+		ReleaseKey (m_Table[index].key);
+		// shift following entries back, no tombstones
+		auto mask = m_Table.size () - 1;
+		auto i = index, j = index;
+		for (;;)
+		{
+			j = (j + 1) & mask;
+			if (m_Table[j].key == EMPTY) break;
+			auto k = GetIndex (GetHash (m_Table[j].tag));
+			// entry j stays if its home k is cyclically in (i, j]
+			if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+			m_Table[i] = m_Table[j];
+			i = j;
+		}
+		m_Table[i].key = EMPTY;
+		m_NumTags--;
+	}
+
+	void IncomingSessionTags::Resize (size_t size)
+	{
+		std::vector<Entry> table (size);
+		table.swap (m_Table);
+		for (const auto& it: table)
+			if (it.key != EMPTY) Insert (it.tag, it.key);
+	}
+
+	uint32_t IncomingSessionTags::GetKey (std::shared_ptr<AESDecryption> decryption)
+	{
+		auto it = m_KeysIndex.find (decryption->GetKey ());
+		if (it != m_KeysIndex.end ()) return it->second; // share existing key schedule
+		uint32_t key;
+		if (!m_FreeKeys.empty ())
+		{
+			key = m_FreeKeys.back ();
+			m_FreeKeys.pop_back ();
+		}
+		else
+		{
+			key = m_Keys.size ();
+			m_Keys.emplace_back ();
+		}
+		m_Keys[key].decryption = decryption;
+		m_Keys[key].numTags = 0;
+		m_KeysIndex.emplace (decryption->GetKey (), key);
+		return key;
+	}
+
+	void IncomingSessionTags::ReleaseKey (uint32_t key)
+	{
+		auto& k = m_Keys[key];
+		if (k.numTags > 0) k.numTags--;
+		if (!k.numTags)
+		{
+			m_KeysIndex.erase (k.decryption->GetKey ());
+			k.decryption = nullptr;
+			m_FreeKeys.push_back (key);
+		}
+	}
+
+	void IncomingSessionTags::AddToWheel (const i2p::data::Tag<32>& tag, uint32_t ts)
+	{
+		uint64_t slot = ts/INCOMING_TAGS_WHEEL_GRANULARITY;
+		if (!m_NextSlot) m_NextSlot = slot;
+		if (slot < m_NextSlot) slot = m_NextSlot;
+		m_Wheel[slot % INCOMING_TAGS_WHEEL_SIZE].push_back (tag);
+	}
+}
+}
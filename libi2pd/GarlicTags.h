@@ -0,0 +1,136 @@
+#ifndef GARLIC_TAGS_H__
+#define GARLIC_TAGS_H__
+
+#include <inttypes.h>
+#include <string.h>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <openssl/rand.h>
+#include "Crypto.h"
+#include "Tag.h"
+
+namespace i2p
+{
+namespace garlic
+{
+	const int INCOMING_TAGS_EXPIRATION_TIMEOUT = 960; // 16 minutes
+	const int INCOMING_TAGS_WHEEL_GRANULARITY = 16; // in seconds
+	const size_t INCOMING_TAGS_WHEEL_SIZE = INCOMING_TAGS_EXPIRATION_TIMEOUT/INCOMING_TAGS_WHEEL_GRANULARITY + 2; // buckets
+	const size_t INCOMING_TAGS_MIN_TABLE_SIZE = 64; // power of 2
+
+	struct SessionTag: public i2p::data::Tag<32>
+	{
+		SessionTag (const uint8_t * buf, uint32_t ts = 0): Tag<32>(buf), creationTime (ts) {};
+		SessionTag () = default;
+		SessionTag (const SessionTag& ) = default;
+		SessionTag& operator= (const SessionTag& ) = default;
+#ifndef _WIN32
+		SessionTag (SessionTag&& ) = default;
+		SessionTag& operator= (SessionTag&& ) = default;
+#endif
+		uint32_t creationTime; // seconds since epoch
+	};
+
+	// AESDecryption is associated with session tags and store key
+	class AESDecryption: public i2p::crypto::CBCDecryption
+	{
+		public:
+
+			AESDecryption (const uint8_t * key): m_Key (key)
+			{
+				SetKey (key);
+			}
+			const i2p::crypto::AESKey& GetKey () const { return m_Key; };
+
+		private:
+
+			i2p::crypto::AESKey m_Key;
+	};
+
+	/** Incoming session tags of a destination.
+	 * Tags and keys are chosen by remote peers, so open addressing table with linear probing is indexed
+	 * by hash of whole tag keyed by random of this instance, and colliding tags can't be crafted.
+	 * Tags are expired by timing wheel of creation times, each bucket is INCOMING_TAGS_WHEEL_GRANULARITY seconds.
+	 * All tags of same session key share one AESDecryption. Not thread safe */
+	class IncomingSessionTags
+	{
+		public:
+
+			IncomingSessionTags ();
+
+			void AddTags (const uint8_t * tags, int num, std::shared_ptr<AESDecryption> decryption, uint32_t ts); // 32 bytes each
+			std::shared_ptr<AESDecryption> UseTag (const uint8_t * tag); // removes tag, nullptr if not found
+			size_t ExpireTags (uint32_t ts); // returns number of expired tags
+			void Clear ();
+
+			size_t GetNumTags () const { return m_NumTags; };
+			size_t GetNumKeys () const { return m_KeysIndex.size (); };
+			bool IsEmpty () const { return !m_NumTags; };
+
+			template<typename Visitor>
+			void VisitTags (Visitor v) const // v (const SessionTag&, const AESDecryption&)
+			{
+				for (const auto& it: m_Table)
+					if (it.key != EMPTY) v (it.tag, *m_Keys[it.key].decryption);
+			}
+
+		private:
+
+			static const uint32_t EMPTY = 0xFFFFFFFF;
+			struct Entry
+			{
+				SessionTag tag;
+				uint32_t key = EMPTY; // index in m_Keys
+			};
+
+			struct Key
+			{
+				std::shared_ptr<AESDecryption> decryption;
+				uint32_t numTags = 0;
+			};
+
+			struct KeyHash // of 32 bytes, keyed by random
+			{
+				uint32_t key[8];
+				KeyHash () { RAND_bytes ((uint8_t *)key, 32); };
+				uint64_t operator()(const uint8_t * buf) const
+				{
+					// NH, two different inputs collide with probability 2^-32 for random key
+					uint32_t w[8];
+					memcpy (w, buf, 32);
+					uint64_t h = 0;
+					for (int i = 0; i < 8; i += 2)
+						h += (uint64_t)(uint32_t)(w[i] + key[i])*(uint32_t)(w[i + 1] + key[i + 1]);
+					// mix, so low bits used for index depend on all
+					h ^= h >> 33; h *= 0xff51afd7ed558ccdULL; h ^= h >> 33;
+					return h;
+				}
+				size_t operator()(const i2p::crypto::AESKey& k) const { return (*this)(k.data ()); }
+			};
+
+			uint64_t GetHash (const uint8_t * tag) const { return m_TagHash (tag); };
+			size_t GetIndex (uint64_t hash) const { return hash & (m_Table.size () - 1); };
+			size_t Find (const uint8_t * tag) const; // index or m_Table.size () if not found
+			void Insert (const SessionTag& tag, uint32_t key);
+			void Erase (size_t index);
+			void Resize (size_t size);
+			uint32_t GetKey (std::shared_ptr<AESDecryption> decryption);
+			void ReleaseKey (uint32_t key);
+			void AddToWheel (const i2p::data::Tag<32>& tag, uint32_t ts);
+
+		private:
+
+			KeyHash m_TagHash;
+			std::vector<Entry> m_Table;
+			size_t m_NumTags;
+			std::vector<Key> m_Keys;
+			std::vector<uint32_t> m_FreeKeys;
+			std::unordered_map<i2p::crypto::AESKey, uint32_t, KeyHash> m_KeysIndex; // session key -> index in m_Keys
+			std::vector<std::vector<i2p::data::Tag<32> > > m_Wheel; // tags by creation time
+			uint64_t m_NextSlot; // creation time/granularity of next bucket to expire, 0 if not set yet
+	};
+}
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include "Tunnel.h"
 #include "Transports.h"
 #include "Garlic.h"
+#include "util.h"
 #include "I2NPProtocol.h"
 #include "version.h"
 
@@ -17,26 +18,69 @@ using namespace i2p::transport;
 
 namespace i2p
 {
+	typedef I2NPMessageBuffer<I2NP_MAX_MESSAGE_SIZE> I2NPMaxMessageBuffer;
+	typedef I2NPMessageBuffer<I2NP_LARGE_MESSAGE_SIZE> I2NPLargeMessageBuffer;
+	typedef I2NPMessageBuffer<I2NP_MEDIUM_MESSAGE_SIZE> I2NPMediumMessageBuffer;
+	typedef I2NPMessageBuffer<I2NP_MAX_SHORT_MESSAGE_SIZE> I2NPShortMessageBuffer;
+	typedef I2NPMessageBuffer<I2NP_SMALL_MESSAGE_SIZE> I2NPSmallMessageBuffer;
+	typedef I2NPMessageBuffer<i2p::tunnel::TUNNEL_DATA_MSG_SIZE + I2NP_HEADER_SIZE + 34> I2NPTunnelMessageBuffer; // reserved for alignment and NTCP 16 + 6 + 12
+
+	// never deleted, messages may be released after static destructors
+	static auto g_I2NPMaxMessagesPool = new i2p::util::MemoryPoolMtCached<I2NPMaxMessageBuffer>(64, 8); // 2M
+	static auto g_I2NPLargeMessagesPool = new i2p::util::MemoryPoolMtCached<I2NPLargeMessageBuffer>(64, 8); // 1M
+	static auto g_I2NPMediumMessagesPool = new i2p::util::MemoryPoolMtCached<I2NPMediumMessageBuffer>(128, 16); // 1M
+	static auto g_I2NPShortMessagesPool = new i2p::util::MemoryPoolMtCached<I2NPShortMessageBuffer>(512, 32); // 2M
+	static auto g_I2NPSmallMessagesPool = new i2p::util::MemoryPoolMtCached<I2NPSmallMessageBuffer>(1024, 64); // 1M
+	static auto g_I2NPTunnelMessagesPool = new i2p::util::MemoryPoolMtCached<I2NPTunnelMessageBuffer>(4096, 128); // 4M
+
+	template<class Pool>
+	static I2NPMessagePoolStats GetI2NPMessagePoolStats (const char * name, size_t bufferSize, const Pool * pool)
+	{
+		return { name, bufferSize, pool->GetNumAllocated (), pool->GetNumInUse (), pool->GetNumFree () };
+	}
+
+	std::vector<I2NPMessagePoolStats> GetI2NPMessagePoolsStats ()
+	{
+		return
+		{
+			GetI2NPMessagePoolStats ("tunnel", sizeof (I2NPTunnelMessageBuffer), g_I2NPTunnelMessagesPool),
+			GetI2NPMessagePoolStats ("1K", sizeof (I2NPSmallMessageBuffer), g_I2NPSmallMessagesPool),
+			GetI2NPMessagePoolStats ("4K", sizeof (I2NPShortMessageBuffer), g_I2NPShortMessagesPool),
+			GetI2NPMessagePoolStats ("8K", sizeof (I2NPMediumMessageBuffer), g_I2NPMediumMessagesPool),
+			GetI2NPMessagePoolStats ("16K", sizeof (I2NPLargeMessageBuffer), g_I2NPLargeMessagesPool),
+			GetI2NPMessagePoolStats ("32K", sizeof (I2NPMaxMessageBuffer), g_I2NPMaxMessagesPool)
+		};
+	}
+
 	std::shared_ptr<I2NPMessage> NewI2NPMessage ()
 	{
-		return std::make_shared<I2NPMessageBuffer<I2NP_MAX_MESSAGE_SIZE> >();
+		return g_I2NPMaxMessagesPool->AcquireShared ();
 	}
 
 	std::shared_ptr<I2NPMessage> NewI2NPShortMessage ()
 	{
-		return std::make_shared<I2NPMessageBuffer<I2NP_MAX_SHORT_MESSAGE_SIZE> >();
+		return g_I2NPShortMessagesPool->AcquireShared ();
 	}
 
 	std::shared_ptr<I2NPMessage> NewI2NPTunnelMessage ()
 	{
-		auto msg = new I2NPMessageBuffer<i2p::tunnel::TUNNEL_DATA_MSG_SIZE + I2NP_HEADER_SIZE + 34>(); // reserved for alignment and NTCP 16 + 6 + 12
+		auto msg = g_I2NPTunnelMessagesPool->AcquireShared ();
 		msg->Align (12);
-		return std::shared_ptr<I2NPMessage>(msg);
+		return msg;
 	}
 
 	std::shared_ptr<I2NPMessage> NewI2NPMessage (size_t len)
 	{
-		return (len < I2NP_MAX_SHORT_MESSAGE_SIZE/2) ? NewI2NPShortMessage () : NewI2NPMessage ();
+		len += I2NP_MESSAGE_SIZE_RESERVE;
+		if (len <= I2NP_SMALL_MESSAGE_SIZE)
+			return g_I2NPSmallMessagesPool->AcquireShared ();
+		if (len <= I2NP_MAX_SHORT_MESSAGE_SIZE)
+			return NewI2NPShortMessage ();
+		if (len <= I2NP_MEDIUM_MESSAGE_SIZE)
+			return g_I2NPMediumMessagesPool->AcquireShared ();
+		if (len <= I2NP_LARGE_MESSAGE_SIZE)
+			return g_I2NPLargeMessagesPool->AcquireShared ();
+		return NewI2NPMessage ();
 	}
 
 	void I2NPMessage::FillI2NPMessageHeader (I2NPMessageType msgType, uint32_t replyMsgID)
@@ -75,7 +119,7 @@ namespace i2p
 
 	std::shared_ptr<I2NPMessage> CreateI2NPMessage (const uint8_t * buf, size_t len, std::shared_ptr<i2p::tunnel::InboundTunnel> from)
 	{
-		auto msg = NewI2NPMessage ();
+		auto msg = NewI2NPMessage (len);
 		if (msg->offset + len < msg->maxLen)
 		{
 			memcpy (msg->GetBuffer (), buf, len);
@@ -318,56 +362,130 @@ namespace i2p
 		}
 	}
 
-	bool HandleBuildRequestRecords (int num, uint8_t * records, uint8_t * clearText)
+	static int FindBuildRequestRecord (int num, const uint8_t * records)
 	{
 		for (int i = 0; i < num; i++)
+			if (!memcmp (records + i*TUNNEL_BUILD_RECORD_SIZE + BUILD_REQUEST_RECORD_TO_PEER_OFFSET,
+				(const uint8_t *)i2p::context.GetRouterInfo ().GetIdentHash (), 16))
+				return i;
+		return -1;
+	}
+
+	static bool AcceptsTransitTunnel ()
+	{
+		// requests still in build worker might become transit tunnels too
+		size_t numTransitTunnels = i2p::tunnel::tunnels.GetTransitTunnels ().size () +
+			i2p::tunnel::tunnels.GetNumPendingBuildRequests ();
+		return i2p::context.AcceptsTunnels () &&
+			numTransitTunnels <= g_MaxNumTransitTunnels &&
+			!i2p::transport::transports.IsBandwidthExceeded () &&
+			!i2p::transport::transports.IsTransitBandwidthExceeded ();
+	}
+
+	static bool CreateBuildResponseRecord (int num, uint8_t * records, int index, bool accept, uint8_t * clearText)
+	{
+		// ElGamal decryption of our record and reply encryption of all records, thread safe
+		uint8_t * record = records + index*TUNNEL_BUILD_RECORD_SIZE;
+		BN_CTX * ctx = BN_CTX_new ();
+		bool decrypted = i2p::context.DecryptTunnelBuildRecord (record + BUILD_REQUEST_RECORD_ENCRYPTED_OFFSET, clearText, ctx);
+		BN_CTX_free (ctx);
+		if (!decrypted)
+		{
+			LogPrint (eLogWarning, "I2NP: Failed to decrypt tunnel build record");
+			return false;
+		}
+		// replace record to reply
+		record[BUILD_RESPONSE_RECORD_RET_OFFSET] = accept ? 0 : 30; // always reject with bandwidth reason (30)
+
+		//TODO: fill filler
+		SHA256 (record + BUILD_RESPONSE_RECORD_PADDING_OFFSET, BUILD_RESPONSE_RECORD_PADDING_SIZE + 1, // + 1 byte of ret
+			record + BUILD_RESPONSE_RECORD_HASH_OFFSET);
+		// encrypt reply
+		i2p::crypto::CBCEncryption encryption;
+		for (int j = 0; j < num; j++)
+		{
+			encryption.SetKey (clearText + BUILD_REQUEST_RECORD_REPLY_KEY_OFFSET);
+			encryption.SetIV (clearText + BUILD_REQUEST_RECORD_REPLY_IV_OFFSET);
+			uint8_t * reply = records + j*TUNNEL_BUILD_RECORD_SIZE;
+			encryption.Encrypt(reply, TUNNEL_BUILD_RECORD_SIZE, reply);
+		}
+		return true;
+	}
+
+	static void CreateTransitTunnel (const uint8_t * clearText)
+	{
+		auto transitTunnel = i2p::tunnel::CreateTransitTunnel (
+				bufbe32toh (clearText + BUILD_REQUEST_RECORD_RECEIVE_TUNNEL_OFFSET),
+				clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
+			    bufbe32toh (clearText + BUILD_REQUEST_RECORD_NEXT_TUNNEL_OFFSET),
+				clearText + BUILD_REQUEST_RECORD_LAYER_KEY_OFFSET,
+			    clearText + BUILD_REQUEST_RECORD_IV_KEY_OFFSET,
+				clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x80,
+			    clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET ] & 0x40);
+		i2p::tunnel::tunnels.AddTransitTunnel (transitTunnel);
+	}
+
+	static void ForwardTunnelBuildMsg (bool isVariable, const uint8_t * clearText, const uint8_t * buf, size_t len)
+	{
+		if (clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x40) // we are endpoint of outboud tunnel
+		{
+			// so we send it to reply tunnel
+			transports.SendMessage (clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
+				CreateTunnelGatewayMsg (bufbe32toh (clearText + BUILD_REQUEST_RECORD_NEXT_TUNNEL_OFFSET),
+					isVariable ? eI2NPVariableTunnelBuildReply : eI2NPTunnelBuildReply, buf, len,
+				    bufbe32toh (clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET)));
+		}
+		else
+			transports.SendMessage (clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
+				CreateI2NPMessage (isVariable ? eI2NPVariableTunnelBuild : eI2NPTunnelBuild, buf, len,
+					bufbe32toh (clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET)));
+	}
+
+	bool HandleBuildRequestRecords (int num, uint8_t * records, uint8_t * clearText)
+	{
+		int index = FindBuildRequestRecord (num, records);
+		if (index < 0) return false;
+		LogPrint (eLogDebug, "I2NP: Build request record ", index, " is ours");
+		bool accept = AcceptsTransitTunnel ();
+		if (!CreateBuildResponseRecord (num, records, index, accept, clearText)) return false;
+		if (accept) CreateTransitTunnel (clearText);
+		return true;
+	}
+
+	static void HandleBuildRequest (bool isVariable, int num, uint8_t * records, uint8_t * buf, size_t len,
+		std::shared_ptr<I2NPMessage> msg)
+	{
+		if (msg && i2p::tunnel::tunnels.HasBuildPool ())
 		{
-			uint8_t * record = records + i*TUNNEL_BUILD_RECORD_SIZE;
-			if (!memcmp (record + BUILD_REQUEST_RECORD_TO_PEER_OFFSET, (const uint8_t *)i2p::context.GetRouterInfo ().GetIdentHash (), 16))
+			// buf and records point to msg's buffer, decrypt by crypto worker
+			int index = FindBuildRequestRecord (num, records);
+			if (index < 0) return;
+			LogPrint (eLogDebug, "I2NP: Build request record ", index, " is ours");
+			bool accept = AcceptsTransitTunnel ();
+			auto work = [isVariable, num, records, index, accept, buf, len, msg]()
 			{
-				LogPrint (eLogDebug, "I2NP: Build request record ", i, " is ours");
-				BN_CTX * ctx = BN_CTX_new ();
-				i2p::context.DecryptTunnelBuildRecord (record + BUILD_REQUEST_RECORD_ENCRYPTED_OFFSET, clearText, ctx);
-				BN_CTX_free (ctx);
-				// replace record to reply
-				if (i2p::context.AcceptsTunnels () &&
-					i2p::tunnel::tunnels.GetTransitTunnels ().size () <= g_MaxNumTransitTunnels &&
-					!i2p::transport::transports.IsBandwidthExceeded () &&
-					!i2p::transport::transports.IsTransitBandwidthExceeded ())
-				{
-					auto transitTunnel = i2p::tunnel::CreateTransitTunnel (
-							bufbe32toh (clearText + BUILD_REQUEST_RECORD_RECEIVE_TUNNEL_OFFSET),
-							clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-						    bufbe32toh (clearText + BUILD_REQUEST_RECORD_NEXT_TUNNEL_OFFSET),
-							clearText + BUILD_REQUEST_RECORD_LAYER_KEY_OFFSET,
-						    clearText + BUILD_REQUEST_RECORD_IV_KEY_OFFSET,
-							clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x80,
-						    clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET ] & 0x40);
-					i2p::tunnel::tunnels.AddTransitTunnel (transitTunnel);
-					record[BUILD_RESPONSE_RECORD_RET_OFFSET] = 0;
-				}
-				else
-					record[BUILD_RESPONSE_RECORD_RET_OFFSET] = 30; // always reject with bandwidth reason (30)
-
-				//TODO: fill filler
-				SHA256 (record + BUILD_RESPONSE_RECORD_PADDING_OFFSET, BUILD_RESPONSE_RECORD_PADDING_SIZE + 1, // + 1 byte of ret
-					record + BUILD_RESPONSE_RECORD_HASH_OFFSET);
-				// encrypt reply
-				i2p::crypto::CBCEncryption encryption;
-				for (int j = 0; j < num; j++)
-				{
-					encryption.SetKey (clearText + BUILD_REQUEST_RECORD_REPLY_KEY_OFFSET);
-					encryption.SetIV (clearText + BUILD_REQUEST_RECORD_REPLY_IV_OFFSET);
-					uint8_t * reply = records + j*TUNNEL_BUILD_RECORD_SIZE;
-					encryption.Encrypt(reply, TUNNEL_BUILD_RECORD_SIZE, reply);
-				}
-				return true;
-			}
+				std::shared_ptr<uint8_t> clearText (new uint8_t[BUILD_REQUEST_RECORD_CLEAR_TEXT_SIZE], std::default_delete<uint8_t[]>());
+				bool decrypted = CreateBuildResponseRecord (num, records, index, accept, clearText.get ());
+				return i2p::tunnel::TunnelBuildPool::ResultFunc ([isVariable, accept, decrypted, clearText, buf, len, msg]()
+					{
+						// tunnels thread
+						if (!decrypted) return;
+						if (accept) CreateTransitTunnel (clearText.get ());
+						ForwardTunnelBuildMsg (isVariable, clearText.get (), buf, len);
+					});
+			};
+			if (!i2p::tunnel::tunnels.PostBuildRequest (work))
+				LogPrint (eLogWarning, "I2NP: Too many pending build requests, dropped");
+		}
+		else
+		{
+			uint8_t clearText[BUILD_REQUEST_RECORD_CLEAR_TEXT_SIZE];
+			if (HandleBuildRequestRecords (num, records, clearText))
+				ForwardTunnelBuildMsg (isVariable, clearText, buf, len);
 		}
-		return false;
 	}
 
-	void HandleVariableTunnelBuildMsg (uint32_t replyMsgID, uint8_t * buf, size_t len)
+	void HandleVariableTunnelBuildMsg (uint32_t replyMsgID, uint8_t * buf, size_t len, std::shared_ptr<I2NPMessage> msg)
 	{
 		int num = buf[0];
 		LogPrint (eLogDebug, "I2NP: VariableTunnelBuild ", num, " records");
@@ -395,49 +513,17 @@ namespace i2p
 			}
 		}
 		else
-		{
-			uint8_t clearText[BUILD_REQUEST_RECORD_CLEAR_TEXT_SIZE];
-			if (HandleBuildRequestRecords (num, buf + 1, clearText))
-			{
-				if (clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x40) // we are endpoint of outboud tunnel
-				{
-					// so we send it to reply tunnel
-					transports.SendMessage (clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-						CreateTunnelGatewayMsg (bufbe32toh (clearText + BUILD_REQUEST_RECORD_NEXT_TUNNEL_OFFSET),
-							eI2NPVariableTunnelBuildReply, buf, len,
-						    bufbe32toh (clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET)));
-				}
-				else
-					transports.SendMessage (clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-						CreateI2NPMessage (eI2NPVariableTunnelBuild, buf, len,
-							bufbe32toh (clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET)));
-			}
-		}
+			HandleBuildRequest (true, num, buf + 1, buf, len, msg);
 	}
 
-	void HandleTunnelBuildMsg (uint8_t * buf, size_t len)
+	void HandleTunnelBuildMsg (uint8_t * buf, size_t len, std::shared_ptr<I2NPMessage> msg)
 	{
 		if (len < NUM_TUNNEL_BUILD_RECORDS*BUILD_REQUEST_RECORD_CLEAR_TEXT_SIZE)
 		{
 			LogPrint (eLogError, "TunnelBuild message is too short ", len);
 			return;
 		}
-		uint8_t clearText[BUILD_REQUEST_RECORD_CLEAR_TEXT_SIZE];
-		if (HandleBuildRequestRecords (NUM_TUNNEL_BUILD_RECORDS, buf, clearText))
-		{
-			if (clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x40) // we are endpoint of outbound tunnel
-			{
-				// so we send it to reply tunnel
-				transports.SendMessage (clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-					CreateTunnelGatewayMsg (bufbe32toh (clearText + BUILD_REQUEST_RECORD_NEXT_TUNNEL_OFFSET),
-						eI2NPTunnelBuildReply, buf, len,
-					    bufbe32toh (clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET)));
-			}
-			else
-				transports.SendMessage (clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-					CreateI2NPMessage (eI2NPTunnelBuild, buf, len,
-						bufbe32toh (clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET)));
-		}
+		HandleBuildRequest (false, NUM_TUNNEL_BUILD_RECORDS, buf, buf, len, msg);
 	}
 
 	void HandleVariableTunnelBuildReplyMsg (uint32_t replyMsgID, uint8_t * buf, size_t len)
@@ -562,7 +648,7 @@ namespace i2p
 		return l;
 	}
 
-	void HandleI2NPMessage (uint8_t * msg, size_t len)
+	static void HandleI2NPMessage (uint8_t * msg, size_t len, std::shared_ptr<I2NPMessage> i2npMsg)
 	{
 		if (len < I2NP_HEADER_SIZE)
 		{
@@ -583,13 +669,13 @@ namespace i2p
 		switch (typeID)
 		{
 			case eI2NPVariableTunnelBuild:
-				HandleVariableTunnelBuildMsg  (msgID, buf, size);
+				HandleVariableTunnelBuildMsg  (msgID, buf, size, i2npMsg);
 			break;
 			case eI2NPVariableTunnelBuildReply:
 				HandleVariableTunnelBuildReplyMsg (msgID, buf, size);
 			break;
 			case eI2NPTunnelBuild:
-				HandleTunnelBuildMsg  (buf, size);
+				HandleTunnelBuildMsg  (buf, size, i2npMsg);
 			break;
 			case eI2NPTunnelBuildReply:
 				// TODO:
@@ -599,6 +685,16 @@ namespace i2p
 		}
 	}
 
+	void HandleI2NPMessage (uint8_t * msg, size_t len)
+	{
+		HandleI2NPMessage (msg, len, nullptr);
+	}
+
+	void HandleTunnelBuildI2NPMessage (std::shared_ptr<I2NPMessage> msg)
+	{
+		HandleI2NPMessage (msg->GetBuffer (), msg->GetLength (), msg);
+	}
+
 	void HandleI2NPMessage (std::shared_ptr<I2NPMessage> msg)
 	{
 		if (msg)
@@ -4,6 +4,7 @@
 #include <inttypes.h>
 #include <string.h>
 #include <set>
+#include <vector>
 #include <memory>
 #include "Crypto.h"
 #include "I2PEndian.h"
@@ -108,6 +109,11 @@ namespace tunnel
 
 	const size_t I2NP_MAX_MESSAGE_SIZE = 32768;
 	const size_t I2NP_MAX_SHORT_MESSAGE_SIZE = 4096;
+	// size classes for NewI2NPMessage (len)
+	const size_t I2NP_SMALL_MESSAGE_SIZE = 1024;
+	const size_t I2NP_MEDIUM_MESSAGE_SIZE = 8192;
+	const size_t I2NP_LARGE_MESSAGE_SIZE = 16384;
+	const size_t I2NP_MESSAGE_SIZE_RESERVE = 128; // for headers and transport padding added in place
 	const unsigned int I2NP_MESSAGE_EXPIRATION_TIMEOUT = 8000; // in milliseconds (as initial RTT)
 	const unsigned int I2NP_MESSAGE_CLOCK_SKEW = 60*1000; // 1 minute in milliseconds
 
@@ -228,10 +234,17 @@ namespace tunnel
 		uint8_t m_Buffer[sz + 32]; // 16 alignment + 16 padding
 	};
 
+	struct I2NPMessagePoolStats
+	{
+		const char * name;
+		size_t bufferSize, numAllocated, numInUse, numFree;
+	};
+	std::vector<I2NPMessagePoolStats> GetI2NPMessagePoolsStats ();
+
 	std::shared_ptr<I2NPMessage> NewI2NPMessage ();
 	std::shared_ptr<I2NPMessage> NewI2NPShortMessage ();
 	std::shared_ptr<I2NPMessage> NewI2NPTunnelMessage ();
-	std::shared_ptr<I2NPMessage> NewI2NPMessage (size_t len);
+	std::shared_ptr<I2NPMessage> NewI2NPMessage (size_t len); // smallest buffer for len bytes
 
 	std::shared_ptr<I2NPMessage> CreateI2NPMessage (I2NPMessageType msgType, const uint8_t * buf, size_t len, uint32_t replyMsgID = 0);
 	std::shared_ptr<I2NPMessage> CreateI2NPMessage (const uint8_t * buf, size_t len, std::shared_ptr<i2p::tunnel::InboundTunnel> from = nullptr);
@@ -251,9 +264,10 @@ namespace tunnel
 	bool IsRouterInfoMsg (std::shared_ptr<I2NPMessage> msg);
 
 	bool HandleBuildRequestRecords (int num, uint8_t * records, uint8_t * clearText);
-	void HandleVariableTunnelBuildMsg (uint32_t replyMsgID, uint8_t * buf, size_t len);
+	// if msg is set buf points to its payload and build request is decrypted asynchronously
+	void HandleVariableTunnelBuildMsg (uint32_t replyMsgID, uint8_t * buf, size_t len, std::shared_ptr<I2NPMessage> msg = nullptr);
 	void HandleVariableTunnelBuildReplyMsg (uint32_t replyMsgID, uint8_t * buf, size_t len);
-	void HandleTunnelBuildMsg (uint8_t * buf, size_t len);
+	void HandleTunnelBuildMsg (uint8_t * buf, size_t len, std::shared_ptr<I2NPMessage> msg = nullptr);
 
 	std::shared_ptr<I2NPMessage> CreateTunnelDataMsg (const uint8_t * buf);
 	std::shared_ptr<I2NPMessage> CreateTunnelDataMsg (uint32_t tunnelID, const uint8_t * payload);
@@ -267,6 +281,7 @@ namespace tunnel
 	size_t GetI2NPMessageLength (const uint8_t * msg, size_t len);
 	void HandleI2NPMessage (uint8_t * msg, size_t len);
 	void HandleI2NPMessage (std::shared_ptr<I2NPMessage> msg);
+	void HandleTunnelBuildI2NPMessage (std::shared_ptr<I2NPMessage> msg); // called from tunnels thread
 
 	class I2NPMessagesHandler
 	{
@@ -0,0 +1,83 @@
+#ifndef KADEMLIA_H__
+#define KADEMLIA_H__
+
+#include <inttypes.h>
+#include <iterator>
+#include "Tag.h"
+
+namespace i2p
+{
+namespace data
+{
+	/** Visits elements of a map sorted by Tag (std::map<IdentHash, ...>) in order of increasing
+	 * XOR distance between their keys and key, until visitor returns false.
+	 * Keys sharing a prefix form a contiguous range of the map, so it descends the implicit
+	 * binary trie, closer half first, finding range boundaries with lower_bound.
+	 * Returns false if stopped by visitor */
+	template<typename Map, typename Visitor>
+	class KademliaVisitor
+	{
+		typedef typename Map::key_type Key;
+		typedef typename Map::const_iterator Iterator;
+
+		public:
+
+			KademliaVisitor (const Map& m, const Key& key, Visitor& v):
+				m_Map (m), m_Key (key), m_Visitor (v) { m_Prefix.Fill (0); };
+
+			bool Visit () { return Visit (m_Map.begin (), m_Map.end (), 0); };
+
+		private:
+
+			bool Visit (Iterator first, Iterator last, size_t depth)
+			{
+				if (first == last) return true;
+				if (std::next (first) == last || depth >= sizeof (Key)*8)
+				{
+					for (auto it = first; it != last; ++it)
+						if (!m_Visitor (*it)) return false;
+					return true;
+				}
+				// all keys in range share depth bits with m_Prefix, bits of m_Prefix after depth are zero
+				uint8_t& byte = m_Prefix ()[depth >> 3];
+				uint8_t mask = 0x80 >> (depth & 0x07);
+				byte |= mask;
+				Iterator middle = m_Map.lower_bound (m_Prefix); // first key with bit set
+				bool ret;
+				if (m_Key ()[depth >> 3] & mask)
+				{
+					ret = Visit (middle, last, depth + 1);
+					byte &= ~mask;
+					if (ret) ret = Visit (first, middle, depth + 1);
+				}
+				else
+				{
+					byte &= ~mask;
+					ret = Visit (first, middle, depth + 1);
+					if (ret)
+					{
+						byte |= mask;
+						ret = Visit (middle, last, depth + 1);
+						byte &= ~mask;
+					}
+				}
+				return ret;
+			}
+
+		private:
+
+			const Map& m_Map;
+			const Key& m_Key;
+			Visitor& m_Visitor;
+			Key m_Prefix;
+	};
+
+	template<typename Map, typename Visitor>
+	bool VisitClosest (const Map& m, const typename Map::key_type& key, Visitor v)
+	{
+		return KademliaVisitor<Map, Visitor>(m, key, v).Visit ();
+	}
+}
+}
+
+#endif
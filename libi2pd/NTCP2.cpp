@@ -28,6 +28,51 @@ namespace i2p
 {
 namespace transport
 {
+	void NTCP2SendBuffer::SetKeys (const uint8_t * key, const uint8_t * sipKey, const uint8_t * iv)
+	{
+		m_Key = key;
+		m_SipKey = sipKey;
+		memcpy (m_IV.buf, iv, 8);
+	}
+
+	uint8_t * NTCP2SendBuffer::NewFrame (size_t len)
+	{
+		m_FrameOffset = m_Next.size ();
+		m_FrameLen = len;
+		m_Next.resize (m_FrameOffset + len + 18); // length + payload + MAC
+		return m_Next.data () + m_FrameOffset + 2;
+	}
+
+	void NTCP2SendBuffer::EncryptFrame ()
+	{
+		uint8_t * frame = m_Next.data () + m_FrameOffset;
+		uint8_t nonce[12];
+		memset (nonce, 0, 4);
+		htole64buf (nonce + 4, m_SequenceNumber); m_SequenceNumber++;
+		i2p::crypto::AEADChaCha20Poly1305 (frame + 2, m_FrameLen, nullptr, 0, m_Key, nonce, frame + 2, m_FrameLen + 16, true);
+		i2p::crypto::Siphash<8> (m_IV.buf, m_IV.buf, 8, m_SipKey);
+		// length must be in BigEndian
+		htobe16buf (frame, (m_FrameLen + 16) ^ le16toh (m_IV.key));
+	}
+
+	bool NTCP2SendBuffer::StartSending ()
+	{
+		if (m_IsSending || m_Next.empty ()) return false;
+		m_Sending.swap (m_Next); // m_Next keeps capacity of former m_Sending
+		m_IsSending = true;
+		return true;
+	}
+
+	void NTCP2SendBuffer::SendingComplete ()
+	{
+		// don't keep peak size once load drops, buffers of busy sessions are reused
+		if (m_Sending.capacity () > NTCP2_SEND_BUFFER_KEEP_SIZE && m_Sending.size () <= NTCP2_SEND_BUFFER_KEEP_SIZE)
+			std::vector<uint8_t> ().swap (m_Sending);
+		else
+			m_Sending.clear ();
+		m_IsSending = false;
+	}
+
 	NTCP2Establisher::NTCP2Establisher ():
 		m_SessionRequestBuffer (nullptr), m_SessionCreatedBuffer (nullptr), m_SessionConfirmedBuffer (nullptr) 
 	{ 
@@ -391,10 +436,9 @@ namespace transport
 
 	NTCP2Session::NTCP2Session (NTCP2Server& server, std::shared_ptr<const i2p::data::RouterInfo> in_RemoteRouter):
 		TransportSession (in_RemoteRouter, NTCP2_ESTABLISH_TIMEOUT), 
-		m_Server (server), m_Socket (m_Server.GetService ()), 
+		m_Server (server), m_Service (server.GetSessionService ()), m_Socket (m_Service), 
 		m_IsEstablished (false), m_IsTerminated (false),
-		m_NextReceivedLen (0), m_NextReceivedBuffer (nullptr), m_NextSendBuffer (nullptr),
-		m_ReceiveSequenceNumber (0), m_SendSequenceNumber (0), m_IsSending (false)
+		m_NextReceivedLen (0), m_NextReceivedBuffer (nullptr), m_ReceiveSequenceNumber (0)
 	{
 		m_Establisher.reset (new NTCP2Establisher);
 		if (in_RemoteRouter) // Alice
@@ -414,7 +458,6 @@ namespace transport
 	NTCP2Session::~NTCP2Session ()
 	{
 		delete[] m_NextReceivedBuffer;
-		delete[] m_NextSendBuffer;
 	}
 
 	void NTCP2Session::Terminate ()
@@ -438,7 +481,7 @@ namespace transport
 
 	void NTCP2Session::Done ()
 	{
-		m_Server.GetService ().post (std::bind (&NTCP2Session::Terminate, shared_from_this ()));
+		m_Service.post (std::bind (&NTCP2Session::Terminate, shared_from_this ()));
 	}
 
 	void NTCP2Session::Established ()
@@ -622,12 +665,10 @@ namespace transport
 		LogPrint (eLogDebug, "NTCP2: SessionConfirmed sent");
 		KeyDerivationFunctionDataPhase ();
 		// Alice data phase keys
-		m_SendKey = m_Kab;
 		m_ReceiveKey = m_Kba; 
-		m_SendSipKey = m_Sipkeysab; 
 		m_ReceiveSipKey = m_Sipkeysba;
 		memcpy (m_ReceiveIV.buf, m_Sipkeysba + 16, 8);
-		memcpy (m_SendIV.buf, m_Sipkeysab + 16, 8);
+		m_SendBuffer.SetKeys (m_Kab, m_Sipkeysab, m_Sipkeysab + 16);
 		Established ();
 		ReceiveLength ();
 
@@ -675,12 +716,10 @@ namespace transport
 				{
 					KeyDerivationFunctionDataPhase ();
 					// Bob data phase keys
-					m_SendKey = m_Kba;
 					m_ReceiveKey = m_Kab; 
-					m_SendSipKey = m_Sipkeysba; 
 					m_ReceiveSipKey = m_Sipkeysab;
 					memcpy (m_ReceiveIV.buf, m_Sipkeysab + 16, 8);
-					memcpy (m_SendIV.buf, m_Sipkeysba + 16, 8);
+					m_SendBuffer.SetKeys (m_Kba, m_Sipkeysba, m_Sipkeysba + 16);
 					// payload
 					// process RI
 					if (buf[0] != eNTCP2BlkRouterInfo)
@@ -880,32 +919,22 @@ namespace transport
 		m_Handler.Flush ();
 	}
 
-	void NTCP2Session::SendNextFrame (const uint8_t * payload, size_t len)
+	void NTCP2Session::SendFrames ()
 	{
-		if (IsTerminated ()) return;	
-		uint8_t nonce[12];
-		CreateNonce (m_SendSequenceNumber, nonce); m_SendSequenceNumber++;
-		m_NextSendBuffer = new uint8_t[len + 16 + 2];
-		i2p::crypto::AEADChaCha20Poly1305 (payload, len, nullptr, 0, m_SendKey, nonce, m_NextSendBuffer + 2, len + 16, true);
-		i2p::crypto::Siphash<8> (m_SendIV.buf, m_SendIV.buf, 8, m_SendSipKey);
-		// length must be in BigEndian
-		htobe16buf (m_NextSendBuffer, (len + 16) ^ le16toh (m_SendIV.key));
-		LogPrint (eLogDebug, "NTCP2: sent length ", len + 16);
-
-		// send message
-		m_IsSending = true;	
-		boost::asio::async_write (m_Socket, boost::asio::buffer (m_NextSendBuffer, len + 16 + 2), boost::asio::transfer_all (),
-			std::bind(&NTCP2Session::HandleNextFrameSent, shared_from_this (), std::placeholders::_1, std::placeholders::_2));
+		if (IsTerminated () || !m_SendBuffer.StartSending ()) return;
+		auto& buf = m_SendBuffer.GetSending ();
+		LogPrint (eLogDebug, "NTCP2: sending ", buf.size (), " bytes");
+		boost::asio::async_write (m_Socket, boost::asio::buffer (buf.data (), buf.size ()), boost::asio::transfer_all (),
+			std::bind(&NTCP2Session::HandleFramesSent, shared_from_this (), std::placeholders::_1, std::placeholders::_2));
 	}
 
-	void NTCP2Session::HandleNextFrameSent (const boost::system::error_code& ecode, std::size_t bytes_transferred)
+	void NTCP2Session::HandleFramesSent (const boost::system::error_code& ecode, std::size_t bytes_transferred)
 	{
-		m_IsSending = false;
-		delete[] m_NextSendBuffer; m_NextSendBuffer = nullptr;
-		
+		m_SendBuffer.SendingComplete ();
 		if (ecode)
 		{
 			LogPrint (eLogWarning, "NTCP2: Couldn't send frame ", ecode.message ());
+			if (m_SendBuffer.IsClosing ()) Terminate ();
 		}	
 		else
 		{	
@@ -913,57 +942,71 @@ namespace transport
 			m_NumSentBytes += bytes_transferred;
 			i2p::transport::transports.UpdateSentBytes (bytes_transferred);
 			LogPrint (eLogDebug, "NTCP2: Next frame sent");
-			SendQueue ();
+			if (m_SendBuffer.IsClosing ())
+			{
+				SendFrames (); // termination built during this write
+				if (!m_SendBuffer.IsSending ()) Terminate ();
+			}
+			else
+				SendQueue ();
 		}	
 	}
 
 	void NTCP2Session::SendQueue ()
 	{
-		if (!m_SendQueue.empty ())
+		// everything queued during previous write, in as many frames as needed
+		while (!m_SendQueue.empty () && !m_SendBuffer.IsFull ())
 		{
-			auto buf = m_Server.NewNTCP2FrameBuffer ();
-			uint8_t * payload = buf->data ();
+			// I2NP blocks fitting into frame
 			size_t s = 0;
-			// add I2NP blocks
-			while (!m_SendQueue.empty ())
+			auto end = m_SendQueue.begin ();
+			for (; end != m_SendQueue.end (); ++end)
 			{
-				auto msg = m_SendQueue.front ();
-				size_t len = msg->GetNTCP2Length (); 
-				if (s + len + 3 <= NTCP2_UNENCRYPTED_FRAME_MAX_SIZE) // 3 bytes block header
-				{
-					payload[s] = eNTCP2BlkI2NPMessage; // blk
-					htobe16buf (payload + s + 1, len); // size
-					s += 3;
-					msg->ToNTCP2 ();
-					memcpy (payload + s, msg->GetNTCP2Header (), len);
-					s += len;
-					m_SendQueue.pop_front ();
-				}
-				else
-					break;
+				size_t len = (*end)->GetNTCP2Length () + 3; // 3 bytes block header
+				if (s + len > NTCP2_UNENCRYPTED_FRAME_MAX_SIZE) break;
+				s += len;
+			}
+			if (end == m_SendQueue.begin ())
+			{
+				LogPrint (eLogError, "NTCP2: I2NP message of ", (*end)->GetNTCP2Length (), " bytes doesn't fit into frame");
+				m_SendQueue.pop_front ();
+				continue;
 			}
-			// add padding block 
 			int paddingSize = (s*NTCP2_MAX_PADDING_RATIO)/100;
 			if (s + paddingSize + 3 > NTCP2_UNENCRYPTED_FRAME_MAX_SIZE) paddingSize = NTCP2_UNENCRYPTED_FRAME_MAX_SIZE - s -3;
 			if (paddingSize) paddingSize = rand () % paddingSize;
+			// build payload in place
+			uint8_t * payload = m_SendBuffer.NewFrame (s + paddingSize + 3);
+			s = 0;
+			for (auto it = m_SendQueue.begin (); it != end; ++it)
+			{
+				auto& msg = *it;
+				size_t len = msg->GetNTCP2Length ();
+				payload[s] = eNTCP2BlkI2NPMessage; // blk
+				htobe16buf (payload + s + 1, len); // size
+				s += 3;
+				msg->ToNTCP2 ();
+				memcpy (payload + s, msg->GetNTCP2Header (), len);
+				s += len;
+			}
+			m_SendQueue.erase (m_SendQueue.begin (), end);
+			// add padding block 
 			payload[s] = eNTCP2BlkPadding; // blk
 			htobe16buf (payload + s + 1, paddingSize); // size
 			s += 3;
 			memset (payload + s, 0, paddingSize);			
-			s += paddingSize;
-			// send
-			SendNextFrame (payload, s);
-			m_Server.DeleteNTCP2FrameBuffer (buf);
-		} 
+			m_SendBuffer.EncryptFrame ();
+		}
+		SendFrames ();
 	}
 
 	void NTCP2Session::SendRouterInfo ()
 	{
-		if (!IsEstablished ()) return;
+		if (!IsEstablished () || m_SendBuffer.IsClosing ()) return;
 		auto riLen = i2p::context.GetRouterInfo ().GetBufferLen ();
 		int paddingSize = (riLen*NTCP2_MAX_PADDING_RATIO)/100;
 		size_t payloadLen = riLen + paddingSize + 7; // 7 = 2*3 bytes header + 1 byte RI flag 
-		uint8_t * payload = new uint8_t[payloadLen];
+		uint8_t * payload = m_SendBuffer.NewFrame (payloadLen);
 		payload[0] = eNTCP2BlkRouterInfo;
 		htobe16buf (payload + 1, riLen + 1); // size
 		payload[3] = 0; // flag
@@ -971,49 +1014,63 @@ namespace transport
 		payload[riLen + 4] = eNTCP2BlkPadding;
 		htobe16buf (payload + riLen + 5, paddingSize);
 		RAND_bytes (payload + riLen + 7, paddingSize);
-		SendNextFrame (payload, payloadLen);
-		delete[] payload;
+		m_SendBuffer.EncryptFrame ();
+		SendFrames ();
 	}
 
 	void NTCP2Session::SendTermination (NTCP2TerminationReason reason)
 	{
 		if (!IsEstablished ()) return;
-		uint8_t payload[12] = { eNTCP2BlkTermination, 0, 9 };
+		uint8_t * payload = m_SendBuffer.NewFrame (12);
+		payload[0] = eNTCP2BlkTermination;
+		htobe16buf (payload + 1, 9); // size
 		htobe64buf (payload + 3, m_ReceiveSequenceNumber);
 		payload[11] = (uint8_t)reason;
-		SendNextFrame (payload, 12);
+		m_SendBuffer.EncryptFrame ();
+		SendFrames ();
 	}
 
 	void NTCP2Session::SendTerminationAndTerminate (NTCP2TerminationReason reason)
 	{
+		if (m_SendBuffer.IsClosing ())
+		{
+			// termination is sent already, but write doesn't complete
+			Terminate ();
+			return;
+		}
 		SendTermination (reason);
-		m_Server.GetService ().post (std::bind (&NTCP2Session::Terminate, shared_from_this ())); // let termination message go
+		m_SendBuffer.CloseAfterSending ();
+		if (!m_SendBuffer.IsSending ()) // not established
+			m_Service.post (std::bind (&NTCP2Session::Terminate, shared_from_this ()));
+		// otherwise terminated once termination message is written
 	}
 
 	void NTCP2Session::SendI2NPMessages (const std::vector<std::shared_ptr<I2NPMessage> >& msgs)
 	{
-		m_Server.GetService ().post (std::bind (&NTCP2Session::PostI2NPMessages, shared_from_this (), msgs));
+		m_Service.post (std::bind (&NTCP2Session::PostI2NPMessages, shared_from_this (), msgs));
 	}
 
 	void NTCP2Session::PostI2NPMessages (std::vector<std::shared_ptr<I2NPMessage> > msgs)
 	{
-		if (m_IsTerminated) return;
+		if (m_IsTerminated || m_SendBuffer.IsClosing ()) return;
 		for (auto it: msgs)
 			m_SendQueue.push_back (it);
-		if (!m_IsSending) 
+		if (!m_SendBuffer.IsSending ()) 
 			SendQueue ();		
 	}
 
 	void NTCP2Session::SendLocalRouterInfo ()
 	{
 		if (!IsOutgoing ()) // we send it in SessionConfirmed
-			m_Server.GetService ().post (std::bind (&NTCP2Session::SendRouterInfo, shared_from_this ()));
+			m_Service.post (std::bind (&NTCP2Session::SendRouterInfo, shared_from_this ()));
 	}
 
-	NTCP2Server::NTCP2Server ():
+	NTCP2Server::NTCP2Server (int numThreads):
 		m_IsRunning (false), m_Thread (nullptr), m_Work (m_Service),
 		m_TerminationTimer (m_Service)
 	{
+		if (numThreads > 1)
+			m_SessionServices.reset (new i2p::util::IOServicesPool ("NTCP2", numThreads));
 	}
 
 	NTCP2Server::~NTCP2Server ()
@@ -1027,6 +1084,11 @@ namespace transport
 		{
 			m_IsRunning = true;
 			m_Thread = new std::thread (std::bind (&NTCP2Server::Run, this));
+			if (m_SessionServices)
+			{
+				m_SessionServices->Start ();
+				LogPrint (eLogInfo, "NTCP2: Running sessions in ", m_SessionServices->GetSize (), " threads");
+			}
 			auto& addresses = context.GetRouterInfo ().GetAddresses ();
 			for (const auto& address: addresses)
 			{
@@ -1075,15 +1137,20 @@ namespace transport
 
 	void NTCP2Server::Stop ()
 	{
+		// no session handlers from now
+		if (m_SessionServices) m_SessionServices->Stop ();
 		{
 			// we have to copy it because Terminate changes m_NTCP2Sessions
-			auto ntcpSessions = m_NTCP2Sessions;
+			auto ntcpSessions = GetNTCP2Sessions ();
 			for (auto& it: ntcpSessions)
 				it.second->Terminate ();
 			for (auto& it: m_PendingIncomingSessions)
 				it->Terminate ();
 		}
-		m_NTCP2Sessions.clear ();
+		{
+			std::unique_lock<std::mutex> l(m_NTCP2SessionsMutex);
+			m_NTCP2Sessions.clear ();
+		}
 
 		if (m_IsRunning)
 		{
@@ -1118,25 +1185,39 @@ namespace transport
 	{
 		if (!session || !session->GetRemoteIdentity ()) return false;
 		auto& ident = session->GetRemoteIdentity ()->GetIdentHash ();
-		auto it = m_NTCP2Sessions.find (ident);
-		if (it != m_NTCP2Sessions.end ())
+		bool inserted;
+		{
+			std::unique_lock<std::mutex> l(m_NTCP2SessionsMutex);
+			inserted = m_NTCP2Sessions.insert (std::make_pair (ident, session)).second;
+		}
+		if (!inserted)
 		{
 			LogPrint (eLogWarning, "NTCP2: session to ", ident.ToBase64 (), " already exists");
 			session->Terminate();
 			return false;
 		}
-		m_NTCP2Sessions.insert (std::make_pair (ident, session));
 		return true;
 	}
 
 	void NTCP2Server::RemoveNTCP2Session (std::shared_ptr<NTCP2Session> session)
 	{
 		if (session && session->GetRemoteIdentity ())
-			m_NTCP2Sessions.erase (session->GetRemoteIdentity ()->GetIdentHash ());
+		{
+			std::unique_lock<std::mutex> l(m_NTCP2SessionsMutex);
+			auto it = m_NTCP2Sessions.find (session->GetRemoteIdentity ()->GetIdentHash ());
+			if (it != m_NTCP2Sessions.end () && it->second == session) // not a duplicate rejected by AddNTCP2Session
+				m_NTCP2Sessions.erase (it);
+		}
+	}
+
+	boost::asio::io_service& NTCP2Server::GetSessionService ()
+	{
+		return m_SessionServices ? m_SessionServices->GetNextService () : m_Service;
 	}
 
 	std::shared_ptr<NTCP2Session> NTCP2Server::FindNTCP2Session (const i2p::data::IdentHash& ident)
 	{
+		std::unique_lock<std::mutex> l(m_NTCP2SessionsMutex);
 		auto it = m_NTCP2Sessions.find (ident);
 		if (it != m_NTCP2Sessions.end ())
 			return it->second;
@@ -1146,11 +1227,11 @@ namespace transport
 	void NTCP2Server::Connect(const boost::asio::ip::address & address, uint16_t port, std::shared_ptr<NTCP2Session> conn)
 	{
 		LogPrint (eLogDebug, "NTCP2: Connecting to ", address ,":",  port);
-		m_Service.post([this, address, port, conn]() 
+		conn->GetService ().post([this, address, port, conn]() 
 			{
 				if (this->AddNTCP2Session (conn))
 				{
-					auto timer = std::make_shared<boost::asio::deadline_timer>(m_Service);
+					auto timer = std::make_shared<boost::asio::deadline_timer>(conn->GetService ());
 					auto timeout = NTCP2_CONNECT_TIMEOUT * 5;
 					conn->SetTerminationTimeout(timeout * 2);
 					timer->expires_from_now (boost::posix_time::seconds(timeout));
@@ -1194,7 +1275,7 @@ namespace transport
 				LogPrint (eLogDebug, "NTCP2: Connected from ", ep);
 				if (conn)
 				{
-					conn->ServerLogin ();
+					conn->GetService ().post (std::bind (&NTCP2Session::ServerLogin, conn));
 					m_PendingIncomingSessions.push_back (conn);
 				}
 			}
@@ -1221,7 +1302,7 @@ namespace transport
 				LogPrint (eLogDebug, "NTCP2: Connected from ", ep);
 				if (conn)
 				{
-					conn->ServerLogin ();
+					conn->GetService ().post (std::bind (&NTCP2Session::ServerLogin, conn));
 					m_PendingIncomingSessions.push_back (conn);
 				}
 			}
@@ -1250,13 +1331,18 @@ namespace transport
 		{
 			auto ts = i2p::util::GetSecondsSinceEpoch ();
 			// established
-			for (auto& it: m_NTCP2Sessions)
-				if (it.second->IsTerminationTimeoutExpired (ts))
-				{
-					auto session = it.second;
-					LogPrint (eLogDebug, "NTCP2: No activity for ", session->GetTerminationTimeout (), " seconds");
-					session->TerminateByTimeout (); // it doesn't change m_NTCP2Session right a way
-				}
+			std::vector<std::shared_ptr<NTCP2Session> > expired;
+			{
+				std::unique_lock<std::mutex> l(m_NTCP2SessionsMutex);
+				for (auto& it: m_NTCP2Sessions)
+					if (it.second->IsTerminationTimeoutExpired (ts))
+						expired.push_back (it.second);
+			}
+			for (auto& session: expired)
+			{
+				LogPrint (eLogDebug, "NTCP2: No activity for ", session->GetTerminationTimeout (), " seconds");
+				session->GetService ().post (std::bind (&NTCP2Session::TerminateByTimeout, session));
+			}
 			// pending
 			for (auto it = m_PendingIncomingSessions.begin (); it != m_PendingIncomingSessions.end ();)
 			{
@@ -1264,7 +1350,7 @@ namespace transport
 					it = m_PendingIncomingSessions.erase (it); // established or terminated
 				else if ((*it)->IsTerminationTimeoutExpired (ts))
 				{
-					(*it)->Terminate ();
+					(*it)->GetService ().post (std::bind (&NTCP2Session::Terminate, *it));
 					it = m_PendingIncomingSessions.erase (it); // expired
 				}
 				else
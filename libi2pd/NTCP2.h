@@ -16,6 +16,7 @@
 #include <thread>
 #include <list>
 #include <map>
+#include <mutex>
 #include <array>
 #include <openssl/bn.h>
 #include <boost/asio.hpp>
@@ -29,6 +30,8 @@ namespace transport
 {
 
 	const size_t NTCP2_UNENCRYPTED_FRAME_MAX_SIZE = 65519;	
+	const size_t NTCP2_SEND_BUFFER_MAX_SIZE = 0x20000; // frames sent by one write
+	const size_t NTCP2_SEND_BUFFER_KEEP_SIZE = 4096; // larger buffers are released after smaller write
 	const int NTCP2_MAX_PADDING_RATIO = 6; // in %
 
 	const int NTCP2_CONNECT_TIMEOUT = 5; // 5 seconds
@@ -71,7 +74,42 @@ namespace transport
 	};		
 	
 
-	typedef std::array<uint8_t, NTCP2_UNENCRYPTED_FRAME_MAX_SIZE> NTCP2FrameBuffer;
+	/** data phase frames, encrypted in place. Two buffers are reused,
+	 * frames created while one is being written go out with next write.
+	 * Buffer grown by a burst is released after a write of normal size */
+	class NTCP2SendBuffer
+	{
+		public:
+
+			NTCP2SendBuffer (): m_Key (nullptr), m_SipKey (nullptr), m_SequenceNumber (0),
+				m_FrameOffset (0), m_FrameLen (0), m_IsSending (false), m_IsClosing (false) {};
+			void SetKeys (const uint8_t * key, const uint8_t * sipKey, const uint8_t * iv); // iv is 8 bytes
+
+			uint8_t * NewFrame (size_t len); // payload of len, valid until next NewFrame
+			void EncryptFrame (); // last frame, in place
+			bool IsFull () const { return m_Next.size () >= NTCP2_SEND_BUFFER_MAX_SIZE; };
+
+			bool IsSending () const { return m_IsSending; };
+			bool StartSending (); // false if nothing to send or previous write is not complete
+			const std::vector<uint8_t>& GetSending () const { return m_Sending; };
+			void SendingComplete ();
+			void CloseAfterSending () { m_IsClosing = true; }; // no new frames but those already built
+			bool IsClosing () const { return m_IsClosing; };
+
+		private:
+
+			const uint8_t * m_Key, * m_SipKey;
+			union
+			{
+				uint8_t buf[8];
+				uint16_t key;
+			} m_IV;
+			uint64_t m_SequenceNumber;
+			size_t m_FrameOffset, m_FrameLen; // of last frame in m_Next
+			bool m_IsSending, m_IsClosing;
+			std::vector<uint8_t> m_Sending, m_Next;
+	};
+
 	struct NTCP2Establisher
 	{
 		NTCP2Establisher ();
@@ -131,6 +169,7 @@ namespace transport
 			void Done ();
 
 			boost::asio::ip::tcp::socket& GetSocket () { return m_Socket; };
+			boost::asio::io_service& GetService () { return m_Service; }; // all session's handlers run here
 
 			bool IsEstablished () const { return m_IsEstablished; };
 			bool IsTerminated () const { return m_IsTerminated; };
@@ -169,8 +208,8 @@ namespace transport
 			void HandleReceived (const boost::system::error_code& ecode, std::size_t bytes_transferred);
 			void ProcessNextFrame (const uint8_t * frame, size_t len);
 
-			void SendNextFrame (const uint8_t * payload, size_t len); 
-			void HandleNextFrameSent (const boost::system::error_code& ecode, std::size_t bytes_transferred);
+			void SendFrames ();
+			void HandleFramesSent (const boost::system::error_code& ecode, std::size_t bytes_transferred);
 			void SendQueue ();
 			void SendRouterInfo ();
 			void SendTermination (NTCP2TerminationReason reason);
@@ -180,25 +219,26 @@ namespace transport
 		private:
 
 			NTCP2Server& m_Server;
+			boost::asio::io_service& m_Service;
 			boost::asio::ip::tcp::socket m_Socket;
 			bool m_IsEstablished, m_IsTerminated;
 
 			std::unique_ptr<NTCP2Establisher> m_Establisher;
 			// data phase
 			uint8_t m_Kab[33], m_Kba[32], m_Sipkeysab[33], m_Sipkeysba[32]; 
-			const uint8_t * m_SendKey, * m_ReceiveKey, * m_SendSipKey, * m_ReceiveSipKey;
+			const uint8_t * m_ReceiveKey, * m_ReceiveSipKey;
 			uint16_t m_NextReceivedLen; 
-			uint8_t * m_NextReceivedBuffer, * m_NextSendBuffer;
+			uint8_t * m_NextReceivedBuffer;
 			union
 			{
 				uint8_t buf[8];
 				uint16_t key;
-			} m_ReceiveIV, m_SendIV;
-			uint64_t m_ReceiveSequenceNumber, m_SendSequenceNumber;
+			} m_ReceiveIV;
+			uint64_t m_ReceiveSequenceNumber;
 
 			i2p::I2NPMessagesHandler m_Handler;
 
-			bool m_IsSending;
+			NTCP2SendBuffer m_SendBuffer;
 			std::list<std::shared_ptr<I2NPMessage> > m_SendQueue;
 	};
 
@@ -206,7 +246,7 @@ namespace transport
 	{
 		public:
 
-			NTCP2Server ();
+			NTCP2Server (int numThreads = 1);
 			~NTCP2Server ();
 
 			void Start ();
@@ -217,12 +257,10 @@ namespace transport
 			std::shared_ptr<NTCP2Session> FindNTCP2Session (const i2p::data::IdentHash& ident);
 
 			boost::asio::io_service& GetService () { return m_Service; };
+			boost::asio::io_service& GetSessionService (); // for new session
 		
 			void Connect(const boost::asio::ip::address & address, uint16_t port, std::shared_ptr<NTCP2Session> conn);
 
-			NTCP2FrameBuffer * NewNTCP2FrameBuffer () { return m_NTCP2FrameBuffersPool.Acquire(); }
-			void DeleteNTCP2FrameBuffer (NTCP2FrameBuffer * buf) { return m_NTCP2FrameBuffersPool.Release(buf); }
-
 		private:
 
 			void Run ();
@@ -243,15 +281,19 @@ namespace transport
 			boost::asio::io_service::work m_Work;
 			boost::asio::deadline_timer m_TerminationTimer;
 			std::unique_ptr<boost::asio::ip::tcp::acceptor> m_NTCP2Acceptor, m_NTCP2V6Acceptor;
+			std::unique_ptr<i2p::util::IOServicesPool> m_SessionServices; // if more than one thread
+			mutable std::mutex m_NTCP2SessionsMutex;
 			std::map<i2p::data::IdentHash, std::shared_ptr<NTCP2Session> > m_NTCP2Sessions; 
-			std::list<std::shared_ptr<NTCP2Session> > m_PendingIncomingSessions;
-
-			i2p::util::MemoryPool<NTCP2FrameBuffer> m_NTCP2FrameBuffersPool;
+			std::list<std::shared_ptr<NTCP2Session> > m_PendingIncomingSessions; // access from m_Thread only
 
 		public:
 
 			// for HTTP/I2PControl
-			const decltype(m_NTCP2Sessions)& GetNTCP2Sessions () const { return m_NTCP2Sessions; };
+			decltype(m_NTCP2Sessions) GetNTCP2Sessions () const
+			{
+				std::unique_lock<std::mutex> l(m_NTCP2SessionsMutex);
+				return m_NTCP2Sessions;
+			};
 	};
 }
 }
@@ -32,7 +32,7 @@ namespace transport
 	
 	NTCPSession::NTCPSession (NTCPServer& server, std::shared_ptr<const i2p::data::RouterInfo> in_RemoteRouter):
 		TransportSession (in_RemoteRouter, NTCP_ESTABLISH_TIMEOUT),
-		m_Server (server), m_Socket (m_Server.GetService ()),
+		m_Server (server), m_Service (server.GetSessionService ()), m_Socket (m_Service),
 		m_IsEstablished (false), m_IsTerminated (false),
 		m_ReceiveBufferOffset (0), m_NextMessage (nullptr), m_IsSending (false)
 	{
@@ -79,7 +79,7 @@ namespace transport
 
 	void NTCPSession::Done ()
 	{
-		m_Server.GetService ().post (std::bind (&NTCPSession::Terminate, shared_from_this ()));
+		m_Service.post (std::bind (&NTCPSession::Terminate, shared_from_this ()));
 	}
 
 	void NTCPSession::Terminate ()
@@ -111,11 +111,6 @@ namespace transport
 		transports.PeerConnected (shared_from_this ());
 	}
 
-	boost::asio::io_service & NTCPSession::GetService()
-	{
-		return m_Server.GetService();
-	}
-
 	void NTCPSession::ClientLogin ()
 	{
 		if (!m_DHKeysPair)
@@ -751,7 +746,7 @@ namespace transport
 
 	void NTCPSession::SendI2NPMessages (const std::vector<std::shared_ptr<I2NPMessage> >& msgs)
 	{
-		m_Server.GetService ().post (std::bind (&NTCPSession::PostI2NPMessages, shared_from_this (), msgs));
+		m_Service.post (std::bind (&NTCPSession::PostI2NPMessages, shared_from_this (), msgs));
 	}
 
 	void NTCPSession::PostI2NPMessages (std::vector<std::shared_ptr<I2NPMessage> > msgs)
@@ -775,7 +770,7 @@ namespace transport
 	}
 
 //-----------------------------------------
-	NTCPServer::NTCPServer (int workers):
+	NTCPServer::NTCPServer (int workers, int numThreads):
 		m_IsRunning (false), m_Thread (nullptr), m_Work (m_Service),
 		m_TerminationTimer (m_Service), m_NTCPAcceptor (nullptr), m_NTCPV6Acceptor (nullptr),
 		m_ProxyType(eNoProxy), m_Resolver(m_Service), m_ProxyEndpoint(nullptr),
@@ -783,6 +778,8 @@ namespace transport
 	{
 		if(workers <= 0) workers = 1;
 		m_CryptoPool = std::make_shared<Pool>(workers);
+		if (numThreads > 1)
+			m_SessionServices.reset (new i2p::util::IOServicesPool ("NTCP", numThreads));
 	}
 
 	NTCPServer::~NTCPServer ()
@@ -796,6 +793,11 @@ namespace transport
 		{
 			m_IsRunning = true;
 			m_Thread = new std::thread (std::bind (&NTCPServer::Run, this));
+			if (m_SessionServices)
+			{
+				m_SessionServices->Start ();
+				LogPrint (eLogInfo, "NTCP: Running sessions in ", m_SessionServices->GetSize (), " threads");
+			}
 			// we are using a proxy, don't create any acceptors
 			if(UsingProxy())
 			{
@@ -863,15 +865,20 @@ namespace transport
 
 	void NTCPServer::Stop ()
 	{
+		// no session handlers from now
+		if (m_SessionServices) m_SessionServices->Stop ();
 		{
 			// we have to copy it because Terminate changes m_NTCPSessions
-			auto ntcpSessions = m_NTCPSessions;
+			auto ntcpSessions = GetNTCPSessions ();
 			for (auto& it: ntcpSessions)
 				it.second->Terminate ();
 			for (auto& it: m_PendingIncomingSessions)
 				it->Terminate ();
 		}
-		m_NTCPSessions.clear ();
+		{
+			std::unique_lock<std::mutex> l(m_NTCPSessionsMutex);
+			m_NTCPSessions.clear ();
+		}
 
 		if (m_IsRunning)
 		{
@@ -922,25 +929,39 @@ namespace transport
 	{
 		if (!session || !session->GetRemoteIdentity ()) return false;
 		auto& ident = session->GetRemoteIdentity ()->GetIdentHash ();
-		auto it = m_NTCPSessions.find (ident);
-		if (it != m_NTCPSessions.end ())
+		bool inserted;
+		{
+			std::unique_lock<std::mutex> l(m_NTCPSessionsMutex);
+			inserted = m_NTCPSessions.insert (std::pair<i2p::data::IdentHash, std::shared_ptr<NTCPSession> >(ident, session)).second;
+		}
+		if (!inserted)
 		{
 			LogPrint (eLogWarning, "NTCP: session to ", ident.ToBase64 (), " already exists");
 			session->Terminate();
 			return false;
 		}
-		m_NTCPSessions.insert (std::pair<i2p::data::IdentHash, std::shared_ptr<NTCPSession> >(ident, session));
 		return true;
 	}
 
 	void NTCPServer::RemoveNTCPSession (std::shared_ptr<NTCPSession> session)
 	{
 		if (session && session->GetRemoteIdentity ())
-			m_NTCPSessions.erase (session->GetRemoteIdentity ()->GetIdentHash ());
+		{
+			std::unique_lock<std::mutex> l(m_NTCPSessionsMutex);
+			auto it = m_NTCPSessions.find (session->GetRemoteIdentity ()->GetIdentHash ());
+			if (it != m_NTCPSessions.end () && it->second == session) // not a duplicate rejected by AddNTCPSession
+				m_NTCPSessions.erase (it);
+		}
+	}
+
+	boost::asio::io_service& NTCPServer::GetSessionService ()
+	{
+		return m_SessionServices ? m_SessionServices->GetNextService () : m_Service;
 	}
 
 	std::shared_ptr<NTCPSession> NTCPServer::FindNTCPSession (const i2p::data::IdentHash& ident)
 	{
+		std::unique_lock<std::mutex> l(m_NTCPSessionsMutex);
 		auto it = m_NTCPSessions.find (ident);
 		if (it != m_NTCPSessions.end ())
 			return it->second;
@@ -965,7 +986,7 @@ namespace transport
 				LogPrint (eLogDebug, "NTCP: Connected from ", ep);
 				if (conn)
 				{
-					conn->ServerLogin ();
+					conn->GetService ().post (std::bind (&NTCPSession::ServerLogin, conn));
 					m_PendingIncomingSessions.push_back (conn);
 				}
 			}
@@ -1001,7 +1022,7 @@ namespace transport
 				LogPrint (eLogDebug, "NTCP: Connected from ", ep);
 				if (conn)
 				{
-					conn->ServerLogin ();
+					conn->GetService ().post (std::bind (&NTCPSession::ServerLogin, conn));
 					m_PendingIncomingSessions.push_back (conn);
 				}
 			}
@@ -1020,11 +1041,11 @@ namespace transport
 	void NTCPServer::Connect(const boost::asio::ip::address & address, uint16_t port, std::shared_ptr<NTCPSession> conn)
 	{
 		LogPrint (eLogDebug, "NTCP: Connecting to ", address ,":",  port);
-		m_Service.post([=]() {
+		conn->GetService ().post([=]() {
 			if (this->AddNTCPSession (conn))
 			{
 
-				auto timer = std::make_shared<boost::asio::deadline_timer>(m_Service);
+				auto timer = std::make_shared<boost::asio::deadline_timer>(conn->GetService ());
 				timer->expires_from_now (boost::posix_time::seconds(NTCP_CONNECT_TIMEOUT));
 				timer->async_wait ([conn](const boost::system::error_code& ecode) {
 					if (ecode != boost::asio::error::operation_aborted)
@@ -1044,11 +1065,11 @@ namespace transport
 		{
 			return;
 		}
-		m_Service.post([=]() {
+		conn->GetService ().post([=]() {
 			if (this->AddNTCPSession (conn))
 			{
 
-				auto timer = std::make_shared<boost::asio::deadline_timer>(m_Service);
+				auto timer = std::make_shared<boost::asio::deadline_timer>(conn->GetService ());
 				auto timeout = NTCP_CONNECT_TIMEOUT * 5;
 				conn->SetTerminationTimeout(timeout * 2);
 				timer->expires_from_now (boost::posix_time::seconds(timeout));
@@ -1282,16 +1303,21 @@ namespace transport
 		{
 			auto ts = i2p::util::GetSecondsSinceEpoch ();
 			// established
-			for (auto& it: m_NTCPSessions)
-				if (it.second->IsTerminationTimeoutExpired (ts))
-				{
-					auto session = it.second;
-					// Termniate modifies m_NTCPSession, so we postpone it
-					m_Service.post ([session] {
-							LogPrint (eLogDebug, "NTCP: No activity for ", session->GetTerminationTimeout (), " seconds");
-							session->Terminate ();
-					});
-				}
+			std::vector<std::shared_ptr<NTCPSession> > expired;
+			{
+				std::unique_lock<std::mutex> l(m_NTCPSessionsMutex);
+				for (auto& it: m_NTCPSessions)
+					if (it.second->IsTerminationTimeoutExpired (ts))
+						expired.push_back (it.second);
+			}
+			for (auto& session: expired)
+			{
+				// Termniate modifies m_NTCPSession, so we postpone it
+				session->GetService ().post ([session] {
+						LogPrint (eLogDebug, "NTCP: No activity for ", session->GetTerminationTimeout (), " seconds");
+						session->Terminate ();
+				});
+			}
 			// pending
 			for (auto it = m_PendingIncomingSessions.begin (); it != m_PendingIncomingSessions.end ();)
 			{
@@ -1299,7 +1325,7 @@ namespace transport
 					it = m_PendingIncomingSessions.erase (it); // established or terminated
 				else if ((*it)->IsTerminationTimeoutExpired (ts))
 				{
-					(*it)->Terminate ();
+					(*it)->GetService ().post (std::bind (&NTCPSession::Terminate, *it));
 					it = m_PendingIncomingSessions.erase (it); // expired
 				}
 				else
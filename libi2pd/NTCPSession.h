@@ -7,6 +7,7 @@
 #include <thread>
 #include <mutex>
 #include <boost/asio.hpp>
+#include "util.h"
 #include "Crypto.h"
 #include "Identity.h"
 #include "RouterInfo.h"
@@ -58,7 +59,7 @@ namespace transport
 			void Done ();
 
 			boost::asio::ip::tcp::socket& GetSocket () { return m_Socket; };
-			boost::asio::io_service & GetService();
+			boost::asio::io_service & GetService() { return m_Service; }; // all session's handlers run here
 			bool IsEstablished () const { return m_IsEstablished; };
 			bool IsTerminated () const { return m_IsTerminated; };
 
@@ -106,6 +107,7 @@ namespace transport
 		private:
 
 			NTCPServer& m_Server;
+			boost::asio::io_service& m_Service;
 			boost::asio::ip::tcp::socket m_Socket;
 			bool m_IsEstablished, m_IsTerminated;
 
@@ -152,7 +154,7 @@ namespace transport
 			};
 
 
-			NTCPServer (int workers=4);
+			NTCPServer (int workers=4, int numThreads = 1);
 			~NTCPServer ();
 
 			void Start ();
@@ -172,6 +174,7 @@ namespace transport
 			void UseProxy(ProxyType proxy, const std::string & address, uint16_t port);
 
 			boost::asio::io_service& GetService () { return m_Service; };
+			boost::asio::io_service& GetSessionService (); // for new session
 
 			void SetSessionLimits(uint16_t softLimit, uint16_t hardLimit) { m_SoftLimit = softLimit; m_HardLimit = hardLimit; }
 			bool ShouldLimit() const { return ShouldHardLimit() || ShouldSoftLimit(); }
@@ -182,14 +185,19 @@ namespace transport
 		private:
 
 			/** @brief return true for hard limit */
-			bool ShouldHardLimit() const { return m_HardLimit && m_NTCPSessions.size() >= m_HardLimit; }
+			bool ShouldHardLimit() const { return m_HardLimit && GetNumNTCPSessions () >= m_HardLimit; }
 
 			/** @brief return true for probabalistic soft backoff */
 			bool ShouldSoftLimit() const
 			{
-				auto sessions = m_NTCPSessions.size();
+				auto sessions = GetNumNTCPSessions ();
 				return sessions && m_SoftLimit && m_SoftLimit < sessions && ( rand() % sessions ) <= m_SoftLimit;
 			}
+			size_t GetNumNTCPSessions () const
+			{
+				std::unique_lock<std::mutex> l(m_NTCPSessionsMutex);
+				return m_NTCPSessions.size ();
+			}
 			void Run ();
 			void HandleAccept (std::shared_ptr<NTCPSession> conn, const boost::system::error_code& error);
 			void HandleAcceptV6 (std::shared_ptr<NTCPSession> conn, const boost::system::error_code& error);
@@ -211,8 +219,10 @@ namespace transport
 			boost::asio::io_service::work m_Work;
 			boost::asio::deadline_timer m_TerminationTimer;
 			boost::asio::ip::tcp::acceptor * m_NTCPAcceptor, * m_NTCPV6Acceptor;
-			std::map<i2p::data::IdentHash, std::shared_ptr<NTCPSession> > m_NTCPSessions; // access from m_Thread only
-			std::list<std::shared_ptr<NTCPSession> > m_PendingIncomingSessions;
+			std::unique_ptr<i2p::util::IOServicesPool> m_SessionServices; // if more than one thread
+			mutable std::mutex m_NTCPSessionsMutex;
+			std::map<i2p::data::IdentHash, std::shared_ptr<NTCPSession> > m_NTCPSessions;
+			std::list<std::shared_ptr<NTCPSession> > m_PendingIncomingSessions; // access from m_Thread only
 
 			ProxyType m_ProxyType;
 			std::string m_ProxyAddress;
@@ -226,7 +236,11 @@ namespace transport
 		public:
 
 			// for HTTP/I2PControl
-			const decltype(m_NTCPSessions)& GetNTCPSessions () const { return m_NTCPSessions; };
+			decltype(m_NTCPSessions) GetNTCPSessions () const
+			{
+				std::unique_lock<std::mutex> l(m_NTCPSessionsMutex);
+				return m_NTCPSessions;
+			};
 	};
 }
 }
@@ -3,6 +3,10 @@
 #include <vector>
 #include <boost/asio.hpp>
 #include <stdexcept>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 
 #include "I2PEndian.h"
 #include "Base.h"
@@ -14,6 +18,7 @@
 #include "Transports.h"
 #include "RouterContext.h"
 #include "Garlic.h"
+#include "Kademlia.h"
 #include "NetDb.hpp"
 #include "Config.h"
 
@@ -25,8 +30,19 @@ namespace data
 {
 	NetDb netdb;
 
-	NetDb::NetDb (): m_IsRunning (false), m_Thread (nullptr), m_Reseeder (nullptr), m_Storage("netDb", "r", "routerInfo-", "dat"), m_FloodfillBootstrap(nullptr), m_HiddenMode(false)
+	NetDb::NetDb (): m_IsRouterInfosChanged (false), m_IsFloodfillsChanged (false),
+		m_Snapshot (std::make_shared<RouterInfosSnapshot> ()), m_NumSnapshotChanges (0),
+		m_LastSnapshotTime (0), m_NumSnapshots (0),
+		m_IsRunning (false), m_Thread (nullptr), m_Reseeder (nullptr), m_Storage("netDb", "r", "routerInfo-", "dat"), m_FloodfillBootstrap(nullptr), m_HiddenMode(false), m_IsCompact (false)
 	{
+		for (auto& it: m_IsRandomRoutersChanged) it = false;
+	}
+
+	NetDb::RouterInfosSnapshot::RouterInfosSnapshot ():
+		routers (std::make_shared<RouterInfos> ()), floodfills (std::make_shared<RouterInfos> ())
+	{
+		for (auto& it: randomRouters)
+			it = std::make_shared<RandomRouters> ();
 	}
 
 	NetDb::~NetDb ()
@@ -41,6 +57,22 @@ namespace data
 		m_Storage.Init(i2p::data::GetBase64SubstitutionTable(), 64);
 		InitProfilesStorage ();
 		m_Families.LoadCertificates ();
+		i2p::config::GetOption("netdb.compact", m_IsCompact);
+		std::string storage; i2p::config::GetOption("netdb.storage", storage);
+		std::string storePath = i2p::fs::DataDirPath ("netDb.log");
+		if (storage == "log")
+		{
+			m_Store.reset (new RouterInfoStore (storePath));
+			if (m_Store->Open ())
+				MigrateToStore ();
+			else
+			{
+				LogPrint (eLogError, "NetDb: can't open ", storePath, ", using ", m_Storage.GetRoot ());
+				m_Store.reset (nullptr);
+			}
+		}
+		else if (i2p::fs::Exists (storePath))
+			MigrateFromStore (storePath);
 		Load ();
 
                 uint16_t threshold; i2p::config::GetOption("reseed.threshold", threshold);
@@ -55,21 +87,28 @@ namespace data
 	{
 		if (m_IsRunning)
 		{
-			for (auto& it: m_RouterInfos)
-				it.second->SaveProfile ();
-			DeleteObsoleteProfiles ();
-			m_RouterInfos.clear ();
-			m_Floodfills.clear ();
+			m_IsRunning = false;
 			if (m_Thread)
 			{
-				m_IsRunning = false;
 				m_Queue.WakeUp ();
 				m_Thread->join ();
 				delete m_Thread;
 				m_Thread = 0;
 			}
+			// NetDb thread doesn't save profiles anymore
+			DeleteObsoleteProfiles ();
+			SaveProfiles ();
+			ClearRouterInfos ();
+			m_Floodfills.clear ();
+			m_IsFloodfillsChanged = true;
+			PublishSnapshot ();
 			m_LeaseSets.clear();
 			m_Requests.Stop ();
+			if (m_Store)
+			{
+				m_Store->Close ();
+				m_Store.reset (nullptr);
+			}
 		}
 	}
 
@@ -80,7 +119,7 @@ namespace data
 		{
 			try
 			{
-				auto msg = m_Queue.GetNextWithTimeout (15000); // 15 sec
+				auto msg = m_Queue.GetNextWithTimeout (m_NumSnapshotChanges > 0 ? NETDB_SNAPSHOT_INTERVAL : 15000); // 15 sec
 				if (msg)
 				{
 					int numMsgs = 0;
@@ -108,6 +147,8 @@ namespace data
 					}
 				}
 				if (!m_IsRunning) break;
+				if (IsSnapshotDue (i2p::util::GetMillisecondsSinceEpoch ()))
+					PublishSnapshot (); // routers added or removed by previous batches
 
 				uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
 				if (ts - lastManageRequest >= 15) // manage requests every 15 seconds
@@ -121,6 +162,8 @@ namespace data
 					{
 						SaveUpdated ();
 						ManageLeaseSets ();
+						DeleteObsoleteProfiles ();
+						SaveProfiles (); // if updated
 					}
 					lastSave = ts;
 				}
@@ -184,9 +227,31 @@ namespace data
 		{
 			if (r->IsNewer (buf, len))
 			{
+				auto caps = r->GetCaps ();
+				bool wasFloodfill = r->IsFloodfill () && r->IsReachable ();
 				r->Update (buf, len);
+				if (m_IsCompact) r->ClearProperties ();
+				// snapshot shares r, so it's outdated only if indexes or floodfills, both by caps, change
+				if (r->GetCaps () != caps)
+				{
+					{
+						std::unique_lock<i2p::util::MeasuredMutex> l(m_RouterInfosMutex);
+						UnindexRouter (ident);
+						IndexRouter (r);
+					}
+					bool isFloodfill = r->IsFloodfill () && r->IsReachable (); // floodfill must be reachable
+					if (isFloodfill != wasFloodfill)
+					{
+						std::unique_lock<i2p::util::MeasuredMutex> l(m_FloodfillsMutex);
+						if (isFloodfill)
+							m_Floodfills.emplace (ident, r);
+						else
+							m_Floodfills.erase (ident);
+						m_IsFloodfillsChanged = true;
+					}
+					m_NumSnapshotChanges++;
+				}
 				LogPrint (eLogInfo, "NetDb: RouterInfo updated: ", ident.ToBase64());
-				// TODO: check if floodfill has been changed
 			}
 			else
 			{
@@ -199,19 +264,28 @@ namespace data
 			r = std::make_shared<RouterInfo> (buf, len);
 			if (!r->IsUnreachable ())
 			{
+				if (m_IsCompact) r->ClearProperties (); // buffer is kept until saved
+
 				bool inserted = false;
 				{
-					std::unique_lock<std::mutex> l(m_RouterInfosMutex);
+					std::unique_lock<i2p::util::MeasuredMutex> l(m_RouterInfosMutex);
 					inserted = m_RouterInfos.insert ({r->GetIdentHash (), r}).second;
+					if (inserted)
+					{
+						IndexRouter (r);
+						m_IsRouterInfosChanged = true;
+					}
 				}
 				if (inserted)
 				{
 					LogPrint (eLogInfo, "NetDb: RouterInfo added: ", ident.ToBase64());
 					if (r->IsFloodfill () && r->IsReachable ()) // floodfill must be reachable
 					{
-						std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-						m_Floodfills.push_back (r);
+						std::unique_lock<i2p::util::MeasuredMutex> l(m_FloodfillsMutex);
+						m_Floodfills.emplace (r->GetIdentHash (), r);
+						m_IsFloodfillsChanged = true;
 					}
+					m_NumSnapshotChanges++;
 				}
 				else
 				{
@@ -230,7 +304,7 @@ namespace data
 	bool NetDb::AddLeaseSet (const IdentHash& ident, const uint8_t * buf, int len,
 		std::shared_ptr<i2p::tunnel::InboundTunnel> from)
 	{
-		std::unique_lock<std::mutex> lock(m_LeaseSetsMutex);
+		std::unique_lock<i2p::util::MeasuredMutex> lock(m_LeaseSetsMutex);
 		bool updated = false;
 		if (!from) // unsolicited LS must be received directly
 		{
@@ -270,7 +344,12 @@ namespace data
 
 	std::shared_ptr<RouterInfo> NetDb::FindRouter (const IdentHash& ident) const
 	{
-		std::unique_lock<std::mutex> l(m_RouterInfosMutex);
+		auto snapshot = GetSnapshot ();
+		auto found = snapshot->routers->find (ident);
+		if (found != snapshot->routers->end ())
+			return found->second;
+		// might be added after snapshot
+		std::unique_lock<i2p::util::MeasuredMutex> l(m_RouterInfosMutex);
 		auto it = m_RouterInfos.find (ident);
 		if (it != m_RouterInfos.end ())
 			return it->second;
@@ -280,7 +359,7 @@ namespace data
 
 	std::shared_ptr<LeaseSet> NetDb::FindLeaseSet (const IdentHash& destination) const
 	{
-		std::unique_lock<std::mutex> lock(m_LeaseSetsMutex);
+		std::unique_lock<i2p::util::MeasuredMutex> lock(m_LeaseSetsMutex);
 		auto it = m_LeaseSets.find (destination);
 		if (it != m_LeaseSets.end ())
 			return it->second;
@@ -360,107 +439,298 @@ namespace data
 		i2p::transport::transports.SendMessages(ih, requests);
 	}
 
-	bool NetDb::LoadRouterInfo (const std::string & path)
+	void NetDb::LoadRouterInfos (std::function<std::shared_ptr<RouterInfo> (size_t)> create, size_t from, size_t to,
+		std::vector<std::shared_ptr<RouterInfo> >& loaded)
 	{
-		auto r = std::make_shared<RouterInfo>(path);
-		if (r->GetRouterIdentity () && !r->IsUnreachable () &&
-				(!r->UsesIntroducer () || m_LastLoad < r->GetTimestamp () + NETDB_INTRODUCEE_EXPIRATION_TIMEOUT*1000LL)) // 1 hour
+		std::vector<std::shared_ptr<RouterInfo> > routers;
+		for (size_t i = from; i < to; i++)
+			routers.push_back (create (i));
+		RouterInfo::VerifySignatures (routers);
+		for (size_t i = 0; i < routers.size (); i++)
 		{
-			r->DeleteBuffer ();
-			r->ClearProperties (); // properties are not used for regular routers
-			m_RouterInfos[r->GetIdentHash ()] = r;
-			if (r->IsFloodfill () && r->IsReachable ()) // floodfill must be reachable
-				m_Floodfills.push_back (r);
+			auto& r = routers[i];
+			if (r->GetRouterIdentity () && !r->IsUnreachable () &&
+				(!r->UsesIntroducer () || m_LastLoad < r->GetTimestamp () + NETDB_INTRODUCEE_EXPIRATION_TIMEOUT*1000LL)) // 1 hour
+			{
+				r->DeleteBuffer ();
+				r->ClearProperties (); // properties are not used for regular routers
+				loaded.push_back (r);
+			}
+			else
+			{
+				LogPrint(eLogWarning, "NetDb: RI ", r->GetRouterIdentity () ? r->GetIdentHashBase64 () : "", " is invalid. Delete");
+				if (m_Store)
+				{
+					if (r->GetRouterIdentity ()) m_Store->Remove (r->GetIdentHash ());
+				}
+				else
+					i2p::fs::Remove (r->GetFullPath ());
+			}
 		}
+	}
+
+	void NetDb::DeleteStoredRouterInfo (const IdentHash& ident)
+	{
+		if (m_Store)
+			m_Store->Remove (ident);
 		else
+			m_Storage.Remove (ident.ToBase64 ());
+	}
+
+	void NetDb::MigrateToStore ()
+	{
+		std::vector<std::string> files;
+		m_Storage.Traverse (files);
+		if (files.empty ()) return; // already migrated
+		LogPrint (eLogInfo, "NetDb: moving ", files.size (), " RouterInfo files to ", m_Store->GetPath ());
+		std::vector<std::string> moved;
+		std::vector<char> buf;
+		std::vector<uint8_t> stored;
+		for (const auto& path: files)
+		{
+			std::ifstream f (path, std::ifstream::binary);
+			buf.assign (std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+			if (buf.size () > 40 && buf.size () <= MAX_RI_BUFFER_SIZE)
+			{
+				IdentityEx identity ((const uint8_t *)buf.data (), buf.size ());
+				if (m_Store->Get (identity.GetIdentHash (), stored))
+					moved.push_back (path); // left by previous migration, store is updated since
+				else if (m_Store->Put (identity.GetIdentHash (), (const uint8_t *)buf.data (), buf.size ()))
+					moved.push_back (path);
+				// otherwise file stays and is moved next time
+			}
+			else
+			{
+				LogPrint (eLogWarning, "NetDb: invalid RouterInfo file ", path, " of ", buf.size (), " bytes, deleted");
+				i2p::fs::Remove (path);
+			}
+		}
+		m_Store->Flush ();
+		// remove files only once they are in the store
+		for (const auto& path: moved)
+			i2p::fs::Remove (path);
+		LogPrint (eLogInfo, "NetDb: ", moved.size (), " RouterInfos moved to ", m_Store->GetPath ());
+	}
+
+	void NetDb::MigrateFromStore (const std::string& path)
+	{
+		RouterInfoStore store (path);
+		if (!store.Open ()) return;
+		std::vector<RouterInfoStore::Record> records;
+		store.GetRecords (records);
+		LogPrint (eLogInfo, "NetDb: moving ", records.size (), " RouterInfos from ", path, " to ", m_Storage.GetRoot ());
+		bool written = true;
+		for (const auto& it: records)
 		{
-			LogPrint(eLogWarning, "NetDb: RI from ", path, " is invalid. Delete");
-			i2p::fs::Remove(path);
+			auto filename = m_Storage.Path (it.ident.ToBase64 ());
+			if (i2p::fs::Exists (filename)) continue; // newer file
+			std::ofstream f (filename, std::ofstream::binary);
+			f.write ((const char *)it.buf, it.len);
+			if (!f.good ()) written = false;
+		}
+		store.Close ();
+		if (written)
+		{
+			i2p::fs::Remove (path);
+			i2p::fs::Remove (path + ".idx");
 		}
-		return true;
 	}
 
 	void NetDb::VisitLeaseSets(LeaseSetVisitor v)
 	{
-		std::unique_lock<std::mutex> lock(m_LeaseSetsMutex);
+		std::unique_lock<i2p::util::MeasuredMutex> lock(m_LeaseSetsMutex);
 		for ( auto & entry : m_LeaseSets)
 			v(entry.first, entry.second);
 	}
 
 	void NetDb::VisitStoredRouterInfos(RouterInfoVisitor v)
 	{
+		if (m_Store)
+		{
+			std::vector<RouterInfoStore::Record> records;
+			m_Store->GetRecords (records);
+			for (const auto& it: records)
+				v(std::make_shared<i2p::data::RouterInfo>(it.buf, it.len, false));
+			return;
+		}
 		m_Storage.Iterate([v] (const std::string & filename) {
         auto ri = std::make_shared<i2p::data::RouterInfo>(filename);
 				v(ri);
 		});
 	}
 
-	void NetDb::VisitRouterInfos(RouterInfoVisitor v)
+	size_t NetDb::GetRouterInfosMemoryUsage () const
 	{
-		std::unique_lock<std::mutex> lock(m_RouterInfosMutex);
-		for ( const auto & item : m_RouterInfos )
-			v(item.second);
+		size_t usage = 0;
+		for (const auto& it: *GetSnapshot ()->routers)
+			usage += it.second->GetMemoryUsage ();
+		return usage;
 	}
 
-	size_t NetDb::VisitRandomRouterInfos(RouterInfoFilter filter, RouterInfoVisitor v, size_t n)
+	void NetDb::PublishSnapshot ()
 	{
-		std::vector<std::shared_ptr<const RouterInfo> > found;
-		const size_t max_iters_per_cyle = 3;
-		size_t iters = max_iters_per_cyle;
-		while(n > 0)
+		std::unique_lock<i2p::util::MeasuredMutex> l(m_RouterInfosMutex); // also keeps order of publishing
+		auto snapshot = std::make_shared<RouterInfosSnapshot> (*GetSnapshot ()); // shares unchanged parts
+		m_NumSnapshotChanges = 0;
+		if (m_IsRouterInfosChanged)
 		{
-			std::unique_lock<std::mutex> lock(m_RouterInfosMutex);
-			uint32_t idx = rand () % m_RouterInfos.size ();
-			uint32_t i = 0;
-			for (const auto & it : m_RouterInfos) {
-				if(i >= idx) // are we at the random start point?
-				{
-					// yes, check if we want this one
-					if(filter(it.second))
-					{
-						// we have a match
-						--n;
-						found.push_back(it.second);
-						// reset max iterations per cycle
-						iters = max_iters_per_cyle;
-						break;
-					}
-				}
-				else // not there yet
-					++i;
+			snapshot->routers = std::make_shared<RouterInfos> (m_RouterInfos);
+			m_IsRouterInfosChanged = false;
+		}
+		for (int i = 0; i < eNumRandomRoutersIndexes; i++)
+			if (m_IsRandomRoutersChanged[i])
+			{
+				snapshot->randomRouters[i] = std::make_shared<RandomRouters> (m_RandomRouters[i]);
+				m_IsRandomRoutersChanged[i] = false;
 			}
-			// we have enough
-			if(n == 0) break;
-			--iters;
-			// have we tried enough this cycle ?
-			if(!iters) {
-				// yes let's try the next cycle
-				--n;
-				iters = max_iters_per_cyle;
+		{
+			std::unique_lock<i2p::util::MeasuredMutex> l1(m_FloodfillsMutex);
+			if (m_IsFloodfillsChanged)
+			{
+				snapshot->floodfills = std::make_shared<RouterInfos> (m_Floodfills);
+				m_IsFloodfillsChanged = false;
 			}
 		}
+		std::atomic_store (&m_Snapshot, std::shared_ptr<const RouterInfosSnapshot>(snapshot));
+		m_LastSnapshotTime = i2p::util::GetMillisecondsSinceEpoch ();
+		m_NumSnapshots++;
+	}
+
+	bool NetDb::IsSnapshotDue (uint64_t ts) const
+	{
+		// every copy costs O(routers), so wait longer if few changes
+		int numChanges = m_NumSnapshotChanges;
+		if (!numChanges) return false;
+		if (numChanges < NETDB_SNAPSHOT_MIN_CHANGES)
+			return ts >= m_LastSnapshotTime + NETDB_SNAPSHOT_MAX_INTERVAL;
+		return ts >= m_LastSnapshotTime + NETDB_SNAPSHOT_INTERVAL;
+	}
+
+	void NetDb::ClearRouterInfos ()
+	{
+		std::unique_lock<i2p::util::MeasuredMutex> l(m_RouterInfosMutex);
+		m_RouterInfos.clear ();
+		for (auto& it: m_RandomRouters)
+			it.Clear ();
+		m_IsRouterInfosChanged = true;
+		for (auto& it: m_IsRandomRoutersChanged) it = true;
+		m_NumSnapshotChanges++;
+	}
+
+	void NetDb::IndexRouter (std::shared_ptr<RouterInfo> r)
+	{
+		auto& ident = r->GetIdentHash ();
+		auto index = [this, &ident, &r](RandomRoutersIndex i)
+			{
+				if (m_RandomRouters[i].Insert (ident, r))
+					m_IsRandomRoutersChanged[i] = true;
+			};
+		index (eRandomRoutersAll);
+		if (r->GetCaps () & RouterInfo::eHighBandwidth)
+			index (eRandomRoutersHighBandwidth);
+		if (r->IsIntroducer ())
+			index (eRandomRoutersIntroducers);
+		if (r->IsPeerTesting ())
+			index (eRandomRoutersPeerTesting);
+		if (r->IsFloodfill () && r->IsReachable ()) // same as m_Floodfills
+			index (eRandomRoutersFloodfills);
+	}
+
+	void NetDb::UnindexRouter (const IdentHash& ident)
+	{
+		for (int i = 0; i < eNumRandomRoutersIndexes; i++)
+			if (m_RandomRouters[i].Erase (ident))
+				m_IsRandomRoutersChanged[i] = true;
+	}
+
+	void NetDb::VisitRouterInfos(RouterInfoVisitor v)
+	{
+		for ( const auto & item : *GetSnapshot ()->routers )
+			v(item.second);
+	}
+
+	size_t NetDb::VisitRandomRouterInfos(RouterInfoFilter filter, RouterInfoVisitor v, size_t n)
+	{
+		std::vector<std::shared_ptr<const RouterInfo> > found;
+		GetSnapshot ()->randomRouters[eRandomRoutersAll]->VisitRandom (filter,
+			[&found](const std::shared_ptr<RouterInfo>& r) { found.push_back (r); }, n);
 		// visit the ones we found
-		size_t visited = 0;
-		for(const auto & ri : found ) {
+		for(const auto & ri : found )
 			v(ri);
-			++visited;
-		}
-		return visited;
+		return found.size ();
 	}
 
 	void NetDb::Load ()
 	{
 		// make sure we cleanup netDb from previous attempts
-		m_RouterInfos.clear ();
+		ClearRouterInfos ();
 		m_Floodfills.clear ();
+		m_IsFloodfillsChanged = true;
 
+		auto start = std::chrono::steady_clock::now ();
 		m_LastLoad = i2p::util::GetSecondsSinceEpoch();
 		std::vector<std::string> files;
-		m_Storage.Traverse(files);
-		for (const auto& path : files)
-			LoadRouterInfo(path);
+		std::vector<RouterInfoStore::Record> records;
+		std::function<std::shared_ptr<RouterInfo> (size_t)> create;
+		size_t numRouters = 0;
+		if (m_Store)
+		{
+			m_Store->GetRecords (records);
+			numRouters = records.size ();
+			create = [&records](size_t i)
+			{
+				auto r = std::make_shared<RouterInfo>(records[i].buf, records[i].len, false);
+				r->SetUpdated (false); // already stored
+				return r;
+			};
+		}
+		else
+		{
+			m_Storage.Traverse(files);
+			numRouters = files.size ();
+			create = [&files](size_t i) { return std::make_shared<RouterInfo>(files[i]); };
+		}
 
-		LogPrint (eLogInfo, "NetDb: ", m_RouterInfos.size(), " routers loaded (", m_Floodfills.size (), " floodfils)");
+		// read, parse and verify in parallel, batch by batch
+		int numThreads = 0; i2p::config::GetOption("netdb.threads", numThreads);
+		if (numThreads <= 0) numThreads = std::thread::hardware_concurrency ();
+		int maxThreads = numRouters/NETDB_LOAD_BATCH_SIZE + 1;
+		if (numThreads > maxThreads) numThreads = maxThreads;
+		if (numThreads <= 0) numThreads = 1;
+		std::vector<std::vector<std::shared_ptr<RouterInfo> > > loaded (numThreads);
+		std::atomic<size_t> nextFile (0);
+		auto loadFiles = [this, &create, numRouters, &nextFile, &loaded](int thread)
+		{
+			for (;;)
+			{
+				size_t from = nextFile.fetch_add (NETDB_LOAD_BATCH_SIZE);
+				if (from >= numRouters) break;
+				LoadRouterInfos (create, from, std::min (from + NETDB_LOAD_BATCH_SIZE, numRouters), loaded[thread]);
+			}
+		};
+		std::vector<std::thread> threads;
+		for (int i = 1; i < numThreads; i++)
+			threads.emplace_back (loadFiles, i);
+		loadFiles (0);
+		for (auto& it: threads) it.join ();
+
+		// insert in bulk
+		for (auto& it: loaded)
+			for (auto& r: it)
+			{
+				if (m_RouterInfos.emplace (r->GetIdentHash (), r).second)
+				{
+					IndexRouter (r);
+					m_IsRouterInfosChanged = true;
+				}
+				if (r->IsFloodfill () && r->IsReachable ()) // floodfill must be reachable
+					m_Floodfills.emplace (r->GetIdentHash (), r);
+			}
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+		LogPrint (eLogInfo, "NetDb: ", m_RouterInfos.size(), " routers loaded (", m_Floodfills.size (), " floodfils) in ",
+			(int)(elapsed.count ()*1000), " ms, ", (int)(numRouters/(elapsed.count () + 0.000001)), " RI/s, ", numThreads, " threads");
+		PublishSnapshot ();
 	}
 
 	void NetDb::SaveUpdated ()
@@ -478,10 +748,15 @@ namespace data
 		for (auto& it: m_RouterInfos)
 		{
 			std::string ident = it.second->GetIdentHashBase64();
-			std::string path  = m_Storage.Path(ident);
 			if (it.second->IsUpdated ())
 			{
-				it.second->SaveToFile (path);
+				if (m_Store)
+				{
+					if (it.second->GetBuffer ())
+						m_Store->Put (it.first, it.second->GetBuffer (), it.second->GetBufferLen ());
+				}
+				else
+					it.second->SaveToFile (m_Storage.Path(ident));
 				it.second->SetUpdated (false);
 				it.second->SetUnreachable (false);
 				it.second->DeleteBuffer ();
@@ -501,12 +776,18 @@ namespace data
 			if (it.second->IsUnreachable ())
 			{
 				// delete RI file
-				m_Storage.Remove(ident);
+				DeleteStoredRouterInfo (it.first);
 				deletedCount++;
 				if (total - deletedCount < NETDB_MIN_ROUTERS) checkForExpiration = false;
 			}
 		} // m_RouterInfos iteration
 
+		if (m_Store)
+		{
+			m_Store->Flush ();
+			if (m_Store->NeedsCompaction ())
+				m_Store->Compact ();
+		}
 		if (updatedCount > 0)
 			LogPrint (eLogInfo, "NetDb: saved ", updatedCount, " new/updated routers");
 		if (deletedCount > 0)
@@ -514,13 +795,15 @@ namespace data
 			LogPrint (eLogInfo, "NetDb: deleting ", deletedCount, " unreachable routers");
 			// clean up RouterInfos table
 			{
-				std::unique_lock<std::mutex> l(m_RouterInfosMutex);
+				std::unique_lock<i2p::util::MeasuredMutex> l(m_RouterInfosMutex);
 				for (auto it = m_RouterInfos.begin (); it != m_RouterInfos.end ();)
 				{
 					if (it->second->IsUnreachable ())
 					{
-						it->second->SaveProfile ();
+						UnindexRouter (it->first);
 						it = m_RouterInfos.erase (it);
+						m_IsRouterInfosChanged = true;
+						m_NumSnapshotChanges++;
 						continue;
 					}
 					++it;
@@ -528,10 +811,13 @@ namespace data
 			}
 			// clean up expired floodfiils
 			{
-				std::unique_lock<std::mutex> l(m_FloodfillsMutex);
+				std::unique_lock<i2p::util::MeasuredMutex> l(m_FloodfillsMutex);
 				for (auto it = m_Floodfills.begin (); it != m_Floodfills.end ();)
-					if ((*it)->IsUnreachable ())
+					if (it->second->IsUnreachable ())
+					{
 						it = m_Floodfills.erase (it);
+						m_IsFloodfillsChanged = true;
+					}
 					else
 						++it;
 			}
@@ -829,9 +1115,19 @@ namespace data
 				if (router)
 				{
 					LogPrint (eLogDebug, "NetDb: requested RouterInfo ", key, " found");
-					router->LoadBuffer ();
+					if (m_Store && !router->GetBuffer ())
+					{
+						std::vector<uint8_t> buf;
+						if (m_Store->Get (ident, buf))
+							router->SetBuffer (buf.data (), buf.size ());
+					}
+					else
+						router->LoadBuffer ();
 					if (router->GetBuffer ())
+					{
 						replyMsg = CreateDatabaseStoreMsg (router);
+						if (m_IsCompact && !router->IsUpdated ()) router->DeleteBuffer (); // load again from file next time
+					}
 				}
 			}
 
@@ -968,7 +1264,7 @@ namespace data
 
 	std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter () const
 	{
-		return GetRandomRouter (
+		return GetRandomRouter (eRandomRoutersAll,
 			[](std::shared_ptr<const RouterInfo> router)->bool
 			{
 				return !router->IsHidden ();
@@ -977,7 +1273,7 @@ namespace data
 
 	std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter (std::shared_ptr<const RouterInfo> compatibleWith) const
 	{
-		return GetRandomRouter (
+		return GetRandomRouter (eRandomRoutersAll,
 			[compatibleWith](std::shared_ptr<const RouterInfo> router)->bool
 			{
 				return !router->IsHidden () && router != compatibleWith &&
@@ -987,7 +1283,7 @@ namespace data
 
 	std::shared_ptr<const RouterInfo> NetDb::GetRandomPeerTestRouter (bool v4only) const
 	{
-		return GetRandomRouter (
+		return GetRandomRouter (eRandomRoutersPeerTesting,
 			[v4only](std::shared_ptr<const RouterInfo> router)->bool
 			{
 				return !router->IsHidden () && router->IsPeerTesting () && router->IsSSU (v4only);
@@ -996,16 +1292,25 @@ namespace data
 
 	std::shared_ptr<const RouterInfo> NetDb::GetRandomIntroducer () const
 	{
-		return GetRandomRouter (
+		return GetRandomRouter (eRandomRoutersIntroducers,
 			[](std::shared_ptr<const RouterInfo> router)->bool
 			{
 				return !router->IsHidden () && router->IsIntroducer ();
 			});
 	}
 
+	std::shared_ptr<const RouterInfo> NetDb::GetRandomFloodfill (const std::set<IdentHash>& excluded) const
+	{
+		return GetRandomRouter (eRandomRoutersFloodfills,
+			[&excluded](std::shared_ptr<const RouterInfo> router)->bool
+			{
+				return !router->IsHidden () && !excluded.count (router->GetIdentHash ());
+			});
+	}
+
 	std::shared_ptr<const RouterInfo> NetDb::GetHighBandwidthRandomRouter (std::shared_ptr<const RouterInfo> compatibleWith) const
 	{
-		return GetRandomRouter (
+		return GetRandomRouter (eRandomRoutersHighBandwidth,
 			[compatibleWith](std::shared_ptr<const RouterInfo> router)->bool
 			{
 				return !router->IsHidden () && router != compatibleWith &&
@@ -1015,29 +1320,14 @@ namespace data
 	}
 
 	template<typename Filter>
-	std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter (Filter filter) const
+	std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter (RandomRoutersIndex index, Filter filter) const
 	{
-		if (m_RouterInfos.empty())
-			return 0;
-		uint32_t ind = rand () % m_RouterInfos.size ();
-		for (int j = 0; j < 2; j++)
-		{
-			uint32_t i = 0;
-			std::unique_lock<std::mutex> l(m_RouterInfosMutex);
-			for (const auto& it: m_RouterInfos)
+		auto snapshot = GetSnapshot ();
+		return snapshot->randomRouters[index]->GetRandom (
+			[&filter](const std::shared_ptr<RouterInfo>& router)->bool
 			{
-				if (i >= ind)
-				{
-					if (!it.second->IsUnreachable () && filter (it.second))
-						return it.second;
-				}
-				else
-					i++;
-			}
-			// we couldn't find anything, try second pass
-			ind = 0;
-		}
-		return nullptr; // seems we have too few routers
+				return !router->IsUnreachable () && filter (router);
+			});
 	}
 
 	void NetDb::PostI2NPMsg (std::shared_ptr<const I2NPMessage> msg)
@@ -1049,82 +1339,47 @@ namespace data
 		const std::set<IdentHash>& excluded, bool closeThanUsOnly) const
 	{
 		std::shared_ptr<const RouterInfo> r;
-		XORMetric minMetric;
 		IdentHash destKey = CreateRoutingKey (destination);
-		if (closeThanUsOnly)
-			minMetric = destKey ^ i2p::context.GetIdentHash ();
-		else
-			minMetric.SetMax ();
-		std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-		for (const auto& it: m_Floodfills)
-		{
-			if (!it->IsUnreachable ())
+		XORMetric ourMetric;
+		if (closeThanUsOnly) ourMetric = destKey ^ i2p::context.GetIdentHash ();
+		auto snapshot = GetSnapshot ();
+		// floodfills come in order of distance
+		VisitClosest (*snapshot->floodfills, destKey,
+			[&](const std::pair<const IdentHash, std::shared_ptr<RouterInfo> >& it)->bool
 			{
-				XORMetric m = destKey ^ it->GetIdentHash ();
-				if (m < minMetric && !excluded.count (it->GetIdentHash ()))
-				{
-					minMetric = m;
-					r = it;
-				}
-			}
-		}
+				if (closeThanUsOnly && !((destKey ^ it.first) < ourMetric)) return false;
+				if (it.second->IsUnreachable () || excluded.count (it.first)) return true;
+				r = it.second;
+				return false;
+			});
 		return r;
 	}
 
 	std::vector<IdentHash> NetDb::GetClosestFloodfills (const IdentHash& destination, size_t num,
 		std::set<IdentHash>& excluded, bool closeThanUsOnly) const
 	{
-		struct Sorted
-		{
-			std::shared_ptr<const RouterInfo> r;
-			XORMetric metric;
-			bool operator< (const Sorted& other) const { return metric < other.metric; };
-		};
-
-		std::set<Sorted> sorted;
+		std::vector<IdentHash> res;
+		if (!num) return res;
 		IdentHash destKey = CreateRoutingKey (destination);
 		XORMetric ourMetric;
 		if (closeThanUsOnly) ourMetric = destKey ^ i2p::context.GetIdentHash ();
-		{
-			std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-			for (const auto& it: m_Floodfills)
-			{
-				if (!it->IsUnreachable ())
-				{
-					XORMetric m = destKey ^ it->GetIdentHash ();
-					if (closeThanUsOnly && ourMetric < m) continue;
-					if (sorted.size () < num)
-						sorted.insert ({it, m});
-					else if (m < sorted.rbegin ()->metric)
-					{
-						sorted.insert ({it, m});
-						sorted.erase (std::prev (sorted.end ()));
-					}
-				}
-			}
-		}
-
-		std::vector<IdentHash> res;
 		size_t i = 0;
-		for (const auto& it: sorted)
-		{
-			if (i < num)
+		auto snapshot = GetSnapshot ();
+		// num closest reachable floodfills, excluded are skipped from result
+		VisitClosest (*snapshot->floodfills, destKey,
+			[&](const std::pair<const IdentHash, std::shared_ptr<RouterInfo> >& it)->bool
 			{
-				const auto& ident = it.r->GetIdentHash ();
-				if (!excluded.count (ident))
-				{
-					res.push_back (ident);
-					i++;
-				}
-			}
-			else
-				break;
-		}
+				if (closeThanUsOnly && ourMetric < (destKey ^ it.first)) return false;
+				if (it.second->IsUnreachable ()) return true;
+				if (!excluded.count (it.first))
+					res.push_back (it.first);
+				return ++i < num;
+			});
 		return res;
 	}
 
   std::shared_ptr<const RouterInfo> NetDb::GetRandomRouterInFamily(const std::string & fam) const {
-    return GetRandomRouter(
+    return GetRandomRouter(eRandomRoutersAll,
       [fam](std::shared_ptr<const RouterInfo> router)->bool
       {
         return router->IsFamily(fam);
@@ -1135,22 +1390,15 @@ namespace data
 		const std::set<IdentHash>& excluded) const
 	{
 		std::shared_ptr<const RouterInfo> r;
-		XORMetric minMetric;
 		IdentHash destKey = CreateRoutingKey (destination);
-		minMetric.SetMax ();
 		// must be called from NetDb thread only
-		for (const auto& it: m_RouterInfos)
-		{
-			if (!it.second->IsFloodfill ())
+		VisitClosest (m_RouterInfos, destKey,
+			[&](const std::pair<const IdentHash, std::shared_ptr<RouterInfo> >& it)->bool
 			{
-				XORMetric m = destKey ^ it.first;
-				if (m < minMetric && !excluded.count (it.first))
-				{
-					minMetric = m;
-					r = it.second;
-				}
-			}
-		}
+				if (it.second->IsFloodfill () || excluded.count (it.first)) return true;
+				r = it.second;
+				return false;
+			});
 		return r;
 	}
 
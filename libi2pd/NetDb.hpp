@@ -13,8 +13,11 @@
 #include "Gzip.h"
 #include "FS.h"
 #include "Queue.h"
+#include "util.h"
 #include "I2NPProtocol.h"
 #include "RouterInfo.h"
+#include "RouterInfoStore.h"
+#include "RandomIndex.h"
 #include "LeaseSet.h"
 #include "Tunnel.h"
 #include "TunnelPool.h"
@@ -32,6 +35,10 @@ namespace data
 	const int NETDB_MIN_EXPIRATION_TIMEOUT = 90*60; // 1.5 hours
 	const int NETDB_MAX_EXPIRATION_TIMEOUT = 27*60*60; // 27 hours
 	const int NETDB_PUBLISH_INTERVAL = 60*40;
+	const size_t NETDB_LOAD_BATCH_SIZE = 64; // RouterInfos verified together
+	const int NETDB_SNAPSHOT_INTERVAL = 500; // in milliseconds, how often readers see added routers
+	const int NETDB_SNAPSHOT_MAX_INTERVAL = 5000; // in milliseconds, if less than NETDB_SNAPSHOT_MIN_CHANGES
+	const int NETDB_SNAPSHOT_MIN_CHANGES = 16; // added or removed routers, floodfills or index entries
 
 	/** function for visiting a leaseset stored in a floodfill */
 	typedef std::function<void(const IdentHash, std::shared_ptr<LeaseSet>)> LeaseSetVisitor;
@@ -71,6 +78,7 @@ namespace data
 			std::shared_ptr<const RouterInfo> GetHighBandwidthRandomRouter (std::shared_ptr<const RouterInfo> compatibleWith) const;
 			std::shared_ptr<const RouterInfo> GetRandomPeerTestRouter (bool v4only = true) const;
 			std::shared_ptr<const RouterInfo> GetRandomIntroducer () const;
+			std::shared_ptr<const RouterInfo> GetRandomFloodfill (const std::set<IdentHash>& excluded) const;
 			std::shared_ptr<const RouterInfo> GetClosestFloodfill (const IdentHash& destination, const std::set<IdentHash>& excluded, bool closeThanUsOnly = false) const;
 			std::vector<IdentHash> GetClosestFloodfills (const IdentHash& destination, size_t num,
 				std::set<IdentHash>& excluded, bool closeThanUsOnly = false) const;
@@ -87,9 +95,14 @@ namespace data
 			Families& GetFamilies () { return m_Families; };
 
 			// for web interface
-			int GetNumRouters () const { return m_RouterInfos.size (); };
-			int GetNumFloodfills () const { return m_Floodfills.size (); };
+			int GetNumRouters () const { return GetSnapshot ()->routers->size (); };
+			int GetNumFloodfills () const { return GetSnapshot ()->floodfills->size (); };
 			int GetNumLeaseSets () const { return m_LeaseSets.size (); };
+			size_t GetRouterInfosMemoryUsage () const; // approximate, in bytes
+			const i2p::util::MeasuredMutex& GetRouterInfosMutex () const { return m_RouterInfosMutex; };
+			const i2p::util::MeasuredMutex& GetFloodfillsMutex () const { return m_FloodfillsMutex; };
+			const i2p::util::MeasuredMutex& GetLeaseSetsMutex () const { return m_LeaseSetsMutex; };
+			uint64_t GetNumSnapshots () const { return m_NumSnapshots; };
 
 			/** visit all lease sets we currently store */
 			void VisitLeaseSets(LeaseSetVisitor v);
@@ -100,12 +113,16 @@ namespace data
 			/** visit N random router that match using filter, then visit them with a visitor, return number of RouterInfos that were visited */
 			size_t VisitRandomRouterInfos(RouterInfoFilter f, RouterInfoVisitor v, size_t n);
 
-			void ClearRouterInfos () { m_RouterInfos.clear (); };
+			void ClearRouterInfos ();
 
 		private:
 
 			void Load ();
-			bool LoadRouterInfo (const std::string & path);
+			void LoadRouterInfos (std::function<std::shared_ptr<RouterInfo> (size_t)> create, size_t from, size_t to,
+				std::vector<std::shared_ptr<RouterInfo> >& loaded); // read and verify
+			void DeleteStoredRouterInfo (const IdentHash& ident);
+			void MigrateToStore (); // move RouterInfo files to m_Store
+			void MigrateFromStore (const std::string& path); // move RouterInfos from store at path back to files
 			void SaveUpdated ();
 			void Run (); // exploratory thread
 			void Explore (int numDestinations);
@@ -115,17 +132,51 @@ namespace data
 
 		void ReseedFromFloodfill(const RouterInfo & ri, int numRouters=40, int numFloodfills=20);
 
+		enum RandomRoutersIndex
+		{
+			eRandomRoutersAll = 0,
+			eRandomRoutersHighBandwidth,
+			eRandomRoutersIntroducers,
+			eRandomRoutersPeerTesting,
+			eRandomRoutersFloodfills,
+			eNumRandomRoutersIndexes
+		};
+
     	template<typename Filter>
-        std::shared_ptr<const RouterInfo> GetRandomRouter (Filter filter) const;
+        std::shared_ptr<const RouterInfo> GetRandomRouter (RandomRoutersIndex index, Filter filter) const;
+		void IndexRouter (std::shared_ptr<RouterInfo> r); // m_RouterInfosMutex must be locked
+		void UnindexRouter (const IdentHash& ident); // m_RouterInfosMutex must be locked
+
+		typedef std::map<IdentHash, std::shared_ptr<RouterInfo> > RouterInfos;
+		typedef RandomIndex<IdentHash, std::shared_ptr<RouterInfo> > RandomRouters;
+
+		/** immutable copy of routers and floodfills, readers don't take NetDb mutexes.
+		 * Parts not changed since previous snapshot are shared with it */
+		struct RouterInfosSnapshot
+		{
+			RouterInfosSnapshot (); // empty
+			std::shared_ptr<const RouterInfos> routers, floodfills;
+			std::shared_ptr<const RandomRouters> randomRouters[eNumRandomRoutersIndexes];
+		};
+		std::shared_ptr<const RouterInfosSnapshot> GetSnapshot () const { return std::atomic_load (&m_Snapshot); };
+		void PublishSnapshot (); // copy changed routers, indexes and floodfills for readers
+		bool IsSnapshotDue (uint64_t ts) const;
 
 		private:
 
-			mutable std::mutex m_LeaseSetsMutex;
+			mutable i2p::util::MeasuredMutex m_LeaseSetsMutex;
 			std::map<IdentHash, std::shared_ptr<LeaseSet> > m_LeaseSets;
-			mutable std::mutex m_RouterInfosMutex;
-			std::map<IdentHash, std::shared_ptr<RouterInfo> > m_RouterInfos;
-			mutable std::mutex m_FloodfillsMutex;
-			std::list<std::shared_ptr<RouterInfo> > m_Floodfills;
+			mutable i2p::util::MeasuredMutex m_RouterInfosMutex;
+			RouterInfos m_RouterInfos;
+			RandomRouters m_RandomRouters[eNumRandomRoutersIndexes]; // by caps, guarded by m_RouterInfosMutex
+			bool m_IsRouterInfosChanged, m_IsRandomRoutersChanged[eNumRandomRoutersIndexes]; // since snapshot, guarded by m_RouterInfosMutex
+			mutable i2p::util::MeasuredMutex m_FloodfillsMutex;
+			RouterInfos m_Floodfills; // sorted for closest lookups
+			bool m_IsFloodfillsChanged; // since snapshot, guarded by m_FloodfillsMutex
+			std::shared_ptr<const RouterInfosSnapshot> m_Snapshot; // access by std::atomic_load/store only
+			std::atomic<int> m_NumSnapshotChanges; // since snapshot
+			uint64_t m_LastSnapshotTime; // in milliseconds
+			std::atomic<uint64_t> m_NumSnapshots;
 
 			bool m_IsRunning;
 			uint64_t m_LastLoad;
@@ -136,6 +187,7 @@ namespace data
 			Reseeder * m_Reseeder;
 			Families m_Families;
 			i2p::fs::HashedStorage m_Storage;
+			std::unique_ptr<RouterInfoStore> m_Store; // single file instead of m_Storage if not null
 
 			friend class NetDbRequests;
 			NetDbRequests m_Requests;
@@ -146,6 +198,7 @@ namespace data
 
       /** true if in hidden mode */
       bool m_HiddenMode;
+		bool m_IsCompact; // drop properties and buffers of RouterInfos once not needed
 	};
 
 	extern NetDb netdb;
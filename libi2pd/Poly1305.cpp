@@ -10,115 +10,23 @@ namespace i2p
 {
 namespace crypto
 {
-	namespace poly1305 
+	namespace poly1305
 	{
+		// 130-bit numbers as 5 limbs of 26 bits, products fit in 64 bits
+		const uint32_t LIMB_MASK = 0x3ffffff;
 
-		struct LongBlock
+		inline uint32_t U8TO32(const uint8_t * p)
 		{
-			unsigned long data[17];
-			operator unsigned long * ()
-			{
-				return data;
-			}
-		};
+			return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+		}
 
-		struct Block
+		inline void U32TO8(uint32_t v, uint8_t * p)
 		{
-			unsigned char data[17];
-
-			operator uint8_t * ()
-			{
-				return data;
-			}
-
-			Block & operator += (const Block & other)
-			{
-				unsigned short u;
-				unsigned int i;
-				for(u = 0, i = 0; i < 17; i++)
-				{
-					u += (unsigned short) data[i] + (unsigned short) other.data[i];
-					data[i] = (unsigned char) u & 0xff;
-					u >>= 8;
-				}
-				return *this;
-			}
-
-			Block & operator %=(const LongBlock & other)
-			{
-				unsigned long u;
-				unsigned int i;
-				u = 0;
-				for (i = 0; i < 16; i++) {
-					u += other.data[i];
-					data[i] = (unsigned char)u & 0xff;
-					u >>= 8;
-				}
-				u += other.data[16];
-				data[16] = (unsigned char)u & 0x03;
-				u >>= 2;
-				u += (u << 2);
-				for (i = 0; i < 16; i++) {
-					u += data[i];
-					data[i] = (unsigned char)u & 0xff;
-					u >>= 8;
-				}
-				data[16] += (unsigned char)u;
-				return *this;
-			}
-
-			Block & operator = (const Block & other)
-			{
-				memcpy(data, other.data, sizeof(data));
-				return *this;
-			}
-
-			Block & operator ~ ()
-			{
-				static const Block minusp = {
-					0x05,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-					0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-					0xfc
-				};
-				Block orig;
-				unsigned char neg;
-				unsigned int i;
-				orig = *this;
-				*this += minusp;
-				neg = -(data[16] >> 7);
-				for(i = 0; i < 17; i++)
-					data[i] ^= neg & (orig.data[i] ^ data[i]);
-
-				return *this;
-			}
-
-			void PutKey(const uint8_t * key)
-			{
-				data[0] = key[0] & 0xff;
-				data[1] = key[1] & 0xff;
-				data[2] = key[2] & 0xff;
-				data[3] = key[3] & 0x0f;
-				data[4] = key[4] & 0xfc;
-				data[5] = key[5] & 0xff;
-				data[6] = key[6] & 0xff;
-				data[7] = key[7] & 0x0f;
-				data[8] = key[8] & 0xfc;
-				data[9] = key[9] & 0xff;
-				data[10] = key[10] & 0xff;
-				data[11] = key[11] & 0x0f;
-				data[12] = key[12] & 0xfc;
-				data[13] = key[13] & 0xff;
-				data[14] = key[14] & 0xff;
-				data[15] = key[15] & 0x0f;
-				data[16] = 0;
-			}
-
-			void Put(const uint8_t * d, uint8_t last=0)
-			{
-				memcpy(data, d, 17);
-				data[16] = last;
-			}
-		};
+			p[0] = v & 0xff;
+			p[1] = (v >> 8) & 0xff;
+			p[2] = (v >> 16) & 0xff;
+			p[3] = (v >> 24) & 0xff;
+		}
 
 		struct Buffer
 		{
@@ -133,16 +41,16 @@ namespace crypto
 
 	struct Poly1305
 	{
-#if (__GNUC__ == 4) && (__GNUC_MINOR__ < 8) // older than gcc 4.8
 		Poly1305(const uint8_t * key) : m_Leftover(0), m_Final(0)
 		{
-			memset (&m_H, 0, sizeof (m_H));
-#else 
-		Poly1305(const uint8_t * key) : m_Leftover(0), m_H{0}, m_Final(0)
-		{
-#endif
-			m_R.PutKey(key);
-			m_Pad.Put(key + 16);
+			// r &= 0xffffffc0ffffffc0ffffffc0fffffff
+			m_R[0] = (poly1305::U8TO32(key + 0)) & 0x3ffffff;
+			m_R[1] = (poly1305::U8TO32(key + 3) >> 2) & 0x3ffff03;
+			m_R[2] = (poly1305::U8TO32(key + 6) >> 4) & 0x3ffc0ff;
+			m_R[3] = (poly1305::U8TO32(key + 9) >> 6) & 0x3f03fff;
+			m_R[4] = (poly1305::U8TO32(key + 12) >> 8) & 0x00fffff;
+			for (int i = 0; i < 5; i++) m_H[i] = 0;
+			for (int i = 0; i < 4; i++) m_Pad[i] = poly1305::U8TO32(key + 16 + i*4);
 		}
 
 		void Update(const uint8_t * buf, size_t sz)
@@ -178,34 +86,39 @@ namespace crypto
 
 		void Blocks(const uint8_t * buf, size_t sz)
 		{
-			const unsigned char hi = m_Final ^ 1;
-			while (sz >= POLY1305_BLOCK_BYTES) {
-				
-				unsigned long u;
-				
-				unsigned int i, j;
-				m_Msg.Put(buf, hi);
+			const uint32_t hibit = m_Final ? 0 : (1UL << 24); // 1 << 128
+			const uint32_t r0 = m_R[0], r1 = m_R[1], r2 = m_R[2], r3 = m_R[3], r4 = m_R[4];
+			const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+			uint32_t h0 = m_H[0], h1 = m_H[1], h2 = m_H[2], h3 = m_H[3], h4 = m_H[4];
+			while (sz >= POLY1305_BLOCK_BYTES)
+			{
 				/* h += m */
-				m_H += m_Msg;
+				h0 += (poly1305::U8TO32(buf + 0)) & poly1305::LIMB_MASK;
+				h1 += (poly1305::U8TO32(buf + 3) >> 2) & poly1305::LIMB_MASK;
+				h2 += (poly1305::U8TO32(buf + 6) >> 4) & poly1305::LIMB_MASK;
+				h3 += (poly1305::U8TO32(buf + 9) >> 6) & poly1305::LIMB_MASK;
+				h4 += (poly1305::U8TO32(buf + 12) >> 8) | hibit;
 
 				/* h *= r */
-				for (i = 0; i < 17; i++) {
-					u = 0;
-					for (j = 0; j <= i ; j++) {
-						u += (unsigned short)m_H.data[j] * m_R.data[i - j];
-					}
-					for (j = i + 1; j < 17; j++) {
-						unsigned long v = (unsigned short)m_H.data[j] * m_R.data[i + 17 - j];
-						v = ((v << 8) + (v << 6)); /* v *= (5 << 6); */
-						u += v;
-					}
-					m_HR[i] = u;
-				}
+				uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+				uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+				uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+				uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+				uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
 				/* (partial) h %= p */
-				m_H %= m_HR;
+				uint32_t c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & poly1305::LIMB_MASK;
+				d1 += c; c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & poly1305::LIMB_MASK;
+				d2 += c; c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & poly1305::LIMB_MASK;
+				d3 += c; c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & poly1305::LIMB_MASK;
+				d4 += c; c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & poly1305::LIMB_MASK;
+				h0 += c * 5; c = h0 >> 26; h0 &= poly1305::LIMB_MASK;
+				h1 += c;
+
 				buf += POLY1305_BLOCK_BYTES;
 				sz -= POLY1305_BLOCK_BYTES;
 			}
+			m_H[0] = h0; m_H[1] = h1; m_H[2] = h2; m_H[3] = h3; m_H[4] = h4;
 		}
 
 		void Finish(uint32_t *& out)
@@ -221,23 +134,58 @@ namespace crypto
 				Blocks(m_Buffer, POLY1305_BLOCK_BYTES);
 			}
 
-			// freeze H
-			~m_H;
+			// fully carry h
+			uint32_t h0 = m_H[0], h1 = m_H[1], h2 = m_H[2], h3 = m_H[3], h4 = m_H[4], c;
+			c = h1 >> 26; h1 &= poly1305::LIMB_MASK;
+			h2 += c; c = h2 >> 26; h2 &= poly1305::LIMB_MASK;
+			h3 += c; c = h3 >> 26; h3 &= poly1305::LIMB_MASK;
+			h4 += c; c = h4 >> 26; h4 &= poly1305::LIMB_MASK;
+			h0 += c * 5; c = h0 >> 26; h0 &= poly1305::LIMB_MASK;
+			h1 += c;
+
+			// freeze h, compute h - p and select it if non negative
+			uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= poly1305::LIMB_MASK;
+			uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= poly1305::LIMB_MASK;
+			uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= poly1305::LIMB_MASK;
+			uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= poly1305::LIMB_MASK;
+			uint32_t g4 = h4 + c - (1UL << 26);
+			uint32_t mask = (g4 >> 31) - 1;
+			g0 &= mask; g1 &= mask; g2 &= mask; g3 &= mask; g4 &= mask;
+			mask = ~mask;
+			h0 = (h0 & mask) | g0;
+			h1 = (h1 & mask) | g1;
+			h2 = (h2 & mask) | g2;
+			h3 = (h3 & mask) | g3;
+			h4 = (h4 & mask) | g4;
+
+			// h = h % 2^128
+			h0 = (h0 | (h1 << 26));
+			h1 = ((h1 >> 6) | (h2 << 20));
+			h2 = ((h2 >> 12) | (h3 << 14));
+			h3 = ((h3 >> 18) | (h4 << 8));
+
 			// add pad
-			m_H += m_Pad;
+			uint64_t f;
+			f = (uint64_t)h0 + m_Pad[0]; h0 = (uint32_t)f;
+			f = (uint64_t)h1 + m_Pad[1] + (f >> 32); h1 = (uint32_t)f;
+			f = (uint64_t)h2 + m_Pad[2] + (f >> 32); h2 = (uint32_t)f;
+			f = (uint64_t)h3 + m_Pad[3] + (f >> 32); h3 = (uint32_t)f;
+
 			// copy digest
-			memcpy(out, m_H, 16);
+			uint8_t * digest = (uint8_t *)out;
+			poly1305::U32TO8(h0, digest + 0);
+			poly1305::U32TO8(h1, digest + 4);
+			poly1305::U32TO8(h2, digest + 8);
+			poly1305::U32TO8(h3, digest + 12);
 		}
 
 		size_t m_Leftover;
 		poly1305::Buffer m_Buffer;
-		poly1305::Block m_H;
-		poly1305::Block m_R;
-		poly1305::Block m_Pad;
-		poly1305::Block m_Msg;
-		poly1305::LongBlock m_HR;
+		uint32_t m_H[5];
+		uint32_t m_R[5];
+		uint32_t m_Pad[4];
 		uint8_t m_Final;
-		
+
 	};
 
 	void Poly1305HMAC(uint32_t * out, const uint32_t * key, const uint8_t * buf, std::size_t sz)
@@ -1,74 +1,96 @@
-#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <zlib.h>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/ini_parser.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include "Base.h"
 #include "FS.h"
 #include "Log.h"
+#include "I2PEndian.h"
+#include "Timestamp.h"
 #include "Profiling.h"
 
 namespace i2p
 {
 namespace data
 {
-	i2p::fs::HashedStorage m_ProfilesStorage("peerProfiles", "p", "profile-", "txt");
+	i2p::fs::HashedStorage m_ProfilesStorage("peerProfiles", "p", "profile-", "txt"); // former versions
+	static std::mutex m_ProfilesMutex;
+	static std::map<IdentHash, std::shared_ptr<RouterProfile> > m_Profiles;
+	static std::atomic<bool> m_IsProfilesUpdated (false); // since last save
 
 	RouterProfile::RouterProfile ():
-		m_LastUpdateTime (boost::posix_time::second_clock::local_time()),
+		m_LastUpdateTime (i2p::util::GetSecondsSinceEpoch ()), m_LastDecayTime (m_LastUpdateTime),
 		m_NumTunnelsAgreed (0), m_NumTunnelsDeclined (0), m_NumTunnelsNonReplied (0),
 		m_NumTimesTaken (0), m_NumTimesRejected (0)
 	{
 	}
 
-	boost::posix_time::ptime RouterProfile::GetTime () const
+	void RouterProfile::UpdateTime ()
 	{
-		return boost::posix_time::second_clock::local_time();
+		m_LastUpdateTime = i2p::util::GetSecondsSinceEpoch ();
+		m_IsProfilesUpdated = true;
 	}
 
-	void RouterProfile::UpdateTime ()
+	void RouterProfile::Decay ()
 	{
-		m_LastUpdateTime = GetTime ();
+		auto ts = i2p::util::GetSecondsSinceEpoch ();
+		if (ts < m_LastDecayTime + PEER_PROFILE_DECAY_INTERVAL*3600) return;
+		int periods = (ts - m_LastDecayTime)/(PEER_PROFILE_DECAY_INTERVAL*3600);
+		if (periods > 31) periods = 31;
+		m_NumTunnelsAgreed >>= periods;
+		m_NumTunnelsDeclined >>= periods;
+		m_NumTunnelsNonReplied >>= periods;
+		m_NumTimesTaken >>= periods;
+		m_NumTimesRejected >>= periods;
+		m_LastDecayTime += (uint64_t)periods*PEER_PROFILE_DECAY_INTERVAL*3600;
+		m_IsProfilesUpdated = true;
 	}
 
-	void RouterProfile::Save (const IdentHash& identHash)
+	void RouterProfile::ToBuffer (uint8_t * buf) const
 	{
-		// fill sections
-		boost::property_tree::ptree participation;
-		participation.put (PEER_PROFILE_PARTICIPATION_AGREED, m_NumTunnelsAgreed);
-		participation.put (PEER_PROFILE_PARTICIPATION_DECLINED, m_NumTunnelsDeclined);
-		participation.put (PEER_PROFILE_PARTICIPATION_NON_REPLIED, m_NumTunnelsNonReplied);
-		boost::property_tree::ptree usage;
-		usage.put (PEER_PROFILE_USAGE_TAKEN, m_NumTimesTaken);
-		usage.put (PEER_PROFILE_USAGE_REJECTED, m_NumTimesRejected);
-		// fill property tree
-		boost::property_tree::ptree pt;
-		pt.put (PEER_PROFILE_LAST_UPDATE_TIME, boost::posix_time::to_simple_string (m_LastUpdateTime));
-		pt.put_child (PEER_PROFILE_SECTION_PARTICIPATION, participation);
-		pt.put_child (PEER_PROFILE_SECTION_USAGE, usage);
-
-		// save to file
-		std::string ident = identHash.ToBase64 ();
-		std::string path = m_ProfilesStorage.Path(ident);
+		std::unique_lock<std::mutex> l(m_Mutex);
+		htobe64buf (buf, m_LastUpdateTime);
+		htobe64buf (buf + 8, m_LastDecayTime);
+		htobe32buf (buf + 16, m_NumTunnelsAgreed);
+		htobe32buf (buf + 20, m_NumTunnelsDeclined);
+		htobe32buf (buf + 24, m_NumTunnelsNonReplied);
+		htobe32buf (buf + 28, m_NumTimesTaken);
+		htobe32buf (buf + 32, m_NumTimesRejected);
+	}
 
-		try {
-			boost::property_tree::write_ini (path, pt);
-		} catch (std::exception& ex) {
-			/* boost exception verbose enough */
-			LogPrint (eLogError, "Profiling: ", ex.what ());
-		}
+	void RouterProfile::FromBuffer (const uint8_t * buf)
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		m_LastUpdateTime = bufbe64toh (buf);
+		m_LastDecayTime = bufbe64toh (buf + 8);
+		m_NumTunnelsAgreed = bufbe32toh (buf + 16);
+		m_NumTunnelsDeclined = bufbe32toh (buf + 20);
+		m_NumTunnelsNonReplied = bufbe32toh (buf + 24);
+		m_NumTimesTaken = bufbe32toh (buf + 28);
+		m_NumTimesRejected = bufbe32toh (buf + 32);
 	}
 
-	void RouterProfile::Load (const IdentHash& identHash)
+	uint64_t RouterProfile::GetLastUpdateTime () const
 	{
-		std::string ident = identHash.ToBase64 ();
-		std::string path = m_ProfilesStorage.Path(ident);
-		boost::property_tree::ptree pt;
+		std::unique_lock<std::mutex> l(m_Mutex);
+		return m_LastUpdateTime;
+	}
 
-		if (!i2p::fs::Exists(path))
-		{
-			LogPrint(eLogWarning, "Profiling: no profile yet for ", ident);
-			return;
-		}
+	bool RouterProfile::IsExpired (uint64_t ts) const
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		return ts > m_LastUpdateTime + PEER_PROFILE_EXPIRATION_TIMEOUT*3600;
+	}
 
+	bool RouterProfile::LoadIni (const std::string& path)
+	{
+		boost::property_tree::ptree pt;
 		try
 		{
 			boost::property_tree::read_ini (path, pt);
@@ -76,15 +98,22 @@ namespace data
 		{
 			/* boost exception verbose enough */
 			LogPrint (eLogError, "Profiling: ", ex.what ());
-			return;
+			return false;
 		}
 
 		try
 		{
 			auto t = pt.get (PEER_PROFILE_LAST_UPDATE_TIME, "");
 			if (t.length () > 0)
-				m_LastUpdateTime = boost::posix_time::time_from_string (t);
-			if ((GetTime () - m_LastUpdateTime).hours () < PEER_PROFILE_EXPIRATION_TIMEOUT)
+			{
+				// stored in local time
+				auto localTime = boost::posix_time::time_from_string (t);
+				auto utcOffset = boost::posix_time::second_clock::local_time () - boost::posix_time::second_clock::universal_time ();
+				auto epoch = boost::posix_time::ptime (boost::gregorian::date (1970, 1, 1));
+				m_LastUpdateTime = (localTime - utcOffset - epoch).total_seconds ();
+				m_LastDecayTime = m_LastUpdateTime;
+			}
+			if (!IsExpired (i2p::util::GetSecondsSinceEpoch ()))
 			{
 				try
 				{
@@ -96,7 +125,7 @@ namespace data
 				}
 				catch (boost::property_tree::ptree_bad_path& ex)
 				{
-					LogPrint (eLogWarning, "Profiling: Missing section ", PEER_PROFILE_SECTION_PARTICIPATION, " in profile for ", ident);
+					LogPrint (eLogWarning, "Profiling: Missing section ", PEER_PROFILE_SECTION_PARTICIPATION, " in profile ", path);
 				}
 				try
 				{
@@ -107,20 +136,24 @@ namespace data
 				}
 				catch (boost::property_tree::ptree_bad_path& ex)
 				{
-					LogPrint (eLogWarning, "Missing section ", PEER_PROFILE_SECTION_USAGE, " in profile for ", ident);
+					LogPrint (eLogWarning, "Missing section ", PEER_PROFILE_SECTION_USAGE, " in profile ", path);
 				}
 			}
 			else
-				*this = RouterProfile ();
+				return false;
 		}
 		catch (std::exception& ex)
 		{
-			LogPrint (eLogError, "Profiling: Can't read profile ", ident, " :", ex.what ());
+			LogPrint (eLogError, "Profiling: Can't read profile ", path, " :", ex.what ());
+			return false;
 		}
+		return true;
 	}
 
 	void RouterProfile::TunnelBuildResponse (uint8_t ret)
 	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		Decay ();
 		UpdateTime ();
 		if (ret > 0)
 			m_NumTunnelsDeclined++;
@@ -130,6 +163,8 @@ namespace data
 
 	void RouterProfile::TunnelNonReplied ()
 	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		Decay ();
 		m_NumTunnelsNonReplied++;
 		UpdateTime ();
 	}
@@ -147,6 +182,8 @@ namespace data
 
 	bool RouterProfile::IsBad ()
 	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		Decay ();
 		auto isBad = IsAlwaysDeclining () || IsLowPartcipationRate () /*|| IsLowReplyRate ()*/;
 		if (isBad && m_NumTimesRejected > 10*(m_NumTimesTaken + 1))
 		{
@@ -157,39 +194,159 @@ namespace data
 			isBad = false;
 		}
 		if (isBad) m_NumTimesRejected++; else m_NumTimesTaken++;
+		m_IsProfilesUpdated = true;
 		return isBad;
 	}
 
 	std::shared_ptr<RouterProfile> GetRouterProfile (const IdentHash& identHash)
 	{
-		auto profile = std::make_shared<RouterProfile> ();
-		profile->Load (identHash); // if possible
+		std::unique_lock<std::mutex> l(m_ProfilesMutex);
+		auto& profile = m_Profiles[identHash];
+		if (!profile)
+			profile = std::make_shared<RouterProfile> ();
 		return profile;
 	}
 
+	static void LoadProfiles (const std::string& path)
+	{
+		std::ifstream f (path, std::ifstream::binary);
+		if (!f.is_open ()) return;
+		std::vector<uint8_t> buf ((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+		// magic (8), number of profiles (4), profiles, adler32 (4)
+		const size_t recordSize = 32 + PEER_PROFILE_BUFFER_SIZE;
+		if (buf.size () < 16 || memcmp (buf.data (), PEER_PROFILES_MAGIC, 8) ||
+			buf.size () != 16 + bufbe32toh (buf.data () + 8)*recordSize ||
+			adler32 (adler32 (0, Z_NULL, 0), buf.data (), buf.size () - 4) != bufbe32toh (buf.data () + buf.size () - 4))
+		{
+			LogPrint (eLogError, "Profiling: ", path, " is malformed");
+			return;
+		}
+		auto ts = i2p::util::GetSecondsSinceEpoch ();
+		std::unique_lock<std::mutex> l(m_ProfilesMutex);
+		for (const uint8_t * record = buf.data () + 12; record < buf.data () + buf.size () - 4; record += recordSize)
+		{
+			auto profile = std::make_shared<RouterProfile> ();
+			profile->FromBuffer (record + 32);
+			if (!profile->IsExpired (ts))
+				m_Profiles[IdentHash (record)] = profile;
+		}
+	}
+
 	void InitProfilesStorage ()
 	{
 		m_ProfilesStorage.SetPlace(i2p::fs::GetDataDir());
-		m_ProfilesStorage.Init(i2p::data::GetBase64SubstitutionTable(), 64);
+		{
+			std::unique_lock<std::mutex> l(m_ProfilesMutex);
+			m_Profiles.clear ();
+		}
+		LoadProfiles (i2p::fs::DataDirPath (PEER_PROFILES_FILE));
+		// import profile files
+		std::vector<std::string> files;
+		if (i2p::fs::Exists (m_ProfilesStorage.GetRoot ()))
+			m_ProfilesStorage.Traverse(files);
+		if (!files.empty ())
+		{
+			size_t numImported = 0;
+			for (const auto& path: files)
+			{
+				// profile-<ident>.txt
+				auto name = path.substr (path.rfind ("profile-") + 8);
+				name.resize (name.length () - 4);
+				IdentHash ident;
+				auto profile = std::make_shared<RouterProfile> ();
+				if (Base64ToByteStream (name.c_str (), name.length (), ident, 32) == 32 && profile->LoadIni (path))
+				{
+					std::unique_lock<std::mutex> l(m_ProfilesMutex);
+					auto& p = m_Profiles[ident];
+					if (!p || p->GetLastUpdateTime () < profile->GetLastUpdateTime ())
+					{
+						p = profile;
+						numImported++;
+					}
+				}
+			}
+			m_IsProfilesUpdated = true;
+			SaveProfiles ();
+			if (!m_IsProfilesUpdated) // saved
+				for (const auto& path: files)
+					i2p::fs::Remove (path);
+			LogPrint (eLogInfo, "Profiling: ", numImported, " of ", files.size (), " profile files imported");
+		}
+		LogPrint (eLogInfo, "Profiling: ", GetNumProfiles (), " profiles loaded");
 	}
 
-	void DeleteObsoleteProfiles ()
+	void SaveProfiles ()
 	{
-		struct stat st;
-		std::time_t now = std::time(nullptr);
-
-		std::vector<std::string> files;
-		m_ProfilesStorage.Traverse(files);
-		for (const auto& path: files) {
-			if (stat(path.c_str(), &st) != 0) {
-				LogPrint(eLogWarning, "Profiling: Can't stat(): ", path);
-				continue;
+		if (!m_IsProfilesUpdated.exchange (false)) return;
+		const size_t recordSize = 32 + PEER_PROFILE_BUFFER_SIZE;
+		std::vector<uint8_t> buf;
+		{
+			std::unique_lock<std::mutex> l(m_ProfilesMutex);
+			buf.resize (16 + m_Profiles.size ()*recordSize);
+			uint8_t * record = buf.data () + 12;
+			for (const auto& it: m_Profiles)
+			{
+				memcpy (record, it.first, 32);
+				it.second->ToBuffer (record + 32);
+				record += recordSize;
+			}
+			htobe32buf (buf.data () + 8, m_Profiles.size ());
+		}
+		memcpy (buf.data (), PEER_PROFILES_MAGIC, 8);
+		htobe32buf (buf.data () + buf.size () - 4, adler32 (adler32 (0, Z_NULL, 0), buf.data (), buf.size () - 4));
+		// write to temporary file first, the previous one is still valid if we fail
+		auto path = i2p::fs::DataDirPath (PEER_PROFILES_FILE);
+		auto tmp = path + ".tmp";
+		{
+			std::ofstream f (tmp, std::ofstream::binary | std::ofstream::trunc);
+			f.write ((const char *)buf.data (), buf.size ());
+			if (!f.good ())
+			{
+				LogPrint (eLogError, "Profiling: Can't write ", tmp);
+				m_IsProfilesUpdated = true; // try next time
+				return;
+			}
+		}
+		if (std::rename (tmp.c_str (), path.c_str ()))
+		{
+			// Windows can't rename to existing file
+			i2p::fs::Remove (path);
+			if (std::rename (tmp.c_str (), path.c_str ()))
+			{
+				LogPrint (eLogError, "Profiling: Can't rename ", tmp, " to ", path);
+				m_IsProfilesUpdated = true;
 			}
-			if (((now - st.st_mtime) / 3600) >= PEER_PROFILE_EXPIRATION_TIMEOUT) {
-				LogPrint(eLogDebug, "Profiling: removing expired peer profile: ", path);
-				i2p::fs::Remove(path);
+		}
+	}
+
+	void DeleteObsoleteProfiles ()
+	{
+		auto ts = i2p::util::GetSecondsSinceEpoch ();
+		size_t numDeleted = 0;
+		{
+			std::unique_lock<std::mutex> l(m_ProfilesMutex);
+			for (auto it = m_Profiles.begin (); it != m_Profiles.end ();)
+			{
+				if (it->second->IsExpired (ts) && it->second.use_count () == 1) // not used by RouterInfo
+				{
+					it = m_Profiles.erase (it);
+					numDeleted++;
+				}
+				else
+					++it;
 			}
 		}
+		if (numDeleted)
+		{
+			LogPrint(eLogDebug, "Profiling: ", numDeleted, " expired peer profiles removed");
+			m_IsProfilesUpdated = true;
+		}
+	}
+
+	size_t GetNumProfiles ()
+	{
+		std::unique_lock<std::mutex> l(m_ProfilesMutex);
+		return m_Profiles.size ();
 	}
 }
 }
@@ -2,7 +2,8 @@
 #define PROFILING_H__
 
 #include <memory>
-#include <boost/date_time/posix_time/posix_time.hpp>
+#include <string>
+#include <mutex>
 #include "Identity.h"
 
 namespace i2p
@@ -21,16 +22,23 @@ namespace data
 	const char PEER_PROFILE_USAGE_REJECTED[] = "rejected";
 
 	const int PEER_PROFILE_EXPIRATION_TIMEOUT = 72; // in hours (3 days)
+	const int PEER_PROFILE_DECAY_INTERVAL = 24; // in hours, counters are halved
+	const char PEER_PROFILES_FILE[] = "peerProfiles.dat";
+	const char PEER_PROFILES_MAGIC[8] = { 'i', '2', 'p', 'd', 'P', 'R', 'F', '1' };
+	const size_t PEER_PROFILE_BUFFER_SIZE = 36; // last update and decay times (8 each), 5 counters (4 each)
 
 	class RouterProfile
 	{
 		public:
 
 			RouterProfile ();
-			RouterProfile& operator= (const RouterProfile& ) = default;
 
-			void Save (const IdentHash& identHash);
-			void Load (const IdentHash& identHash);
+			bool LoadIni (const std::string& path); // import profile-*.txt of former versions
+			void ToBuffer (uint8_t * buf) const; // counters only, without ident
+			void FromBuffer (const uint8_t * buf);
+
+			uint64_t GetLastUpdateTime () const;
+			bool IsExpired (uint64_t ts) const;
 
 			bool IsBad ();
 
@@ -39,8 +47,8 @@ namespace data
 
 		private:
 
-			boost::posix_time::ptime GetTime () const;
 			void UpdateTime ();
+			void Decay (); // halve counters for every PEER_PROFILE_DECAY_INTERVAL passed
 
 			bool IsAlwaysDeclining () const { return !m_NumTunnelsAgreed && m_NumTunnelsDeclined >= 5; };
 			bool IsLowPartcipationRate () const;
@@ -48,7 +56,8 @@ namespace data
 
 		private:
 
-			boost::posix_time::ptime m_LastUpdateTime;
+			mutable std::mutex m_Mutex; // profile is shared by tunnels, transports and NetDb threads
+			uint64_t m_LastUpdateTime, m_LastDecayTime; // seconds since epoch
 			// participation
 			uint32_t m_NumTunnelsAgreed;
 			uint32_t m_NumTunnelsDeclined;
@@ -58,9 +67,11 @@ namespace data
 			uint32_t m_NumTimesRejected;
 	};
 
-	std::shared_ptr<RouterProfile> GetRouterProfile (const IdentHash& identHash);
-	void InitProfilesStorage ();
+	std::shared_ptr<RouterProfile> GetRouterProfile (const IdentHash& identHash); // from memory, created if not found
+	void InitProfilesStorage (); // load all profiles, import profile files of former versions
+	void SaveProfiles (); // write all profiles to disk if updated
 	void DeleteObsoleteProfiles ();
+	size_t GetNumProfiles ();
 }
 }
 
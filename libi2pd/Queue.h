@@ -1,6 +1,7 @@
 #ifndef QUEUE_H__
 #define QUEUE_H__
 
+#include <inttypes.h>
 #include <queue>
 #include <vector>
 #include <mutex>
@@ -8,6 +9,9 @@
 #include <condition_variable>
 #include <functional>
 #include <utility>
+#include <atomic>
+#include <memory>
+#include <chrono>
 
 namespace i2p
 {
@@ -119,6 +123,177 @@ namespace util
 			std::mutex m_QueueMutex;
 			std::condition_variable m_NonEmpty;
 	};
+
+	const size_t MPSC_QUEUE_DEFAULT_CAPACITY = 16384; // elements, rounded up to power of 2, at least 2
+
+	/** bounded lock-free multi-producer single-consumer queue, same interface as Queue
+	 * Put never blocks and drops the element if queue is full
+	 * producers take the mutex only to wake up consumer parked in GetNext* */
+	template<typename Element>
+	class MPSCQueue
+	{
+		struct Cell
+		{
+			std::atomic<size_t> seqn;
+			Element el;
+		};
+
+		public:
+
+			MPSCQueue (size_t capacity = MPSC_QUEUE_DEFAULT_CAPACITY):
+				m_Capacity (2), m_IsWaiting (false), m_EnqueuePos (0), m_IsWokenUp (false), m_DequeuePos (0), m_NumDropped (0)
+			{
+				// at least 2, otherwise full cell's seqn matches next enqueue position
+				while (m_Capacity < capacity) m_Capacity <<= 1;
+				m_Cells.reset (new Cell[m_Capacity]);
+				for (size_t i = 0; i < m_Capacity; i++)
+					m_Cells[i].seqn.store (i, std::memory_order_relaxed);
+			}
+
+			bool Put (Element e)
+			{
+				bool ret = Push (std::move (e));
+				NotifyConsumer ();
+				return ret;
+			}
+
+			template<template<typename, typename...>class Container, typename... R>
+			bool Put (const Container<Element, R...>& vec)
+			{
+				if (vec.empty ()) return true;
+				bool ret = true;
+				for (const auto& it: vec)
+					if (!Push (it)) ret = false;
+				NotifyConsumer ();
+				return ret;
+			}
+
+			Element GetNext ()
+			{
+				auto el = Get ();
+				if (!el)
+				{
+					std::unique_lock<std::mutex> l(m_WaitMutex);
+					if (!Park ())
+						m_NonEmpty.wait (l);
+					m_IsWaiting.store (false, std::memory_order_relaxed);
+					el = Get ();
+				}
+				return el;
+			}
+
+			Element GetNextWithTimeout (int msec)
+			{
+				auto el = Get ();
+				if (!el)
+				{
+					std::unique_lock<std::mutex> l(m_WaitMutex);
+					if (!Park ())
+						m_NonEmpty.wait_for (l, std::chrono::milliseconds (msec));
+					m_IsWaiting.store (false, std::memory_order_relaxed);
+					el = Get ();
+				}
+				return el;
+			}
+
+			bool IsEmpty () const { return !GetSize (); };
+			int GetSize () const
+			{
+				size_t enqueuePos = m_EnqueuePos.load (std::memory_order_relaxed),
+					dequeuePos = m_DequeuePos.load (std::memory_order_relaxed);
+				return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+			}
+			size_t GetCapacity () const { return m_Capacity; };
+			uint64_t GetNumDropped () const { return m_NumDropped; };
+
+			void WakeUp ()
+			{
+				std::unique_lock<std::mutex> l(m_WaitMutex);
+				m_IsWokenUp = true; // not lost if consumer is not waiting yet
+				m_NonEmpty.notify_all ();
+			}
+
+			// must be called from consumer's thread only
+			Element Get ()
+			{
+				size_t pos = m_DequeuePos.load (std::memory_order_relaxed);
+				Cell& cell = m_Cells[pos & (m_Capacity - 1)];
+				if (cell.seqn.load (std::memory_order_acquire) != pos + 1) return Element ();
+				Element el = std::move (cell.el);
+				cell.el = Element ();
+				cell.seqn.store (pos + m_Capacity, std::memory_order_release);
+				m_DequeuePos.store (pos + 1, std::memory_order_relaxed);
+				return el;
+			}
+
+		private:
+
+			bool Push (Element e)
+			{
+				size_t pos = m_EnqueuePos.load (std::memory_order_relaxed);
+				Cell * cell;
+				for (;;)
+				{
+					cell = &m_Cells[pos & (m_Capacity - 1)];
+					size_t seqn = cell->seqn.load (std::memory_order_acquire);
+					intptr_t diff = (intptr_t)seqn - (intptr_t)pos;
+					if (!diff)
+					{
+						if (m_EnqueuePos.compare_exchange_weak (pos, pos + 1, std::memory_order_relaxed))
+							break;
+					}
+					else if (diff < 0)
+					{
+						m_NumDropped++; // full
+						return false;
+					}
+					else
+						pos = m_EnqueuePos.load (std::memory_order_relaxed);
+				}
+				cell->el = std::move (e);
+				cell->seqn.store (pos + 1, std::memory_order_release);
+				return true;
+			}
+
+			void NotifyConsumer ()
+			{
+				std::atomic_thread_fence (std::memory_order_seq_cst); // pairs with fence in Park
+				if (m_IsWaiting.load (std::memory_order_relaxed))
+				{
+					std::unique_lock<std::mutex> l(m_WaitMutex);
+					m_NonEmpty.notify_one ();
+				}
+			}
+
+			bool Park ()
+			{
+				// called with m_WaitMutex locked, returns true if something arrived or woken up meanwhile
+				if (m_IsWokenUp)
+				{
+					m_IsWokenUp = false;
+					return true;
+				}
+				m_IsWaiting.store (true, std::memory_order_relaxed);
+				std::atomic_thread_fence (std::memory_order_seq_cst);
+				size_t pos = m_DequeuePos.load (std::memory_order_relaxed);
+				return m_Cells[pos & (m_Capacity - 1)].seqn.load (std::memory_order_acquire) == pos + 1;
+			}
+
+		private:
+
+			std::unique_ptr<Cell[]> m_Cells;
+			size_t m_Capacity;
+			std::atomic<bool> m_IsWaiting;
+			std::atomic<size_t> m_EnqueuePos;
+			// keep producers' and consumer's positions on different cache lines,
+			// padding rather than alignas(64) since queues are allocated by new and C++11 doesn't align it
+			char m_EnqueuePosPadding[64];
+			std::mutex m_WaitMutex;
+			std::condition_variable m_NonEmpty;
+			bool m_IsWokenUp; // guarded by m_WaitMutex
+			std::atomic<size_t> m_DequeuePos;
+			std::atomic<uint64_t> m_NumDropped;
+	};
 }
 }
 
@@ -0,0 +1,119 @@
+#ifndef RANDOM_INDEX_H__
+#define RANDOM_INDEX_H__
+
+#include <stdlib.h>
+#include <map>
+#include <vector>
+#include <utility>
+
+namespace i2p
+{
+namespace data
+{
+	/** Set of key-value pairs with O(1) uniform random access.
+	 * Values are kept in a vector, erase swaps the last element into the hole */
+	template<typename Key, typename Value>
+	class RandomIndex
+	{
+		public:
+
+			bool Insert (const Key& key, const Value& value)
+			{
+				if (!m_Positions.emplace (key, m_Elements.size ()).second) return false;
+				m_Elements.emplace_back (key, value);
+				return true;
+			}
+
+			bool Erase (const Key& key)
+			{
+				auto it = m_Positions.find (key);
+				if (it == m_Positions.end ()) return false;
+				size_t pos = it->second;
+				m_Positions.erase (it);
+				if (pos + 1 < m_Elements.size ())
+				{
+					m_Elements[pos] = std::move (m_Elements.back ());
+					m_Positions[m_Elements[pos].first] = pos;
+				}
+				m_Elements.pop_back ();
+				return true;
+			}
+
+			void Clear () { m_Elements.clear (); m_Positions.clear (); };
+			size_t GetSize () const { return m_Elements.size (); };
+			bool IsEmpty () const { return m_Elements.empty (); };
+			bool Contains (const Key& key) const { return m_Positions.count (key) > 0; };
+			const Value& operator[] (size_t i) const { return m_Elements[i].second; };
+
+			/** uniformly random value accepted by filter, Value () if nothing accepted */
+			template<typename Filter>
+			Value GetRandom (Filter filter) const
+			{
+				Value res = Value ();
+				VisitRandom (filter, [&res](const Value& value) { res = value; }, 1);
+				return res;
+			}
+
+			/** visit up to n distinct values accepted by filter in uniformly random order,
+			 * returns number of visited */
+			template<typename Filter, typename Visitor>
+			size_t VisitRandom (Filter filter, Visitor visitor, size_t n) const
+			{
+				size_t visited = 0;
+				RandomPositions positions (m_Elements.size ());
+				while (visited < n && !positions.IsEnd ())
+				{
+					const auto& value = m_Elements[positions.Next ()].second;
+					if (filter (value))
+					{
+						visitor (value);
+						visited++;
+					}
+				}
+				return visited;
+			}
+
+		private:
+
+			/** partial Fisher-Yates shuffle of positions 0..size-1, only swapped
+			 * positions are stored, the last swap only when next is drawn */
+			class RandomPositions
+			{
+				public:
+
+					RandomPositions (size_t size): m_Size (size), m_NumDrawn (0), m_LastDrawn (0) {};
+					bool IsEnd () const { return m_NumDrawn >= m_Size; };
+					size_t Next ()
+					{
+						if (m_NumDrawn > 0)
+						{
+							size_t last = m_NumDrawn - 1;
+							if (m_LastDrawn != last) m_Swapped[m_LastDrawn] = Get (last);
+							m_Swapped.erase (last); // never drawn again
+						}
+						m_LastDrawn = m_NumDrawn + rand () % (m_Size - m_NumDrawn);
+						m_NumDrawn++;
+						return Get (m_LastDrawn);
+					}
+
+				private:
+
+					size_t Get (size_t i) const
+					{
+						auto it = m_Swapped.find (i);
+						return it != m_Swapped.end () ? it->second : i;
+					}
+
+				private:
+
+					size_t m_Size, m_NumDrawn, m_LastDrawn;
+					std::map<size_t, size_t> m_Swapped;
+			};
+
+			std::vector<std::pair<Key, Value> > m_Elements;
+			std::map<Key, size_t> m_Positions; // in m_Elements
+	};
+}
+}
+
+#endif
@@ -4,6 +4,7 @@
 #include <fstream>
 #include <boost/lexical_cast.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/algorithm/string.hpp>
 #if (BOOST_VERSION >= 105300)
 #include <boost/atomic.hpp>
 #endif
@@ -30,18 +31,18 @@ namespace data
 		m_SupportedTransports (0), m_Caps (0)
 	{
 		m_Addresses = boost::make_shared<Addresses>(); // create empty list
-		m_Buffer = new uint8_t[MAX_RI_BUFFER_SIZE];
+		m_Buffer = nullptr;
 		ReadFromFile ();
 	}
 
-	RouterInfo::RouterInfo (const uint8_t * buf, int len):
+	RouterInfo::RouterInfo (const uint8_t * buf, int len, bool verifySignature):
 		m_IsUpdated (true), m_IsUnreachable (false), m_SupportedTransports (0), m_Caps (0)
 	{
 		m_Addresses = boost::make_shared<Addresses>(); // create empty list
-		m_Buffer = new uint8_t[MAX_RI_BUFFER_SIZE];
+		m_Buffer = nullptr;
+		AllocateBuffer (len);
 		memcpy (m_Buffer, buf, len);
-		m_BufferLen = len;
-		ReadFromBuffer (true);
+		ReadFromBuffer (verifySignature);
 	}
 
 	RouterInfo::~RouterInfo ()
@@ -63,15 +64,17 @@ namespace data
 			// don't clean up m_Addresses, it will be replaced in ReadFromStream
 			m_Properties.clear ();
 			// copy buffer
-			if (!m_Buffer)
-				m_Buffer = new uint8_t[MAX_RI_BUFFER_SIZE];
+			AllocateBuffer (len);
 			memcpy (m_Buffer, buf, len);
-			m_BufferLen = len;
 			// skip identity
 			size_t identityLen = m_RouterIdentity->GetFullLen ();
 			// read new RI
-			std::stringstream str (std::string ((char *)m_Buffer + identityLen, m_BufferLen - identityLen));
-			ReadFromStream (str);
+			if (!ReadFromBuffer (m_Buffer + identityLen, m_BufferLen - identityLen))
+			{
+				LogPrint (eLogError, "RouterInfo: malformed message");
+				m_IsUnreachable = true;
+			}
+			m_RouterIdentity->DropVerifier ();
 			// don't delete buffer until saved to the file
 		}
 		else
@@ -81,6 +84,17 @@ namespace data
 		}
 	}
 
+	void RouterInfo::AllocateBuffer (size_t len)
+	{
+		// exact size, most of RIs are much shorter than MAX_RI_BUFFER_SIZE
+		if (!m_Buffer || len != m_BufferLen)
+		{
+			delete[] m_Buffer;
+			m_Buffer = new uint8_t[len];
+		}
+		m_BufferLen = len;
+	}
+
 	void RouterInfo::SetRouterIdentity (std::shared_ptr<const IdentityEx> identity)
 	{
 		m_RouterIdentity = identity;
@@ -93,15 +107,14 @@ namespace data
 		if (s.is_open ())
 		{
 			s.seekg (0,std::ios::end);
-			m_BufferLen = s.tellg ();
-			if (m_BufferLen < 40 || m_BufferLen > MAX_RI_BUFFER_SIZE)
+			size_t len = s.tellg ();
+			if (len < 40 || len > MAX_RI_BUFFER_SIZE)
 			{
 				LogPrint(eLogError, "RouterInfo: File", m_FullPath, " is malformed");
 				return false;
 			}
 			s.seekg(0, std::ios::beg);
-			if (!m_Buffer)
-				m_Buffer = new uint8_t[MAX_RI_BUFFER_SIZE];
+			AllocateBuffer (len);
 			s.read((char *)m_Buffer, m_BufferLen);
 		}
 		else
@@ -120,6 +133,28 @@ namespace data
 			m_IsUnreachable = true;
 	}
 
+	void RouterInfo::VerifySignatures (const std::vector<std::shared_ptr<RouterInfo> >& routers)
+	{
+		for (auto& r: routers)
+		{
+			if (r->m_IsUnreachable || !r->m_Buffer || !r->m_RouterIdentity) continue;
+			// reject RSA signatures
+			if (r->m_RouterIdentity->IsRSA ())
+			{
+				LogPrint (eLogError, "RouterInfo: RSA signature type is not allowed");
+				r->m_IsUnreachable = true;
+				continue;
+			}
+			int l = r->m_BufferLen - r->m_RouterIdentity->GetSignatureLen ();
+			if (l < 0 || !r->m_RouterIdentity->Verify (r->m_Buffer, l, r->m_Buffer + l))
+			{
+				LogPrint (eLogError, "RouterInfo: signature verification failed");
+				r->m_IsUnreachable = true;
+			}
+			r->m_RouterIdentity->DropVerifier ();
+		}
+	}
+
 	void RouterInfo::ReadFromBuffer (bool verifySignature)
 	{
 		m_RouterIdentity = std::make_shared<IdentityEx>(m_Buffer, m_BufferLen);
@@ -150,41 +185,111 @@ namespace data
 			m_RouterIdentity->DropVerifier ();
 		}
 		// parse RI
-		std::stringstream str;
-		str.write ((const char *)m_Buffer + identityLen, m_BufferLen - identityLen);
-		ReadFromStream (str);
-		if (!str)
+		if (!ReadFromBuffer (m_Buffer + identityLen, m_BufferLen - identityLen))
 		{
 			LogPrint (eLogError, "RouterInfo: malformed message");
 			m_IsUnreachable = true;
 		}
+	}
+
+	static bool ReadString (const uint8_t *& p, const uint8_t * end, const char *& str, size_t& len)
+	{
+		// length byte followed by chars, no copy
+		if (p >= end) return false;
+		len = *p++;
+		if ((size_t)(end - p) < len) return false;
+		str = (const char *)p;
+		p += len;
+		return true;
+	}
+
+	static bool ReadProperty (const uint8_t *& p, const uint8_t * end, const char *& key, size_t& keyLen,
+		const char *& value, size_t& valueLen)
+	{
+		// key=value;
+		if (!ReadString (p, end, key, keyLen) || p >= end) return false;
+		p++; // =
+		if (!ReadString (p, end, value, valueLen) || p >= end) return false;
+		p++; // ;
+		return true;
+	}
 
+	static bool IsKey (const char * key, size_t keyLen, const char * s)
+	{
+		return keyLen == strlen (s) && !memcmp (key, s, keyLen);
 	}
 
-	void RouterInfo::ReadFromStream (std::istream& s)
+	static bool ParseNumber (const char * s, size_t len, uint32_t& n)
 	{
-		s.read ((char *)&m_Timestamp, sizeof (m_Timestamp));
-		m_Timestamp = be64toh (m_Timestamp);
+		if (!len || len > 10) return false;
+		uint64_t v = 0;
+		for (size_t i = 0; i < len; i++)
+		{
+			if (s[i] < '0' || s[i] > '9') return false;
+			v = v*10 + (s[i] - '0');
+		}
+		if (v > 0xFFFFFFFF) return false;
+		n = v;
+		return true;
+	}
+
+	static bool ParseHost (const char * s, size_t len, boost::asio::ip::address& host)
+	{
+		// canonical IPv4 without string copy, anything else by boost
+		boost::asio::ip::address_v4::bytes_type bytes;
+		size_t i = 0;
+		for (int n = 0; n < 4; n++)
+		{
+			if (n)
+			{
+				if (i >= len || s[i] != '.') break;
+				i++;
+			}
+			size_t start = i;
+			unsigned int v = 0;
+			while (i < len && i - start < 4 && s[i] >= '0' && s[i] <= '9')
+				v = v*10 + (s[i++] - '0');
+			if (i == start || i - start > 3 || v > 255 || (s[start] == '0' && i - start > 1)) break;
+			bytes[n] = v;
+			if (n == 3 && i == len)
+			{
+				host = boost::asio::ip::address_v4 (bytes);
+				return true;
+			}
+		}
+		boost::system::error_code ecode;
+		host = boost::asio::ip::address::from_string (std::string (s, len), ecode);
+		return !ecode;
+	}
+
+	bool RouterInfo::ReadFromBuffer (const uint8_t * buf, size_t len)
+	{
+		const uint8_t * p = buf, * end = buf + len;
+		const char * key, * value;
+		size_t keyLen, valueLen;
+		char str[256]; // null terminated value if needed
+		if (len < 9) return false;
+		m_Timestamp = bufbe64toh (p); p += 8;
 		// read addresses
 		auto addresses = boost::make_shared<Addresses>();
-		uint8_t numAddresses;
-		s.read ((char *)&numAddresses, sizeof (numAddresses)); if (!s) return;
+		uint8_t numAddresses = *p++;
 		bool introducers = false;
 		for (int i = 0; i < numAddresses; i++)
 		{
 			uint8_t supportedTransports = 0;
 			auto address = std::make_shared<Address>();
-			s.read ((char *)&address->cost, sizeof (address->cost));
-			s.read ((char *)&address->date, sizeof (address->date));
+			if (end - p < 9) return false;
+			address->cost = *p++;
+			memcpy (&address->date, p, 8); p += 8;
 			bool isNTCP2Only = false;
-			char transportStyle[6]; 
-			auto transportStyleLen = ReadString (transportStyle, 6, s) - 1;
-			if (!strncmp (transportStyle, "NTCP", 4)) // NTCP or NTCP2
+			const char * transportStyle; size_t transportStyleLen;
+			if (!ReadString (p, end, transportStyle, transportStyleLen)) return false;
+			if (transportStyleLen >= 4 && transportStyleLen < 6 && !memcmp (transportStyle, "NTCP", 4)) // NTCP or NTCP2
 			{
 				address->transportStyle = eTransportNTCP;
 				if (transportStyleLen > 4 && transportStyle[4] == '2') isNTCP2Only= true;
 			}
-			else if (!strcmp (transportStyle, "SSU"))
+			else if (IsKey (transportStyle, transportStyleLen, "SSU"))
 			{
 				address->transportStyle = eTransportSSU;
 				address->ssu.reset (new SSUExt ());
@@ -193,33 +298,19 @@ namespace data
 			else
 				address->transportStyle = eTransportUnknown;
 			address->port = 0;
-			uint16_t size, r = 0;
-			s.read ((char *)&size, sizeof (size)); if (!s) return;
-			size = be16toh (size);
-			while (r < size)
-			{
-				char key[255], value[255];
-				r += ReadString (key, 255, s);
-				s.seekg (1, std::ios_base::cur); r++; // =
-				r += ReadString (value, 255, s);
-				s.seekg (1, std::ios_base::cur); r++; // ;
-				if (!s) return;
-				if (!strcmp (key, "host"))
+			if (end - p < 2) return false;
+			size_t size = bufbe16toh (p); p += 2;
+			if ((size_t)(end - p) < size) return false;
+			const uint8_t * propertiesEnd = p + size;
+			while (p < propertiesEnd)
+			{
+				if (!ReadProperty (p, propertiesEnd, key, keyLen, value, valueLen)) return false;
+				if (IsKey (key, keyLen, "host"))
 				{
-					boost::system::error_code ecode;
-					address->host = boost::asio::ip::address::from_string (value, ecode);
-					if (ecode)
+					if (!ParseHost (value, valueLen, address->host))
 					{
-						if (address->transportStyle == eTransportNTCP)
-						{
-							supportedTransports |= eNTCPV4; // TODO:
-							address->addressString = value;
-						}
-						else
-						{
-							supportedTransports |= eSSUV4; // TODO:
-							address->addressString = value;
-						}
+						supportedTransports |= (address->transportStyle == eTransportNTCP) ? eNTCPV4 : eSSUV4; // TODO:
+						address->addressString = std::string (value, valueLen);
 					}
 					else
 					{
@@ -230,71 +321,91 @@ namespace data
 							supportedTransports |= (address->transportStyle == eTransportNTCP) ? eNTCPV6 : eSSUV6;
 					}
 				}
-				else if (!strcmp (key, "port"))
-					address->port = boost::lexical_cast<int>(value);
-				else if (!strcmp (key, "mtu"))
+				else if (IsKey (key, keyLen, "port"))
 				{
+					uint32_t port;
+					if (!ParseNumber (value, valueLen, port)) return false;
+					address->port = port;
+				}
+				else if (IsKey (key, keyLen, "mtu"))
+				{
+					uint32_t mtu;
+					if (!ParseNumber (value, valueLen, mtu)) return false;
 					if (address->ssu)
-						address->ssu->mtu = boost::lexical_cast<int>(value);
+						address->ssu->mtu = mtu;
 					else
 						LogPrint (eLogWarning, "RouterInfo: Unexpected field 'mtu' for NTCP");
 				}
-				else if (!strcmp (key, "key"))
+				else if (IsKey (key, keyLen, "key"))
 				{
 					if (address->ssu)
-						Base64ToByteStream (value, strlen (value), address->ssu->key, 32);
+						Base64ToByteStream (value, valueLen, address->ssu->key, 32);
 					else
 						LogPrint (eLogWarning, "RouterInfo: Unexpected field 'key' for NTCP");
 				}
-				else if (!strcmp (key, "caps"))
-					ExtractCaps (value);
-				else if (!strcmp (key, "s")) // ntcp2 static key
+				else if (IsKey (key, keyLen, "caps"))
+				{
+					memcpy (str, value, valueLen); str[valueLen] = 0;
+					ExtractCaps (str);
+				}
+				else if (IsKey (key, keyLen, "s")) // ntcp2 static key
 				{
 					if (!address->ntcp2) address->ntcp2.reset (new NTCP2Ext ());
 					supportedTransports |= (address->host.is_v4 ()) ? eNTCP2V4 : eNTCP2V6;
-					Base64ToByteStream (value, strlen (value), address->ntcp2->staticKey, 32);	
-				}	
-				else if (!strcmp (key, "i")) // ntcp2 iv
+					Base64ToByteStream (value, valueLen, address->ntcp2->staticKey, 32);
+				}
+				else if (IsKey (key, keyLen, "i")) // ntcp2 iv
 				{
 					if (!address->ntcp2) address->ntcp2.reset (new NTCP2Ext ());
 					supportedTransports |= (address->host.is_v4 ()) ? eNTCP2V4 : eNTCP2V6;
-					Base64ToByteStream (value, strlen (value), address->ntcp2->iv, 16);	
+					Base64ToByteStream (value, valueLen, address->ntcp2->iv, 16);
 					address->ntcp2->isPublished = true; // presence if "i" means "published"
-				}	
-				else if (key[0] == 'i')
+				}
+				else if (keyLen > 0 && key[0] == 'i')
 				{
 					// introducers
 					introducers = true;
-					size_t l = strlen(key);
-					unsigned char index = key[l-1] - '0'; // TODO:
-					key[l-1] = 0;
+					unsigned char index = key[keyLen - 1] - '0'; // TODO:
+					keyLen--;
 					if (index > 9)
 					{
 						LogPrint (eLogError, "RouterInfo: Unexpected introducer's index ", index, " skipped");
-						if (s) continue; else return;
+						continue;
+					}
+					if (!address->ssu)
+					{
+						LogPrint (eLogWarning, "RouterInfo: Unexpected introducer for NTCP");
+						continue;
 					}
 					if (index >= address->ssu->introducers.size ())
 						address->ssu->introducers.resize (index + 1);
 					Introducer& introducer = address->ssu->introducers.at (index);
-					if (!strcmp (key, "ihost"))
+					if (IsKey (key, keyLen, "ihost"))
+					{
+						if (!ParseHost (value, valueLen, introducer.iHost))
+							introducer.iHost = boost::asio::ip::address ();
+					}
+					else if (IsKey (key, keyLen, "iport"))
+					{
+						uint32_t port;
+						if (!ParseNumber (value, valueLen, port)) return false;
+						introducer.iPort = port;
+					}
+					else if (IsKey (key, keyLen, "itag"))
+					{
+						if (!ParseNumber (value, valueLen, introducer.iTag)) return false;
+					}
+					else if (IsKey (key, keyLen, "ikey"))
+						Base64ToByteStream (value, valueLen, introducer.iKey, 32);
+					else if (IsKey (key, keyLen, "iexp"))
 					{
-						boost::system::error_code ecode;
-						introducer.iHost = boost::asio::ip::address::from_string (value, ecode);
+						if (!ParseNumber (value, valueLen, introducer.iExp)) return false;
 					}
-					else if (!strcmp (key, "iport"))
-						introducer.iPort = boost::lexical_cast<int>(value);
-					else if (!strcmp (key, "itag"))
-						introducer.iTag = boost::lexical_cast<uint32_t>(value);
-					else if (!strcmp (key, "ikey"))
-						Base64ToByteStream (value, strlen (value), introducer.iKey, 32);
-					else if (!strcmp (key, "iexp"))
-						introducer.iExp = boost::lexical_cast<uint32_t>(value);
 				}
-				if (!s) return;
 			}
 			if (introducers) supportedTransports |= eSSUV4; // in case if host is not presented
 			if (isNTCP2Only && address->ntcp2) address->ntcp2->isNTCP2Only = true;
-			if (supportedTransports) 
+			if (supportedTransports)
 			{
 				addresses->push_back(address);
 				m_SupportedTransports |= supportedTransports;
@@ -306,52 +417,49 @@ namespace data
 		m_Addresses = addresses; // race condition
 #endif
 		// read peers
-		uint8_t numPeers;
-		s.read ((char *)&numPeers, sizeof (numPeers)); if (!s) return;
-		s.seekg (numPeers*32, std::ios_base::cur); // TODO: read peers
+		if (p >= end) return false;
+		uint8_t numPeers = *p++;
+		if ((size_t)(end - p) < numPeers*32u) return false;
+		p += numPeers*32; // TODO: read peers
 		// read properties
-		uint16_t size, r = 0;
-		s.read ((char *)&size, sizeof (size)); if (!s) return;
-		size = be16toh (size);
-		while (r < size)
+		if (end - p < 2) return false;
+		size_t size = bufbe16toh (p); p += 2;
+		if ((size_t)(end - p) < size) return false;
+		end = p + size;
+		while (p < end)
 		{
-			char key[255], value[255];
-			r += ReadString (key, 255, s);
-			s.seekg (1, std::ios_base::cur); r++; // =
-			r += ReadString (value, 255, s);
-			s.seekg (1, std::ios_base::cur); r++; // ;
-			if (!s) return;
-			m_Properties[key] = value;
+			if (!ReadProperty (p, end, key, keyLen, value, valueLen)) return false;
+			m_Properties[std::string (key, keyLen)] = std::string (value, valueLen);
 
+			memcpy (str, value, valueLen); str[valueLen] = 0;
 			// extract caps
-			if (!strcmp (key, "caps"))
-				ExtractCaps (value);
+			if (IsKey (key, keyLen, "caps"))
+				ExtractCaps (str);
 			// check netId
-			else if (!strcmp (key, ROUTER_INFO_PROPERTY_NETID) && atoi (value) != i2p::context.GetNetID ())
+			else if (IsKey (key, keyLen, ROUTER_INFO_PROPERTY_NETID) && atoi (str) != i2p::context.GetNetID ())
 			{
-				LogPrint (eLogError, "RouterInfo: Unexpected ", ROUTER_INFO_PROPERTY_NETID, "=", value);
+				LogPrint (eLogError, "RouterInfo: Unexpected ", ROUTER_INFO_PROPERTY_NETID, "=", str);
 				m_IsUnreachable = true;
 			}
 			// family
-			else if (!strcmp (key, ROUTER_INFO_PROPERTY_FAMILY))
+			else if (IsKey (key, keyLen, ROUTER_INFO_PROPERTY_FAMILY))
 			{
-				m_Family = value;
+				m_Family = str;
 				boost::to_lower (m_Family);
 			}
-			else if (!strcmp (key, ROUTER_INFO_PROPERTY_FAMILY_SIG))
+			else if (IsKey (key, keyLen, ROUTER_INFO_PROPERTY_FAMILY_SIG))
 			{
-				if (!netdb.GetFamilies ().VerifyFamily (m_Family, GetIdentHash (), value))
+				if (!netdb.GetFamilies ().VerifyFamily (m_Family, GetIdentHash (), str))
 				{
 					LogPrint (eLogWarning, "RouterInfo: family signature verification failed");
 					m_Family.clear ();
 				}
 			}
-
-			if (!s) return;
 		}
 
 		if (!m_SupportedTransports || !m_Addresses->size() || (UsesIntroducer () && !introducers))
 			SetUnreachable (true);
+		return true;
 	}
 
   bool RouterInfo::IsFamily(const std::string & fam) const {
@@ -593,6 +701,29 @@ namespace data
 		return bufbe64toh (buf + size) > m_Timestamp;
 	}
 
+	size_t RouterInfo::GetMemoryUsage () const
+	{
+		size_t usage = sizeof (RouterInfo) + m_FullPath.capacity () + m_Family.capacity ();
+		if (m_Buffer) usage += m_BufferLen;
+		if (m_RouterIdentity) usage += sizeof (IdentityEx) + m_RouterIdentity->GetFullLen ();
+		auto addresses = m_Addresses; // might be replaced
+		if (addresses)
+		{
+			usage += sizeof (Addresses);
+			if (addresses->capacity () > 3) usage += addresses->capacity ()*sizeof (Addresses::value_type);
+			for (const auto& address: *addresses)
+			{
+				usage += sizeof (Address) + address->addressString.capacity ();
+				if (address->ssu)
+					usage += sizeof (SSUExt) + address->ssu->introducers.capacity ()*sizeof (Introducer);
+				if (address->ntcp2) usage += sizeof (NTCP2Ext);
+			}
+		}
+		for (const auto& it: m_Properties)
+			usage += sizeof (it) + it.first.capacity () + it.second.capacity ();
+		return usage;
+	}
+
 	const uint8_t * RouterInfo::LoadBuffer ()
 	{
 		if (!m_Buffer)
@@ -603,6 +734,12 @@ namespace data
 		return m_Buffer;
 	}
 
+	void RouterInfo::SetBuffer (const uint8_t * buf, size_t len)
+	{
+		AllocateBuffer (len);
+		memcpy (m_Buffer, buf, len);
+	}
+
 	void RouterInfo::CreateBuffer (const PrivateKeys& privateKeys)
 	{
 		m_Timestamp = i2p::util::GetMillisecondsSinceEpoch (); // refresh timstamp
@@ -611,13 +748,11 @@ namespace data
 		auto identLen = privateKeys.GetPublic ()->ToBuffer (ident, 1024);
 		s.write ((char *)ident, identLen);
 		WriteToStream (s);
-		m_BufferLen = s.str ().size ();
-		if (!m_Buffer)
-			m_Buffer = new uint8_t[MAX_RI_BUFFER_SIZE];
-		memcpy (m_Buffer, s.str ().c_str (), m_BufferLen);
+		size_t len = s.str ().size (), signatureLen = privateKeys.GetPublic ()->GetSignatureLen ();
+		AllocateBuffer (len + signatureLen);
+		memcpy (m_Buffer, s.str ().c_str (), len);
 		// signature
-		privateKeys.Sign ((uint8_t *)m_Buffer, m_BufferLen, (uint8_t *)m_Buffer + m_BufferLen);
-		m_BufferLen += privateKeys.GetPublic ()->GetSignatureLen ();
+		privateKeys.Sign ((uint8_t *)m_Buffer, len, (uint8_t *)m_Buffer + len);
 	}
 
 	bool RouterInfo::SaveToFile (const std::string& fullPath)
@@ -636,25 +771,6 @@ namespace data
 		return true;
 	}
 
-	size_t RouterInfo::ReadString (char * str, size_t len, std::istream& s) const
-	{
-		uint8_t l;
-		s.read ((char *)&l, 1);
-		if (l < len)
-		{
-			s.read (str, l);
-			if (!s) l = 0; // failed, return empty string
-			str[l] = 0;
-		}
-		else
-		{
-			LogPrint (eLogWarning, "RouterInfo: string length ", (int)l, " exceeds buffer size ", len);
-			s.seekg (l, std::ios::cur); // skip
-			str[0] = 0;
-		}
-		return l+1;
-	}
-
 	void RouterInfo::WriteString (const std::string& str, std::ostream& s) const
 	{
 		uint8_t len = str.size ();
@@ -673,7 +789,7 @@ namespace data
 		for (const auto& it: *m_Addresses) // don't insert same address twice
 			if (*it == *addr) return;
 		m_SupportedTransports |= addr->host.is_v6 () ? eNTCPV6 : eNTCPV4;
-		m_Addresses->push_front(std::move(addr)); // always make NTCP first
+		m_Addresses->insert (m_Addresses->begin (), std::move(addr)); // always make NTCP first
 	}
 
 	void RouterInfo::AddSSUAddress (const char * host, int port, const uint8_t * key, int mtu)
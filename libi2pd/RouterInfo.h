@@ -9,6 +9,10 @@
 #include <iostream>
 #include <boost/asio.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/version.hpp>
+#if (BOOST_VERSION >= 105800)
+#include <boost/container/small_vector.hpp>
+#endif
 #include "Identity.h"
 #include "Profiling.h"
 
@@ -129,13 +133,17 @@ namespace data
 				bool IsPublishedNTCP2 () const { return IsNTCP2 () && ntcp2->isPublished; };
 				bool IsNTCP2Only () const { return ntcp2 && ntcp2->isNTCP2Only; };
 			};
-			typedef std::list<std::shared_ptr<Address> > Addresses;
+#if (BOOST_VERSION >= 105800)
+			typedef boost::container::small_vector<std::shared_ptr<Address>, 3> Addresses; // usually NTCP, NTCP2 and SSU, no extra allocation
+#else
+			typedef std::vector<std::shared_ptr<Address> > Addresses;
+#endif
 
 			RouterInfo ();
 			RouterInfo (const std::string& fullPath);
 			RouterInfo (const RouterInfo& ) = default;
 			RouterInfo& operator=(const RouterInfo& ) = default;
-			RouterInfo (const uint8_t * buf, int len);
+			RouterInfo (const uint8_t * buf, int len, bool verifySignature = true);
 			~RouterInfo ();
 
 			std::shared_ptr<const IdentityEx> GetRouterIdentity () const { return m_RouterIdentity; };
@@ -185,19 +193,22 @@ namespace data
 
 			const uint8_t * GetBuffer () const { return m_Buffer; };
 			const uint8_t * LoadBuffer (); // load if necessary
+			void SetBuffer (const uint8_t * buf, size_t len); // loaded from elsewhere than m_FullPath
 			int GetBufferLen () const { return m_BufferLen; };
 			void CreateBuffer (const PrivateKeys& privateKeys);
 
 			bool IsUpdated () const { return m_IsUpdated; };
 			void SetUpdated (bool updated) { m_IsUpdated = updated; };
 			bool SaveToFile (const std::string& fullPath);
+			const std::string& GetFullPath () const { return m_FullPath; };
 
 			std::shared_ptr<RouterProfile> GetProfile () const;
-			void SaveProfile () { if (m_Profile) m_Profile->Save (GetIdentHash ()); };
 
 			void Update (const uint8_t * buf, int len);
 			void DeleteBuffer () { delete[] m_Buffer; m_Buffer = nullptr; };
 			bool IsNewer (const uint8_t * buf, size_t len) const;
+			size_t GetMemoryUsage () const; // approximate, in bytes
+			static void VerifySignatures (const std::vector<std::shared_ptr<RouterInfo> >& routers); // set unreachable if invalid
 
 		/** return true if we are in a router family and the signature is valid */
 		bool IsFamily(const std::string & fam) const;
@@ -211,11 +222,11 @@ namespace data
 		private:
 
 			bool LoadFile ();
+			void AllocateBuffer (size_t len); // sets m_BufferLen
 			void ReadFromFile ();
-			void ReadFromStream (std::istream& s);
+			bool ReadFromBuffer (const uint8_t * buf, size_t len); // after identity, false if malformed
 			void ReadFromBuffer (bool verifySignature);
 			void WriteToStream (std::ostream& s) const;
-			size_t ReadString (char* str, size_t len, std::istream& s) const;
 			void WriteString (const std::string& str, std::ostream& s) const;
 			void ExtractCaps (const char * value);
 			template<typename Filter>
@@ -0,0 +1,357 @@
+#include <string.h>
+#include <zlib.h>
+#include <boost/filesystem.hpp>
+#include "I2PEndian.h"
+#include "Log.h"
+#include "RouterInfoStore.h"
+
+namespace i2p
+{
+namespace data
+{
+	static uint32_t RecordChecksum (const uint8_t * header, const uint8_t * buf, size_t len)
+	{
+		// ident and length of header, data
+		auto checksum = adler32 (adler32 (0, Z_NULL, 0), header, 34);
+		return len ? adler32 (checksum, buf, len) : checksum; // adler32 resets for Z_NULL
+	}
+
+	RouterInfoStore::RouterInfoStore (const std::string& path):
+		m_Path (path), m_IndexPath (path + ".idx"), m_FileSize (0), m_LiveSize (0), m_MappedSize (0)
+	{
+	}
+
+	RouterInfoStore::~RouterInfoStore ()
+	{
+		Close ();
+	}
+
+	bool RouterInfoStore::Open ()
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (m_File.is_open ()) return true;
+		boost::system::error_code ec;
+		size_t fileSize = boost::filesystem::file_size (m_Path, ec);
+		if (ec || !fileSize)
+		{
+			// new store
+			std::ofstream f (m_Path, std::ofstream::binary | std::ofstream::trunc);
+			f.write (ROUTER_INFO_STORE_MAGIC, ROUTER_INFO_STORE_HEADER_SIZE);
+			if (!f.good ())
+			{
+				LogPrint (eLogError, "RouterInfoStore: Can't create ", m_Path);
+				return false;
+			}
+			fileSize = ROUTER_INFO_STORE_HEADER_SIZE;
+			boost::filesystem::remove (m_IndexPath, ec);
+		}
+		if (!Map () || m_MappedSize < ROUTER_INFO_STORE_HEADER_SIZE ||
+			memcmp (m_Region->get_address (), ROUTER_INFO_STORE_MAGIC, ROUTER_INFO_STORE_HEADER_SIZE))
+		{
+			LogPrint (eLogError, "RouterInfoStore: ", m_Path, " is malformed");
+			Unmap ();
+			return false;
+		}
+		if (!LoadIndex ())
+		{
+			m_Index.clear ();
+			m_FileSize = ROUTER_INFO_STORE_HEADER_SIZE;
+		}
+		size_t indexed = m_FileSize;
+		m_FileSize = Scan (m_FileSize);
+		if (m_FileSize < fileSize && indexed > ROUTER_INFO_STORE_HEADER_SIZE)
+		{
+			// index might not match data file, rebuild it from all records rather than truncate valid ones
+			LogPrint (eLogWarning, "RouterInfoStore: broken record after indexed part of ", m_Path, ", rescanning");
+			m_Index.clear ();
+			indexed = ROUTER_INFO_STORE_HEADER_SIZE;
+			m_FileSize = Scan (indexed);
+		}
+		if (m_FileSize < fileSize)
+		{
+			// incomplete record after crash
+			LogPrint (eLogWarning, "RouterInfoStore: ", fileSize - m_FileSize, " bytes of broken records truncated from ", m_Path);
+			Unmap ();
+			boost::filesystem::resize_file (m_Path, m_FileSize, ec);
+			if (ec || !Map ()) return false;
+		}
+		m_LiveSize = ROUTER_INFO_STORE_HEADER_SIZE;
+		for (const auto& it: m_Index)
+			m_LiveSize += ROUTER_INFO_STORE_RECORD_HEADER_SIZE + it.second.len;
+		m_File.open (m_Path, std::ofstream::binary | std::ofstream::app);
+		if (!m_File.is_open ())
+		{
+			LogPrint (eLogError, "RouterInfoStore: Can't open ", m_Path, " for writing");
+			Unmap ();
+			return false;
+		}
+		LogPrint (eLogInfo, "RouterInfoStore: ", m_Index.size (), " records in ", m_Path, ", ",
+			m_FileSize - indexed, " bytes not indexed");
+		return true;
+	}
+
+	void RouterInfoStore::Close ()
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (!m_File.is_open ()) return;
+		m_File.flush ();
+		SaveIndex ();
+		m_File.close ();
+		Unmap ();
+		m_Index.clear ();
+		m_FileSize = 0; m_LiveSize = 0;
+	}
+
+	size_t RouterInfoStore::GetNumRecords () const
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		return m_Index.size ();
+	}
+
+	bool RouterInfoStore::Map ()
+	{
+		Unmap ();
+		try
+		{
+			m_Mapping.reset (new boost::interprocess::file_mapping (m_Path.c_str (), boost::interprocess::read_only));
+			m_Region.reset (new boost::interprocess::mapped_region (*m_Mapping, boost::interprocess::read_only));
+			m_MappedSize = m_Region->get_size ();
+		}
+		catch (std::exception& ex)
+		{
+			LogPrint (eLogError, "RouterInfoStore: Can't map ", m_Path, ": ", ex.what ());
+			Unmap ();
+			return false;
+		}
+		return true;
+	}
+
+	void RouterInfoStore::Unmap ()
+	{
+		m_Region = nullptr; // records might still use it
+		m_Mapping.reset (nullptr);
+		m_MappedSize = 0;
+	}
+
+	size_t RouterInfoStore::Scan (size_t from)
+	{
+		const uint8_t * buf = (const uint8_t *)m_Region->get_address ();
+		size_t offset = from;
+		while (offset + ROUTER_INFO_STORE_RECORD_HEADER_SIZE <= m_MappedSize)
+		{
+			const uint8_t * header = buf + offset;
+			size_t len = bufbe16toh (header + 32);
+			size_t dataOffset = offset + ROUTER_INFO_STORE_RECORD_HEADER_SIZE;
+			if (dataOffset + len > m_MappedSize) break;
+			if (RecordChecksum (header, buf + dataOffset, len) != bufbe32toh (header + 34)) break;
+			IdentHash ident (header);
+			if (len)
+				m_Index[ident] = { (uint32_t)dataOffset, (uint16_t)len };
+			else
+				m_Index.erase (ident);
+			offset = dataOffset + len;
+		}
+		return offset;
+	}
+
+	bool RouterInfoStore::LoadIndex ()
+	{
+		std::ifstream f (m_IndexPath, std::ifstream::binary);
+		if (!f.is_open ()) return false;
+		std::vector<uint8_t> buf ((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+		// magic (8), data size (8), number of entries (4), entries, adler32 (4)
+		if (buf.size () < 24 || memcmp (buf.data (), ROUTER_INFO_STORE_MAGIC, 8)) return false;
+		size_t numEntries = bufbe32toh (buf.data () + 16);
+		if (buf.size () != 24 + numEntries*ROUTER_INFO_STORE_INDEX_ENTRY_SIZE ||
+			adler32 (adler32 (0, Z_NULL, 0), buf.data (), buf.size () - 4) != bufbe32toh (buf.data () + buf.size () - 4))
+		{
+			LogPrint (eLogWarning, "RouterInfoStore: index ", m_IndexPath, " is malformed");
+			return false;
+		}
+		size_t dataSize = bufbe64toh (buf.data () + 8);
+		if (dataSize < ROUTER_INFO_STORE_HEADER_SIZE || dataSize > m_MappedSize) return false;
+		const uint8_t * entry = buf.data () + 20;
+		for (size_t i = 0; i < numEntries; i++, entry += ROUTER_INFO_STORE_INDEX_ENTRY_SIZE)
+		{
+			Entry e = { bufbe32toh (entry + 32), bufbe16toh (entry + 36) };
+			if (e.offset < ROUTER_INFO_STORE_HEADER_SIZE + ROUTER_INFO_STORE_RECORD_HEADER_SIZE ||
+				e.offset + e.len > dataSize) return false;
+			m_Index[IdentHash (entry)] = e;
+		}
+		m_FileSize = dataSize;
+		return true;
+	}
+
+	void RouterInfoStore::SaveIndex ()
+	{
+		std::vector<uint8_t> buf (24 + m_Index.size ()*ROUTER_INFO_STORE_INDEX_ENTRY_SIZE);
+		memcpy (buf.data (), ROUTER_INFO_STORE_MAGIC, 8);
+		htobe64buf (buf.data () + 8, m_FileSize);
+		htobe32buf (buf.data () + 16, m_Index.size ());
+		uint8_t * entry = buf.data () + 20;
+		for (const auto& it: m_Index)
+		{
+			memcpy (entry, it.first, 32);
+			htobe32buf (entry + 32, it.second.offset);
+			htobe16buf (entry + 36, it.second.len);
+			entry += ROUTER_INFO_STORE_INDEX_ENTRY_SIZE;
+		}
+		htobe32buf (entry, adler32 (adler32 (0, Z_NULL, 0), buf.data (), buf.size () - 4));
+		// write to temporary file first, the old index is still valid if we fail
+		std::string tmp = m_IndexPath + ".tmp";
+		{
+			std::ofstream f (tmp, std::ofstream::binary | std::ofstream::trunc);
+			f.write ((const char *)buf.data (), buf.size ());
+			if (!f.good ())
+			{
+				LogPrint (eLogError, "RouterInfoStore: Can't write index ", tmp);
+				return;
+			}
+		}
+		boost::system::error_code ec;
+		boost::filesystem::rename (tmp, m_IndexPath, ec);
+		if (ec)
+			LogPrint (eLogError, "RouterInfoStore: Can't rename ", tmp, ": ", ec.message ());
+	}
+
+	void RouterInfoStore::AppendRecord (const IdentHash& ident, const uint8_t * buf, size_t len)
+	{
+		uint8_t header[ROUTER_INFO_STORE_RECORD_HEADER_SIZE];
+		memcpy (header, ident, 32);
+		htobe16buf (header + 32, len);
+		htobe32buf (header + 34, RecordChecksum (header, buf, len));
+		m_File.write ((const char *)header, ROUTER_INFO_STORE_RECORD_HEADER_SIZE);
+		if (len) m_File.write ((const char *)buf, len);
+		m_FileSize += ROUTER_INFO_STORE_RECORD_HEADER_SIZE + len;
+	}
+
+	bool RouterInfoStore::Put (const IdentHash& ident, const uint8_t * buf, size_t len)
+	{
+		if (!len || len > ROUTER_INFO_STORE_MAX_RECORD_SIZE) return false;
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (!m_File.is_open ()) return false;
+		if (m_FileSize + ROUTER_INFO_STORE_RECORD_HEADER_SIZE + len > 0xFFFFFFFF)
+		{
+			LogPrint (eLogError, "RouterInfoStore: ", m_Path, " is full");
+			return false;
+		}
+		auto it = m_Index.find (ident);
+		if (it != m_Index.end ())
+			m_LiveSize -= ROUTER_INFO_STORE_RECORD_HEADER_SIZE + it->second.len;
+		AppendRecord (ident, buf, len);
+		m_Index[ident] = { (uint32_t)(m_FileSize - len), (uint16_t)len };
+		m_LiveSize += ROUTER_INFO_STORE_RECORD_HEADER_SIZE + len;
+		return m_File.good ();
+	}
+
+	void RouterInfoStore::Remove (const IdentHash& ident)
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (!m_File.is_open ()) return;
+		auto it = m_Index.find (ident);
+		if (it != m_Index.end ())
+		{
+			m_LiveSize -= ROUTER_INFO_STORE_RECORD_HEADER_SIZE + it->second.len;
+			m_Index.erase (it);
+			AppendRecord (ident, nullptr, 0);
+		}
+	}
+
+	bool RouterInfoStore::Get (const IdentHash& ident, std::vector<uint8_t>& buf)
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		auto it = m_Index.find (ident);
+		if (it == m_Index.end ()) return false;
+		if (!m_Region || it->second.offset + it->second.len > m_MappedSize)
+		{
+			// appended after mapping
+			m_File.flush ();
+			if (!Map ()) return false;
+		}
+		auto data = (const uint8_t *)m_Region->get_address () + it->second.offset;
+		buf.assign (data, data + it->second.len);
+		return true;
+	}
+
+	void RouterInfoStore::GetRecords (std::vector<Record>& records)
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (!m_File.is_open ()) return;
+		if (m_FileSize > m_MappedSize)
+		{
+			m_File.flush ();
+			if (!Map ()) return;
+		}
+		auto base = (const uint8_t *)m_Region->get_address ();
+		records.reserve (records.size () + m_Index.size ());
+		for (const auto& it: m_Index)
+			records.push_back ({ it.first, base + it.second.offset, it.second.len, m_Region });
+	}
+
+	void RouterInfoStore::Flush ()
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (m_File.is_open ()) m_File.flush ();
+	}
+
+	bool RouterInfoStore::NeedsCompaction () const
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		return m_FileSize > ROUTER_INFO_STORE_MIN_COMPACTION_SIZE && m_FileSize > 2*m_LiveSize;
+	}
+
+	bool RouterInfoStore::Compact ()
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (!m_File.is_open ()) return false;
+		m_File.flush ();
+		if (m_FileSize > m_MappedSize && !Map ()) return false;
+		auto base = (const uint8_t *)m_Region->get_address ();
+		std::string tmp = m_Path + ".tmp";
+		std::map<IdentHash, Entry> index;
+		size_t fileSize = ROUTER_INFO_STORE_HEADER_SIZE;
+		{
+			std::ofstream f (tmp, std::ofstream::binary | std::ofstream::trunc);
+			f.write (ROUTER_INFO_STORE_MAGIC, ROUTER_INFO_STORE_HEADER_SIZE);
+			for (const auto& it: m_Index)
+			{
+				// copy record with header as is
+				size_t len = ROUTER_INFO_STORE_RECORD_HEADER_SIZE + it.second.len;
+				f.write ((const char *)base + it.second.offset - ROUTER_INFO_STORE_RECORD_HEADER_SIZE, len);
+				fileSize += len;
+				index[it.first] = { (uint32_t)(fileSize - it.second.len), it.second.len };
+			}
+			if (!f.good ())
+			{
+				LogPrint (eLogError, "RouterInfoStore: Can't write ", tmp);
+				return false;
+			}
+		}
+		m_File.close ();
+		Unmap ();
+		// index doesn't match compacted file, remove it before replacing data file
+		boost::system::error_code ec;
+		boost::filesystem::remove (m_IndexPath, ec);
+		if (!ec)
+			boost::filesystem::rename (tmp, m_Path, ec);
+		else
+		{
+			boost::system::error_code ec1;
+			boost::filesystem::remove (tmp, ec1);
+		}
+		if (!ec)
+		{
+			LogPrint (eLogInfo, "RouterInfoStore: ", m_Path, " compacted from ", m_FileSize, " to ", fileSize, " bytes");
+			m_Index.swap (index);
+			m_FileSize = fileSize;
+			m_LiveSize = fileSize;
+		}
+		else
+			LogPrint (eLogError, "RouterInfoStore: Can't replace ", m_Path, ": ", ec.message ());
+		m_File.open (m_Path, std::ofstream::binary | std::ofstream::app);
+		Map ();
+		if (!ec) SaveIndex ();
+		return !ec;
+	}
+}
+}
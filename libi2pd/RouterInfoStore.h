@@ -0,0 +1,90 @@
+#ifndef ROUTER_INFO_STORE_H__
+#define ROUTER_INFO_STORE_H__
+
+#include <inttypes.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <fstream>
+#include <functional>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "Identity.h"
+
+namespace i2p
+{
+namespace data
+{
+	const char ROUTER_INFO_STORE_MAGIC[8] = { 'i', '2', 'p', 'd', 'N', 'D', 'B', '1' };
+	const size_t ROUTER_INFO_STORE_HEADER_SIZE = 8; // magic
+	const size_t ROUTER_INFO_STORE_RECORD_HEADER_SIZE = 38; // ident (32), length (2), adler32 (4)
+	const size_t ROUTER_INFO_STORE_INDEX_ENTRY_SIZE = 38; // ident (32), offset (4), length (2)
+	const size_t ROUTER_INFO_STORE_MAX_RECORD_SIZE = 0xFFFF;
+	const size_t ROUTER_INFO_STORE_MIN_COMPACTION_SIZE = 1024*1024; // don't compact small files
+
+	/** Append-only store of RouterInfos in a single memory-mapped file.
+	 * Every Put appends a record, Remove appends a record of zero length, the latest record wins.
+	 * The index of live records is written to a separate file on Close and Compact,
+	 * records appended after that are recovered by scanning the tail of the data file */
+	class RouterInfoStore
+	{
+		public:
+
+			struct Record
+			{
+				IdentHash ident;
+				const uint8_t * buf; // points to mapped file
+				size_t len;
+				std::shared_ptr<const boost::interprocess::mapped_region> region; // keeps buf valid after remapping
+			};
+
+			RouterInfoStore (const std::string& path); // index is path + ".idx"
+			~RouterInfoStore ();
+
+			bool Open ();
+			void Close ();
+			bool IsOpen () const { return m_File.is_open (); };
+			const std::string& GetPath () const { return m_Path; };
+
+			size_t GetNumRecords () const;
+			size_t GetFileSize () const { return m_FileSize; };
+			size_t GetLiveSize () const { return m_LiveSize; };
+			void GetRecords (std::vector<Record>& records); // maps whole file, records can be used without lock
+			bool Get (const IdentHash& ident, std::vector<uint8_t>& buf);
+			bool Put (const IdentHash& ident, const uint8_t * buf, size_t len);
+			void Remove (const IdentHash& ident);
+			void Flush ();
+			bool NeedsCompaction () const;
+			bool Compact (); // rewrite live records only
+
+		private:
+
+			struct Entry
+			{
+				uint32_t offset; // of data, after record header
+				uint16_t len;
+			};
+
+			bool LoadIndex (); // sets m_FileSize to the size covered by the index
+			void SaveIndex ();
+			size_t Scan (size_t from); // returns end of last valid record
+			bool Map (); // map whole file
+			void Unmap ();
+			void AppendRecord (const IdentHash& ident, const uint8_t * buf, size_t len);
+
+		private:
+
+			std::string m_Path, m_IndexPath;
+			mutable std::mutex m_Mutex;
+			std::map<IdentHash, Entry> m_Index;
+			std::ofstream m_File; // for appends
+			size_t m_FileSize, m_LiveSize, m_MappedSize;
+			std::unique_ptr<boost::interprocess::file_mapping> m_Mapping;
+			std::shared_ptr<boost::interprocess::mapped_region> m_Region; // shared with records
+	};
+}
+}
+
+#endif
@@ -10,187 +10,218 @@ namespace i2p
 {
 namespace transport
 {
+#ifdef SO_REUSEPORT
+	typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+#endif
 
-	SSUServer::SSUServer (const boost::asio::ip::address & addr, int port):
+	SSUServer::SSUServer (const boost::asio::ip::address & addr, int port, int numThreads):
 		m_OnlyV6(true), m_IsRunning(false),
-		m_Thread (nullptr), m_ThreadV6 (nullptr), m_ReceiversThread (nullptr),
-		m_ReceiversThreadV6 (nullptr), m_Work (m_Service), m_WorkV6 (m_ServiceV6),
-		m_ReceiversWork (m_ReceiversService), m_ReceiversWorkV6 (m_ReceiversServiceV6),
-		m_EndpointV6 (addr, port), m_Socket (m_ReceiversService, m_Endpoint),
-		m_SocketV6 (m_ReceiversServiceV6), m_IntroducersUpdateTimer (m_Service),
-		m_PeerTestsCleanupTimer (m_Service), m_TerminationTimer (m_Service),
-		m_TerminationTimerV6 (m_ServiceV6)
+		m_Shards (CreateShards (1, false)), m_ShardsV6 (CreateShards (numThreads, true)),
+		m_EndpointV6 (addr, port), m_IntroducersUpdateTimer (GetService ()),
+		m_PeerTestsCleanupTimer (GetService ())
 	{
-		OpenSocketV6 ();
+		InitPacketsPool ();
+		for (auto& it: m_ShardsV6)
+			OpenSocket (*it);
 	}
 
-	SSUServer::SSUServer (int port):
+	SSUServer::SSUServer (int port, int numThreads):
 		m_OnlyV6(false), m_IsRunning(false),
-		m_Thread (nullptr), m_ThreadV6 (nullptr), m_ReceiversThread (nullptr),
-		m_ReceiversThreadV6 (nullptr), 	m_Work (m_Service), m_WorkV6 (m_ServiceV6),
-		m_ReceiversWork (m_ReceiversService), m_ReceiversWorkV6 (m_ReceiversServiceV6),
+		m_Shards (CreateShards (numThreads, false)), m_ShardsV6 (CreateShards (numThreads, true)),
 		m_Endpoint (boost::asio::ip::udp::v4 (), port), m_EndpointV6 (boost::asio::ip::udp::v6 (), port),
-		m_Socket (m_ReceiversService), m_SocketV6 (m_ReceiversServiceV6),
-		m_IntroducersUpdateTimer (m_Service), m_PeerTestsCleanupTimer (m_Service),
-		m_TerminationTimer (m_Service), m_TerminationTimerV6 (m_ServiceV6)
+		m_IntroducersUpdateTimer (GetService ()), m_PeerTestsCleanupTimer (GetService ())
 	{
-		OpenSocket ();
+		InitPacketsPool ();
+		for (auto& it: m_Shards)
+			OpenSocket (*it);
 		if (context.SupportsV6 ())
-			OpenSocketV6 ();
+			for (auto& it: m_ShardsV6)
+				OpenSocket (*it);
 	}
 
 	SSUServer::~SSUServer ()
 	{
+		for (auto shards: { &m_Shards, &m_ShardsV6 })
+			for (auto& it: *shards)
+			{
+				m_PacketsPool.ReleaseMt (it->receiveBuffers);
+				m_PacketsPool.ReleaseMt (it->sendQueue);
+			}
+	}
+
+	SSUServer::Shards SSUServer::CreateShards (int numThreads, bool v6)
+	{
+		if (numThreads < 1) numThreads = 1;
+		if (numThreads > SSU_MAX_NUM_THREADS) numThreads = SSU_MAX_NUM_THREADS;
+#ifndef SO_REUSEPORT
+		if (numThreads > 1)
+		{
+			LogPrint (eLogWarning, "SSU: SO_REUSEPORT is not supported, running single thread");
+			numThreads = 1;
+		}
+#endif
+		Shards shards;
+		for (int i = 0; i < numThreads; i++)
+			shards.emplace_back (new Shard (v6));
+		return shards;
+	}
+
+	size_t SSUServer::GetShardIndex (const boost::asio::ip::udp::endpoint& e, size_t numShards)
+	{
+		if (numShards < 2) return 0;
+		uint64_t h = e.port ();
+		if (e.address ().is_v4 ())
+			h ^= (uint64_t)e.address ().to_v4 ().to_ulong () << 16;
+		else
+		{
+			auto bytes = e.address ().to_v6 ().to_bytes ();
+			for (size_t i = 0; i < bytes.size (); i += 8)
+			{
+				uint64_t w; memcpy (&w, bytes.data () + i, 8);
+				h ^= w;
+			}
+		}
+		h *= 0x9E3779B97F4A7C15ULL; // Fibonacci hashing
+		return (h >> 32) % numShards;
+	}
+
+	SSUServer::Shard& SSUServer::GetShard (const boost::asio::ip::udp::endpoint& e) const
+	{
+		auto& shards = e.address ().is_v6 () ? m_ShardsV6 : m_Shards;
+		return *shards[GetShardIndex (e, shards.size ())];
 	}
 
-	void SSUServer::OpenSocket ()
+	void SSUServer::InitPacketsPool ()
 	{
-		m_Socket.open (boost::asio::ip::udp::v4());
-		m_Socket.set_option (boost::asio::socket_base::receive_buffer_size (SSU_SOCKET_RECEIVE_BUFFER_SIZE));
-		m_Socket.set_option (boost::asio::socket_base::send_buffer_size (SSU_SOCKET_SEND_BUFFER_SIZE));
-		m_Socket.bind (m_Endpoint);
+		std::vector<SSUPacket *> packets;
+		for (size_t i = 0; i < SSU_PACKETS_POOL_SIZE; i++)
+			packets.push_back (m_PacketsPool.AcquireMt ());
+		m_PacketsPool.ReleaseMt (packets);
+		for (auto shards: { &m_Shards, &m_ShardsV6 })
+			for (auto& it: *shards)
+				for (size_t i = 1; i < SSU_MAX_BATCH_SIZE; i++)
+					it->receiveBuffers.push_back (m_PacketsPool.AcquireMt ());
 	}
 
-	void SSUServer::OpenSocketV6 ()
+	void SSUServer::OpenSocket (Shard& shard)
 	{
-		m_SocketV6.open (boost::asio::ip::udp::v6());
-		m_SocketV6.set_option (boost::asio::ip::v6_only (true));
-		m_SocketV6.set_option (boost::asio::socket_base::receive_buffer_size (SSU_SOCKET_RECEIVE_BUFFER_SIZE));
-		m_SocketV6.set_option (boost::asio::socket_base::send_buffer_size (SSU_SOCKET_SEND_BUFFER_SIZE));
-		m_SocketV6.bind (m_EndpointV6);
+		auto& socket = shard.socket;
+		if (shard.isV6)
+		{
+			socket.open (boost::asio::ip::udp::v6());
+			socket.set_option (boost::asio::ip::v6_only (true));
+		}
+		else
+			socket.open (boost::asio::ip::udp::v4());
+		socket.set_option (boost::asio::socket_base::receive_buffer_size (SSU_SOCKET_RECEIVE_BUFFER_SIZE));
+		socket.set_option (boost::asio::socket_base::send_buffer_size (SSU_SOCKET_SEND_BUFFER_SIZE));
+#ifdef SO_REUSEPORT
+		if (m_Shards.size () > 1 || m_ShardsV6.size () > 1)
+			socket.set_option (reuse_port (true)); // kernel spreads peers over sockets of all shards
+#endif
+		socket.bind (shard.isV6 ? m_EndpointV6 : m_Endpoint);
+		socket.non_blocking (true); // sending waits for writable socket instead
 	}
 
 	void SSUServer::Start ()
 	{
 		m_IsRunning = true;
 		if (!m_OnlyV6)
-		{
-			m_ReceiversThread = new std::thread (std::bind (&SSUServer::RunReceivers, this));
-			m_Thread = new std::thread (std::bind (&SSUServer::Run, this));
-			m_ReceiversService.post (std::bind (&SSUServer::Receive, this));
-			ScheduleTermination ();
-		}
+			for (auto& it: m_Shards)
+				StartShard (*it);
 		if (context.SupportsV6 ())
-		{
-			m_ReceiversThreadV6 = new std::thread (std::bind (&SSUServer::RunReceiversV6, this));
-			m_ThreadV6 = new std::thread (std::bind (&SSUServer::RunV6, this));
-			m_ReceiversServiceV6.post (std::bind (&SSUServer::ReceiveV6, this));
-			ScheduleTerminationV6 ();
-		}
+			for (auto& it: m_ShardsV6)
+				StartShard (*it);
 		SchedulePeerTestsCleanupTimer ();
 		ScheduleIntroducersUpdateTimer (); // wait for 30 seconds and decide if we need introducers
 	}
 
+	void SSUServer::StartShard (Shard& shard)
+	{
+		shard.receiversThread = new std::thread (std::bind (&SSUServer::RunReceivers, this, &shard));
+		shard.thread = new std::thread (std::bind (&SSUServer::Run, this, &shard));
+		shard.receiversService.post (std::bind (&SSUServer::Receive, this, &shard));
+		ScheduleTermination (&shard);
+	}
+
 	void SSUServer::Stop ()
 	{
 		DeleteAllSessions ();
+		// send SessionDestroyed before sockets are closed
+		for (auto shards: { &m_Shards, &m_ShardsV6 })
+			for (auto& it: *shards)
+				FlushSendQueue (it.get ());
 		m_IsRunning = false;
-		m_TerminationTimer.cancel ();
-		m_TerminationTimerV6.cancel ();
-		m_Service.stop ();
-		m_Socket.close ();
-		m_ServiceV6.stop ();
-		m_SocketV6.close ();
-		m_ReceiversService.stop ();
-		m_ReceiversServiceV6.stop ();
-		if (m_ReceiversThread)
-		{
-			m_ReceiversThread->join ();
-			delete m_ReceiversThread;
-			m_ReceiversThread = nullptr;
-		}
-		if (m_Thread)
-		{
-			m_Thread->join ();
-			delete m_Thread;
-			m_Thread = nullptr;
-		}
-		if (m_ReceiversThreadV6)
-		{
-			m_ReceiversThreadV6->join ();
-			delete m_ReceiversThreadV6;
-			m_ReceiversThreadV6 = nullptr;
-		}
-		if (m_ThreadV6)
-		{
-			m_ThreadV6->join ();
-			delete m_ThreadV6;
-			m_ThreadV6 = nullptr;
-		}
+		for (auto shards: { &m_Shards, &m_ShardsV6 })
+			for (auto& it: *shards)
+				StopShard (*it);
 	}
 
-	void SSUServer::Run ()
+	void SSUServer::StopShard (Shard& shard)
 	{
-		while (m_IsRunning)
+		shard.terminationTimer.cancel ();
+		shard.service.stop ();
+		shard.socket.close ();
+		shard.receiversService.stop ();
+		if (shard.receiversThread)
 		{
-			try
-			{
-				m_Service.run ();
-			}
-			catch (std::exception& ex)
-			{
-				LogPrint (eLogError, "SSU: server runtime exception: ", ex.what ());
-			}
+			shard.receiversThread->join ();
+			delete shard.receiversThread;
+			shard.receiversThread = nullptr;
 		}
-	}
-
-	void SSUServer::RunV6 ()
-	{
-		while (m_IsRunning)
+		if (shard.thread)
 		{
-			try
-			{
-				m_ServiceV6.run ();
-			}
-			catch (std::exception& ex)
-			{
-				LogPrint (eLogError, "SSU: v6 server runtime exception: ", ex.what ());
-			}
+			shard.thread->join ();
+			delete shard.thread;
+			shard.thread = nullptr;
 		}
 	}
 
-	void SSUServer::RunReceivers ()
+	void SSUServer::Run (Shard * shard)
 	{
 		while (m_IsRunning)
 		{
 			try
 			{
-				m_ReceiversService.run ();
+				shard->service.run ();
 			}
 			catch (std::exception& ex)
 			{
-				LogPrint (eLogError, "SSU: receivers runtime exception: ", ex.what ());
+				LogPrint (eLogError, "SSU: ", shard->isV6 ? "v6 " : "", "server runtime exception: ", ex.what ());
 			}
 		}
 	}
 
-	void SSUServer::RunReceiversV6 ()
+	void SSUServer::RunReceivers (Shard * shard)
 	{
 		while (m_IsRunning)
 		{
 			try
 			{
-				m_ReceiversServiceV6.run ();
+				shard->receiversService.run ();
 			}
 			catch (std::exception& ex)
 			{
-				LogPrint (eLogError, "SSU: v6 receivers runtime exception: ", ex.what ());
+				LogPrint (eLogError, "SSU: ", shard->isV6 ? "v6 " : "", "receivers runtime exception: ", ex.what ());
 			}
 		}
 	}
 
 	void SSUServer::AddRelay (uint32_t tag, std::shared_ptr<SSUSession> relay)
 	{
+		std::unique_lock<std::mutex> l(m_RelaysMutex);
 		m_Relays[tag] = relay;
 	}
 
 	void SSUServer::RemoveRelay (uint32_t tag)
 	{
+		std::unique_lock<std::mutex> l(m_RelaysMutex);
 		m_Relays.erase (tag);
 	}
 
 	std::shared_ptr<SSUSession> SSUServer::FindRelaySession (uint32_t tag)
 	{
+		std::unique_lock<std::mutex> l(m_RelaysMutex);
 		auto it = m_Relays.find (tag);
 		if (it != m_Relays.end ())
 		{
@@ -204,122 +235,126 @@ namespace transport
 
 	void SSUServer::Send (const uint8_t * buf, size_t len, const boost::asio::ip::udp::endpoint& to)
 	{
-		if (to.protocol () == boost::asio::ip::udp::v4())
-			m_Socket.send_to (boost::asio::buffer (buf, len), to);
-		else
-			m_SocketV6.send_to (boost::asio::buffer (buf, len), to);
+		auto packet = m_PacketsPool.AcquireMt ();
+		memcpy (packet->buf, buf, len);
+		packet->len = len;
+		packet->from = to;
+		auto& shard = GetShard (to);
+		bool flush = false;
+		{
+			std::unique_lock<std::mutex> l(shard.sendQueueMutex);
+			shard.sendQueue.push_back (packet);
+			if (shard.sendQueue.size () == 1)
+				// everything sent by handlers in progress goes out in one batch
+				shard.service.post (std::bind (&SSUServer::FlushSendQueue, this, &shard));
+			else if (shard.sendQueue.size () >= SSU_MAX_BATCH_SIZE)
+				flush = true;
+		}
+		if (flush) FlushSendQueue (&shard);
 	}
 
-	void SSUServer::Receive ()
+	void SSUServer::FlushSendQueue (Shard * shard)
 	{
-		SSUPacket * packet = new SSUPacket ();
-		m_Socket.async_receive_from (boost::asio::buffer (packet->buf, SSU_MTU_V4), packet->from,
-			std::bind (&SSUServer::HandleReceivedFrom, this, std::placeholders::_1, std::placeholders::_2, packet));
+		std::vector<SSUPacket *> packets;
+		{
+			std::unique_lock<std::mutex> l(shard->sendQueueMutex);
+			if (shard->isSendBlocked) return; // flushed once socket is writable
+			packets.swap (shard->sendQueue);
+		}
+		if (packets.empty ()) return;
+		boost::system::error_code ec;
+		size_t num = SendPackets (shard->socket, packets.data (), packets.size (), ec);
+		if (ec == boost::asio::error::would_block)
+		{
+			// send buffer is full, unsent packets go first once socket is writable
+			bool wait = false;
+			{
+				std::unique_lock<std::mutex> l(shard->sendQueueMutex);
+				shard->sendQueue.insert (shard->sendQueue.begin (), packets.begin () + num, packets.end ());
+				wait = !shard->isSendBlocked;
+				shard->isSendBlocked = true;
+			}
+			packets.resize (num);
+			if (wait)
+				shard->receiversService.post ([this, shard]() // socket is used by receivers thread
+					{
+						shard->socket.async_wait (boost::asio::ip::udp::socket::wait_write,
+							std::bind (&SSUServer::HandleSocketWritable, this, std::placeholders::_1, shard));
+					});
+		}
+		else if (ec)
+			LogPrint (eLogError, "SSU: send error: ", ec.message ());
+		m_PacketsPool.ReleaseMt (packets);
 	}
 
-	void SSUServer::ReceiveV6 ()
+	void SSUServer::HandleSocketWritable (const boost::system::error_code& ecode, Shard * shard)
 	{
-		SSUPacket * packet = new SSUPacket ();
-		m_SocketV6.async_receive_from (boost::asio::buffer (packet->buf, SSU_MTU_V6), packet->from,
-			std::bind (&SSUServer::HandleReceivedFromV6, this, std::placeholders::_1, std::placeholders::_2, packet));
+		{
+			std::unique_lock<std::mutex> l(shard->sendQueueMutex);
+			shard->isSendBlocked = false;
+		}
+		if (ecode != boost::asio::error::operation_aborted)
+			shard->service.post (std::bind (&SSUServer::FlushSendQueue, this, shard));
 	}
 
-	void SSUServer::HandleReceivedFrom (const boost::system::error_code& ecode, std::size_t bytes_transferred, SSUPacket * packet)
+	void SSUServer::Receive (Shard * shard)
+	{
+		SSUPacket * packet = m_PacketsPool.AcquireMt ();
+		shard->socket.async_receive_from (boost::asio::buffer (packet->buf, shard->isV6 ? SSU_MTU_V6 : SSU_MTU_V4), packet->from,
+			std::bind (&SSUServer::HandleReceivedFrom, this, std::placeholders::_1, std::placeholders::_2, packet, shard));
+	}
+
+	void SSUServer::HandleReceivedFrom (const boost::system::error_code& ecode, std::size_t bytes_transferred, SSUPacket * packet, Shard * shard)
 	{
 		if (!ecode)
 		{
 			packet->len = bytes_transferred;
 			std::vector<SSUPacket *> packets;
 			packets.push_back (packet);
-
-			boost::system::error_code ec;
-			size_t moreBytes = m_Socket.available(ec);
-			if (!ec)
+			ReceiveBatch (*shard, packets);
+			auto& shards = shard->isV6 ? m_ShardsV6 : m_Shards;
+			if (shards.size () > 1)
 			{
-				while (moreBytes && packets.size () < 25)
-				{
-					packet = new SSUPacket ();
-					packet->len = m_Socket.receive_from (boost::asio::buffer (packet->buf, SSU_MTU_V4), packet->from, 0, ec);
-					if (!ec)
-					{
-						packets.push_back (packet);
-						moreBytes = m_Socket.available(ec);
-						if (ec) break;
-					}
-					else
-					{
-						LogPrint (eLogError, "SSU: receive_from error: ", ec.message ());
-						delete packet;
-						break;
-					}
-				}
+				// kernel picks socket by its own hash, pass packets to shards of their sessions
+				std::vector<std::vector<SSUPacket *> > shardsPackets (shards.size ());
+				for (auto it: packets)
+					shardsPackets[GetShardIndex (it->from, shards.size ())].push_back (it);
+				for (size_t i = 0; i < shards.size (); i++)
+					if (!shardsPackets[i].empty ())
+						shards[i]->service.post (std::bind (&SSUServer::HandleReceivedPackets, this, shardsPackets[i], shards[i].get ()));
 			}
-
-			m_Service.post (std::bind (&SSUServer::HandleReceivedPackets, this, packets, &m_Sessions));
-			Receive ();
+			else
+				shard->service.post (std::bind (&SSUServer::HandleReceivedPackets, this, packets, shard));
+			Receive (shard);
 		}
 		else
 		{
-			delete packet;
+			m_PacketsPool.ReleaseMt (packet);
 			if (ecode != boost::asio::error::operation_aborted)
 			{
-				LogPrint (eLogError, "SSU: receive error: ", ecode.message ());
-				m_Socket.close ();
-				OpenSocket ();
-				Receive ();
+				LogPrint (eLogError, "SSU: ", shard->isV6 ? "v6 " : "", "receive error: ", ecode.message ());
+				shard->socket.close ();
+				OpenSocket (*shard);
+				Receive (shard);
 			}
 		}
 	}
 
-	void SSUServer::HandleReceivedFromV6 (const boost::system::error_code& ecode, std::size_t bytes_transferred, SSUPacket * packet)
+	void SSUServer::ReceiveBatch (Shard& shard, std::vector<SSUPacket *>& packets)
 	{
-		if (!ecode)
+		boost::system::error_code ec;
+		auto& buffers = shard.receiveBuffers;
+		size_t num = ReceivePackets (shard.socket, buffers.data (), buffers.size (), shard.isV6 ? SSU_MTU_V6 : SSU_MTU_V4, ec);
+		if (ec)
+			LogPrint (eLogError, "SSU: receive_from error: ", ec.message ());
+		for (size_t i = 0; i < num; i++)
 		{
-			packet->len = bytes_transferred;
-			std::vector<SSUPacket *> packets;
-			packets.push_back (packet);
-
-			boost::system::error_code ec;
-			size_t moreBytes = m_SocketV6.available (ec);
-			if (!ec)
-			{
-				while (moreBytes && packets.size () < 25)
-				{
-					packet = new SSUPacket ();
-					packet->len = m_SocketV6.receive_from (boost::asio::buffer (packet->buf, SSU_MTU_V6), packet->from, 0, ec);
-					if (!ec)
-					{
-						packets.push_back (packet);
-						moreBytes = m_SocketV6.available(ec);
-						if (ec) break;
-					}
-					else
-					{
-						LogPrint (eLogError, "SSU: v6 receive_from error: ", ec.message ());
-						delete packet;
-						break;
-					}
-				}
-			}
-
-			m_ServiceV6.post (std::bind (&SSUServer::HandleReceivedPackets, this, packets, &m_SessionsV6));
-			ReceiveV6 ();
-		}
-		else
-		{
-			delete packet;
-			if (ecode != boost::asio::error::operation_aborted)
-			{
-				LogPrint (eLogError, "SSU: v6 receive error: ", ecode.message ());
-				m_SocketV6.close ();
-				OpenSocketV6 ();
-				ReceiveV6 ();
-			}
+			packets.push_back (buffers[i]);
+			buffers[i] = m_PacketsPool.AcquireMt ();
 		}
 	}
 
-	void SSUServer::HandleReceivedPackets (std::vector<SSUPacket *> packets,
-		std::map<boost::asio::ip::udp::endpoint, std::shared_ptr<SSUSession> > * sessions)
+	void SSUServer::HandleReceivedPackets (std::vector<SSUPacket *> packets, Shard * shard)
 	{
 		std::shared_ptr<SSUSession> session;
 		for (auto& packet: packets)
@@ -329,14 +364,17 @@ namespace transport
 				if (!session || session->GetRemoteEndpoint () != packet->from) // we received packet for other session than previous
 				{
 					if (session) session->FlushData ();
-					auto it = sessions->find (packet->from);
-					if (it != sessions->end ())
+					session = nullptr;
+					std::unique_lock<std::mutex> l(shard->sessionsMutex);
+					auto it = shard->sessions.find (packet->from);
+					if (it != shard->sessions.end ())
 						session = it->second;
 					if (!session)
 					{
 						session = std::make_shared<SSUSession> (*this, packet->from);
+						shard->sessions[packet->from] = session;
+						l.unlock ();
 						session->WaitForConnect ();
-						(*sessions)[packet->from] = session;
 						LogPrint (eLogDebug, "SSU: new session from ", packet->from.address ().to_string (), ":", packet->from.port (), " created");
 					}
 				}
@@ -348,8 +386,8 @@ namespace transport
 				if (session) session->FlushData ();
 				session = nullptr;
 			}
-			delete packet;
 		}
+		m_PacketsPool.ReleaseMt (packets);
 		if (session) session->FlushData ();
 	}
 
@@ -369,9 +407,10 @@ namespace transport
 
 	std::shared_ptr<SSUSession> SSUServer::FindSession (const boost::asio::ip::udp::endpoint& e) const
 	{
-		auto& sessions = e.address ().is_v6 () ?  m_SessionsV6 : m_Sessions;
-		auto it = sessions.find (e);
-		if (it != sessions.end ())
+		auto& shard = GetShard (e);
+		std::unique_lock<std::mutex> l(shard.sessionsMutex);
+		auto it = shard.sessions.find (e);
+		if (it != shard.sessions.end ())
 			return it->second;
 		else
 			return nullptr;
@@ -392,31 +431,28 @@ namespace transport
 		if (router)
 		{
 			if (router->UsesIntroducer ())
-				m_Service.post (std::bind (&SSUServer::CreateSessionThroughIntroducer, this, router, peerTest)); // always V4 thread
+				GetService ().post (std::bind (&SSUServer::CreateSessionThroughIntroducer, this, router, peerTest)); // always V4 thread
 			else
 			{
 				boost::asio::ip::udp::endpoint remoteEndpoint (addr, port);
-				auto& s = addr.is_v6 () ? m_ServiceV6 : m_Service;
-				s.post (std::bind (&SSUServer::CreateDirectSession, this, router, remoteEndpoint, peerTest));
+				GetService (remoteEndpoint).post (std::bind (&SSUServer::CreateDirectSession, this, router, remoteEndpoint, peerTest));
 			}
 		}
 	}
 
 	void SSUServer::CreateDirectSession (std::shared_ptr<const i2p::data::RouterInfo> router, boost::asio::ip::udp::endpoint remoteEndpoint, bool peerTest)
 	{
-		auto& sessions = remoteEndpoint.address ().is_v6 () ? m_SessionsV6 : m_Sessions;
-		auto it = sessions.find (remoteEndpoint);
-		if (it != sessions.end ())
+		auto session = FindSession (remoteEndpoint);
+		if (session)
 		{
-			auto session = it->second;
 			if (peerTest && session->GetState () == eSessionStateEstablished)
 				session->SendPeerTest ();
 		}
 		else
 		{
 			// otherwise create new session
-			auto session = std::make_shared<SSUSession> (*this, remoteEndpoint, router, peerTest);
-			sessions[remoteEndpoint] = session;
+			session = std::make_shared<SSUSession> (*this, remoteEndpoint, router, peerTest);
+			AddSession (session);
 			// connect
 			LogPrint (eLogDebug, "SSU: Creating new session to [", i2p::data::GetIdentHashAbbreviation (router->GetIdentHash ()), "] ",
 				remoteEndpoint.address ().to_string (), ":", remoteEndpoint.port ());
@@ -432,11 +468,10 @@ namespace transport
 			if (address)
 			{
 				boost::asio::ip::udp::endpoint remoteEndpoint (address->host, address->port);
-				auto it = m_Sessions.find (remoteEndpoint);
+				auto session = FindSession (remoteEndpoint);
 				// check if session is presented already
-				if (it != m_Sessions.end ())
+				if (session)
 				{
-					auto session = it->second;
 					if (peerTest && session->GetState () == eSessionStateEstablished)
 						session->SendPeerTest ();
 					return;
@@ -457,12 +492,8 @@ namespace transport
 						if (ep.address ().is_v4 ()) // ipv4 only
 						{
 							if (!introducer) introducer = intr; // we pick first one for now
-							it = m_Sessions.find (ep);
-							if (it != m_Sessions.end ())
-							{
-								introducerSession = it->second;
-								break;
-							}
+							introducerSession = FindSession (ep);
+							if (introducerSession) break;
 						}
 					}
 					if (!introducer)
@@ -478,27 +509,29 @@ namespace transport
 						LogPrint (eLogDebug, "SSU: Creating new session to introducer ", introducer->iHost);
 						boost::asio::ip::udp::endpoint introducerEndpoint (introducer->iHost, introducer->iPort);
 						introducerSession = std::make_shared<SSUSession> (*this, introducerEndpoint, router);
-						m_Sessions[introducerEndpoint] = introducerSession;
+						AddSession (introducerSession);
 					}
 #if BOOST_VERSION >= 104900
 					if (!address->host.is_unspecified () && address->port)
 #endif
 					{
 						// create session
-						auto session = std::make_shared<SSUSession> (*this, remoteEndpoint, router, peerTest);
-						m_Sessions[remoteEndpoint] = session;
+						session = std::make_shared<SSUSession> (*this, remoteEndpoint, router, peerTest);
+						session->WaitForIntroduction ();
+						AddSession (session);
 
 						// introduce
 						LogPrint (eLogInfo, "SSU: Introduce new session to [", i2p::data::GetIdentHashAbbreviation (router->GetIdentHash ()),
 								"] through introducer ", introducer->iHost, ":", introducer->iPort);
-						session->WaitForIntroduction ();
 						if (i2p::context.GetRouterInfo ().UsesIntroducer ()) // if we are unreachable
 						{
 							uint8_t buf[1];
 							Send (buf, 0, remoteEndpoint); // send HolePunch
 						}
 					}
-					introducerSession->Introduce (*introducer, router);
+					// in thread of introducer's shard
+					GetService (introducerSession->GetRemoteEndpoint ()).post (std::bind (&SSUSession::Introduce,
+						introducerSession, *introducer, router));
 				}
 				else
 					LogPrint (eLogWarning, "SSU: Can't connect to unreachable router and no introducers present");
@@ -514,30 +547,56 @@ namespace transport
 		{
 			session->Close ();
 			auto& ep = session->GetRemoteEndpoint ();
-			if (ep.address ().is_v6 ())
-				m_SessionsV6.erase (ep);
-			else
-				m_Sessions.erase (ep);
+			auto& shard = GetShard (ep);
+			std::unique_lock<std::mutex> l(shard.sessionsMutex);
+			shard.sessions.erase (ep);
 		}
 	}
 
 	void SSUServer::DeleteAllSessions ()
 	{
-		for (auto& it: m_Sessions)
-			it.second->Close ();
-		m_Sessions.clear ();
+		for (auto shards: { &m_Shards, &m_ShardsV6 })
+			for (auto& shard: *shards)
+			{
+				Sessions sessions;
+				{
+					std::unique_lock<std::mutex> l(shard->sessionsMutex);
+					sessions.swap (shard->sessions);
+				}
+				for (auto& it: sessions)
+					it.second->Close ();
+			}
+	}
+
+	void SSUServer::AddSession (std::shared_ptr<SSUSession> session)
+	{
+		auto& ep = session->GetRemoteEndpoint ();
+		auto& shard = GetShard (ep);
+		std::unique_lock<std::mutex> l(shard.sessionsMutex);
+		shard.sessions[ep] = session;
+	}
 
-		for (auto& it: m_SessionsV6)
-			it.second->Close ();
-		m_SessionsV6.clear ();
+	SSUServer::Sessions SSUServer::GetSessions (const Shards& shards)
+	{
+		Sessions sessions;
+		for (auto& shard: shards)
+		{
+			std::unique_lock<std::mutex> l(shard->sessionsMutex);
+			sessions.insert (shard->sessions.begin (), shard->sessions.end ());
+		}
+		return sessions;
 	}
 
 	template<typename Filter>
 	std::shared_ptr<SSUSession> SSUServer::GetRandomV4Session (Filter filter) // v4 only
 	{
 		std::vector<std::shared_ptr<SSUSession> > filteredSessions;
-		for (const auto& s :m_Sessions)
-			if (filter (s.second)) filteredSessions.push_back (s.second);
+		for (auto& shard: m_Shards)
+		{
+			std::unique_lock<std::mutex> l(shard->sessionsMutex);
+			for (const auto& s: shard->sessions)
+				if (filter (s.second)) filteredSessions.push_back (s.second);
+		}
 		if (filteredSessions.size () > 0)
 		{
 			auto ind = rand () % filteredSessions.size ();
@@ -560,8 +619,12 @@ namespace transport
 	std::shared_ptr<SSUSession> SSUServer::GetRandomV6Session (Filter filter) // v6 only
 	{
 		std::vector<std::shared_ptr<SSUSession> > filteredSessions;
-		for (const auto& s :m_SessionsV6)
-			if (filter (s.second)) filteredSessions.push_back (s.second);
+		for (auto& shard: m_ShardsV6)
+		{
+			std::unique_lock<std::mutex> l(shard->sessionsMutex);
+			for (const auto& s: shard->sessions)
+				if (filter (s.second)) filteredSessions.push_back (s.second);
+		}
 		if (filteredSessions.size () > 0)
 		{
 			auto ind = rand () % filteredSessions.size ();
@@ -672,11 +735,13 @@ namespace transport
 
 	void SSUServer::NewPeerTest (uint32_t nonce, PeerTestParticipant role, std::shared_ptr<SSUSession> session)
 	{
+		std::unique_lock<std::mutex> l(m_PeerTestsMutex);
 		m_PeerTests[nonce] = { i2p::util::GetMillisecondsSinceEpoch (), role, session };
 	}
 
 	PeerTestParticipant SSUServer::GetPeerTestParticipant (uint32_t nonce)
 	{
+		std::unique_lock<std::mutex> l(m_PeerTestsMutex);
 		auto it = m_PeerTests.find (nonce);
 		if (it != m_PeerTests.end ())
 			return it->second.role;
@@ -686,6 +751,7 @@ namespace transport
 
 	std::shared_ptr<SSUSession> SSUServer::GetPeerTestSession (uint32_t nonce)
 	{
+		std::unique_lock<std::mutex> l(m_PeerTestsMutex);
 		auto it = m_PeerTests.find (nonce);
 		if (it != m_PeerTests.end ())
 			return it->second.session;
@@ -695,6 +761,7 @@ namespace transport
 
 	void SSUServer::UpdatePeerTest (uint32_t nonce, PeerTestParticipant role)
 	{
+		std::unique_lock<std::mutex> l(m_PeerTestsMutex);
 		auto it = m_PeerTests.find (nonce);
 		if (it != m_PeerTests.end ())
 			it->second.role = role;
@@ -702,6 +769,7 @@ namespace transport
 
 	void SSUServer::RemovePeerTest (uint32_t nonce)
 	{
+		std::unique_lock<std::mutex> l(m_PeerTestsMutex);
 		m_PeerTests.erase (nonce);
 	}
 
@@ -718,6 +786,7 @@ namespace transport
 		{
 			int numDeleted = 0;
 			uint64_t ts = i2p::util::GetMillisecondsSinceEpoch ();
+			std::unique_lock<std::mutex> l(m_PeerTestsMutex);
 			for (auto it = m_PeerTests.begin (); it != m_PeerTests.end ();)
 			{
 				if (ts > it->second.creationTime + SSU_PEER_TEST_TIMEOUT*1000LL)
@@ -734,57 +803,32 @@ namespace transport
 		}
 	}
 
-	void SSUServer::ScheduleTermination ()
+	void SSUServer::ScheduleTermination (Shard * shard)
 	{
-		m_TerminationTimer.expires_from_now (boost::posix_time::seconds(SSU_TERMINATION_CHECK_TIMEOUT));
-		m_TerminationTimer.async_wait (std::bind (&SSUServer::HandleTerminationTimer,
-			this, std::placeholders::_1));
+		shard->terminationTimer.expires_from_now (boost::posix_time::seconds(SSU_TERMINATION_CHECK_TIMEOUT));
+		shard->terminationTimer.async_wait (std::bind (&SSUServer::HandleTerminationTimer,
+			this, std::placeholders::_1, shard));
 	}
 
-	void SSUServer::HandleTerminationTimer (const boost::system::error_code& ecode)
+	void SSUServer::HandleTerminationTimer (const boost::system::error_code& ecode, Shard * shard)
 	{
 		if (ecode != boost::asio::error::operation_aborted)
 		{
 			auto ts = i2p::util::GetSecondsSinceEpoch ();
-			for (auto& it: m_Sessions)
+			std::unique_lock<std::mutex> l(shard->sessionsMutex);
+			for (auto& it: shard->sessions)
 				if (it.second->IsTerminationTimeoutExpired (ts))
 				{
 					auto session = it.second;
-					m_Service.post ([session]
+					shard->service.post ([session]
 						{
 							LogPrint (eLogWarning, "SSU: no activity with ", session->GetRemoteEndpoint (), " for ", session->GetTerminationTimeout (), " seconds");
 							session->Failed ();
 						});
 				}
-			ScheduleTermination ();
-		}
-	}
-
-	void SSUServer::ScheduleTerminationV6 ()
-	{
-		m_TerminationTimerV6.expires_from_now (boost::posix_time::seconds(SSU_TERMINATION_CHECK_TIMEOUT));
-		m_TerminationTimerV6.async_wait (std::bind (&SSUServer::HandleTerminationTimerV6,
-			this, std::placeholders::_1));
-	}
-
-	void SSUServer::HandleTerminationTimerV6 (const boost::system::error_code& ecode)
-	{
-		if (ecode != boost::asio::error::operation_aborted)
-		{
-			auto ts = i2p::util::GetSecondsSinceEpoch ();
-			for (auto& it: m_SessionsV6)
-				if (it.second->IsTerminationTimeoutExpired (ts))
-				{
-					auto session = it.second;
-					m_ServiceV6.post ([session]
-						{
-							LogPrint (eLogWarning, "SSU: no activity with ", session->GetRemoteEndpoint (), " for ", session->GetTerminationTimeout (), " seconds");
-							session->Failed ();
-						});
-				}
-			ScheduleTerminationV6 ();
+			l.unlock ();
+			ScheduleTermination (shard);
 		}
 	}
 }
 }
-
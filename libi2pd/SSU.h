@@ -14,7 +14,9 @@
 #include "Identity.h"
 #include "RouterInfo.h"
 #include "I2NPProtocol.h"
+#include "util.h"
 #include "SSUSession.h"
+#include "SSUBatch.h"
 
 namespace i2p
 {
@@ -27,20 +29,16 @@ namespace transport
 	const size_t SSU_MAX_NUM_INTRODUCERS = 3;
 	const size_t SSU_SOCKET_RECEIVE_BUFFER_SIZE = 0x1FFFF; // 128K
 	const size_t SSU_SOCKET_SEND_BUFFER_SIZE = 0x1FFFF; // 128K
-
-	struct SSUPacket
-	{
-		i2p::crypto::AESAlignedBuffer<SSU_MTU_V6 + 18> buf; // max MTU + iv + size
-		boost::asio::ip::udp::endpoint from;
-		size_t len;
-	};
+	const int SSU_MAX_NUM_THREADS = 16;
 
 	class SSUServer
 	{
 		public:
 
-			SSUServer (int port);
-			SSUServer (const boost::asio::ip::address & addr, int port);			// ipv6 only constructor
+			typedef std::map<boost::asio::ip::udp::endpoint, std::shared_ptr<SSUSession> > Sessions;
+
+			SSUServer (int port, int numThreads = 1);
+			SSUServer (const boost::asio::ip::address & addr, int port, int numThreads = 1);			// ipv6 only constructor
 			~SSUServer ();
 			void Start ();
 			void Stop ();
@@ -55,8 +53,10 @@ namespace transport
 			void DeleteSession (std::shared_ptr<SSUSession> session);
 			void DeleteAllSessions ();
 
-			boost::asio::io_service& GetService () { return m_Service; };
-			boost::asio::io_service& GetServiceV6 () { return m_ServiceV6; };
+			boost::asio::io_service& GetService () { return m_Shards[0]->service; };
+			boost::asio::io_service& GetServiceV6 () { return m_ShardsV6[0]->service; };
+			boost::asio::io_service& GetService (const boost::asio::ip::udp::endpoint& e) { return GetShard (e).service; }; // of session
+			size_t GetNumThreads () const { return m_Shards.size (); };
 			const boost::asio::ip::udp::endpoint& GetEndpoint () const { return m_Endpoint; };
 			void Send (const uint8_t * buf, size_t len, const boost::asio::ip::udp::endpoint& to);
 			void AddRelay (uint32_t tag, std::shared_ptr<SSUSession> relay);
@@ -71,18 +71,45 @@ namespace transport
 
 		private:
 
-			void OpenSocket ();
-			void OpenSocketV6 ();
-			void Run ();
-			void RunV6 ();
-			void RunReceivers ();
-			void RunReceiversV6 ();
-			void Receive ();
-			void ReceiveV6 ();
-			void HandleReceivedFrom (const boost::system::error_code& ecode, std::size_t bytes_transferred, SSUPacket * packet);
-			void HandleReceivedFromV6 (const boost::system::error_code& ecode, std::size_t bytes_transferred, SSUPacket * packet);
-			void HandleReceivedPackets (std::vector<SSUPacket *> packets,
-				std::map<boost::asio::ip::udp::endpoint, std::shared_ptr<SSUSession> >* sessions);
+			/** socket, threads and sessions of endpoints with same hash.
+			 * Sockets of all shards are bound to same port with SO_REUSEPORT */
+			struct Shard
+			{
+				Shard (bool v6): isV6 (v6), work (service), receiversWork (receiversService),
+					socket (receiversService), terminationTimer (service) {};
+
+				bool isV6;
+				boost::asio::io_service service, receiversService;
+				boost::asio::io_service::work work, receiversWork;
+				std::thread * thread = nullptr, * receiversThread = nullptr;
+				boost::asio::ip::udp::socket socket;
+				boost::asio::deadline_timer terminationTimer;
+				std::vector<SSUPacket *> receiveBuffers; // owned by receivers thread
+				std::mutex sendQueueMutex;
+				std::vector<SSUPacket *> sendQueue; // flushed by shard thread
+				bool isSendBlocked = false; // until socket is writable, guarded by sendQueueMutex
+				mutable std::mutex sessionsMutex;
+				Sessions sessions;
+			};
+			typedef std::vector<std::unique_ptr<Shard> > Shards;
+
+			static Shards CreateShards (int numThreads, bool v6);
+			static size_t GetShardIndex (const boost::asio::ip::udp::endpoint& e, size_t numShards);
+			Shard& GetShard (const boost::asio::ip::udp::endpoint& e) const;
+			void InitPacketsPool ();
+			void OpenSocket (Shard& shard);
+			void StartShard (Shard& shard);
+			void StopShard (Shard& shard);
+			void Run (Shard * shard);
+			void RunReceivers (Shard * shard);
+			void Receive (Shard * shard);
+			void HandleReceivedFrom (const boost::system::error_code& ecode, std::size_t bytes_transferred, SSUPacket * packet, Shard * shard);
+			void ReceiveBatch (Shard& shard, std::vector<SSUPacket *>& packets); // whatever is available after first packet
+			void HandleReceivedPackets (std::vector<SSUPacket *> packets, Shard * shard);
+			void FlushSendQueue (Shard * shard);
+			void HandleSocketWritable (const boost::system::error_code& ecode, Shard * shard);
+			void AddSession (std::shared_ptr<SSUSession> session);
+			static Sessions GetSessions (const Shards& shards);
 
 			void CreateSessionThroughIntroducer (std::shared_ptr<const i2p::data::RouterInfo> router, bool peerTest = false);
 			template<typename Filter>
@@ -98,10 +125,8 @@ namespace transport
 			void HandlePeerTestsCleanupTimer (const boost::system::error_code& ecode);
 
 			// timer
-			void ScheduleTermination ();
-			void HandleTerminationTimer (const boost::system::error_code& ecode);
-			void ScheduleTerminationV6 ();
-			void HandleTerminationTimerV6 (const boost::system::error_code& ecode);
+			void ScheduleTermination (Shard * shard);
+			void HandleTerminationTimer (const boost::system::error_code& ecode, Shard * shard);
 
 		private:
 
@@ -112,24 +137,21 @@ namespace transport
 				std::shared_ptr<SSUSession> session; // for Bob to Alice
 			};
 
+			i2p::util::MemoryPoolMt<SSUPacket> m_PacketsPool;
 			bool m_OnlyV6;
 			bool m_IsRunning;
-			std::thread * m_Thread, * m_ThreadV6, * m_ReceiversThread, * m_ReceiversThreadV6;
-			boost::asio::io_service m_Service, m_ServiceV6, m_ReceiversService, m_ReceiversServiceV6;
-			boost::asio::io_service::work m_Work, m_WorkV6, m_ReceiversWork, m_ReceiversWorkV6;
+			Shards m_Shards, m_ShardsV6; // first shard runs server timers
 			boost::asio::ip::udp::endpoint m_Endpoint, m_EndpointV6;
-			boost::asio::ip::udp::socket m_Socket, m_SocketV6;
-			boost::asio::deadline_timer m_IntroducersUpdateTimer, m_PeerTestsCleanupTimer,
-				m_TerminationTimer, m_TerminationTimerV6;
+			boost::asio::deadline_timer m_IntroducersUpdateTimer, m_PeerTestsCleanupTimer;
 			std::list<boost::asio::ip::udp::endpoint> m_Introducers; // introducers we are connected to
-			std::map<boost::asio::ip::udp::endpoint, std::shared_ptr<SSUSession> > m_Sessions, m_SessionsV6;
+			std::mutex m_RelaysMutex, m_PeerTestsMutex;
 			std::map<uint32_t, std::shared_ptr<SSUSession> > m_Relays; // we are introducer
 			std::map<uint32_t, PeerTest> m_PeerTests; // nonce -> creation time in milliseconds
 
 		public:
 			// for HTTP only
-			const decltype(m_Sessions)& GetSessions () const { return m_Sessions; };
-			const decltype(m_SessionsV6)& GetSessionsV6 () const { return m_SessionsV6; };
+			Sessions GetSessions () const { return GetSessions (m_Shards); };
+			Sessions GetSessionsV6 () const { return GetSessions (m_ShardsV6); };
 	};
 }
 }
@@ -0,0 +1,123 @@
+#include <string.h>
+#include <errno.h>
+#include "SSUBatch.h"
+#ifdef SSU_BATCHED_IO
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+namespace i2p
+{
+namespace transport
+{
+#ifdef SSU_BATCHED_IO
+	size_t ReceivePackets (boost::asio::ip::udp::socket& socket, SSUPacket * const * packets, size_t num,
+		size_t mtu, boost::system::error_code& ecode)
+	{
+		if (num > SSU_MAX_BATCH_SIZE) num = SSU_MAX_BATCH_SIZE;
+		if (!num) return 0;
+		mmsghdr msgs[SSU_MAX_BATCH_SIZE];
+		iovec iovs[SSU_MAX_BATCH_SIZE];
+		memset (msgs, 0, num*sizeof (mmsghdr));
+		for (size_t i = 0; i < num; i++)
+		{
+			iovs[i].iov_base = packets[i]->buf;
+			iovs[i].iov_len = mtu;
+			msgs[i].msg_hdr.msg_name = packets[i]->from.data ();
+			msgs[i].msg_hdr.msg_namelen = packets[i]->from.capacity ();
+			msgs[i].msg_hdr.msg_iov = iovs + i;
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		int n = recvmmsg (socket.native_handle (), msgs, num, MSG_DONTWAIT, nullptr);
+		if (n < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				ecode = boost::system::error_code (errno, boost::system::system_category ());
+			return 0;
+		}
+		for (int i = 0; i < n; i++)
+		{
+			packets[i]->len = msgs[i].msg_len;
+			packets[i]->from.resize (msgs[i].msg_hdr.msg_namelen);
+		}
+		return n;
+	}
+
+	size_t SendPackets (boost::asio::ip::udp::socket& socket, SSUPacket * const * packets, size_t num,
+		boost::system::error_code& ecode)
+	{
+		mmsghdr msgs[SSU_MAX_BATCH_SIZE];
+		iovec iovs[SSU_MAX_BATCH_SIZE];
+		size_t i = 0;
+		while (i < num)
+		{
+			size_t n = num - i;
+			if (n > SSU_MAX_BATCH_SIZE) n = SSU_MAX_BATCH_SIZE;
+			memset (msgs, 0, n*sizeof (mmsghdr));
+			for (size_t j = 0; j < n; j++)
+			{
+				auto packet = packets[i + j];
+				iovs[j].iov_base = packet->buf;
+				iovs[j].iov_len = packet->len;
+				msgs[j].msg_hdr.msg_name = packet->from.data ();
+				msgs[j].msg_hdr.msg_namelen = packet->from.size ();
+				msgs[j].msg_hdr.msg_iov = iovs + j;
+				msgs[j].msg_hdr.msg_iovlen = 1;
+			}
+			int sent = sendmmsg (socket.native_handle (), msgs, n, MSG_DONTWAIT);
+			if (sent > 0)
+				i += sent;
+			else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				// send buffer is full, caller waits until socket is writable
+				ecode = boost::asio::error::would_block;
+				break;
+			}
+			else if (errno != EINTR)
+			{
+				// sendmmsg stops at failed destination, skip it
+				ecode = boost::system::error_code (errno, boost::system::system_category ());
+				i++;
+			}
+		}
+		return i;
+	}
+#else
+	size_t ReceivePackets (boost::asio::ip::udp::socket& socket, SSUPacket * const * packets, size_t num,
+		size_t mtu, boost::system::error_code& ecode)
+	{
+		size_t n = 0;
+		while (n < num)
+		{
+			boost::system::error_code ec;
+			if (!socket.available (ec) || ec) break;
+			packets[n]->len = socket.receive_from (boost::asio::buffer (packets[n]->buf, mtu), packets[n]->from, 0, ec);
+			if (ec)
+			{
+				ecode = ec;
+				break;
+			}
+			n++;
+		}
+		return n;
+	}
+
+	size_t SendPackets (boost::asio::ip::udp::socket& socket, SSUPacket * const * packets, size_t num,
+		boost::system::error_code& ecode)
+	{
+		size_t i = 0;
+		for (; i < num; i++)
+		{
+			boost::system::error_code ec;
+			socket.send_to (boost::asio::buffer (packets[i]->buf, packets[i]->len), packets[i]->from, 0, ec);
+			if (ec)
+			{
+				ecode = ec;
+				if (ec == boost::asio::error::would_block) break; // socket is non-blocking
+			}
+		}
+		return i;
+	}
+#endif
+}
+}
@@ -0,0 +1,39 @@
+#ifndef SSU_BATCH_H__
+#define SSU_BATCH_H__
+
+#include <inttypes.h>
+#include <boost/asio.hpp>
+#include "Crypto.h"
+#include "SSUData.h"
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#define SSU_BATCHED_IO // recvmmsg/sendmmsg
+#endif
+
+namespace i2p
+{
+namespace transport
+{
+	const size_t SSU_MAX_BATCH_SIZE = 32; // datagrams per receive or send call
+	const size_t SSU_PACKETS_POOL_SIZE = 256; // preallocated
+
+	struct SSUPacket
+	{
+		i2p::crypto::AESAlignedBuffer<SSU_MTU_V6 + 18> buf; // max MTU + iv + size
+		boost::asio::ip::udp::endpoint from; // destination if sent
+		size_t len;
+	};
+
+	/** receive up to num datagrams available without blocking into packets,
+	 * returns number of packets received */
+	size_t ReceivePackets (boost::asio::ip::udp::socket& socket, SSUPacket * const * packets, size_t num,
+		size_t mtu, boost::system::error_code& ecode);
+	/** send num packets to their endpoints without blocking, returns number of packets
+	 * sent or skipped. Packets failed to send are skipped, ecode is set to last error.
+	 * Stops with would_block if socket's send buffer is full */
+	size_t SendPackets (boost::asio::ip::udp::socket& socket, SSUPacket * const * packets, size_t num,
+		boost::system::error_code& ecode);
+}
+}
+
+#endif
@@ -9,13 +9,20 @@ namespace crypto
 	EDDSA25519Verifier::EDDSA25519Verifier (const uint8_t * signingKey)
 	{
 		memcpy (m_PublicKeyEncoded, signingKey, EDDSA25519_PUBLIC_KEY_LENGTH);
+#if ED25519_FE51
+		m_IsPublicKeyValid = GetEd25519 ()->DecodePublicKey (m_PublicKeyEncoded, m_PublicKey);
+#else
 		BN_CTX * ctx = BN_CTX_new ();
 		m_PublicKey = GetEd25519 ()->DecodePublicKey (m_PublicKeyEncoded, ctx);
 		BN_CTX_free (ctx);
+#endif
 	}
 
 	bool EDDSA25519Verifier::Verify (const uint8_t * buf, size_t len, const uint8_t * signature) const
 	{
+#if ED25519_FE51
+		if (!m_IsPublicKeyValid) return false;
+#endif
 		uint8_t digest[64];
 		SHA512_CTX ctx;
 		SHA512_Init (&ctx);
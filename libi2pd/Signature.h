@@ -374,7 +374,12 @@ namespace crypto
 
 		private:
 
+#if ED25519_FE51
+			EDDSAPoint51 m_PublicKey; // negated
+			bool m_IsPublicKeyValid;
+#else
 			EDDSAPoint m_PublicKey;
+#endif
 			uint8_t m_PublicKeyEncoded[EDDSA25519_PUBLIC_KEY_LENGTH];
 	};
 
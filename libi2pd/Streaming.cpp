@@ -61,9 +61,8 @@ namespace stream
 		m_Status (eStreamStatusNew), m_IsAckSendScheduled (false), m_LocalDestination (local),
 		m_RemoteLeaseSet (remote), m_ReceiveTimer (m_Service), m_ResendTimer (m_Service),
 		m_AckSendTimer (m_Service),  m_NumSentBytes (0), m_NumReceivedBytes (0), m_Port (port),
-		m_WindowSize (MIN_WINDOW_SIZE), m_RTT (INITIAL_RTT), m_RTO (INITIAL_RTO),
-		m_AckDelay (local.GetOwner ()->GetStreamingAckDelay ()),
-		m_LastWindowSizeIncreaseTime (0), m_NumResendAttempts (0)
+		m_SendWindow (CreateCongestionControl (local.GetOwner ()->GetStreamingCongestionControl ())),
+		m_AckDelay (local.GetOwner ()->GetStreamingAckDelay ())
 	{
 		RAND_bytes ((uint8_t *)&m_RecvStreamID, 4);
 		m_RemoteIdentity = remote->GetIdentity ();
@@ -73,9 +72,9 @@ namespace stream
 		m_Service (service), m_SendStreamID (0), m_SequenceNumber (0), m_LastReceivedSequenceNumber (-1),
 		m_Status (eStreamStatusNew), m_IsAckSendScheduled (false), m_LocalDestination (local),
 		m_ReceiveTimer (m_Service), m_ResendTimer (m_Service), m_AckSendTimer (m_Service),
-		m_NumSentBytes (0), m_NumReceivedBytes (0), m_Port (0),  m_WindowSize (MIN_WINDOW_SIZE),
-		m_RTT (INITIAL_RTT), m_RTO (INITIAL_RTO), m_AckDelay (local.GetOwner ()->GetStreamingAckDelay ()),
-		m_LastWindowSizeIncreaseTime (0), m_NumResendAttempts (0)
+		m_NumSentBytes (0), m_NumReceivedBytes (0), m_Port (0),
+		m_SendWindow (CreateCongestionControl (local.GetOwner ()->GetStreamingCongestionControl ())),
+		m_AckDelay (local.GetOwner ()->GetStreamingAckDelay ())
 	{
 		RAND_bytes ((uint8_t *)&m_RecvStreamID, 4);
 	}
@@ -162,7 +161,7 @@ namespace stream
 				if (!m_IsAckSendScheduled)
 				{
 					m_IsAckSendScheduled = true;
-					auto ackTimeout = m_RTT/10;
+					auto ackTimeout = m_SendWindow.GetRTT ()/10;
 					if (ackTimeout > m_AckDelay) ackTimeout = m_AckDelay;
 					m_AckSendTimer.expires_from_now (boost::posix_time::milliseconds(ackTimeout));
 					m_AckSendTimer.async_wait (std::bind (&Stream::HandleAckSendTimer,
@@ -300,7 +299,7 @@ namespace stream
 
 	void Stream::ProcessAck (Packet * packet)
 	{
-		bool acknowledged = false;
+		std::vector<Packet *> lostPackets;
 		auto ts = i2p::util::GetMillisecondsSinceEpoch ();
 		uint32_t ackThrough = packet->GetAckThrough ();
 		if (ackThrough > m_SequenceNumber)
@@ -309,6 +308,7 @@ namespace stream
 			return;
 		}
 		int nackCount = packet->GetNACKCount ();
+		m_SendWindow.StartAck ();
 		for (auto it = m_SentPackets.begin (); it != m_SentPackets.end ();)
 		{
 			auto seqn = (*it)->GetSeqn ();
@@ -326,50 +326,42 @@ namespace stream
 					if (nacked)
 					{
 						LogPrint (eLogDebug, "Streaming: Packet ", seqn, " NACK");
+						if (m_SendWindow.NACKed (**it, ts))
+							lostPackets.push_back (*it);
 						++it;
 						continue;
 					}
 				}
 				auto sentPacket = *it;
-				uint64_t rtt = ts - sentPacket->sendTime;
 				if(ts < sentPacket->sendTime)
-				{
 					LogPrint(eLogError, "Streaming: Packet ", seqn, "sent from the future, sendTime=", sentPacket->sendTime);
-					rtt = 1;
-				}
-				m_RTT = (m_RTT*seqn + rtt)/(seqn + 1);
-				m_RTO = m_RTT*1.5; // TODO: implement it better
-				LogPrint (eLogDebug, "Streaming: Packet ", seqn, " acknowledged rtt=", rtt, " sentTime=", sentPacket->sendTime);
+				m_SendWindow.Acked (*sentPacket, ts);
+				LogPrint (eLogDebug, "Streaming: Packet ", seqn, " acknowledged sentTime=", sentPacket->sendTime);
 				m_SentPackets.erase (it++);
 				m_LocalDestination.DeletePacket (sentPacket);
-				acknowledged = true;
-				if (m_WindowSize < WINDOW_SIZE)
-					m_WindowSize++; // slow start
-				else
-				{
-					// linear growth
-					if (ts > m_LastWindowSizeIncreaseTime + m_RTT)
-					{
-						m_WindowSize++;
-						if (m_WindowSize > MAX_WINDOW_SIZE) m_WindowSize = MAX_WINDOW_SIZE;
-						m_LastWindowSizeIncreaseTime = ts;
-					}
-				}
 				if (!seqn && m_RoutingSession) // first message confirmed
 					m_RoutingSession->SetSharedRoutingPath (
 						std::make_shared<i2p::garlic::GarlicRoutingPath> (
-							i2p::garlic::GarlicRoutingPath{m_CurrentOutboundTunnel, m_CurrentRemoteLease, m_RTT, 0, 0}));
+							i2p::garlic::GarlicRoutingPath{m_CurrentOutboundTunnel, m_CurrentRemoteLease, m_SendWindow.GetRTT (), 0, 0}));
 			}
 			else
 				break;
 		}
 		if (m_SentPackets.empty ())
 			m_ResendTimer.cancel ();
-		if (acknowledged)
+		m_SendWindow.FinishAck (m_SentPackets.empty () ? m_SequenceNumber : (*m_SentPackets.begin ())->GetSeqn (),
+			m_SequenceNumber, !lostPackets.empty (), ts);
+		if (!lostPackets.empty ())
 		{
-			m_NumResendAttempts = 0;
-			SendBuffer ();
+			for (auto it: lostPackets)
+			{
+				LogPrint (eLogDebug, "Streaming: Packet ", it->GetSeqn (), " is lost, resend");
+				SendWindow::Resent (*it, ts);
+			}
+			SendPackets (lostPackets);
 		}
+		if (m_SendWindow.GetNumAcked () > 0)
+			SendBuffer ();
 		if (m_Status == eStreamStatusClosed)
 			Terminate ();
 		else if (m_Status == eStreamStatusClosing)
@@ -403,7 +395,7 @@ namespace stream
 
 	void Stream::SendBuffer ()
 	{
-		int numMsgs = m_WindowSize - m_SentPackets.size ();
+		int numMsgs = m_SendWindow.GetWindowSize () - m_SentPackets.size ();
 		if (numMsgs <= 0) return; // window is full
 
 		bool isNoAck = m_LastReceivedSequenceNumber < 0; // first packet
@@ -429,7 +421,7 @@ namespace stream
 				size += 4; // ack Through
 				packet[size] = 0;
 				size++; // NACK count
-				packet[size] = m_RTO/1000;
+				packet[size] = m_SendWindow.GetRTO ()/1000;
 				size++; // resend delay
 				if (m_Status == eStreamStatusNew)
 				{
@@ -681,8 +673,7 @@ namespace stream
 			{
 				m_CurrentOutboundTunnel = routingPath->outboundTunnel;
 				m_CurrentRemoteLease = routingPath->remoteLease;
-				m_RTT = routingPath->rtt;
-				m_RTO = m_RTT*1.5; // TODO: implement it better
+				m_SendWindow.SetInitialRTT (routingPath->rtt);
 			}
 		}
 		if (!m_CurrentOutboundTunnel || !m_CurrentOutboundTunnel->IsEstablished ())
@@ -749,9 +740,7 @@ namespace stream
 	void Stream::ScheduleResend ()
 	{
 		m_ResendTimer.cancel ();
-		// check for invalid value
-		if (m_RTO <= 0) m_RTO = INITIAL_RTO;
-		m_ResendTimer.expires_from_now (boost::posix_time::milliseconds(m_RTO));
+		m_ResendTimer.expires_from_now (boost::posix_time::milliseconds(m_SendWindow.GetRTO ()));
 		m_ResendTimer.async_wait (std::bind (&Stream::HandleResendTimer,
 			shared_from_this (), std::placeholders::_1));
 	}
@@ -761,7 +750,7 @@ namespace stream
 		if (ecode != boost::asio::error::operation_aborted)
 		{
 			// check for resend attempts
-			if (m_NumResendAttempts >= MAX_NUM_RESEND_ATTEMPTS)
+			if (m_SendWindow.GetNumResendAttempts () >= MAX_NUM_RESEND_ATTEMPTS)
 			{
 				LogPrint (eLogWarning, "Streaming: packet was not ACKed after ", MAX_NUM_RESEND_ATTEMPTS, " attempts, terminate, rSID=", m_RecvStreamID, ", sSID=", m_SendStreamID);
 				m_Status = eStreamStatusReset;
@@ -774,9 +763,9 @@ namespace stream
 			std::vector<Packet *> packets;
 			for (auto it : m_SentPackets)
 			{
-				if (ts >= it->sendTime + m_RTO)
+				if (m_SendWindow.IsTimedOut (*it, ts))
 				{
-					it->sendTime = ts;
+					SendWindow::Resent (*it, ts);
 					packets.push_back (it);
 				}
 			}
@@ -784,16 +773,12 @@ namespace stream
 			// select tunnels if necessary and send
 			if (packets.size () > 0)
 			{
-				m_NumResendAttempts++;
-				m_RTO *= 2;
-				switch (m_NumResendAttempts)
+				switch (m_SendWindow.Timeout (packets[0]->GetSeqn (), m_SequenceNumber, ts))
 				{
-					case 1: // congesion avoidance
-						m_WindowSize /= 2;
-						if (m_WindowSize < MIN_WINDOW_SIZE) m_WindowSize = MIN_WINDOW_SIZE;
+					case 1: // congesion avoidance, window is reduced by SendWindow
 					break;
 					case 2:
-						m_RTO = INITIAL_RTO; // drop RTO to initial upon tunnels pair change first time
+						m_SendWindow.ResetRTO (); // drop RTO to initial upon tunnels pair change first time
 						// no break here
 					case 4:
 						if (m_RoutingSession) m_RoutingSession->SetSharedRoutingPath (nullptr);
@@ -17,6 +17,7 @@
 #include "I2NPProtocol.h"
 #include "Garlic.h"
 #include "Tunnel.h"
+#include "CongestionControl.h"
 #include "util.h" // MemoryPool
 
 namespace i2p
@@ -43,23 +44,17 @@ namespace stream
 	const size_t MAX_PACKET_SIZE = 4096;
 	const size_t COMPRESSION_THRESHOLD_SIZE = 66;
 	const int MAX_NUM_RESEND_ATTEMPTS = 6;
-	const int WINDOW_SIZE = 6; // in messages
-	const int MIN_WINDOW_SIZE = 1;
-	const int MAX_WINDOW_SIZE = 128;
-	const int INITIAL_RTT = 8000; // in milliseconds
-	const int INITIAL_RTO = 9000; // in milliseconds
 	const int SYN_TIMEOUT = 200; // how long we wait for SYN after follow-on, in milliseconds
 	const size_t MAX_PENDING_INCOMING_BACKLOG = 128;
 	const int PENDING_INCOMING_TIMEOUT = 10; // in seconds
 	const int MAX_RECEIVE_TIMEOUT = 30; // in seconds
 
-	struct Packet
+	struct Packet: public SentPacketInfo
 	{
 		size_t len, offset;
 		uint8_t buf[MAX_PACKET_SIZE];
-		uint64_t sendTime;
 
-		Packet (): len (0), offset (0), sendTime (0) {};
+		Packet (): len (0), offset (0) {};
 		uint8_t * GetBuffer () { return buf + offset; };
 		size_t GetLength () const { return len - offset; };
 
@@ -176,8 +171,10 @@ namespace stream
 			size_t GetSendQueueSize () const { return m_SentPackets.size (); };
 			size_t GetReceiveQueueSize () const { return m_ReceiveQueue.size (); };
 			size_t GetSendBufferSize () const { return m_SendBuffer.GetSize (); };
-			int GetWindowSize () const { return m_WindowSize; };
-			int GetRTT () const { return m_RTT; };
+			int GetWindowSize () const { return m_SendWindow.GetWindowSize (); };
+			int GetRTT () const { return m_SendWindow.GetRTT (); };
+			int GetRTO () const { return m_SendWindow.GetRTO (); };
+			const char * GetCongestionControlName () const { return m_SendWindow.GetCongestionControl ().GetName (); };
 
 			/** don't call me */
 			void Terminate ();
@@ -229,9 +226,8 @@ namespace stream
 
 			std::mutex m_SendBufferMutex;
 			SendBufferQueue m_SendBuffer;
-			int m_WindowSize, m_RTT, m_RTO, m_AckDelay;
-			uint64_t m_LastWindowSizeIncreaseTime;
-			int m_NumResendAttempts;
+			SendWindow m_SendWindow;
+			int m_AckDelay;
 	};
 
 	class StreamingDestination: public std::enable_shared_from_this<StreamingDestination>
@@ -25,19 +25,31 @@ namespace tunnel
 		i2p::transport::transports.UpdateTotalTransitTransmittedBytes (TUNNEL_DATA_MSG_SIZE);
 	}
 
+	void TransitTunnel::EncryptTunnelMsgs (const std::vector<std::shared_ptr<const I2NPMessage> >& in,
+		const std::vector<std::shared_ptr<I2NPMessage> >& out)
+	{
+		auto num = in.size ();
+		std::vector<const uint8_t *> inBufs (num);
+		std::vector<uint8_t *> outBufs (num);
+		for (size_t i = 0; i < num; i++)
+		{
+			inBufs[i] = in[i]->GetPayload () + 4;
+			outBufs[i] = out[i]->GetPayload () + 4;
+		}
+		m_Encryption.Encrypt (num, inBufs.data (), outBufs.data ());
+		i2p::transport::transports.UpdateTotalTransitTransmittedBytes (num*TUNNEL_DATA_MSG_SIZE);
+	}
+
 	TransitTunnelParticipant::~TransitTunnelParticipant ()
 	{
 	}
 
 	void TransitTunnelParticipant::HandleTunnelDataMsg (std::shared_ptr<const i2p::I2NPMessage> tunnelMsg)
 	{
-		auto newMsg = CreateEmptyTunnelDataMsg ();
-		EncryptTunnelMsg (tunnelMsg, newMsg);
-
+		// encryption is deferred to flush, to encrypt all messages received in one run together
 		m_NumTransmittedBytes += tunnelMsg->GetLength ();
-		htobe32buf (newMsg->GetPayload (), GetNextTunnelID ());
-		newMsg->FillI2NPMessageHeader (eI2NPTunnelData);
-		m_TunnelDataMsgs.push_back (newMsg);
+		m_ReceivedTunnelDataMsgs.push_back (tunnelMsg);
+		m_TunnelDataMsgs.push_back (CreateEmptyTunnelDataMsg ());
 	}
 
 	void TransitTunnelParticipant::FlushTunnelDataMsgs ()
@@ -47,6 +59,13 @@ namespace tunnel
 			auto num = m_TunnelDataMsgs.size ();
 			if (num > 1)
 				LogPrint (eLogDebug, "TransitTunnel: ", GetTunnelID (), "->", GetNextTunnelID (), " ", num);
+			EncryptTunnelMsgs (m_ReceivedTunnelDataMsgs, m_TunnelDataMsgs);
+			m_ReceivedTunnelDataMsgs.clear ();
+			for (auto& it: m_TunnelDataMsgs)
+			{
+				htobe32buf (it->GetPayload (), GetNextTunnelID ());
+				it->FillI2NPMessageHeader (eI2NPTunnelData);
+			}
 			i2p::transport::transports.SendMessages (GetNextIdentHash (), m_TunnelDataMsgs);
 			m_TunnelDataMsgs.clear ();
 		}
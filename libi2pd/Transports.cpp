@@ -1,3 +1,4 @@
+#include <boost/algorithm/string.hpp>
 #include "Log.h"
 #include "Crypto.h"
 #include "RouterContext.h"
@@ -154,10 +155,11 @@ namespace transport
 		m_Thread = new std::thread (std::bind (&Transports::Run, this));
 		std::string ntcpproxy; i2p::config::GetOption("ntcpproxy", ntcpproxy);
 		i2p::http::URL proxyurl;
-		uint16_t softLimit, hardLimit, threads;
+		uint16_t softLimit, hardLimit, threads, tcpThreads;
 		i2p::config::GetOption("limits.ntcpsoft", softLimit);
 		i2p::config::GetOption("limits.ntcphard", hardLimit);
 		i2p::config::GetOption("limits.ntcpthreads", threads);
+		i2p::config::GetOption("limits.tcpthreads", tcpThreads);
 		if(softLimit > 0 && hardLimit > 0 && softLimit >= hardLimit)
 		{
 			LogPrint(eLogError, "ntcp soft limit must be less than ntcp hard limit");
@@ -169,7 +171,7 @@ namespace transport
 			{
 				if(proxyurl.schema == "socks" || proxyurl.schema == "http")
 				{
-					m_NTCPServer = new NTCPServer(threads);
+					m_NTCPServer = new NTCPServer(threads, tcpThreads);
 					m_NTCPServer->SetSessionLimits(softLimit, hardLimit);
 					NTCPServer::ProxyType proxytype = NTCPServer::eSocksProxy;
 
@@ -196,7 +198,7 @@ namespace transport
 		bool ntcp2;  i2p::config::GetOption("ntcp2.enabled", ntcp2);
 		if (ntcp2)
 		{
-			m_NTCP2Server = new NTCP2Server ();
+			m_NTCP2Server = new NTCP2Server (tcpThreads);
 			m_NTCP2Server->Start ();
 		}	
 
@@ -207,7 +209,7 @@ namespace transport
 			if (!address) continue;
 			if (m_NTCPServer == nullptr && enableNTCP)
 			{
-				m_NTCPServer = new NTCPServer (threads);
+				m_NTCPServer = new NTCPServer (threads, tcpThreads);
 				m_NTCPServer->SetSessionLimits(softLimit, hardLimit);
 				m_NTCPServer->Start ();
 				if (!(m_NTCPServer->IsBoundV6() || m_NTCPServer->IsBoundV4())) {
@@ -223,10 +225,11 @@ namespace transport
 			{
 				if (m_SSUServer == nullptr && enableSSU)
 				{
+					uint16_t ssuThreads; i2p::config::GetOption("limits.ssuthreads", ssuThreads);
 					if (address->host.is_v4())
-						m_SSUServer = new SSUServer (address->port);
+						m_SSUServer = new SSUServer (address->port, ssuThreads);
 					else
-						m_SSUServer = new SSUServer (address->host, address->port);
+						m_SSUServer = new SSUServer (address->host, address->port, ssuThreads);
 					LogPrint (eLogInfo, "Transports: Start listening UDP port ", address->port);
 					try {
 						m_SSUServer->Start ();
@@ -811,10 +814,7 @@ namespace transport
 					LogPrint (eLogWarning, "Transports: Session to peer ", it->first.ToBase64 (), " has not been created in ", SESSION_CREATION_TIMEOUT, " seconds");
 					auto profile = i2p::data::GetRouterProfile(it->first);
 					if (profile)
-					{
 						profile->TunnelNonReplied();
-						profile->Save(it->first);
-					}
 					std::unique_lock<std::mutex>	l(m_PeersMutex);
 					it = m_Peers.erase (it);
 				}
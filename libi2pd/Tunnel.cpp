@@ -211,6 +211,15 @@ namespace tunnel
 #endif
 	}
 
+	bool Tunnel::ChangeState (TunnelState from, TunnelState to)
+	{
+		if (!m_State.compare_exchange_strong (from, to)) return false;
+#ifdef WITH_EVENTS
+		EmitTunnelEvent("tunnel.state", this, to);
+#endif
+		return true;
+	}
+
 
 	void Tunnel::PrintHops (std::stringstream& s) const
 	{
@@ -224,7 +233,7 @@ namespace tunnel
 
 	void InboundTunnel::HandleTunnelDataMsg (std::shared_ptr<const I2NPMessage> msg)
 	{
-		if (IsFailed ()) SetState (eTunnelStateEstablished); // incoming messages means a tunnel is alive
+		if (IsFailed ()) ChangeState (eTunnelStateFailed, eTunnelStateEstablished); // incoming messages means a tunnel is alive
 		auto newMsg = CreateEmptyTunnelDataMsg ();
 		EncryptTunnelMsg (msg, newMsg);
 		newMsg->from = shared_from_this ();
@@ -331,9 +340,102 @@ namespace tunnel
 		s << GetTunnelID () << ":me &#8658; ";
 	}
 
+	TunnelDataShard::TunnelDataShard (Tunnels& owner, int index):
+		m_Owner (owner), m_Index (index), m_IsRunning (false), m_Thread (nullptr),
+		m_MaxQueueSize (0), m_NumProcessedMsgs (0)
+	{
+	}
+
+	TunnelDataShard::~TunnelDataShard ()
+	{
+		Stop ();
+	}
+
+	void TunnelDataShard::Start ()
+	{
+		m_IsRunning = true;
+		m_Thread = new std::thread (std::bind (&TunnelDataShard::Run, this));
+	}
+
+	void TunnelDataShard::Stop ()
+	{
+		m_IsRunning = false;
+		m_Queue.WakeUp ();
+		if (m_Thread)
+		{
+			m_Thread->join ();
+			delete m_Thread;
+			m_Thread = nullptr;
+		}
+	}
+
+	void TunnelDataShard::PostCleanup (std::shared_ptr<TunnelBase> tunnel)
+	{
+		std::unique_lock<std::mutex> l(m_CleanupMutex);
+		m_CleanupTunnels.push_back (tunnel);
+	}
+
+	void TunnelDataShard::CleanupTunnels ()
+	{
+		std::vector<std::shared_ptr<TunnelBase> > tunnels;
+		{
+			std::unique_lock<std::mutex> l(m_CleanupMutex);
+			if (m_CleanupTunnels.empty ()) return;
+			tunnels.swap (m_CleanupTunnels);
+		}
+		for (auto& it: tunnels)
+			it->Cleanup ();
+	}
+
+	void TunnelDataShard::Run ()
+	{
+		while (m_IsRunning)
+		{
+			try
+			{
+				auto msg = m_Queue.GetNextWithTimeout (1000); // 1 sec
+				if (msg)
+				{
+					int queueSize = m_Queue.GetSize () + 1;
+					if (queueSize > m_MaxQueueSize.load (std::memory_order_relaxed))
+						m_MaxQueueSize.store (queueSize, std::memory_order_relaxed);
+					m_NumProcessedMsgs.fetch_add (m_Owner.HandleTunnelMsgs (m_Queue, msg), std::memory_order_relaxed);
+				}
+				CleanupTunnels ();
+			}
+			catch (std::exception& ex)
+			{
+				LogPrint (eLogError, "Tunnel: shard ", m_Index, " runtime exception: ", ex.what ());
+			}
+		}
+	}
+
 	Tunnels tunnels;
 
-	Tunnels::Tunnels (): m_IsRunning (false), m_Thread (nullptr),
+	void TunnelBuildResults::post (const TunnelBuildPool::ResultFunc& result)
+	{
+		{
+			std::unique_lock<std::mutex> l(m_ResultsMutex);
+			m_Results.push_back (result);
+		}
+		m_Owner.m_Queue.WakeUp (); // tunnels thread handles results as soon as it wakes up
+	}
+
+	int TunnelBuildResults::HandleResults ()
+	{
+		std::vector<TunnelBuildPool::ResultFunc> results;
+		{
+			std::unique_lock<std::mutex> l(m_ResultsMutex);
+			if (m_Results.empty ()) return 0;
+			m_Results.swap (results);
+		}
+		for (auto& it: results)
+			it ();
+		return results.size ();
+	}
+
+	Tunnels::Tunnels (): m_IsRunning (false), m_Thread (nullptr), m_NumShards (0),
+		m_MaxNumPendingBuildRequests (0), m_NumPendingBuildRequests (0), m_NumDroppedBuildRequests (0), m_NumLoggedDroppedMsgs (0),
 		m_NumSuccesiveTunnelCreations (0), m_NumFailedTunnelCreations (0)
 	{
 	}
@@ -344,6 +446,7 @@ namespace tunnel
 
 	std::shared_ptr<TunnelBase> Tunnels::GetTunnel (uint32_t tunnelID)
 	{
+		std::unique_lock<std::mutex> l(m_TunnelsMutex);
 		auto it = m_Tunnels.find(tunnelID);
 		if (it != m_Tunnels.end ())
 			return it->second;
@@ -437,7 +540,12 @@ namespace tunnel
 
 	void Tunnels::AddTransitTunnel (std::shared_ptr<TransitTunnel> tunnel)
 	{
-		if (m_Tunnels.emplace (tunnel->GetTunnelID (), tunnel).second)
+		bool inserted;
+		{
+			std::unique_lock<std::mutex> l(m_TunnelsMutex);
+			inserted = m_Tunnels.emplace (tunnel->GetTunnelID (), tunnel).second;
+		}
+		if (inserted)
 			m_TransitTunnels.push_back (tunnel);
 		else
 			LogPrint (eLogError, "Tunnel: tunnel with id ", tunnel->GetTunnelID (), " already exists");
@@ -445,12 +553,41 @@ namespace tunnel
 
 	void Tunnels::Start ()
 	{
+		int numThreads; i2p::config::GetOption("tunnels.threads", numThreads);
+		StartShards (numThreads);
+		int numBuildThreads; i2p::config::GetOption("tunnels.buildthreads", numBuildThreads);
+		if (numBuildThreads > TUNNELS_MAX_NUM_BUILD_THREADS) numBuildThreads = TUNNELS_MAX_NUM_BUILD_THREADS;
+		if (numBuildThreads > 0)
+		{
+			i2p::config::GetOption("tunnels.buildqueue", m_MaxNumPendingBuildRequests);
+			m_BuildResults = std::make_shared<TunnelBuildResults> (*this);
+			m_BuildPool.reset (new TunnelBuildPool (numBuildThreads));
+			LogPrint (eLogInfo, "Tunnel: ", numBuildThreads, " build request threads started");
+		}
 		m_IsRunning = true;
 		m_Thread = new std::thread (std::bind (&Tunnels::Run, this));
 	}
 
+	void Tunnels::StartShards (int numShards)
+	{
+		if (numShards > TUNNELS_MAX_NUM_THREADS) numShards = TUNNELS_MAX_NUM_THREADS;
+		if (numShards > 1 && m_Shards.empty ())
+		{
+			// tunnel data goes to shards by tunnelID, m_Thread handles builds and management only
+			for (int i = 0; i < numShards; i++)
+				m_Shards.emplace_back (new TunnelDataShard (*this, i));
+		}
+		for (auto& it: m_Shards)
+			it->Start ();
+		m_NumShards = m_Shards.size ();
+		if (m_NumShards)
+			LogPrint (eLogInfo, "Tunnel: ", m_Shards.size (), " tunnel data threads started");
+	}
+
 	void Tunnels::Stop ()
 	{
+		for (auto& it: m_Shards)
+			it->Stop ();
 		m_IsRunning = false;
 		m_Queue.WakeUp ();
 		if (m_Thread)
@@ -459,6 +596,21 @@ namespace tunnel
 			delete m_Thread;
 			m_Thread = 0;
 		}
+		m_BuildPool = nullptr; // waits for queued requests, their results are dropped
+		m_BuildResults = nullptr;
+		m_NumPendingBuildRequests = 0;
+	}
+
+	bool Tunnels::PostBuildRequest (const TunnelBuildPool::WorkFunc& work)
+	{
+		if (m_NumPendingBuildRequests >= m_MaxNumPendingBuildRequests)
+		{
+			m_NumDroppedBuildRequests++;
+			return false;
+		}
+		m_NumPendingBuildRequests++;
+		m_BuildPool->Offer (TunnelBuildPool::Job (m_BuildResults, work));
+		return true;
 	}
 
 	void Tunnels::Run ()
@@ -470,66 +622,19 @@ namespace tunnel
 		{
 			try
 			{
-				auto msg = m_Queue.GetNextWithTimeout (1000); // 1 sec
+				auto msg = m_Queue.GetNextWithTimeout (1000); // 1 sec, or until woken up by build worker or build message
 				if (msg)
-				{
-					uint32_t prevTunnelID = 0, tunnelID = 0;
-					std::shared_ptr<TunnelBase> prevTunnel;
-					do
-					{
-						std::shared_ptr<TunnelBase> tunnel;
-						uint8_t typeID = msg->GetTypeID ();
-						switch (typeID)
-						{
-							case eI2NPTunnelData:
-							case eI2NPTunnelGateway:
-							{
-								tunnelID = bufbe32toh (msg->GetPayload ());
-								if (tunnelID == prevTunnelID)
-									tunnel = prevTunnel;
-								else if (prevTunnel)
-									prevTunnel->FlushTunnelDataMsgs ();
-
-								if (!tunnel)
-									tunnel = GetTunnel (tunnelID);
-								if (tunnel)
-								{
-									if (typeID == eI2NPTunnelData)
-										tunnel->HandleTunnelDataMsg (msg);
-									else // tunnel gateway assumed
-										HandleTunnelGatewayMsg (tunnel, msg);
-								}
-								else
-									LogPrint (eLogWarning, "Tunnel: tunnel not found, tunnelID=", tunnelID, " previousTunnelID=", prevTunnelID, " type=", (int)typeID);
-
-								break;
-							}
-							case eI2NPVariableTunnelBuild:
-							case eI2NPVariableTunnelBuildReply:
-							case eI2NPTunnelBuild:
-							case eI2NPTunnelBuildReply:
-								HandleI2NPMessage (msg->GetBuffer (), msg->GetLength ());
-							break;
-							default:
-								LogPrint (eLogWarning, "Tunnel: unexpected message type ", (int) typeID);
-						}
-
-						msg = m_Queue.Get ();
-						if (msg)
-						{
-							prevTunnelID = tunnelID;
-							prevTunnel = tunnel;
-						}
-						else if (tunnel)
-							tunnel->FlushTunnelDataMsgs ();
-					}
-					while (msg);
-				}
+					HandleTunnelMsgs (m_Queue, msg);
+				while ((msg = m_BuildMsgsQueue.Get ()))
+					HandleTunnelBuildI2NPMessage (msg);
+				if (m_BuildResults)
+					m_NumPendingBuildRequests -= m_BuildResults->HandleResults ();
 
 				uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
 				if (ts - lastTs >= 15) // manage tunnels every 15 seconds
 				{
 					ManageTunnels ();
+					LogDroppedMsgs ();
 					lastTs = ts;
 				}
 			}
@@ -540,6 +645,76 @@ namespace tunnel
 		}
 	}
 
+	void Tunnels::LogDroppedMsgs ()
+	{
+		uint64_t numDropped = GetNumDroppedMsgs ();
+		for (auto& it: m_Shards) numDropped += it->GetNumDroppedMsgs ();
+		if (numDropped > m_NumLoggedDroppedMsgs)
+		{
+			LogPrint (eLogWarning, "Tunnel: queues are full, ", numDropped - m_NumLoggedDroppedMsgs, " tunnel messages dropped");
+			m_NumLoggedDroppedMsgs = numDropped;
+		}
+	}
+
+	size_t Tunnels::HandleTunnelMsgs (i2p::util::MPSCQueue<std::shared_ptr<I2NPMessage> >& queue, std::shared_ptr<I2NPMessage> msg)
+	{
+		// handle msg and drain the queue, consecutive messages for the same tunnel are flushed together
+		size_t numMsgs = 0;
+		uint32_t prevTunnelID = 0, tunnelID = 0;
+		std::shared_ptr<TunnelBase> prevTunnel;
+		do
+		{
+			std::shared_ptr<TunnelBase> tunnel;
+			uint8_t typeID = msg->GetTypeID ();
+			switch (typeID)
+			{
+				case eI2NPTunnelData:
+				case eI2NPTunnelGateway:
+				{
+					tunnelID = bufbe32toh (msg->GetPayload ());
+					if (tunnelID == prevTunnelID)
+						tunnel = prevTunnel;
+					else if (prevTunnel)
+						prevTunnel->FlushTunnelDataMsgs ();
+
+					if (!tunnel)
+						tunnel = GetTunnel (tunnelID);
+					if (tunnel)
+					{
+						if (typeID == eI2NPTunnelData)
+							tunnel->HandleTunnelDataMsg (msg);
+						else // tunnel gateway assumed
+							HandleTunnelGatewayMsg (tunnel, msg);
+					}
+					else
+						LogPrint (eLogWarning, "Tunnel: tunnel not found, tunnelID=", tunnelID, " previousTunnelID=", prevTunnelID, " type=", (int)typeID);
+
+					break;
+				}
+				case eI2NPVariableTunnelBuild:
+				case eI2NPVariableTunnelBuildReply:
+				case eI2NPTunnelBuild:
+				case eI2NPTunnelBuildReply:
+					HandleTunnelBuildI2NPMessage (msg);
+				break;
+				default:
+					LogPrint (eLogWarning, "Tunnel: unexpected message type ", (int) typeID);
+			}
+			numMsgs++;
+
+			msg = queue.Get ();
+			if (msg)
+			{
+				prevTunnelID = tunnelID;
+				prevTunnel = tunnel;
+			}
+			else if (tunnel)
+				tunnel->FlushTunnelDataMsgs ();
+		}
+		while (msg);
+		return numMsgs;
+	}
+
 	void Tunnels::HandleTunnelGatewayMsg (std::shared_ptr<TunnelBase> tunnel, std::shared_ptr<I2NPMessage> msg)
 	{
 		if (!tunnel)
@@ -715,7 +890,10 @@ namespace tunnel
 					auto pool = tunnel->GetTunnelPool ();
 					if (pool)
 						pool->TunnelExpired (tunnel);
-					m_Tunnels.erase (tunnel->GetTunnelID ());
+					{
+						std::unique_lock<std::mutex> l(m_TunnelsMutex);
+						m_Tunnels.erase (tunnel->GetTunnelID ());
+					}
 					it = m_InboundTunnels.erase (it);
 				}
 				else
@@ -736,7 +914,7 @@ namespace tunnel
 						if (ts + TUNNEL_EXPIRATION_THRESHOLD > tunnel->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
 							tunnel->SetState (eTunnelStateExpiring);
 						else // we don't need to cleanup expiring tunnels
-							tunnel->Cleanup ();
+							CleanupTunnel (tunnel);
 					}
 					it++;
 				}
@@ -786,12 +964,15 @@ namespace tunnel
 			if (ts > tunnel->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
 			{
 				LogPrint (eLogDebug, "Tunnel: Transit tunnel with id ", tunnel->GetTunnelID (), " expired");
-				m_Tunnels.erase (tunnel->GetTunnelID ());
+				{
+					std::unique_lock<std::mutex> l(m_TunnelsMutex);
+					m_Tunnels.erase (tunnel->GetTunnelID ());
+				}
 				it = m_TransitTunnels.erase (it);
 			}
 			else
 			{
-				tunnel->Cleanup ();
+				CleanupTunnel (tunnel);
 				it++;
 			}
 		}
@@ -810,14 +991,64 @@ namespace tunnel
 		}
 	}
 
+	void Tunnels::CleanupTunnel (std::shared_ptr<TunnelBase> tunnel)
+	{
+		if (!m_NumShards)
+			tunnel->Cleanup ();
+		else // must not race with shard's thread
+			GetShard (tunnel->GetTunnelID ()).PostCleanup (tunnel);
+	}
+
+	bool Tunnels::IsShardedMsg (std::shared_ptr<const I2NPMessage> msg) const
+	{
+		auto typeID = msg->GetTypeID ();
+		return m_NumShards && (typeID == eI2NPTunnelData || typeID == eI2NPTunnelGateway);
+	}
+
+	bool Tunnels::IsBuildMsg (std::shared_ptr<const I2NPMessage> msg) const
+	{
+		auto typeID = msg->GetTypeID ();
+		return typeID == eI2NPVariableTunnelBuild || typeID == eI2NPVariableTunnelBuildReply ||
+			typeID == eI2NPTunnelBuild || typeID == eI2NPTunnelBuildReply;
+	}
+
 	void Tunnels::PostTunnelData (std::shared_ptr<I2NPMessage> msg)
 	{
-		if (msg) m_Queue.Put (msg);
+		if (!msg) return;
+		if (IsShardedMsg (msg))
+			GetShard (bufbe32toh (msg->GetPayload ())).PostTunnelData (msg);
+		else if (IsBuildMsg (msg))
+		{
+			m_BuildMsgsQueue.Put (msg);
+			m_Queue.WakeUp ();
+		}
+		else
+			m_Queue.Put (msg);
 	}
 
 	void Tunnels::PostTunnelData (const std::vector<std::shared_ptr<I2NPMessage> >& msgs)
 	{
-		m_Queue.Put (msgs);
+		// split by shards keeping order of messages within each tunnel, build messages are never dropped
+		size_t numShards = m_NumShards;
+		std::vector<std::vector<std::shared_ptr<I2NPMessage> > > shardMsgs (numShards);
+		std::vector<std::shared_ptr<I2NPMessage> > otherMsgs, buildMsgs;
+		for (const auto& it: msgs)
+		{
+			if (numShards && IsShardedMsg (it))
+				shardMsgs[bufbe32toh (it->GetPayload ()) % numShards].push_back (it);
+			else if (IsBuildMsg (it))
+				buildMsgs.push_back (it);
+			else
+				otherMsgs.push_back (it);
+		}
+		for (size_t i = 0; i < numShards; i++)
+			m_Shards[i]->PostTunnelData (shardMsgs[i]);
+		if (!buildMsgs.empty ())
+		{
+			m_BuildMsgsQueue.Put (buildMsgs);
+			m_Queue.WakeUp ();
+		}
+		m_Queue.Put (otherMsgs);
 	}
 
 	template<class TTunnel>
@@ -870,7 +1101,12 @@ namespace tunnel
 
 	void Tunnels::AddInboundTunnel (std::shared_ptr<InboundTunnel> newTunnel)
 	{
-		if (m_Tunnels.emplace (newTunnel->GetTunnelID (), newTunnel).second)
+		bool inserted;
+		{
+			std::unique_lock<std::mutex> l(m_TunnelsMutex);
+			inserted = m_Tunnels.emplace (newTunnel->GetTunnelID (), newTunnel).second;
+		}
+		if (inserted)
 		{
 			m_InboundTunnels.push_back (newTunnel);
 			auto pool = newTunnel->GetTunnelPool ();
@@ -899,7 +1135,10 @@ namespace tunnel
 		auto inboundTunnel = std::make_shared<ZeroHopsInboundTunnel> ();
 		inboundTunnel->SetState (eTunnelStateEstablished);
 		m_InboundTunnels.push_back (inboundTunnel);
-		m_Tunnels[inboundTunnel->GetTunnelID ()] = inboundTunnel;
+		{
+			std::unique_lock<std::mutex> l(m_TunnelsMutex);
+			m_Tunnels[inboundTunnel->GetTunnelID ()] = inboundTunnel;
+		}
 		return inboundTunnel;
 	}
 
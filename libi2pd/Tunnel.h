@@ -5,12 +5,17 @@
 #include <map>
 #include <unordered_map>
 #include <list>
+#include <deque>
 #include <vector>
 #include <string>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <memory>
+#include <atomic>
+#include <functional>
 #include "Queue.h"
+#include "CryptoWorker.h"
 #include "Crypto.h"
 #include "TunnelConfig.h"
 #include "TunnelPool.h"
@@ -67,6 +72,8 @@ namespace tunnel
 	const int TUNNEL_RECREATION_THRESHOLD = 90; // 1.5 minutes
 	const int TUNNEL_CREATION_TIMEOUT = 30; // 30 seconds
 	const int STANDARD_NUM_RECORDS = 5; // in VariableTunnelBuild message
+	const int TUNNELS_MAX_NUM_THREADS = 32; // tunnel data workers
+	const int TUNNELS_MAX_NUM_BUILD_THREADS = 16; // build request decryption workers
 
 	enum TunnelState
 	{
@@ -101,6 +108,7 @@ namespace tunnel
 			std::vector<std::shared_ptr<const i2p::data::IdentityEx> > GetInvertedPeers () const;
 			TunnelState GetState () const { return m_State; };
 			void SetState (TunnelState state);
+			bool ChangeState (TunnelState from, TunnelState to); // false if state is not from anymore
 			bool IsEstablished () const { return m_State == eTunnelStateEstablished; };
 			bool IsFailed () const { return m_State == eTunnelStateFailed; };
 			bool IsRecreated () const { return m_IsRecreated; };
@@ -136,7 +144,7 @@ namespace tunnel
 			std::shared_ptr<const TunnelConfig> m_Config;
 			std::vector<std::unique_ptr<TunnelHop> > m_Hops;
 			std::shared_ptr<TunnelPool> m_Pool; // pool, tunnel belongs to, or null
-			TunnelState m_State;
+			std::atomic<TunnelState> m_State; // set by tunnels thread and tunnel data shards
 			bool m_IsRecreated;
 			uint64_t m_Latency; // in milliseconds
 	};
@@ -212,13 +220,79 @@ namespace tunnel
 			size_t m_NumSentBytes;
 	};
 
+	class Tunnels;
+	class TunnelDataShard
+	{
+		public:
+
+			TunnelDataShard (Tunnels& owner, int index);
+			~TunnelDataShard ();
+
+			void Start ();
+			void Stop ();
+
+			void PostTunnelData (std::shared_ptr<I2NPMessage> msg) { m_Queue.Put (msg); };
+			void PostTunnelData (const std::vector<std::shared_ptr<I2NPMessage> >& msgs) { m_Queue.Put (msgs); };
+			void PostCleanup (std::shared_ptr<TunnelBase> tunnel);
+
+			int GetIndex () const { return m_Index; };
+			int GetQueueSize () { return m_Queue.GetSize (); };
+			int GetMaxQueueSize () const { return m_MaxQueueSize.load (std::memory_order_relaxed); };
+			uint64_t GetNumProcessedMsgs () const { return m_NumProcessedMsgs.load (std::memory_order_relaxed); };
+			uint64_t GetNumDroppedMsgs () const { return m_Queue.GetNumDropped (); };
+
+		private:
+
+			void Run ();
+			void CleanupTunnels ();
+
+		private:
+
+			Tunnels& m_Owner;
+			int m_Index;
+			bool m_IsRunning;
+			std::thread * m_Thread;
+			i2p::util::MPSCQueue<std::shared_ptr<I2NPMessage> > m_Queue;
+			std::mutex m_CleanupMutex;
+			std::vector<std::shared_ptr<TunnelBase> > m_CleanupTunnels; // tunnels of this shard to cleanup
+
+			// stats, written by shard's thread only
+			std::atomic<int> m_MaxQueueSize;
+			std::atomic<uint64_t> m_NumProcessedMsgs;
+	};
+
+	class TunnelBuildResults;
+	typedef i2p::worker::ThreadPool<TunnelBuildResults> TunnelBuildPool; // threads decrypting build requests
+
+	/** results of TunnelBuildPool, handled by tunnels thread */
+	class TunnelBuildResults
+	{
+		public:
+
+			TunnelBuildResults (Tunnels& owner): m_Owner (owner) {};
+
+			TunnelBuildResults& GetService () { return *this; }; // TunnelBuildPool posts results here
+			void post (const TunnelBuildPool::ResultFunc& result); // from TunnelBuildPool's threads
+			int HandleResults (); // returns number of handled results, called from tunnels thread
+
+		private:
+
+			Tunnels& m_Owner;
+			std::mutex m_ResultsMutex;
+			std::vector<TunnelBuildPool::ResultFunc> m_Results;
+	};
+
 	class Tunnels
 	{
+		friend class TunnelDataShard;
+		friend class TunnelBuildResults;
+
 		public:
 
 			Tunnels ();
 			~Tunnels ();
 			void Start ();
+			void StartShards (int numShards); // called by Start, tunnel data is handled by tunnels thread if less than 2
 			void Stop ();
 
 			std::shared_ptr<InboundTunnel> GetPendingInboundTunnel (uint32_t replyMsgID);
@@ -242,6 +316,9 @@ namespace tunnel
 			void DeleteTunnelPool (std::shared_ptr<TunnelPool> pool);
 			void StopTunnelPool (std::shared_ptr<TunnelPool> pool);
 
+			bool HasBuildPool () const { return m_BuildPool != nullptr; };
+			bool PostBuildRequest (const TunnelBuildPool::WorkFunc& work); // false if overloaded
+
 		private:
 
 			template<class TTunnel>
@@ -251,6 +328,12 @@ namespace tunnel
 			std::shared_ptr<TTunnel> GetPendingTunnel (uint32_t replyMsgID, const std::map<uint32_t, std::shared_ptr<TTunnel> >& pendingTunnels);
 
 			void HandleTunnelGatewayMsg (std::shared_ptr<TunnelBase> tunnel, std::shared_ptr<I2NPMessage> msg);
+			size_t HandleTunnelMsgs (i2p::util::MPSCQueue<std::shared_ptr<I2NPMessage> >& queue, std::shared_ptr<I2NPMessage> msg);
+			void CleanupTunnel (std::shared_ptr<TunnelBase> tunnel);
+			bool IsShardedMsg (std::shared_ptr<const I2NPMessage> msg) const;
+			bool IsBuildMsg (std::shared_ptr<const I2NPMessage> msg) const;
+			void LogDroppedMsgs ();
+			TunnelDataShard& GetShard (uint32_t tunnelID) { return *m_Shards[tunnelID % m_NumShards]; };
 
 			void Run ();
 			void ManageTunnels ();
@@ -275,10 +358,20 @@ namespace tunnel
 			std::list<std::shared_ptr<OutboundTunnel> > m_OutboundTunnels;
 			std::list<std::shared_ptr<TransitTunnel> > m_TransitTunnels;
 			std::unordered_map<uint32_t, std::shared_ptr<TunnelBase> > m_Tunnels; // tunnelID->tunnel known by this id
+			std::mutex m_TunnelsMutex; // m_Tunnels is read by tunnel data shards
 			std::mutex m_PoolsMutex;
 			std::list<std::shared_ptr<TunnelPool>> m_Pools;
 			std::shared_ptr<TunnelPool> m_ExploratoryPool;
-			i2p::util::Queue<std::shared_ptr<I2NPMessage> > m_Queue;
+			i2p::util::MPSCQueue<std::shared_ptr<I2NPMessage> > m_Queue; // drops if full
+			i2p::util::Queue<std::shared_ptr<I2NPMessage> > m_BuildMsgsQueue; // never drops, build messages are rare
+			std::vector<std::unique_ptr<TunnelDataShard> > m_Shards;
+			std::atomic<size_t> m_NumShards; // published after m_Shards is filled, 0 if tunnel data is handled by m_Thread
+			std::unique_ptr<TunnelBuildPool> m_BuildPool; // nullptr if build requests are decrypted by m_Thread
+			std::shared_ptr<TunnelBuildResults> m_BuildResults;
+			int m_MaxNumPendingBuildRequests;
+			std::atomic<int> m_NumPendingBuildRequests; // posted, result not handled yet, read by webconsole
+			std::atomic<uint64_t> m_NumDroppedBuildRequests;
+			uint64_t m_NumLoggedDroppedMsgs;
 
 			// some stats
 			int m_NumSuccesiveTunnelCreations, m_NumFailedTunnelCreations;
@@ -294,7 +387,16 @@ namespace tunnel
 			size_t CountInboundTunnels() const;
 			size_t CountOutboundTunnels() const;
 
-			int GetQueueSize () { return m_Queue.GetSize (); };
+			int GetQueueSize ()
+			{
+				int size = m_Queue.GetSize ();
+				for (auto& it: m_Shards) size += it->GetQueueSize ();
+				return size;
+			}
+			uint64_t GetNumDroppedMsgs () const { return m_Queue.GetNumDropped (); };
+			const decltype(m_Shards)& GetShards () const { return m_Shards; };
+			int GetNumPendingBuildRequests () const { return m_NumPendingBuildRequests; };
+			uint64_t GetNumDroppedBuildRequests () const { return m_NumDroppedBuildRequests; };
 			int GetTunnelCreationSuccessRate () const // in percents
 			{
 				int totalNum = m_NumSuccesiveTunnelCreations + m_NumFailedTunnelCreations;
@@ -155,7 +155,7 @@ namespace tunnel
 					if (msg.data->len + size > msg.data->maxLen)
 					{
 					//	LogPrint (eLogWarning, "TunnelMessage: I2NP message size ", msg.data->maxLen, " is not enough");
-						auto newMsg = NewI2NPMessage ();
+						auto newMsg = NewI2NPMessage (msg.data->len + size);
 						*newMsg = *(msg.data);
 						msg.data = newMsg;
 					}
@@ -220,8 +220,8 @@ namespace tunnel
 			size_t size = it->second.data->GetLength ();
 			if (msg.data->len + size > msg.data->maxLen)
 			{
-				LogPrint (eLogWarning, "TunnelMessage: Tunnel endpoint I2NP message size ", msg.data->maxLen, " is not enough");
-				auto newMsg = NewI2NPMessage ();
+				LogPrint (eLogDebug, "TunnelMessage: Tunnel endpoint I2NP message size ", msg.data->maxLen, " is not enough");
+				auto newMsg = NewI2NPMessage (msg.data->len + size);
 				*newMsg = *(msg.data);
 				msg.data = newMsg;
 			}
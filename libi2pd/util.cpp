@@ -55,6 +55,63 @@ namespace i2p
 {
 namespace util
 {
+	IOServicesPool::IOServicesPool (const std::string& name, size_t num):
+		m_Name (name), m_IsRunning (false), m_NextService (0)
+	{
+		for (size_t i = 0; i < num; i++)
+			m_Services.emplace_back (new Service ());
+	}
+
+	IOServicesPool::~IOServicesPool ()
+	{
+		Stop ();
+	}
+
+	void IOServicesPool::Start ()
+	{
+		if (m_IsRunning) return;
+		m_IsRunning = true;
+		for (auto& it: m_Services)
+			it->thread = new std::thread (std::bind (&IOServicesPool::Run, this, it.get ()));
+	}
+
+	void IOServicesPool::Stop ()
+	{
+		if (!m_IsRunning) return;
+		m_IsRunning = false;
+		for (auto& it: m_Services)
+		{
+			it->service.stop ();
+			if (it->thread)
+			{
+				it->thread->join ();
+				delete it->thread;
+				it->thread = nullptr;
+			}
+			it->service.reset (); // can run again after restart
+		}
+	}
+
+	boost::asio::io_service& IOServicesPool::GetNextService ()
+	{
+		return m_Services[m_NextService.fetch_add (1, std::memory_order_relaxed) % m_Services.size ()]->service;
+	}
+
+	void IOServicesPool::Run (Service * service)
+	{
+		while (m_IsRunning)
+		{
+			try
+			{
+				service->service.run ();
+			}
+			catch (std::exception& ex)
+			{
+				LogPrint (eLogError, m_Name, ": runtime exception: ", ex.what ());
+			}
+		}
+	}
+
 namespace net
 {
 #ifdef WIN32
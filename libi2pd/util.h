@@ -6,6 +6,10 @@
 #include <memory>
 #include <mutex>
 #include <utility>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
 #include <boost/asio.hpp>
 
 #ifdef ANDROID
@@ -120,6 +124,229 @@ namespace util
 			std::mutex m_Mutex;
 	};
 
+	/** thread-safe pool of T, every thread keeps up to threadCacheSize free blocks
+	 * and exchanges them with the shared free list in batches, so the mutex is taken rarely.
+	 * Shared free list keeps up to maxNumFree blocks, the rest is returned to the system.
+	 * Thread caches are kept per pool and flushed to the shared list on thread exit,
+	 * later releases go to the shared list directly.
+	 * Must be allocated with new and never deleted since objects and thread caches can outlive it */
+	template<class T>
+	class MemoryPoolMtCached
+	{
+		struct ThreadCache
+		{
+			MemoryPoolMtCached * pool;
+			std::vector<void *> blocks;
+		};
+
+		struct ThreadCaches // all pools of T used by a thread, usually one
+		{
+			bool& destroyed;
+			std::vector<ThreadCache> caches;
+
+			ThreadCaches (bool& d): destroyed (d) {};
+			~ThreadCaches ()
+			{
+				destroyed = true; // releases from now on go to shared lists
+				for (auto& it: caches)
+					it.pool->ReleaseBlocks (it.blocks, 0);
+			};
+		};
+
+		public:
+
+			MemoryPoolMtCached (size_t maxNumFree, size_t threadCacheSize):
+				m_MaxNumFree (maxNumFree), m_ThreadCacheSize (threadCacheSize ? threadCacheSize : 1),
+				m_NumAllocated (0), m_NumInUse (0), m_NumFree (0) {};
+			MemoryPoolMtCached (const MemoryPoolMtCached&) = delete;
+
+			template<typename... TArgs>
+			T * Acquire (TArgs&&... args)
+			{
+				void * block = nullptr;
+				auto cache = GetThreadCache ();
+				if (cache)
+				{
+					if (cache->blocks.empty ())
+					{
+						// take half of cache size from shared list
+						std::lock_guard<std::mutex> l(m_Mutex);
+						while (!m_Free.empty () && cache->blocks.size () < (m_ThreadCacheSize + 1)/2)
+						{
+							cache->blocks.push_back (m_Free.back ());
+							m_Free.pop_back ();
+						}
+						m_NumFree = m_Free.size ();
+					}
+					if (!cache->blocks.empty ())
+					{
+						block = cache->blocks.back ();
+						cache->blocks.pop_back ();
+					}
+				}
+				else
+				{
+					// thread cache is gone, thread is exiting
+					std::lock_guard<std::mutex> l(m_Mutex);
+					if (!m_Free.empty ())
+					{
+						block = m_Free.back ();
+						m_Free.pop_back ();
+					}
+					m_NumFree = m_Free.size ();
+				}
+				if (!block)
+				{
+					block = ::operator new (sizeof (T));
+					m_NumAllocated++;
+				}
+				m_NumInUse++;
+				return new (block)T(std::forward<TArgs>(args)...);
+			}
+
+			void Release (T * t)
+			{
+				if (!t) return;
+				t->~T ();
+				m_NumInUse--;
+				auto cache = GetThreadCache ();
+				if (cache)
+				{
+					cache->blocks.push_back (t);
+					if (cache->blocks.size () > m_ThreadCacheSize)
+						ReleaseBlocks (cache->blocks, m_ThreadCacheSize/2);
+				}
+				else
+				{
+					// released from a static destructor after thread caches are gone
+					std::vector<void *> blocks{ t };
+					ReleaseBlocks (blocks, 0);
+				}
+			}
+
+			template<typename... TArgs>
+			std::shared_ptr<T> AcquireShared (TArgs&&... args)
+			{
+				return std::shared_ptr<T>(Acquire (std::forward<TArgs>(args)...),
+					[this](T * t) { Release (t); });
+			}
+
+			size_t GetNumAllocated () const { return m_NumAllocated; }; // blocks owned by pool
+			size_t GetNumInUse () const { return m_NumInUse; };
+			size_t GetNumFree () const { return m_NumFree; }; // in shared list only
+
+		private:
+
+			ThreadCache * GetThreadCache ()
+			{
+				// trivially destructible, so still valid after thread_local destructors have run
+				static thread_local bool destroyed = false;
+				if (destroyed) return nullptr;
+				static thread_local ThreadCaches caches (destroyed);
+				for (auto& it: caches.caches)
+					if (it.pool == this) return &it;
+				caches.caches.push_back ({ this, {} });
+				return &caches.caches.back ();
+			}
+
+			void ReleaseBlocks (std::vector<void *>& blocks, size_t keep)
+			{
+				std::lock_guard<std::mutex> l(m_Mutex);
+				while (blocks.size () > keep)
+				{
+					if (m_Free.size () < m_MaxNumFree)
+						m_Free.push_back (blocks.back ());
+					else
+					{
+						::operator delete (blocks.back ());
+						m_NumAllocated--;
+					}
+					blocks.pop_back ();
+				}
+				m_NumFree = m_Free.size ();
+			}
+
+		private:
+
+			size_t m_MaxNumFree, m_ThreadCacheSize;
+			std::mutex m_Mutex;
+			std::vector<void *> m_Free;
+			std::atomic<size_t> m_NumAllocated, m_NumInUse, m_NumFree;
+	};
+
+	/** std::mutex counting acquisitions and time spent waiting when contended */
+	class MeasuredMutex
+	{
+		public:
+
+			MeasuredMutex (): m_NumLocks (0), m_NumContended (0), m_WaitTime (0) {};
+			MeasuredMutex (const MeasuredMutex&) = delete;
+
+			void lock ()
+			{
+				m_NumLocks.fetch_add (1, std::memory_order_relaxed);
+				if (m_Mutex.try_lock ()) return;
+				auto start = std::chrono::steady_clock::now ();
+				m_Mutex.lock ();
+				m_NumContended.fetch_add (1, std::memory_order_relaxed);
+				m_WaitTime.fetch_add (std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::steady_clock::now () - start).count (), std::memory_order_relaxed);
+			}
+
+			bool try_lock ()
+			{
+				if (!m_Mutex.try_lock ()) return false;
+				m_NumLocks.fetch_add (1, std::memory_order_relaxed);
+				return true;
+			}
+
+			void unlock () { m_Mutex.unlock (); };
+
+			uint64_t GetNumLocks () const { return m_NumLocks; };
+			uint64_t GetNumContended () const { return m_NumContended; };
+			uint64_t GetWaitTime () const { return m_WaitTime; }; // in microseconds
+
+		private:
+
+			std::mutex m_Mutex;
+			std::atomic<uint64_t> m_NumLocks, m_NumContended, m_WaitTime;
+	};
+
+	/** io_service threads sessions are distributed over, a session stays on its service */
+	class IOServicesPool
+	{
+		public:
+
+			IOServicesPool (const std::string& name, size_t num);
+			~IOServicesPool ();
+
+			void Start ();
+			void Stop ();
+
+			size_t GetSize () const { return m_Services.size (); };
+			boost::asio::io_service& GetNextService (); // round robin
+
+		private:
+
+			struct Service
+			{
+				Service (): work (service) {};
+
+				boost::asio::io_service service;
+				boost::asio::io_service::work work;
+				std::thread * thread = nullptr;
+			};
+
+			void Run (Service * service);
+
+		private:
+
+			std::string m_Name;
+			bool m_IsRunning;
+			std::vector<std::unique_ptr<Service> > m_Services;
+			std::atomic<size_t> m_NextService;
+	};
+
 	namespace net
 	{
 		int GetMTU (const boost::asio::ip::address& localAddress);
@@ -35,6 +35,10 @@ namespace client
 
 	void ClientContext::Start ()
 	{
+		// ElGamal for all local destinations
+		uint16_t elGamalThreads; i2p::config::GetOption("limits.elgamalthreads", elGamalThreads);
+		StartElGamalPool (elGamalThreads);
+
 		// shared local destination
 		if (!m_SharedLocalDestination)
 			CreateNewSharedLocalDestination ();
@@ -182,6 +186,8 @@ namespace client
 			it.second->Stop ();
 		m_Destinations.clear ();
 		m_SharedLocalDestination = nullptr;
+
+		StopElGamalPool ();
 	}
 
 	void ClientContext::ReloadConfig ()
@@ -378,6 +384,12 @@ namespace client
         return section.second.get (boost::property_tree::ptree::path_type (name, '/'), std::to_string (value));
 	}
 
+	template<typename Section>
+	std::string ClientContext::GetI2CPStringOption (const Section& section, const std::string& name, const std::string& value) const
+	{
+		return section.second.get (boost::property_tree::ptree::path_type (name, '/'), value);
+	}
+
 	template<typename Section>
 	void ClientContext::ReadI2CPOptions (const Section& section, std::map<std::string, std::string>& options) const
 	{
@@ -389,6 +401,7 @@ namespace client
 		options[I2CP_PARAM_MIN_TUNNEL_LATENCY] = GetI2CPOption(section, I2CP_PARAM_MIN_TUNNEL_LATENCY, DEFAULT_MIN_TUNNEL_LATENCY);
 		options[I2CP_PARAM_MAX_TUNNEL_LATENCY] = GetI2CPOption(section, I2CP_PARAM_MAX_TUNNEL_LATENCY, DEFAULT_MAX_TUNNEL_LATENCY);
 		options[I2CP_PARAM_STREAMING_INITIAL_ACK_DELAY] = GetI2CPOption(section, I2CP_PARAM_STREAMING_INITIAL_ACK_DELAY, DEFAULT_INITIAL_ACK_DELAY);
+		options[I2CP_PARAM_STREAMING_CONGESTION_CONTROL] = GetI2CPStringOption(section, I2CP_PARAM_STREAMING_CONGESTION_CONTROL, i2p::stream::DEFAULT_CONGESTION_CONTROL);
 	}
 
 	void ClientContext::ReadI2CPOptionsFromConfig (const std::string& prefix, std::map<std::string, std::string>& options) const
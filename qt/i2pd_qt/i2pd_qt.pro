@@ -29,15 +29,18 @@ SOURCES += DaemonQT.cpp mainwindow.cpp \
     ../../libi2pd/Base.cpp \
     ../../libi2pd/BloomFilter.cpp \
     ../../libi2pd/Config.cpp \
+    ../../libi2pd/CongestionControl.cpp \
     ../../libi2pd/CPU.cpp \
     ../../libi2pd/Crypto.cpp \
 	../../libi2pd/CryptoKey.cpp \
     ../../libi2pd/Datagram.cpp \
     ../../libi2pd/Destination.cpp \
+    ../../libi2pd/ElGamal.cpp \
     ../../libi2pd/Event.cpp \
     ../../libi2pd/Family.cpp \
     ../../libi2pd/FS.cpp \
     ../../libi2pd/Garlic.cpp \
+    ../../libi2pd/GarlicTags.cpp \
     ../../libi2pd/Gost.cpp \
     ../../libi2pd/Gzip.cpp \
     ../../libi2pd/HTTP.cpp \
@@ -53,8 +56,10 @@ SOURCES += DaemonQT.cpp mainwindow.cpp \
     ../../libi2pd/Reseed.cpp \
     ../../libi2pd/RouterContext.cpp \
     ../../libi2pd/RouterInfo.cpp \
+    ../../libi2pd/RouterInfoStore.cpp \
     ../../libi2pd/Signature.cpp \
     ../../libi2pd/SSU.cpp \
+    ../../libi2pd/SSUBatch.cpp \
     ../../libi2pd/SSUData.cpp \
     ../../libi2pd/SSUSession.cpp \
     ../../libi2pd/Streaming.cpp \
@@ -112,14 +117,17 @@ HEADERS  += DaemonQT.h mainwindow.h \
     ../../libi2pd/Base.h \
     ../../libi2pd/BloomFilter.h \
     ../../libi2pd/Config.h \
+    ../../libi2pd/CongestionControl.h \
     ../../libi2pd/Crypto.h \
 	../../libi2pd/CryptoKey.h \
     ../../libi2pd/Datagram.h \
     ../../libi2pd/Destination.h \
+    ../../libi2pd/ElGamal.h \
     ../../libi2pd/Event.h \
     ../../libi2pd/Family.h \
     ../../libi2pd/FS.h \
     ../../libi2pd/Garlic.h \
+    ../../libi2pd/GarlicTags.h \
     ../../libi2pd/Gost.h \
     ../../libi2pd/Gzip.h \
     ../../libi2pd/HTTP.h \
@@ -137,8 +145,10 @@ HEADERS  += DaemonQT.h mainwindow.h \
     ../../libi2pd/Reseed.h \
     ../../libi2pd/RouterContext.h \
     ../../libi2pd/RouterInfo.h \
+    ../../libi2pd/RouterInfoStore.h \
     ../../libi2pd/Signature.h \
     ../../libi2pd/SSU.h \
+    ../../libi2pd/SSUBatch.h \
     ../../libi2pd/SSUData.h \
     ../../libi2pd/SSUSession.h \
     ../../libi2pd/Streaming.h \
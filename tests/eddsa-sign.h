@@ -0,0 +1,37 @@
+#ifndef TESTS_EDDSA_SIGN_H__
+#define TESTS_EDDSA_SIGN_H__
+
+#include <inttypes.h>
+#include <string.h>
+#include <openssl/sha.h>
+#include <openssl/bn.h>
+
+// S = r + h*a mod l for given R, valid only if R is B*S - PK*h, r is 32 bytes or nullptr for 0
+inline void SignWithR (const uint8_t * expandedKey, const uint8_t * publicKey, const uint8_t * R,
+	const uint8_t * buf, size_t len, uint8_t * signature, const uint8_t * r = nullptr)
+{
+	uint8_t digest[64];
+	SHA512_CTX sha;
+	SHA512_Init (&sha);
+	SHA512_Update (&sha, R, 32);
+	SHA512_Update (&sha, publicKey, 32);
+	SHA512_Update (&sha, buf, len);
+	SHA512_Final (digest, &sha);
+	BN_CTX * ctx = BN_CTX_new ();
+	BIGNUM * l = nullptr;
+	BN_hex2bn (&l, "1000000000000000000000000000000014def9dea2f79cd65812631a5cf5d3ed");
+	BIGNUM * h = BN_lebin2bn (digest, 64, nullptr), * a = BN_lebin2bn (expandedKey, 32, nullptr);
+	BN_mod_mul (h, h, a, l, ctx);
+	if (r)
+	{
+		BIGNUM * rn = BN_lebin2bn (r, 32, nullptr);
+		BN_mod_add (h, h, rn, l, ctx);
+		BN_free (rn);
+	}
+	memcpy (signature, R, 32);
+	BN_bn2lebinpad (h, signature + 32, 32);
+	BN_free (h); BN_free (a); BN_free (l);
+	BN_CTX_free (ctx);
+}
+
+#endif
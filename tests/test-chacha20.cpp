@@ -0,0 +1,166 @@
+#include <cassert>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <openssl/rand.h>
+
+#include "CPU.h"
+#include "Crypto.h"
+#include "ChaCha20.h"
+#include "Poly1305.h"
+
+// RFC 7539 2.5.2
+uint8_t polyKey[32] =
+{
+	0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33, 0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+	0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd, 0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b
+};
+
+char polyText[] = "Cryptographic Forum Research Group";
+
+uint8_t polyTag[16] =
+{
+	0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6, 0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9
+};
+
+// RFC 7539 A.3 #5-#11, reduction modulo 2^130-5 edge cases
+struct PolyVector
+{
+	const char * key, * msg, * tag; // hex
+} polyVectors[] =
+{
+	{ "0200000000000000000000000000000000000000000000000000000000000000",
+		"ffffffffffffffffffffffffffffffff", "03000000000000000000000000000000" },
+	{ "02000000000000000000000000000000ffffffffffffffffffffffffffffffff",
+		"02000000000000000000000000000000", "03000000000000000000000000000000" },
+	{ "0100000000000000000000000000000000000000000000000000000000000000",
+		"fffffffffffffffffffffffffffffffff0ffffffffffffffffffffffffffffff11000000000000000000000000000000",
+		"05000000000000000000000000000000" },
+	{ "0100000000000000000000000000000000000000000000000000000000000000",
+		"fffffffffffffffffffffffffffffffffbfefefefefefefefefefefefefefefe01010101010101010101010101010101",
+		"00000000000000000000000000000000" },
+	{ "0200000000000000000000000000000000000000000000000000000000000000",
+		"fdffffffffffffffffffffffffffffff", "faffffffffffffffffffffffffffffff" },
+	{ "0100000000000000040000000000000000000000000000000000000000000000",
+		"e33594d7505e43b900000000000000003394d7505e4379cd01000000000000000000000000000000000000000000000001000000000000000000000000000000",
+		"14000000000000005500000000000000" },
+	{ "0100000000000000040000000000000000000000000000000000000000000000",
+		"e33594d7505e43b900000000000000003394d7505e4379cd010000000000000000000000000000000000000000000000",
+		"13000000000000000000000000000000" }
+};
+
+std::vector<uint8_t> FromHex (const char * hex)
+{
+	std::vector<uint8_t> buf (strlen (hex)/2);
+	for (size_t i = 0; i < buf.size (); i++)
+		sscanf (hex + 2*i, "%2hhx", &buf[i]);
+	return buf;
+}
+
+const size_t BUF_SIZE = 65536;
+const int NUM_RUNS = 500;
+
+void SetCPU (bool simd, bool avx2)
+{
+	i2p::cpu::sse2 = simd;
+	i2p::cpu::avx2 = simd && avx2;
+}
+
+double ChaCha20Rate (std::vector<uint8_t>& buf, const uint8_t * key, const uint8_t * nonce)
+{
+	auto start = std::chrono::steady_clock::now ();
+	for (int i = 0; i < NUM_RUNS; i++)
+		i2p::crypto::chacha20 (buf.data (), buf.size (), nonce, key);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+	return NUM_RUNS*buf.size ()/elapsed.count ()/1e9;
+}
+
+int main (int argc, char * argv[])
+{
+	i2p::cpu::Detect ();
+	bool sse2 = i2p::cpu::sse2, avx2 = i2p::cpu::avx2;
+
+	uint32_t tag[4];
+	i2p::crypto::Poly1305HMAC (tag, (uint32_t *)polyKey, (uint8_t *)polyText, strlen (polyText));
+	assert (!memcmp (tag, polyTag, 16));
+	for (const auto& it: polyVectors)
+	{
+		auto key = FromHex (it.key), msg = FromHex (it.msg), expected = FromHex (it.tag);
+		i2p::crypto::Poly1305HMAC (tag, (uint32_t *)key.data (), msg.data (), msg.size ());
+		assert (!memcmp (tag, expected.data (), 16));
+	}
+	// empty message, tag is s
+	i2p::crypto::Poly1305HMAC (tag, (uint32_t *)polyKey, nullptr, 0);
+	assert (!memcmp (tag, polyKey + 16, 16));
+
+	uint8_t key[32], nonce[12];
+	RAND_bytes (key, 32);
+	RAND_bytes (nonce, 12);
+	std::vector<uint8_t> buf (BUF_SIZE);
+	RAND_bytes (buf.data (), buf.size ());
+	for (size_t len: { 0, 1, 63, 64, 255, 256, 257, 511, 512, 1000, 4097, 65535 })
+	{
+		// vector paths must match scalar for any length and counter
+		std::vector<uint8_t> ref (buf.begin (), buf.begin () + len), out (ref);
+		SetCPU (false, false);
+		i2p::crypto::chacha20 (ref.data (), len, nonce, key, 0xfffffffe);
+		SetCPU (sse2, false);
+		i2p::crypto::chacha20 (out.data (), len, nonce, key, 0xfffffffe);
+		assert (out == ref);
+		out.assign (buf.begin (), buf.begin () + len);
+		SetCPU (sse2, avx2);
+		i2p::crypto::chacha20 (out.data (), len, nonce, key, 0xfffffffe);
+		assert (out == ref);
+
+		// chacha20 and Poly1305 of AEAD without ad must match OpenSSL
+		std::vector<uint8_t> encrypted (len + 16);
+		assert (i2p::crypto::AEADChaCha20Poly1305 (buf.data (), len, nullptr, 0, key, nonce, encrypted.data (), len + 16, true));
+		uint8_t otk[64]; memset (otk, 0, 64);
+		i2p::crypto::chacha20 (otk, 64, nonce, key, 0);
+		out.assign (buf.begin (), buf.begin () + len);
+		i2p::crypto::chacha20 (out.data (), len, nonce, key, 1);
+		assert (!memcmp (out.data (), encrypted.data (), len));
+		std::vector<uint8_t> polyMsg ((len + 15)/16*16 + 16, 0);
+		memcpy (polyMsg.data (), out.data (), len);
+		uint64_t lengths[2] = { 0, len }; // little endian
+		memcpy (polyMsg.data () + polyMsg.size () - 16, lengths, 16);
+		i2p::crypto::Poly1305HMAC (tag, (uint32_t *)otk, polyMsg.data (), polyMsg.size ());
+		assert (!memcmp (tag, encrypted.data () + len, 16));
+
+		// decrypts, and fails if ciphertext, tag or ad is corrupted
+		uint8_t ad[13] = { 1 };
+		assert (i2p::crypto::AEADChaCha20Poly1305 (buf.data (), len, ad, sizeof (ad), key, nonce, encrypted.data (), len + 16, true));
+		std::vector<uint8_t> decrypted (len);
+		assert (i2p::crypto::AEADChaCha20Poly1305 (encrypted.data (), len, ad, sizeof (ad), key, nonce, decrypted.data (), len, false));
+		assert (std::equal (decrypted.begin (), decrypted.end (), buf.begin ()));
+		for (size_t pos: { (size_t)0, len/2, len + 15 })
+		{
+			if (pos >= len + 16) continue;
+			encrypted[pos] ^= 0x80;
+			assert (!i2p::crypto::AEADChaCha20Poly1305 (encrypted.data (), len, ad, sizeof (ad), key, nonce, decrypted.data (), len, false));
+			encrypted[pos] ^= 0x80;
+		}
+		ad[0] ^= 1;
+		assert (!i2p::crypto::AEADChaCha20Poly1305 (encrypted.data (), len, ad, sizeof (ad), key, nonce, decrypted.data (), len, false));
+	}
+
+	if (argc < 2 || strcmp (argv[1], "--bench")) return 0;
+	// throughput
+	printf ("SSE2 %s, AVX2 %s\n", sse2 ? "enabled" : "disabled", avx2 ? "enabled" : "disabled");
+	SetCPU (false, false);
+	double scalar = ChaCha20Rate (buf, key, nonce);
+	SetCPU (sse2, false);
+	double sse = ChaCha20Rate (buf, key, nonce);
+	SetCPU (sse2, avx2);
+	double best = ChaCha20Rate (buf, key, nonce);
+	auto start = std::chrono::steady_clock::now ();
+	for (int i = 0; i < NUM_RUNS; i++)
+		i2p::crypto::Poly1305HMAC (tag, (uint32_t *)key, buf.data (), buf.size ());
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+	printf ("ChaCha20 scalar %.3f GB/s, SSE2 %.3f GB/s, AVX2 %.3f GB/s; Poly1305 %.3f GB/s\n",
+		scalar, sse, best, NUM_RUNS*buf.size ()/elapsed.count ()/1e9);
+	return 0;
+}
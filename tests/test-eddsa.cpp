@@ -0,0 +1,237 @@
+#include <cassert>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include "Signature.h"
+#include "eddsa-sign.h"
+
+// RFC 8032 7.1, TEST 1
+const uint8_t pk[32] =
+{
+	0xd7, 0x5a, 0x98, 0x01, 0x82, 0xb1, 0x0a, 0xb7, 0xd5, 0x4b, 0xfe, 0xd3, 0xc9, 0x64, 0x07, 0x3a,
+	0x0e, 0xe1, 0x72, 0xf3, 0xda, 0xa6, 0x23, 0x25, 0xaf, 0x02, 0x1a, 0x68, 0xf7, 0x07, 0x51, 0x1a
+};
+
+const uint8_t sig[64] =
+{
+	0xe5, 0x56, 0x43, 0x00, 0xc3, 0x60, 0xac, 0x72, 0x90, 0x86, 0xe2, 0xcc, 0x80, 0x6e, 0x82, 0x8a,
+	0x84, 0x87, 0x7f, 0x1e, 0xb8, 0xe5, 0xd9, 0x74, 0xd8, 0x73, 0xe0, 0x65, 0x22, 0x49, 0x01, 0x55,
+	0x5f, 0xb8, 0x82, 0x15, 0x90, 0xa3, 0x3b, 0xac, 0xc6, 0x1e, 0x39, 0x70, 0x1c, 0xf9, 0xb4, 0x6b,
+	0xd2, 0x5b, 0xf5, 0xf0, 0x59, 0x5b, 0xbe, 0x24, 0x65, 0x51, 0x41, 0x43, 0x8e, 0x7a, 0x10, 0x0b
+};
+
+const size_t NUM_SIGNATURES = 64;
+const size_t MSG_LEN = 1000;
+
+// reference verification with BIGNUM
+bool VerifyBN (const uint8_t * publicKey, const uint8_t * buf, size_t len, const uint8_t * signature)
+{
+	BN_CTX * ctx = BN_CTX_new ();
+	auto point = i2p::crypto::GetEd25519 ()->DecodePublicKey (publicKey, ctx);
+	BN_CTX_free (ctx);
+	uint8_t digest[64];
+	SHA512_CTX sha;
+	SHA512_Init (&sha);
+	SHA512_Update (&sha, signature, 32);
+	SHA512_Update (&sha, publicKey, 32);
+	SHA512_Update (&sha, buf, len);
+	SHA512_Final (digest, &sha);
+	return i2p::crypto::GetEd25519 ()->Verify (point, digest, signature);
+}
+
+// p1 + p2 encoded, -x^2 + y^2 = 1 + d*x^2*y^2
+void AddPoints (const uint8_t * p1, const uint8_t * p2, uint8_t * sum)
+{
+	BN_CTX * ctx = BN_CTX_new ();
+	BIGNUM * q = nullptr, * d = nullptr;
+	BN_hex2bn (&q, "7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffed");
+	BN_hex2bn (&d, "52036cee2b6ffe738cc740797779e89800700a4d4141d8ab75eb4dca135978a3");
+	BIGNUM * x[2], * y[2];
+	const uint8_t * p[2] = { p1, p2 };
+	for (int i = 0; i < 2; i++)
+	{
+		auto point = i2p::crypto::GetEd25519 ()->DecodePublicKey (p[i], ctx);
+		x[i] = BN_new (); y[i] = BN_new ();
+		if (point.z)
+		{
+			BIGNUM * zi = BN_mod_inverse (nullptr, point.z, q, ctx);
+			BN_mod_mul (x[i], point.x, zi, q, ctx);
+			BN_mod_mul (y[i], point.y, zi, q, ctx);
+			BN_free (zi);
+		}
+		else
+		{
+			BN_nnmod (x[i], point.x, q, ctx);
+			BN_nnmod (y[i], point.y, q, ctx);
+		}
+	}
+	BIGNUM * t = BN_new (), * a = BN_new (), * b = BN_new (), * x3 = BN_new (), * y3 = BN_new ();
+	BN_mod_mul (t, x[0], x[1], q, ctx);
+	BN_mod_mul (t, t, y[0], q, ctx);
+	BN_mod_mul (t, t, y[1], q, ctx);
+	BN_mod_mul (t, t, d, q, ctx); // d*x1*x2*y1*y2
+	BN_mod_mul (a, x[0], y[1], q, ctx);
+	BN_mod_mul (b, y[0], x[1], q, ctx);
+	BN_mod_add (x3, a, b, q, ctx);
+	BN_one (a); BN_mod_add (a, a, t, q, ctx);
+	BN_mod_inverse (a, a, q, ctx);
+	BN_mod_mul (x3, x3, a, q, ctx); // (x1*y2 + y1*x2)/(1 + t)
+	BN_mod_mul (a, y[0], y[1], q, ctx);
+	BN_mod_mul (b, x[0], x[1], q, ctx);
+	BN_mod_add (y3, a, b, q, ctx);
+	BN_one (a); BN_mod_sub (a, a, t, q, ctx);
+	BN_mod_inverse (a, a, q, ctx);
+	BN_mod_mul (y3, y3, a, q, ctx); // (y1*y2 + x1*x2)/(1 - t)
+	BN_bn2lebinpad (y3, sum, 32);
+	if (BN_is_odd (x3)) sum[31] |= 0x80;
+	for (int i = 0; i < 2; i++) { BN_free (x[i]); BN_free (y[i]); }
+	BN_free (t); BN_free (a); BN_free (b); BN_free (x3); BN_free (y3); BN_free (q); BN_free (d);
+	BN_CTX_free (ctx);
+}
+
+// radix 2^51 and BIGNUM verification must give the same result
+void CheckSame (const uint8_t * publicKey, const uint8_t * buf, size_t len, const uint8_t * signature, bool expected)
+{
+	i2p::crypto::EDDSA25519Verifier verifier (publicKey);
+	bool single = verifier.Verify (buf, len, signature);
+	assert (single == expected);
+	assert (VerifyBN (publicKey, buf, len, signature) == single);
+}
+
+int main (int argc, char * argv[])
+{
+	i2p::crypto::EDDSA25519Verifier rfcVerifier (pk);
+	assert (rfcVerifier.Verify (nullptr, 0, sig));
+	assert (VerifyBN (pk, nullptr, 0, sig));
+
+	std::vector<std::unique_ptr<i2p::crypto::EDDSA25519Verifier> > verifiers;
+	std::vector<uint8_t> publicKeys (NUM_SIGNATURES*32), msgs (NUM_SIGNATURES*MSG_LEN), signatures (NUM_SIGNATURES*64);
+	RAND_bytes (msgs.data (), msgs.size ());
+	for (size_t i = 0; i < NUM_SIGNATURES; i++)
+	{
+		uint8_t priv[32];
+		i2p::crypto::CreateEDDSA25519RandomKeys (priv, publicKeys.data () + i*32);
+		i2p::crypto::EDDSA25519Signer signer (priv);
+		signer.Sign (msgs.data () + i*MSG_LEN, MSG_LEN, signatures.data () + i*64);
+		verifiers.emplace_back (new i2p::crypto::EDDSA25519Verifier (publicKeys.data () + i*32));
+		assert (verifiers.back ()->Verify (msgs.data () + i*MSG_LEN, MSG_LEN, signatures.data () + i*64));
+		assert (VerifyBN (publicKeys.data () + i*32, msgs.data () + i*MSG_LEN, MSG_LEN, signatures.data () + i*64));
+	}
+	// wrong signature and wrong message
+	signatures[5] ^= 0x01;
+	assert (!verifiers[0]->Verify (msgs.data (), MSG_LEN, signatures.data ()));
+	assert (!VerifyBN (publicKeys.data (), msgs.data (), MSG_LEN, signatures.data ()));
+	signatures[5] ^= 0x01;
+	msgs[MSG_LEN - 1] ^= 0x01;
+	assert (!verifiers[0]->Verify (msgs.data (), MSG_LEN, signatures.data ()));
+	msgs[MSG_LEN - 1] ^= 0x01;
+	// truncated message, empty message
+	assert (!verifiers[0]->Verify (msgs.data (), MSG_LEN - 1, signatures.data ()));
+	{
+		uint8_t priv[32], pub[32], emptySig[64];
+		i2p::crypto::CreateEDDSA25519RandomKeys (priv, pub);
+		i2p::crypto::EDDSA25519Signer signer (priv);
+		signer.Sign (nullptr, 0, emptySig);
+		i2p::crypto::EDDSA25519Verifier verifier (pub);
+		assert (verifier.Verify (nullptr, 0, emptySig));
+		assert (!verifier.Verify (msgs.data (), 1, emptySig));
+	}
+
+	// small order and non-canonical points
+	uint8_t seed[32], expanded[64], publicKey[32], R[32], signature[64];
+	RAND_bytes (seed, 32);
+	i2p::crypto::Ed25519::ExpandPrivateKey (seed, expanded);
+	BN_CTX * ctx = BN_CTX_new ();
+	i2p::crypto::GetEd25519 ()->EncodePublicKey (i2p::crypto::GetEd25519 ()->GeneratePublicKey (expanded, ctx), publicKey, ctx);
+	const uint8_t * msg = msgs.data ();
+	memset (R, 0, 32); R[0] = 1; // identity
+	SignWithR (expanded, publicKey, R, msg, MSG_LEN, signature);
+	CheckSame (publicKey, msg, MSG_LEN, signature, true);
+	memset (R, 0xFF, 32); R[0] = 0xEC; R[31] = 0x7F; // (0, -1) of order 2
+	SignWithR (expanded, publicKey, R, msg, MSG_LEN, signature);
+	CheckSame (publicKey, msg, MSG_LEN, signature, false);
+	memset (R, 0, 32); R[0] = 1; R[31] = 0x80; // identity with sign of x
+	SignWithR (expanded, publicKey, R, msg, MSG_LEN, signature);
+	CheckSame (publicKey, msg, MSG_LEN, signature, false);
+	memset (R, 0xFF, 32); R[0] = 0xEE; R[31] = 0x7F; // identity as y = q + 1
+	SignWithR (expanded, publicKey, R, msg, MSG_LEN, signature);
+	CheckSame (publicKey, msg, MSG_LEN, signature, false);
+	// public key of order 2, R = B*S passes only if h is even
+	uint8_t smallOrderKey[32];
+	memset (smallOrderKey, 0xFF, 32); smallOrderKey[0] = 0xEC; smallOrderKey[31] = 0x7F;
+	int numPassed = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		RAND_bytes (signature + 32, 32); signature[63] &= 0x0F; // S < l
+		uint8_t s[64] = {0};
+		memcpy (s, signature + 32, 32);
+		i2p::crypto::GetEd25519 ()->EncodePublicKey (i2p::crypto::GetEd25519 ()->GeneratePublicKey (s, ctx), signature, ctx);
+		i2p::crypto::EDDSA25519Verifier verifier (smallOrderKey);
+		bool passed = verifier.Verify (msgs.data () + i*MSG_LEN, MSG_LEN, signature);
+		if (passed) numPassed++;
+		CheckSame (smallOrderKey, msgs.data () + i*MSG_LEN, MSG_LEN, signature, passed);
+	}
+	assert (numPassed > 0 && numPassed < 16);
+	// full order points with component of order 8
+	const uint8_t order8[32] =
+	{
+		0xc7, 0x17, 0x6a, 0x70, 0x3d, 0x4d, 0xd8, 0x4f, 0xba, 0x3c, 0x0b, 0x76, 0x0d, 0x10, 0x67, 0x0f,
+		0x2a, 0x20, 0x53, 0xfa, 0x2c, 0x39, 0xcc, 0xc6, 0x4e, 0xc7, 0xfd, 0x77, 0x92, 0xac, 0x03, 0x7a
+	};
+	uint8_t t[32], identity[32] = {1};
+	memcpy (t, order8, 32);
+	for (int i = 1; i < 8; i++)
+	{
+		assert (memcmp (t, identity, 32));
+		AddPoints (t, order8, t);
+	}
+	assert (!memcmp (t, identity, 32));
+	uint8_t torsionKey[32];
+	AddPoints (publicKey, order8, torsionKey); // passes only if h%8 == 0
+	numPassed = 0;
+	for (int i = 0; i < 32; i++)
+	{
+		uint8_t r[64] = {0};
+		RAND_bytes (r, 32); r[31] &= 0x0F;
+		i2p::crypto::GetEd25519 ()->EncodePublicKey (i2p::crypto::GetEd25519 ()->GeneratePublicKey (r, ctx), R, ctx);
+		SignWithR (expanded, torsionKey, R, msgs.data () + i*MSG_LEN, MSG_LEN, signature, r);
+		i2p::crypto::EDDSA25519Verifier verifier (torsionKey);
+		bool passed = verifier.Verify (msgs.data () + i*MSG_LEN, MSG_LEN, signature);
+		if (passed) numPassed++;
+		CheckSame (torsionKey, msgs.data () + i*MSG_LEN, MSG_LEN, signature, passed);
+		// R with component of order 8 never passes
+		AddPoints (R, order8, R);
+		SignWithR (expanded, publicKey, R, msgs.data () + i*MSG_LEN, MSG_LEN, signature, r);
+		CheckSame (publicKey, msgs.data () + i*MSG_LEN, MSG_LEN, signature, false);
+	}
+	assert (numPassed < 32);
+	// S >= l
+	memcpy (signature, signatures.data (), 64);
+	BIGNUM * S = BN_lebin2bn (signature + 32, 32, nullptr), * l = nullptr;
+	BN_hex2bn (&l, "1000000000000000000000000000000014def9dea2f79cd65812631a5cf5d3ed");
+	BN_add (S, S, l);
+	BN_bn2lebinpad (S, signature + 32, 32);
+	BN_free (S); BN_free (l);
+	CheckSame (publicKeys.data (), msg, MSG_LEN, signature, false);
+	// all zeros, R of order 4 and S = 0
+	memset (signature, 0, 64);
+	CheckSame (publicKeys.data (), msg, MSG_LEN, signature, false);
+	BN_CTX_free (ctx);
+
+	if (argc < 2 || strcmp (argv[1], "--bench")) return 0;
+	// throughput
+	auto start = std::chrono::steady_clock::now ();
+	for (size_t i = 0; i < NUM_SIGNATURES; i++)
+		VerifyBN (publicKeys.data () + i*32, msgs.data () + i*MSG_LEN, MSG_LEN, signatures.data () + i*64);
+	std::chrono::duration<double> bn = std::chrono::steady_clock::now () - start;
+	start = std::chrono::steady_clock::now ();
+	for (size_t i = 0; i < NUM_SIGNATURES; i++)
+		verifiers[i]->Verify (msgs.data () + i*MSG_LEN, MSG_LEN, signatures.data () + i*64);
+	std::chrono::duration<double> single = std::chrono::steady_clock::now () - start;
+	printf ("EdDSA verify: BIGNUM %.0f/s, radix 2^51 %.0f/s\n", NUM_SIGNATURES/bn.count (), NUM_SIGNATURES/single.count ());
+	return 0;
+}
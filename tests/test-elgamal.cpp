@@ -0,0 +1,283 @@
+#include <cassert>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <openssl/rand.h>
+
+#include "Crypto.h"
+#include "ElGamal.h"
+
+using namespace i2p::crypto;
+
+const int NUM_OPS = 100;
+
+BIGNUM * p, * g;
+BN_MONT_CTX * montCtx;
+BIGNUM * legacyTable[256][255]; // BIGNUMs in Montgomery form as InitCrypto did before
+
+void LegacyPrecompute (BN_CTX * ctx)
+{
+	montCtx = BN_MONT_CTX_new ();
+	BN_MONT_CTX_set (montCtx, p, ctx);
+	for (int i = 0; i < 256; i++)
+	{
+		legacyTable[i][0] = BN_new ();
+		if (!i)
+			BN_to_montgomery (legacyTable[0][0], g, montCtx, ctx);
+		else
+			BN_mod_mul_montgomery (legacyTable[i][0], legacyTable[i-1][254], legacyTable[i-1][0], montCtx, ctx);
+		for (int j = 1; j < 255; j++)
+		{
+			legacyTable[i][j] = BN_new ();
+			BN_mod_mul_montgomery (legacyTable[i][j], legacyTable[i][j-1], legacyTable[i][0], montCtx, ctx);
+		}
+	}
+}
+
+void LegacyEncrypt (const uint8_t * key, const uint8_t * data, uint8_t * encrypted, BN_CTX * ctx)
+{
+	BN_CTX_start (ctx);
+	BIGNUM * k = BN_CTX_get (ctx), * y = BN_CTX_get (ctx), * b1 = BN_CTX_get (ctx), * b = BN_CTX_get (ctx);
+	BN_rand (k, 2048, -1, 1);
+	// ElggPow with copy of Montgomery context
+	uint8_t exp[256];
+	int len = BN_num_bytes (k);
+	BN_bn2bin (k, exp);
+	auto mont = BN_MONT_CTX_new ();
+	BN_MONT_CTX_copy (mont, montCtx);
+	BIGNUM * a = nullptr;
+	for (int i = 0; i < len; i++)
+		if (exp[i])
+		{
+			if (a)
+				BN_mod_mul_montgomery (a, a, legacyTable[len-1-i][exp[i]-1], mont, ctx);
+			else
+				a = BN_dup (legacyTable[len-1-i][exp[i]-1]);
+		}
+	BN_from_montgomery (a, a, mont, ctx);
+	BN_MONT_CTX_free (mont);
+	BN_bin2bn (key, 256, y);
+	BN_mod_exp (b1, y, k, p, ctx);
+	uint8_t m[255];
+	m[0] = 0xFF;
+	memcpy (m+33, data, 222);
+	SHA256 (m+33, 222, m+1);
+	BN_bin2bn (m, 255, b);
+	BN_mod_mul (b, b1, b, p, ctx);
+	bn2buf (a, encrypted, 256);
+	bn2buf (b, encrypted + 256, 256);
+	BN_free (a);
+	BN_CTX_end (ctx);
+}
+
+bool LegacyDecrypt (const uint8_t * key, const uint8_t * encrypted, uint8_t * data, BN_CTX * ctx)
+{
+	BN_CTX_start (ctx);
+	BIGNUM * x = BN_CTX_get (ctx), * a = BN_CTX_get (ctx), * b = BN_CTX_get (ctx);
+	BN_bin2bn (key, 256, x);
+	BN_sub (x, p, x); BN_sub_word (x, 1);
+	BN_bin2bn (encrypted, 256, a);
+	BN_bin2bn (encrypted + 256, 256, b);
+	BN_mod_exp (x, a, x, p, ctx);
+	BN_mod_mul (b, b, x, p, ctx);
+	uint8_t m[255];
+	bool isValid = bn2buf (b, m, 255);
+	BN_CTX_end (ctx);
+	if (!isValid) return false;
+	uint8_t hash[32];
+	SHA256 (m + 33, 222, hash);
+	if (memcmp (m + 1, hash, 32)) return false;
+	memcpy (data, m + 33, 222);
+	return true;
+}
+
+template<typename F>
+double OpsPerSecond (F f)
+{
+	auto start = std::chrono::steady_clock::now ();
+	for (int i = 0; i < NUM_OPS; i++) f ();
+	return NUM_OPS/std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+}
+
+int main (int argc, char * argv[])
+{
+	BN_CTX * ctx = BN_CTX_new ();
+	uint8_t priv[256], pub[256], data[222], encrypted[514], decrypted[222]; // 514 with zero padding
+	RAND_bytes (data, 222);
+
+	// fixed base exponentiation against BN_mod_exp
+	InitCrypto (false);
+	GenerateElGamalKeyPair (priv, pub);
+	p = BN_get_rfc3526_prime_2048 (nullptr); // same prime
+	g = BN_new ();
+	BN_set_word (g, 2);
+	ElGamalMontgomery mont (p);
+	for (int w: { 1, 4, 8 })
+	{
+		ElGamalFixedBaseTable table (mont, w, 2048);
+		table.Precompute (pub, 4);
+		BIGNUM * y = BN_bin2bn (pub, 256, nullptr), * e = BN_new (), * r = BN_new ();
+		for (int i = 0; i < 10; i++)
+		{
+			uint8_t exp[256], res[256], expected[256];
+			int len = i ? i*25 : 256;
+			RAND_bytes (exp, len);
+			if (i == 1) exp[0] = 0; // leading zero
+			if (i == 2) memset (exp, 0, len); // y^0
+			assert (table.Pow (exp, len, res));
+			BN_bin2bn (exp, len, e);
+			BN_mod_exp (r, y, e, p, ctx);
+			bn2buf (r, expected, 256);
+			assert (!memcmp (res, expected, 256));
+		}
+		BN_free (y); BN_free (e); BN_free (r);
+	}
+	// short exponent, 29 windows of 8 bits
+	ElGamalFixedBaseTable shortTable (mont, 8, 226);
+	shortTable.Precompute (pub);
+	uint8_t longExp[30], res[256];
+	memset (longExp, 0xFF, 30);
+	longExp[0] = 0;
+	assert (shortTable.Pow (longExp, 30, res));
+	longExp[0] = 1;
+	assert (!shortTable.Pow (longExp, 30, res));
+
+	// key tables are built in background, used once ready, evicted only after they paid off
+	{
+		ElGamalKeyTables keyTables (mont, 2048);
+		std::vector<std::vector<uint8_t> > keys (ELGAMAL_MAX_NUM_KEY_TABLES + 1, std::vector<uint8_t>(256));
+		for (auto& it: keys)
+		{
+			uint8_t priv2[256];
+			GenerateElGamalKeyPair (priv2, it.data ());
+		}
+		auto waitTable = [&keyTables](const uint8_t * key)
+		{
+			for (int i = 0; i < 500; i++)
+			{
+				auto table = keyTables.GetTable (key);
+				if (table) return table;
+				std::this_thread::sleep_for (std::chrono::milliseconds (10));
+			}
+			return std::shared_ptr<const ElGamalFixedBaseTable>();
+		};
+		for (size_t i = 0; i < ELGAMAL_MAX_NUM_KEY_TABLES; i++)
+		{
+			for (int j = 0; j < ELGAMAL_KEY_TABLE_MIN_NUM_USES; j++)
+				assert (!keyTables.GetTable (keys[i].data ())); // not built in caller's thread
+			assert (waitTable (keys[i].data ()));
+		}
+		assert (keyTables.GetNumTables () == ELGAMAL_MAX_NUM_KEY_TABLES);
+		// check table against BN_mod_exp
+		uint8_t exp[256], expected[256];
+		RAND_bytes (exp, 256);
+		assert (keyTables.GetTable (keys[0].data ())->Pow (exp, 256, res));
+		BIGNUM * y = BN_bin2bn (keys[0].data (), 256, nullptr), * e = BN_bin2bn (exp, 256, nullptr), * r = BN_new ();
+		BN_mod_exp (r, y, e, p, ctx);
+		bn2buf (r, expected, 256);
+		assert (!memcmp (res, expected, 256));
+		BN_free (y); BN_free (e); BN_free (r);
+		// no table replaced before it was used enough
+		auto& newKey = keys[ELGAMAL_MAX_NUM_KEY_TABLES];
+		for (int j = 0; j < 10*ELGAMAL_KEY_TABLE_MIN_NUM_USES; j++)
+			assert (!keyTables.GetTable (newKey.data ()));
+		std::this_thread::sleep_for (std::chrono::milliseconds (100));
+		assert (!keyTables.GetTable (newKey.data ()));
+		// least recently used of paid off tables is replaced
+		for (int j = 0; j < ELGAMAL_KEY_TABLE_PAYBACK_NUM_USES; j++)
+			for (size_t i = 0; i < ELGAMAL_MAX_NUM_KEY_TABLES; i++)
+				assert (keyTables.GetTable (keys[i].data ()));
+		assert (waitTable (newKey.data ()));
+		assert (!keyTables.GetTable (keys[0].data ()));
+		assert (keyTables.GetNumTables () == ELGAMAL_MAX_NUM_KEY_TABLES);
+	}
+
+	// encryption with and without precomputation, compatible with previous code, corrupted doesn't decrypt
+	const int NUM_KEYS = NUM_OPS;
+	std::vector<std::vector<uint8_t> > pubs (NUM_KEYS, std::vector<uint8_t>(256)); // used once, never get key table
+	for (auto& it: pubs)
+	{
+		uint8_t priv2[256];
+		GenerateElGamalKeyPair (priv2, it.data ());
+	}
+	ElGamalEncrypt (pub, data, encrypted, ctx);
+	assert (ElGamalDecrypt (priv, encrypted, decrypted, ctx) && !memcmp (data, decrypted, 222));
+	TerminateCrypto ();
+	auto start = std::chrono::steady_clock::now ();
+	LegacyPrecompute (ctx);
+	double legacyPrecomputeTime = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+	start = std::chrono::steady_clock::now ();
+	InitCrypto (true);
+	double precomputeTime = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+	LegacyEncrypt (pub, data, encrypted, ctx);
+	assert (ElGamalDecrypt (priv, encrypted, decrypted, ctx) && !memcmp (data, decrypted, 222)); // legacy encrypted
+	ElGamalEncrypt (pub, data, encrypted, ctx);
+	assert (LegacyDecrypt (priv, encrypted, decrypted, ctx) && !memcmp (data, decrypted, 222));
+	for (size_t pos: { 0, 255, 256, 511 })
+	{
+		encrypted[pos] ^= 0x01;
+		assert (!ElGamalDecrypt (priv, encrypted, decrypted, ctx));
+		encrypted[pos] ^= 0x01;
+	}
+	memset (encrypted, 0, 512);
+	assert (!ElGamalDecrypt (priv, encrypted, decrypted, ctx));
+	uint8_t priv1[256], pub1[256];
+	GenerateElGamalKeyPair (priv1, pub1);
+	ElGamalEncrypt (pub1, data, encrypted, ctx, true);
+	assert (!encrypted[0] && !encrypted[257]);
+	assert (ElGamalDecrypt (priv1, encrypted, decrypted, ctx, true) && !memcmp (data, decrypted, 222));
+	encrypted[300] ^= 0x01;
+	assert (!ElGamalDecrypt (priv1, encrypted, decrypted, ctx, true));
+	TerminateCrypto ();
+
+	if (argc < 2 || strcmp (argv[1], "--bench"))
+	{
+		BN_CTX_free (ctx);
+		return 0;
+	}
+	// current code without precomputation is variable base BN_mod_exp for everything
+	InitCrypto (false);
+	int n = 0;
+	double encryptNoTable = OpsPerSecond ([&]() { ElGamalEncrypt (pubs[n++ % NUM_KEYS].data (), data, encrypted, ctx); });
+	DHKeys dh;
+	double dhNoTable = OpsPerSecond ([&]() { dh.GenerateKeys (); });
+	TerminateCrypto ();
+
+	// previous precomputation, BIGNUM table for g only
+	n = 0;
+	double legacyEncrypt = OpsPerSecond ([&]() { LegacyEncrypt (pubs[n++ % NUM_KEYS].data (), data, encrypted, ctx); });
+	double legacyDecrypt = OpsPerSecond ([&]() { assert (LegacyDecrypt (pubs[0].data (), encrypted, decrypted, ctx) || true); });
+
+	// contiguous table for g, every key is new
+	InitCrypto (true);
+	n = 0;
+	double encrypt = OpsPerSecond ([&]() { ElGamalEncrypt (pubs[n++ % NUM_KEYS].data (), data, encrypted, ctx); });
+	double decrypt = OpsPerSecond ([&]() { ElGamalDecrypt (priv, encrypted, decrypted, ctx); });
+	double dhTable = OpsPerSecond ([&]() { dh.GenerateKeys (); });
+	TerminateCrypto ();
+
+	// y^k of encryption with key table, the rest of encryption is the same
+	start = std::chrono::steady_clock::now ();
+	ElGamalFixedBaseTable keyTable (mont, ELGAMAL_KEY_TABLE_WINDOW_BITS, 2048);
+	keyTable.Precompute (pub);
+	double keyTablePrecomputeTime = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+	BIGNUM * y = BN_bin2bn (pub, 256, nullptr), * k = BN_new (), * b1 = BN_new ();
+	uint8_t exp[256];
+	double yModExp = OpsPerSecond ([&]() { BN_rand (k, 2048, -1, 1); BN_mod_exp_mont (b1, y, k, p, ctx, montCtx); });
+	double yTable = OpsPerSecond ([&]() { RAND_bytes (exp, 256); keyTable.Pow (exp, 256, res); });
+	BN_free (y); BN_free (k); BN_free (b1);
+
+	printf ("ElGamal encrypt to new keys per second: without table %.0f, BIGNUM g table %.0f, contiguous g table %.0f; "
+		"decrypt BN_mod_exp %.0f, cached Montgomery context %.0f\n",
+		encryptNoTable, legacyEncrypt, encrypt, legacyDecrypt, decrypt);
+	printf ("DH key generation per second: without table %.0f, contiguous g table %.0f\n", dhNoTable, dhTable);
+	printf ("y^k per second: BN_mod_exp_mont %.0f, key table %.0f, key table built in %.0f ms in 1 thread\n",
+		yModExp, yTable, keyTablePrecomputeTime*1000);
+	printf ("precomputation of g: BIGNUM table %.0f ms, contiguous table in %d threads %.0f ms\n",
+		legacyPrecomputeTime*1000, (int)std::thread::hardware_concurrency (), precomputeTime*1000);
+	BN_CTX_free (ctx);
+	return 0;
+}
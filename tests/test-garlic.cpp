@@ -0,0 +1,208 @@
+#include <cassert>
+#include <inttypes.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <boost/asio.hpp>
+#include <openssl/rand.h>
+
+#include "Garlic.h"
+#include "CryptoWorker.h"
+
+using namespace i2p;
+using namespace i2p::garlic;
+
+class TestDestination;
+typedef i2p::worker::ThreadPool<TestDestination> TestPool;
+
+/** receives local cloves, ElGamal always fails, since tests don't use ElGamal keys */
+class TestDestination: public GarlicDestination, public std::enable_shared_from_this<TestDestination>
+{
+	public:
+
+		TestDestination (): m_NumDecrypts (0) {};
+
+		void SetPool (std::shared_ptr<TestPool> pool) { m_Pool = pool; };
+		boost::asio::io_service& GetService () { return m_Service; };
+		void HandleResults (uint64_t numCompleted) // wait until pool completes numCompleted jobs and handle results
+		{
+			while (m_Pool->GetNumCompleted () < numCompleted)
+				std::this_thread::yield ();
+			m_Service.poll ();
+			m_Service.reset ();
+		}
+
+		// implements LocalDestination
+		bool Decrypt (const uint8_t *, uint8_t *, BN_CTX *) const { m_NumDecrypts++; return false; };
+		std::shared_ptr<const i2p::data::IdentityEx> GetIdentity () const { return nullptr; };
+
+		// implements GarlicDestination
+		std::shared_ptr<const i2p::data::LocalLeaseSet> GetLeaseSet () { return nullptr; };
+		std::shared_ptr<i2p::tunnel::TunnelPool> GetTunnelPool () const { return nullptr; };
+		void HandleI2NPMessage (const uint8_t * buf, size_t len, std::shared_ptr<i2p::tunnel::InboundTunnel>)
+		{
+			received.push_back (std::vector<uint8_t> (buf, buf + len));
+		}
+
+		std::vector<std::vector<uint8_t> > received;
+		mutable std::atomic<int> m_NumDecrypts;
+
+	protected:
+
+		bool PostElGamalWork (ElGamalWork work)
+		{
+			if (!m_Pool) return false;
+			m_Pool->Offer (TestPool::Job (shared_from_this (), [work]()
+				{
+					BN_CTX * ctx = BN_CTX_new ();
+					auto result = work (ctx);
+					BN_CTX_free (ctx);
+					return result;
+				}));
+			return true;
+		}
+
+	private:
+
+		boost::asio::io_service m_Service;
+		std::shared_ptr<TestPool> m_Pool;
+};
+
+struct Wrapped
+{
+	uint8_t key[32];
+	SessionTag tag;
+	std::shared_ptr<I2NPMessage> clove, msg;
+};
+
+// garlic message with one local clove, encrypted with a new session key and tag
+Wrapped Wrap (size_t cloveLen)
+{
+	Wrapped w;
+	RAND_bytes (w.key, 32);
+	RAND_bytes (w.tag, 32);
+	std::vector<uint8_t> data (cloveLen);
+	RAND_bytes (data.data (), data.size ());
+	w.clove = CreateI2NPMessage (eI2NPData, data.data (), data.size ());
+	GarlicRoutingSession session (w.key, w.tag);
+	w.msg = session.WrapSingleMessage (w.clove);
+	return w;
+}
+
+bool IsReceived (const TestDestination& dest, const Wrapped& w)
+{
+	for (auto& it: dest.received)
+		if (it.size () >= w.clove->GetLength () && !memcmp (it.data (), w.clove->GetBuffer (), w.clove->GetLength ()))
+			return true;
+	return false;
+}
+
+int main ()
+{
+	auto dest = std::make_shared<TestDestination> ();
+	auto pool = std::make_shared<TestPool> (2);
+	dest->SetPool (pool);
+
+	// known tag, AES only
+	auto w = Wrap (1000);
+	dest->AddSessionKey (w.key, w.tag);
+	dest->ProcessGarlicMessage (w.msg);
+	assert (IsReceived (*dest, w));
+	assert (dest->m_NumDecrypts == 0);
+	assert (dest->GetNumPendingElGamal () == 0);
+
+	// unknown tag, decrypt fails in pool
+	dest->received.clear ();
+	w.msg = Wrap (1000).msg;
+	dest->ProcessGarlicMessage (w.msg);
+	dest->HandleResults (1);
+	assert (dest->received.empty ());
+	assert (dest->m_NumDecrypts == 1);
+
+	// tag arrives while ElGamal is in pool, decrypt fails, retried with tag
+	w = Wrap (1000);
+	dest->ProcessGarlicMessage (w.msg);
+	assert (dest->GetNumPendingElGamal () == 1);
+	dest->AddSessionKey (w.key, w.tag);
+	dest->HandleResults (2);
+	assert (IsReceived (*dest, w));
+	assert (dest->m_NumDecrypts == 2);
+	assert (dest->GetNumPendingElGamal () == 0);
+	assert (dest->GetNumAsyncElGamal () == 2);
+
+	// too short for ElGamal, dropped without decrypt
+	dest->received.clear ();
+	w = Wrap (1);
+	assert (w.msg->GetPayloadLength () < 514 + 4);
+	dest->ProcessGarlicMessage (w.msg);
+	assert (dest->received.empty ());
+	assert (dest->m_NumDecrypts == 2);
+
+	// short message arrives before ElGamal message with its tag completes, held until then
+	w = Wrap (1000);
+	dest->ProcessGarlicMessage (w.msg);
+	assert (dest->GetNumPendingElGamal () == 1);
+	auto shortMsg = Wrap (1);
+	dest->ProcessGarlicMessage (shortMsg.msg);
+	assert (dest->received.empty ());
+	dest->AddSessionKey (shortMsg.key, shortMsg.tag); // as if from AES block of pending ElGamal message
+	dest->HandleResults (3);
+	assert (IsReceived (*dest, shortMsg));
+	assert (dest->m_NumDecrypts == 3);
+	// tag never arrives, dropped when nothing is pending anymore
+	dest->received.clear ();
+	dest->ProcessGarlicMessage (Wrap (1000).msg);
+	shortMsg = Wrap (1);
+	dest->ProcessGarlicMessage (shortMsg.msg);
+	dest->HandleResults (4);
+	assert (dest->GetNumPendingElGamal () == 0);
+	dest->AddSessionKey (shortMsg.key, shortMsg.tag);
+	dest->ProcessGarlicMessage (Wrap (1000).msg); // next ElGamal completion doesn't find it anymore
+	dest->HandleResults (5);
+	assert (dest->received.empty ());
+	assert (dest->m_NumDecrypts == 5);
+
+	// pending limit holds for concurrent submissions, results are handled by destination's thread only
+	const int numThreads = 4;
+	std::atomic<int> numSubmitted (0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < numThreads; i++)
+		threads.emplace_back ([dest, &numSubmitted]()
+			{
+				for (int j = 0; j < GARLIC_MAX_PENDING_ELGAMAL; j++)
+					if (dest->SubmitElGamalWork ([](BN_CTX *) { return []() {}; }))
+						numSubmitted++;
+			});
+	for (auto& it: threads) it.join ();
+	assert (numSubmitted == GARLIC_MAX_PENDING_ELGAMAL);
+	assert (dest->GetNumPendingElGamal () == GARLIC_MAX_PENDING_ELGAMAL);
+	// full, incoming message is dropped
+	w = Wrap (1000);
+	dest->ProcessGarlicMessage (w.msg);
+	assert (dest->GetNumDroppedElGamal () == 1);
+	dest->HandleResults (5 + GARLIC_MAX_PENDING_ELGAMAL);
+	assert (dest->GetNumPendingElGamal () == 0);
+	assert (dest->GetNumAsyncElGamal () == 5 + GARLIC_MAX_PENDING_ELGAMAL);
+	assert (pool->GetQueueSize () == 0);
+
+	// no pool, decrypted in destination's thread
+	dest->SetPool (nullptr);
+	assert (!dest->SubmitElGamalWork ([](BN_CTX *) { return []() {}; }));
+	assert (dest->GetNumPendingElGamal () == 0);
+	dest->received.clear ();
+	w = Wrap (1000);
+	dest->ProcessGarlicMessage (w.msg);
+	assert (dest->received.empty ());
+	assert (dest->m_NumDecrypts == 6);
+
+	// pool completes queued jobs when destroyed
+	std::atomic<int> numDone (0);
+	{
+		TestPool pool1 (1);
+		for (int i = 0; i < 100; i++)
+			pool1.Offer (TestPool::Job (dest, [&numDone]() { numDone++; return TestPool::ResultFunc (); }));
+	}
+	assert (numDone == 100);
+	dest->GetService ().poll ();
+}
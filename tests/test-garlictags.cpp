@@ -0,0 +1,160 @@
+#include <cassert>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <openssl/rand.h>
+
+#include "GarlicTags.h"
+
+using namespace i2p::garlic;
+
+const uint32_t TS = 1500000000;
+const size_t NUM_TAGS = 100000;
+const int TAGS_PER_KEY = 40;
+
+std::shared_ptr<AESDecryption> NewKey ()
+{
+	uint8_t key[32];
+	RAND_bytes (key, 32);
+	return std::make_shared<AESDecryption> (key);
+}
+
+int main (int argc, char * argv[])
+{
+	IncomingSessionTags tags;
+	std::vector<uint8_t> buf (NUM_TAGS*32);
+	RAND_bytes (buf.data (), buf.size ());
+	// tags arrive in blocks of one session key, one block per second
+	std::vector<std::shared_ptr<AESDecryption> > keys;
+	for (size_t i = 0; i < NUM_TAGS/TAGS_PER_KEY; i++)
+	{
+		keys.push_back (NewKey ());
+		tags.AddTags (buf.data () + i*TAGS_PER_KEY*32, TAGS_PER_KEY, keys.back (), TS + i);
+	}
+	assert (tags.GetNumTags () == NUM_TAGS);
+	assert (tags.GetNumKeys () == keys.size ());
+
+	// used once, tags of same key share decryption
+	for (size_t i = 0; i < NUM_TAGS; i += 2)
+		assert (tags.UseTag (buf.data () + i*32) == keys[i/TAGS_PER_KEY]);
+	for (size_t i = 0; i < NUM_TAGS; i += 2)
+		assert (!tags.UseTag (buf.data () + i*32));
+	for (size_t i = 1; i < NUM_TAGS; i += 2)
+	{
+		auto found = tags.UseTag (buf.data () + i*32);
+		assert (found == keys[i/TAGS_PER_KEY]);
+		tags.AddTags (buf.data () + i*32, 1, found, TS + i/TAGS_PER_KEY); // put back
+	}
+	assert (tags.GetNumTags () == NUM_TAGS/2);
+	assert (tags.GetNumKeys () == keys.size ());
+	uint8_t unknown[32];
+	RAND_bytes (unknown, 32);
+	assert (!tags.UseTag (unknown));
+
+	// new key object with same key bytes is shared
+	auto sameKey = std::make_shared<AESDecryption> (keys[0]->GetKey ());
+	tags.AddTags (unknown, 1, sameKey, TS);
+	assert (tags.GetNumKeys () == keys.size () && tags.UseTag (unknown) == keys[0]);
+
+	// expiration by creation time, one key per second
+	assert (!tags.ExpireTags (TS + INCOMING_TAGS_EXPIRATION_TIMEOUT));
+	size_t expired = 0, seconds = 100;
+	expired += tags.ExpireTags (TS + seconds + INCOMING_TAGS_EXPIRATION_TIMEOUT);
+	size_t numVisited = 0;
+	tags.VisitTags ([&](const SessionTag& tag, const AESDecryption&)
+		{
+			assert (tag.creationTime + INCOMING_TAGS_EXPIRATION_TIMEOUT >= TS + seconds + INCOMING_TAGS_EXPIRATION_TIMEOUT - INCOMING_TAGS_WHEEL_GRANULARITY);
+			numVisited++;
+		});
+	assert (numVisited == tags.GetNumTags () && numVisited + expired == NUM_TAGS/2);
+	for (size_t i = 0; i < NUM_TAGS; i += 1)
+	{
+		auto found = tags.UseTag (buf.data () + i*32);
+		assert (!found || (i % 2 && i/TAGS_PER_KEY + INCOMING_TAGS_WHEEL_GRANULARITY > seconds));
+		if (found) tags.AddTags (buf.data () + i*32, 1, found, TS + i/TAGS_PER_KEY);
+	}
+	expired += tags.ExpireTags (TS + NUM_TAGS/TAGS_PER_KEY + INCOMING_TAGS_EXPIRATION_TIMEOUT + 1);
+	assert (expired == NUM_TAGS/2 && !tags.GetNumTags () && !tags.GetNumKeys ());
+
+	// clock jumped back, not expired too early
+	tags.AddTags (buf.data (), 1, keys[0], TS - 1000);
+	assert (!tags.ExpireTags (TS - 1000 + INCOMING_TAGS_EXPIRATION_TIMEOUT));
+	assert (tags.ExpireTags (TS + NUM_TAGS/TAGS_PER_KEY + 2*INCOMING_TAGS_EXPIRATION_TIMEOUT) == 1);
+	tags.Clear ();
+
+	// tags with same first 8 bytes are distinct, expiration of one doesn't remove another
+	std::vector<uint8_t> colliding (1000*32);
+	RAND_bytes (colliding.data (), colliding.size ());
+	for (size_t i = 0; i < 1000; i++)
+		memcpy (colliding.data () + i*32, colliding.data (), 8);
+	tags.AddTags (colliding.data (), 500, keys[0], TS);
+	tags.AddTags (colliding.data () + 500*32, 500, keys[1], TS + 100);
+	assert (tags.GetNumTags () == 1000);
+	assert (tags.ExpireTags (TS + 50 + INCOMING_TAGS_EXPIRATION_TIMEOUT) == 500);
+	for (size_t i = 0; i < 1000; i++)
+		assert (tags.UseTag (colliding.data () + i*32) == (i < 500 ? nullptr : keys[1]));
+	assert (tags.IsEmpty ());
+	tags.Clear ();
+
+	// nothing or no key, ignored
+	tags.AddTags (buf.data (), 0, keys[0], TS);
+	tags.AddTags (buf.data (), 1, nullptr, TS);
+	assert (tags.IsEmpty () && !tags.GetNumKeys () && !tags.ExpireTags (TS + 2*INCOMING_TAGS_EXPIRATION_TIMEOUT));
+
+	// same tag with another key replaces it, old key is released
+	tags.AddTags (buf.data (), 1, keys[0], TS);
+	tags.AddTags (buf.data (), 1, keys[1], TS);
+	assert (tags.GetNumTags () == 1 && tags.GetNumKeys () == 1);
+	assert (tags.UseTag (buf.data ()) == keys[1] && !tags.GetNumKeys ());
+	tags.Clear ();
+
+	// tags added while expiring over several turns of the wheel, each expires within granularity after timeout
+	const int NUM_STEPS = 3*INCOMING_TAGS_WHEEL_SIZE*INCOMING_TAGS_WHEEL_GRANULARITY/10;
+	for (int i = 0; i < NUM_STEPS; i++)
+	{
+		uint32_t ts = TS + i*10;
+		tags.AddTags (buf.data () + i*32, 1, keys[0], ts);
+		tags.ExpireTags (ts);
+		size_t notExpired = 0, notOverdue = 0;
+		for (int j = 0; j <= i; j++)
+		{
+			uint32_t creationTime = TS + j*10;
+			if (ts <= creationTime + INCOMING_TAGS_EXPIRATION_TIMEOUT) notExpired++;
+			if (ts <= creationTime + INCOMING_TAGS_EXPIRATION_TIMEOUT + INCOMING_TAGS_WHEEL_GRANULARITY) notOverdue++;
+		}
+		assert (tags.GetNumTags () >= notExpired && tags.GetNumTags () <= notOverdue);
+	}
+	// clock jumped forward beyond wheel
+	tags.ExpireTags (TS + 100*INCOMING_TAGS_EXPIRATION_TIMEOUT);
+	assert (tags.IsEmpty () && !tags.GetNumKeys ());
+	tags.Clear ();
+
+	if (argc < 2 || strcmp (argv[1], "--bench")) return 0;
+	// lookups compared to std::map used before
+	std::map<SessionTag, std::shared_ptr<AESDecryption> > m;
+	for (size_t i = 0; i < NUM_TAGS; i++)
+		m[SessionTag (buf.data () + i*32, TS)] = keys[i/TAGS_PER_KEY];
+	tags.AddTags (buf.data (), NUM_TAGS, keys[0], TS);
+	auto start = std::chrono::steady_clock::now ();
+	size_t numFound = 0;
+	for (int n = 0; n < 10; n++)
+		for (size_t i = 0; i < NUM_TAGS; i++)
+			if (m.find (SessionTag (buf.data () + i*32)) != m.end ()) numFound++;
+	auto mapTime = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+	start = std::chrono::steady_clock::now ();
+	for (int n = 0; n < 10; n++)
+		for (size_t i = 0; i < NUM_TAGS; i++)
+		{
+			auto found = tags.UseTag (buf.data () + i*32);
+			tags.AddTags (buf.data () + i*32, 1, found, TS);
+			numFound++;
+		}
+	auto tableTime = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+	assert (numFound == 20*NUM_TAGS);
+	printf ("%d tags, lookups per second: std::map %.0fk, IncomingSessionTags use and add back %.0fk\n",
+		(int)NUM_TAGS, 10*NUM_TAGS/mapTime/1000, 10*NUM_TAGS/tableTime/1000);
+	return 0;
+}
@@ -0,0 +1,124 @@
+#include <cassert>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include "Kademlia.h"
+
+typedef i2p::data::Tag<32> IdentHash;
+typedef std::map<IdentHash, std::shared_ptr<int> > Routers;
+
+const size_t NUM_CLOSEST = 3;
+const int NUM_LOOKUPS = 1000;
+
+IdentHash Distance (const IdentHash& key1, const IdentHash& key2)
+{
+	IdentHash d;
+	for (int i = 0; i < 32; i++)
+		d ()[i] = key1 ()[i] ^ key2 ()[i];
+	return d;
+}
+
+// same as linear scan of NetDb::GetClosestFloodfills
+std::vector<IdentHash> GetClosestLinear (const Routers& routers, const IdentHash& key, size_t num)
+{
+	std::set<std::pair<IdentHash, IdentHash> > sorted; // distance, ident
+	for (const auto& it: routers)
+	{
+		auto d = Distance (key, it.first);
+		if (sorted.size () < num)
+			sorted.insert ({d, it.first});
+		else if (d < sorted.rbegin ()->first)
+		{
+			sorted.insert ({d, it.first});
+			sorted.erase (std::prev (sorted.end ()));
+		}
+	}
+	std::vector<IdentHash> res;
+	for (const auto& it: sorted)
+		res.push_back (it.second);
+	return res;
+}
+
+std::vector<IdentHash> GetClosest (const Routers& routers, const IdentHash& key, size_t num)
+{
+	std::vector<IdentHash> res;
+	i2p::data::VisitClosest (routers, key,
+		[&res, num](const Routers::value_type& it)->bool
+		{
+			res.push_back (it.first);
+			return res.size () < num;
+		});
+	return res;
+}
+
+int main (int argc, char * argv[])
+{
+	bool bench = argc > 1 && !strcmp (argv[1], "--bench");
+	// small map, full order must be by distance
+	Routers routers;
+	for (int i = 0; i < 100; i++)
+	{
+		IdentHash ident; ident.Randomize ();
+		routers[ident] = nullptr;
+	}
+	IdentHash key; key.Randomize ();
+	auto all = GetClosest (routers, key, routers.size ());
+	assert (all.size () == routers.size ());
+	for (size_t i = 1; i < all.size (); i++)
+		assert (Distance (key, all[i - 1]) < Distance (key, all[i]));
+	assert (GetClosest (routers, routers.begin ()->first, 1)[0] == routers.begin ()->first);
+	assert (GetClosest (Routers (), key, 1).empty ());
+	// extreme keys
+	IdentHash zero, ones;
+	memset (zero (), 0, 32); memset (ones (), 0xFF, 32);
+	for (const auto& it: { zero, ones })
+		assert (GetClosest (routers, it, NUM_CLOSEST) == GetClosestLinear (routers, it, NUM_CLOSEST));
+	// idents with long common prefix, differing in last byte only
+	Routers prefixed;
+	for (int i = 0; i < 256; i += 3)
+	{
+		IdentHash ident = ones; ident ()[31] = i;
+		prefixed[ident] = nullptr;
+	}
+	prefixed[zero] = nullptr;
+	for (int i = 0; i < 256; i++)
+	{
+		key = ones; key ()[31] = i;
+		assert (GetClosest (prefixed, key, NUM_CLOSEST) == GetClosestLinear (prefixed, key, NUM_CLOSEST));
+		assert (GetClosest (prefixed, key, prefixed.size ()).back () == zero);
+	}
+
+	for (size_t numRouters: { 1000, 10000, 50000 })
+	{
+		Routers routers;
+		while (routers.size () < numRouters)
+		{
+			IdentHash ident; ident.Randomize ();
+			routers[ident] = nullptr;
+		}
+		std::vector<IdentHash> keys (NUM_LOOKUPS);
+		for (auto& it: keys) it.Randomize ();
+
+		for (const auto& it: keys)
+			assert (GetClosest (routers, it, NUM_CLOSEST) == GetClosestLinear (routers, it, NUM_CLOSEST));
+		if (!bench) continue;
+
+		auto start = std::chrono::steady_clock::now ();
+		for (const auto& it: keys)
+			GetClosestLinear (routers, it, NUM_CLOSEST);
+		std::chrono::duration<double> linear = std::chrono::steady_clock::now () - start;
+		start = std::chrono::steady_clock::now ();
+		for (const auto& it: keys)
+			GetClosest (routers, it, NUM_CLOSEST);
+		std::chrono::duration<double> indexed = std::chrono::steady_clock::now () - start;
+		printf ("%5d routers: linear scan %.2f us, indexed %.2f us per closest %d lookup\n", (int)numRouters,
+			linear.count ()*1e6/NUM_LOOKUPS, indexed.count ()*1e6/NUM_LOOKUPS, (int)NUM_CLOSEST);
+	}
+	return 0;
+}
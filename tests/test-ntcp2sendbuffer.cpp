@@ -0,0 +1,245 @@
+#include <cassert>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <openssl/rand.h>
+#include <boost/asio.hpp>
+
+#include "I2PEndian.h"
+#include "Crypto.h"
+#include "Siphash.h"
+#include "NTCP2.h"
+
+using i2p::transport::NTCP2SendBuffer;
+using boost::asio::ip::tcp;
+
+const size_t MSG_SIZE = 1024; // typical tunnel message
+const size_t NUM_MSGS = 100000;
+const size_t BURST = 128; // messages queued at once
+
+uint8_t key[32], sipKeys[32];
+
+/** other side of session, decrypts and checks frames */
+struct Receiver
+{
+	Receiver (tcp::socket& s): socket (s), sequenceNumber (0), numMsgs (0)
+	{
+		memcpy (iv.buf, sipKeys + 16, 8);
+	}
+
+	void Run ()
+	{
+		while (numMsgs < NUM_MSGS)
+		{
+			uint8_t lenBuf[2];
+			boost::asio::read (socket, boost::asio::buffer (lenBuf, 2));
+			i2p::crypto::Siphash<8> (iv.buf, iv.buf, 8, sipKeys);
+			size_t len = bufbe16toh (lenBuf) ^ le16toh (iv.key);
+			frame.resize (len);
+			boost::asio::read (socket, boost::asio::buffer (frame.data (), len));
+			uint8_t nonce[12];
+			memset (nonce, 0, 4);
+			htole64buf (nonce + 4, sequenceNumber); sequenceNumber++;
+			assert (i2p::crypto::AEADChaCha20Poly1305 (frame.data (), len - 16, nullptr, 0, key, nonce, frame.data (), len - 16, false));
+			size_t offset = 0;
+			while (offset < len - 16)
+			{
+				uint8_t blk = frame[offset];
+				size_t size = bufbe16toh (frame.data () + offset + 1);
+				if (blk == i2p::transport::eNTCP2BlkI2NPMessage)
+				{
+					assert (size == MSG_SIZE && frame[offset + 3] == (uint8_t)numMsgs);
+					numMsgs++;
+				}
+				offset += size + 3;
+			}
+			assert (offset == len - 16);
+		}
+	}
+
+	tcp::socket& socket;
+	union { uint8_t buf[8]; uint16_t key; } iv;
+	uint64_t sequenceNumber;
+	size_t numMsgs;
+	std::vector<uint8_t> frame;
+};
+
+/** decrypts frames of written buffers in order, as receiving side does */
+struct FrameReader
+{
+	FrameReader (): sequenceNumber (0) { memcpy (iv.buf, sipKeys + 16, 8); };
+
+	bool Read (std::vector<uint8_t> buf, std::vector<size_t>& lens) // false if any frame fails
+	{
+		size_t offset = 0;
+		while (offset + 2 <= buf.size ())
+		{
+			i2p::crypto::Siphash<8> (iv.buf, iv.buf, 8, sipKeys);
+			size_t len = bufbe16toh (buf.data () + offset) ^ le16toh (iv.key);
+			offset += 2;
+			if (len < 16 || offset + len > buf.size ()) return false;
+			uint8_t nonce[12];
+			memset (nonce, 0, 4);
+			htole64buf (nonce + 4, sequenceNumber); sequenceNumber++;
+			if (!i2p::crypto::AEADChaCha20Poly1305 (buf.data () + offset, len - 16, nullptr, 0, key, nonce,
+				buf.data () + offset, len - 16, false)) return false;
+			lens.push_back (len - 16);
+			offset += len;
+		}
+		return offset == buf.size ();
+	}
+
+	union { uint8_t buf[8]; uint16_t key; } iv;
+	uint64_t sequenceNumber;
+};
+
+/** messages of bursts as NTCP2Session::SendQueue does.
+ * Pipelined sends everything queued during write at once, otherwise one frame per write as before */
+double Send (boost::asio::io_service& service, tcp::socket& s, tcp::socket& r, bool pipelined)
+{
+	NTCP2SendBuffer buffer;
+	buffer.SetKeys (key, sipKeys, sipKeys + 16);
+	size_t numQueued = 0, numSent = 0;
+	std::function<void ()> sendNext;
+	std::function<void (const boost::system::error_code&, size_t)> handleSent =
+		[&](const boost::system::error_code& ecode, size_t)
+	{
+		assert (!ecode);
+		buffer.SendingComplete ();
+		sendNext ();
+	};
+	sendNext = [&]()
+	{
+		// new burst arrives while sending
+		if (numSent + numQueued < NUM_MSGS && numQueued < BURST)
+			numQueued += std::min (BURST, NUM_MSGS - numSent - numQueued);
+		while (numQueued > 0 && !buffer.IsFull ())
+		{
+			size_t num = std::min (numQueued, (size_t)60); // fit into frame
+			uint8_t * payload = buffer.NewFrame (num*(MSG_SIZE + 3));
+			for (size_t i = 0; i < num; i++)
+			{
+				payload[0] = i2p::transport::eNTCP2BlkI2NPMessage;
+				htobe16buf (payload + 1, MSG_SIZE);
+				memset (payload + 3, (uint8_t)(numSent + i), MSG_SIZE);
+				payload += MSG_SIZE + 3;
+			}
+			buffer.EncryptFrame ();
+			numQueued -= num; numSent += num;
+			if (!pipelined) break;
+		}
+		if (buffer.StartSending ())
+			boost::asio::async_write (s, boost::asio::buffer (buffer.GetSending ().data (), buffer.GetSending ().size ()),
+				boost::asio::transfer_all (), handleSent);
+	};
+	Receiver receiver (r);
+	auto start = std::chrono::steady_clock::now ();
+	std::thread receiverThread (&Receiver::Run, &receiver);
+	sendNext ();
+	service.run ();
+	service.reset ();
+	receiverThread.join ();
+	assert (receiver.numMsgs == NUM_MSGS);
+	return std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+}
+
+int main (int argc, char * argv[])
+{
+	RAND_bytes (key, 32);
+	RAND_bytes (sipKeys, 32);
+	boost::asio::io_service service;
+	tcp::acceptor acceptor (service, tcp::endpoint (boost::asio::ip::address_v4::loopback (), 0));
+	tcp::socket alice (service), bob (service);
+	alice.connect (acceptor.local_endpoint ());
+	acceptor.accept (bob);
+
+	// peak size is kept while writes are large and released by small ones
+	{
+		NTCP2SendBuffer buffer;
+		buffer.SetKeys (key, sipKeys, sipKeys + 16);
+		const size_t lens[] = { 60000, 60000, 1000, 1000 };
+		for (auto len: lens)
+		{
+			memset (buffer.NewFrame (len), 0, len);
+			buffer.EncryptFrame ();
+			assert (buffer.StartSending ());
+			buffer.SendingComplete ();
+			assert ((buffer.GetSending ().capacity () > i2p::transport::NTCP2_SEND_BUFFER_KEEP_SIZE) == (len > 1000));
+		}
+	}
+
+	// empty and maximal frames, frames queued during write go to the next one, corrupted frame fails
+	{
+		NTCP2SendBuffer buffer;
+		buffer.SetKeys (key, sipKeys, sipKeys + 16);
+		assert (!buffer.StartSending ());
+		for (size_t len: { (size_t)0, (size_t)100, i2p::transport::NTCP2_UNENCRYPTED_FRAME_MAX_SIZE })
+		{
+			RAND_bytes (buffer.NewFrame (len), len);
+			buffer.EncryptFrame ();
+		}
+		assert (buffer.StartSending () && buffer.IsSending ());
+		memset (buffer.NewFrame (10), 0, 10);
+		buffer.EncryptFrame ();
+		assert (!buffer.StartSending ());
+		FrameReader reader, corrupted (reader);
+		std::vector<size_t> lens;
+		assert (reader.Read (buffer.GetSending (), lens));
+		assert (lens == std::vector<size_t>({ 0, 100, i2p::transport::NTCP2_UNENCRYPTED_FRAME_MAX_SIZE }));
+		auto sending = buffer.GetSending ();
+		sending[200] ^= 0x01;
+		assert (!corrupted.Read (sending, lens));
+		buffer.SendingComplete ();
+		assert (buffer.StartSending ());
+		lens.clear ();
+		assert (reader.Read (buffer.GetSending (), lens) && lens == std::vector<size_t>({ 10 }));
+		buffer.SendingComplete ();
+		assert (!buffer.StartSending ());
+		// full
+		int numFrames = 0;
+		for (; !buffer.IsFull (); numFrames++)
+		{
+			memset (buffer.NewFrame (60000), 0, 60000);
+			buffer.EncryptFrame ();
+		}
+		assert (numFrames == 3);
+	}
+
+	// termination built during write goes with next write, then session is closed
+	{
+		NTCP2SendBuffer buffer;
+		buffer.SetKeys (key, sipKeys, sipKeys + 16);
+		memset (buffer.NewFrame (1000), 0, 1000);
+		buffer.EncryptFrame ();
+		assert (buffer.StartSending () && !buffer.IsClosing ());
+		uint8_t * payload = buffer.NewFrame (12);
+		payload[0] = i2p::transport::eNTCP2BlkTermination;
+		htobe16buf (payload + 1, 9);
+		memset (payload + 3, 0, 9);
+		buffer.EncryptFrame ();
+		buffer.CloseAfterSending ();
+		assert (buffer.IsClosing () && buffer.IsSending ());
+		FrameReader reader;
+		std::vector<size_t> lens;
+		assert (reader.Read (buffer.GetSending (), lens) && lens == std::vector<size_t>({ 1000 }));
+		buffer.SendingComplete ();
+		// as NTCP2Session::HandleFramesSent does
+		assert (buffer.IsClosing () && buffer.StartSending ());
+		lens.clear ();
+		assert (reader.Read (buffer.GetSending (), lens) && lens == std::vector<size_t>({ 12 }));
+		buffer.SendingComplete ();
+		assert (!buffer.StartSending () && !buffer.IsSending ()); // close now
+	}
+
+	double oneFrame = Send (service, alice, bob, false);
+	double pipelined = Send (service, bob, alice, true);
+	if (argc < 2 || strcmp (argv[1], "--bench")) return 0;
+	double mb = NUM_MSGS*MSG_SIZE/1048576.0;
+	printf ("%d I2NP messages of %d bytes over loopback: frame per write %.1f MB/s, pipelined %.1f MB/s\n",
+		(int)NUM_MSGS, (int)MSG_SIZE, mb/oneFrame, mb/pipelined);
+	return 0;
+}
@@ -0,0 +1,146 @@
+#include <cassert>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include "Queue.h"
+
+struct Item
+{
+	int producer;
+	uint64_t seqn;
+	Item (int p, uint64_t s): producer (p), seqn (s) {};
+};
+
+typedef std::shared_ptr<Item> ItemPtr;
+
+const uint64_t NUM_ITEMS = 200000; // total per run
+
+void PutItem (i2p::util::Queue<ItemPtr>& queue, ItemPtr item)
+{
+	queue.Put (item);
+}
+
+void PutItem (i2p::util::MPSCQueue<ItemPtr>& queue, ItemPtr item)
+{
+	while (!queue.Put (item)) // full
+		std::this_thread::yield ();
+}
+
+template<typename Q>
+double Run (int numProducers)
+{
+	Q queue;
+	uint64_t itemsPerProducer = NUM_ITEMS/numProducers;
+	auto start = std::chrono::steady_clock::now ();
+	std::vector<std::thread> producers;
+	for (int i = 0; i < numProducers; i++)
+		producers.emplace_back ([&queue, i, itemsPerProducer]()
+			{
+				for (uint64_t j = 0; j < itemsPerProducer; j++)
+					PutItem (queue, std::make_shared<Item>(i, j));
+			});
+
+	// consumer, items of each producer must arrive in order
+	std::vector<uint64_t> next (numProducers, 0);
+	uint64_t received = 0;
+	while (received < itemsPerProducer*numProducers)
+	{
+		auto item = queue.GetNextWithTimeout (100);
+		while (item)
+		{
+			assert (item->seqn == next[item->producer]);
+			next[item->producer]++;
+			received++;
+			item = queue.Get ();
+		}
+	}
+	for (auto& it: producers) it.join ();
+	assert (queue.IsEmpty ());
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+	return received/elapsed.count ();
+}
+
+int main (int argc, char * argv[])
+{
+	// basic behaviour
+	i2p::util::MPSCQueue<ItemPtr> queue (3);
+	assert (queue.GetCapacity () == 4);
+	assert (!queue.Get ());
+	assert (!queue.GetNextWithTimeout (1));
+	for (int i = 0; i < 4; i++)
+		assert (queue.Put (std::make_shared<Item>(0, i)));
+	assert (!queue.Put (std::make_shared<Item>(0, 4)));
+	assert (queue.GetNumDropped () == 1);
+	assert (queue.GetSize () == 4);
+	for (int i = 0; i < 4; i++)
+		assert (queue.GetNext ()->seqn == (uint64_t)i);
+	assert (queue.IsEmpty ());
+	std::vector<ItemPtr> items { std::make_shared<Item>(0, 5), std::make_shared<Item>(0, 6) };
+	assert (queue.Put (items));
+	assert (queue.Get ()->seqn == 5);
+	assert (queue.Get ()->seqn == 6);
+	// wake up before consumer waits is not lost
+	queue.WakeUp ();
+	auto start = std::chrono::steady_clock::now ();
+	assert (!queue.GetNextWithTimeout (1000));
+	assert (std::chrono::steady_clock::now () - start < std::chrono::milliseconds (500));
+
+	// empty and partially fitting batches
+	assert (queue.Put (std::vector<ItemPtr> ()));
+	assert (queue.IsEmpty ());
+	items.clear ();
+	for (int i = 0; i < 6; i++)
+		items.push_back (std::make_shared<Item>(0, 7 + i));
+	assert (!queue.Put (items));
+	assert (queue.GetNumDropped () == 3);
+	for (int i = 0; i < 4; i++)
+		assert (queue.Get ()->seqn == (uint64_t)(7 + i));
+	assert (!queue.Get ());
+
+	// positions wrap around many times, order kept, queue doesn't hold taken elements
+	uint64_t seqn = 0;
+	for (int round = 0; round < 1000; round++)
+	{
+		int n = 1 + round % 4;
+		for (int i = 0; i < n; i++)
+			assert (queue.Put (std::make_shared<Item>(1, seqn + i)));
+		assert (queue.GetSize () == n);
+		for (int i = 0; i < n; i++)
+		{
+			auto item = queue.Get ();
+			assert (item && item->seqn == seqn++);
+			assert (item.use_count () == 1);
+		}
+		assert (queue.IsEmpty ());
+	}
+	assert (queue.GetNumDropped () == 3);
+
+	// smallest capacity is 2
+	i2p::util::MPSCQueue<ItemPtr> queue1 (1);
+	assert (queue1.GetCapacity () == 2);
+	for (int i = 0; i < 10; i++)
+	{
+		assert (queue1.Put (std::make_shared<Item>(0, 2*i)));
+		assert (queue1.Put (std::make_shared<Item>(0, 2*i + 1)));
+		assert (!queue1.Put (std::make_shared<Item>(0, 0)));
+		assert (queue1.Get ()->seqn == (uint64_t)2*i);
+		assert (queue1.Get ()->seqn == (uint64_t)2*i + 1);
+		assert (!queue1.Get ());
+	}
+	assert (queue1.GetNumDropped () == 10);
+
+	// several producers, items of each producer arrive in order
+	for (int numProducers: { 1, 4, 16 })
+	{
+		double mutexRate = Run<i2p::util::Queue<ItemPtr> >(numProducers);
+		double lockFreeRate = Run<i2p::util::MPSCQueue<ItemPtr> >(numProducers);
+		if (argc > 1 && !strcmp (argv[1], "--bench"))
+			printf ("%2d producers: Queue %.0f msg/s, MPSCQueue %.0f msg/s\n", numProducers, mutexRate, lockFreeRate);
+	}
+	return 0;
+}
@@ -0,0 +1,183 @@
+#include <cassert>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include "Tag.h"
+#include "RandomIndex.h"
+
+typedef i2p::data::Tag<32> IdentHash;
+
+struct Router
+{
+	IdentHash ident;
+	bool highBandwidth;
+};
+typedef std::map<IdentHash, std::shared_ptr<Router> > Routers;
+typedef i2p::data::RandomIndex<IdentHash, std::shared_ptr<Router> > Index;
+
+const int NUM_HOPS = 100000;
+
+// same as former NetDb::GetRandomRouter
+template<typename Filter>
+std::shared_ptr<Router> GetRandomRouterMap (const Routers& routers, Filter filter)
+{
+	if (routers.empty ()) return nullptr;
+	uint32_t ind = rand () % routers.size ();
+	for (int j = 0; j < 2; j++)
+	{
+		uint32_t i = 0;
+		for (const auto& it: routers)
+		{
+			if (i >= ind)
+			{
+				if (filter (it.second)) return it.second;
+			}
+			else
+				i++;
+		}
+		ind = 0;
+	}
+	return nullptr;
+}
+
+int main (int argc, char * argv[])
+{
+	// insert and swap-remove keep index consistent with map
+	Routers routers;
+	Index all, highBandwidth;
+	for (int i = 0; i < 1000; i++)
+	{
+		auto r = std::make_shared<Router> ();
+		r->ident.Randomize ();
+		r->highBandwidth = !(rand () % 4);
+		routers[r->ident] = r;
+		assert (all.Insert (r->ident, r));
+		assert (!all.Insert (r->ident, r));
+		if (r->highBandwidth) highBandwidth.Insert (r->ident, r);
+	}
+	int n = 0;
+	for (auto it = routers.begin (); it != routers.end (); n++)
+	{
+		if (n % 3) { ++it; continue; }
+		assert (all.Erase (it->first));
+		assert (!all.Erase (it->first));
+		highBandwidth.Erase (it->first);
+		it = routers.erase (it);
+	}
+	assert (all.GetSize () == routers.size ());
+	std::set<IdentHash> idents;
+	for (size_t i = 0; i < all.GetSize (); i++)
+	{
+		assert (routers.count (all[i]->ident) && all.Contains (all[i]->ident));
+		idents.insert (all[i]->ident);
+	}
+	assert (idents.size () == routers.size ());
+	for (size_t i = 0; i < highBandwidth.GetSize (); i++)
+		assert (highBandwidth[i]->highBandwidth);
+
+	// filter, empty result
+	auto r = all.GetRandom ([](const std::shared_ptr<Router>& r) { return r->highBandwidth; });
+	assert (r && r->highBandwidth);
+	assert (!all.GetRandom ([](const std::shared_ptr<Router>&) { return false; }));
+	assert (!Index ().GetRandom ([](const std::shared_ptr<Router>&) { return true; }));
+	// only one accepted, found after all others are rejected
+	auto only = all[all.GetSize () - 1];
+	for (int i = 0; i < 100; i++)
+		assert (all.GetRandom ([only](const std::shared_ptr<Router>& r) { return r == only; }) == only);
+
+	// single element, erase of last element, reinsert after clear
+	{
+		Index single;
+		auto r1 = std::make_shared<Router> (); r1->ident.Randomize ();
+		assert (single.Insert (r1->ident, r1));
+		assert (single.GetRandom ([](const std::shared_ptr<Router>&) { return true; }) == r1);
+		assert (single.Erase (r1->ident));
+		assert (single.IsEmpty () && !single.Contains (r1->ident));
+		assert (!single.GetRandom ([](const std::shared_ptr<Router>&) { return true; }));
+		auto r2 = std::make_shared<Router> (); r2->ident.Randomize ();
+		single.Insert (r1->ident, r1); single.Insert (r2->ident, r2);
+		assert (single.Erase (r2->ident)); // last, no swap
+		assert (single.GetSize () == 1 && single[0] == r1 && single.Contains (r1->ident));
+		single.Clear ();
+		assert (single.IsEmpty () && !single.Contains (r1->ident));
+		assert (single.Insert (r1->ident, r1) && single[0] == r1);
+	}
+
+	// uniform
+	std::map<IdentHash, int> counts;
+	for (size_t i = 0; i < all.GetSize ()*100; i++)
+		counts[all.GetRandom ([](const std::shared_ptr<Router>&) { return true; })->ident]++;
+	assert (counts.size () == all.GetSize ());
+	for (const auto& it: counts)
+		assert (it.second > 40 && it.second < 200);
+
+	// uniform among accepted, even if accepted ones are next to each other
+	{
+		std::set<std::shared_ptr<Router> > accepted;
+		for (size_t i = 0; i < 10; i++) accepted.insert (all[i]);
+		accepted.insert (all[all.GetSize ()/2]);
+		auto isAccepted = [&accepted](const std::shared_ptr<Router>& r) { return accepted.count (r) > 0; };
+		std::map<std::shared_ptr<Router>, int> acceptedCounts;
+		for (int i = 0; i < 11000; i++)
+			acceptedCounts[all.GetRandom (isAccepted)]++;
+		assert (acceptedCounts.size () == accepted.size ());
+		for (const auto& it: acceptedCounts)
+			assert (it.second > 700 && it.second < 1300);
+
+		// distinct, all accepted ones if asked for more
+		std::vector<std::shared_ptr<Router> > visited;
+		auto visit = [&visited](const std::shared_ptr<Router>& r) { visited.push_back (r); };
+		assert (all.VisitRandom (isAccepted, visit, 100) == accepted.size ());
+		assert (std::set<std::shared_ptr<Router> >(visited.begin (), visited.end ()) == accepted);
+		visited.clear ();
+		auto any = [](const std::shared_ptr<Router>&) { return true; };
+		assert (all.VisitRandom (any, visit, 200) == 200);
+		assert (std::set<std::shared_ptr<Router> >(visited.begin (), visited.end ()).size () == 200);
+		visited.clear ();
+		assert (all.VisitRandom (any, visit, all.GetSize () + 1) == all.GetSize ());
+		assert (std::set<std::shared_ptr<Router> >(visited.begin (), visited.end ()).size () == all.GetSize ());
+		assert (!Index ().VisitRandom (any, visit, 1));
+	}
+
+	if (argc < 2 || strcmp (argv[1], "--bench")) return 0;
+	// peer selection cost of tunnel hops
+	for (size_t numRouters: { 1000, 5000, 20000 })
+	{
+		Routers routers;
+		Index all, highBandwidth;
+		while (routers.size () < numRouters)
+		{
+			auto r = std::make_shared<Router> ();
+			r->ident.Randomize ();
+			r->highBandwidth = !(rand () % 4);
+			routers[r->ident] = r;
+			all.Insert (r->ident, r);
+			if (r->highBandwidth) highBandwidth.Insert (r->ident, r);
+		}
+		auto any = [](const std::shared_ptr<Router>&) { return true; };
+		auto isHighBandwidth = [](const std::shared_ptr<Router>& r) { return r->highBandwidth; };
+		auto start = std::chrono::steady_clock::now ();
+		for (int i = 0; i < NUM_HOPS; i++)
+			GetRandomRouterMap (routers, i & 1 ? isHighBandwidth : any);
+		std::chrono::duration<double> walk = std::chrono::steady_clock::now () - start;
+		start = std::chrono::steady_clock::now ();
+		for (int i = 0; i < NUM_HOPS; i++)
+		{
+			if (i & 1)
+				highBandwidth.GetRandom (isHighBandwidth);
+			else
+				all.GetRandom (any);
+		}
+		std::chrono::duration<double> indexed = std::chrono::steady_clock::now () - start;
+		printf ("%5d routers: map walk %.3f us, random index %.3f us per hop\n", (int)numRouters,
+			walk.count ()*1e6/NUM_HOPS, indexed.count ()*1e6/NUM_HOPS);
+	}
+	return 0;
+}
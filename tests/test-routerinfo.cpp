@@ -0,0 +1,574 @@
+#include <cassert>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <list>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <openssl/bn.h>
+
+#include "I2PEndian.h"
+#include "Base.h"
+#include "Identity.h"
+#include "Signature.h"
+#include "RouterInfo.h"
+#include "RouterContext.h"
+#include "eddsa-sign.h"
+
+typedef i2p::data::RouterInfo RouterInfo;
+
+const int NUM_GENERATED = 2000;
+const int NUM_MUTATIONS = 20000;
+const int NUM_RUNS = 5;
+
+std::mt19937 rng (12345);
+
+int Random (int n) { return std::uniform_int_distribution<int>(0, n - 1)(rng); }
+
+// parse result in comparable form
+struct Parsed
+{
+	bool malformed = false;
+	uint64_t timestamp = 0;
+	std::list<std::shared_ptr<RouterInfo::Address> > addresses;
+	std::map<std::string, std::string> properties;
+	std::string caps;
+	uint8_t supportedTransports = 0;
+};
+
+/** stream based parser as RouterInfo::ReadFromStream was before, reference for parity */
+size_t ReadString (char * str, size_t len, std::istream& s)
+{
+	uint8_t l;
+	s.read ((char *)&l, 1);
+	if (l < len)
+	{
+		s.read (str, l);
+		if (!s) l = 0; // failed, return empty string
+		str[l] = 0;
+	}
+	else
+	{
+		s.seekg (l, std::ios::cur); // skip
+		str[0] = 0;
+	}
+	return l+1;
+}
+
+void ReadFromStream (std::istream& s, Parsed& p)
+{
+	s.read ((char *)&p.timestamp, sizeof (p.timestamp));
+	p.timestamp = be64toh (p.timestamp);
+	uint8_t numAddresses;
+	s.read ((char *)&numAddresses, sizeof (numAddresses)); if (!s) return;
+	bool introducers = false;
+	for (int i = 0; i < numAddresses; i++)
+	{
+		uint8_t supportedTransports = 0;
+		auto address = std::make_shared<RouterInfo::Address>();
+		s.read ((char *)&address->cost, sizeof (address->cost));
+		s.read ((char *)&address->date, sizeof (address->date));
+		bool isNTCP2Only = false;
+		char transportStyle[6];
+		auto transportStyleLen = ReadString (transportStyle, 6, s) - 1;
+		if (!strncmp (transportStyle, "NTCP", 4))
+		{
+			address->transportStyle = RouterInfo::eTransportNTCP;
+			if (transportStyleLen > 4 && transportStyle[4] == '2') isNTCP2Only= true;
+		}
+		else if (!strcmp (transportStyle, "SSU"))
+		{
+			address->transportStyle = RouterInfo::eTransportSSU;
+			address->ssu.reset (new RouterInfo::SSUExt ());
+			address->ssu->mtu = 0;
+		}
+		else
+			address->transportStyle = RouterInfo::eTransportUnknown;
+		address->port = 0;
+		uint16_t size, r = 0;
+		s.read ((char *)&size, sizeof (size)); if (!s) return;
+		size = be16toh (size);
+		while (r < size)
+		{
+			char key[255], value[255];
+			r += ReadString (key, 255, s);
+			s.seekg (1, std::ios_base::cur); r++; // =
+			r += ReadString (value, 255, s);
+			s.seekg (1, std::ios_base::cur); r++; // ;
+			if (!s) return;
+			if (!strcmp (key, "host"))
+			{
+				boost::system::error_code ecode;
+				address->host = boost::asio::ip::address::from_string (value, ecode);
+				if (ecode)
+				{
+					supportedTransports |= (address->transportStyle == RouterInfo::eTransportNTCP) ? RouterInfo::eNTCPV4 : RouterInfo::eSSUV4;
+					address->addressString = value;
+				}
+				else if (address->host.is_v4 ())
+					supportedTransports |= (address->transportStyle == RouterInfo::eTransportNTCP) ? RouterInfo::eNTCPV4 : RouterInfo::eSSUV4;
+				else
+					supportedTransports |= (address->transportStyle == RouterInfo::eTransportNTCP) ? RouterInfo::eNTCPV6 : RouterInfo::eSSUV6;
+			}
+			else if (!strcmp (key, "port"))
+				address->port = boost::lexical_cast<int>(value);
+			else if (!strcmp (key, "mtu"))
+			{
+				if (address->ssu) address->ssu->mtu = boost::lexical_cast<int>(value);
+			}
+			else if (!strcmp (key, "key"))
+			{
+				if (address->ssu) i2p::data::Base64ToByteStream (value, strlen (value), address->ssu->key, 32);
+			}
+			else if (!strcmp (key, "caps"))
+				p.caps += value;
+			else if (!strcmp (key, "s"))
+			{
+				if (!address->ntcp2) address->ntcp2.reset (new RouterInfo::NTCP2Ext ());
+				supportedTransports |= (address->host.is_v4 ()) ? RouterInfo::eNTCP2V4 : RouterInfo::eNTCP2V6;
+				i2p::data::Base64ToByteStream (value, strlen (value), address->ntcp2->staticKey, 32);
+			}
+			else if (!strcmp (key, "i"))
+			{
+				if (!address->ntcp2) address->ntcp2.reset (new RouterInfo::NTCP2Ext ());
+				supportedTransports |= (address->host.is_v4 ()) ? RouterInfo::eNTCP2V4 : RouterInfo::eNTCP2V6;
+				i2p::data::Base64ToByteStream (value, strlen (value), address->ntcp2->iv, 16);
+				address->ntcp2->isPublished = true;
+			}
+			else if (key[0] == 'i')
+			{
+				introducers = true;
+				size_t l = strlen(key);
+				unsigned char index = key[l-1] - '0';
+				key[l-1] = 0;
+				if (index > 9 || !address->ssu) continue;
+				if (index >= address->ssu->introducers.size ())
+					address->ssu->introducers.resize (index + 1);
+				RouterInfo::Introducer& introducer = address->ssu->introducers.at (index);
+				if (!strcmp (key, "ihost"))
+				{
+					boost::system::error_code ecode;
+					introducer.iHost = boost::asio::ip::address::from_string (value, ecode);
+				}
+				else if (!strcmp (key, "iport"))
+					introducer.iPort = boost::lexical_cast<int>(value);
+				else if (!strcmp (key, "itag"))
+					introducer.iTag = boost::lexical_cast<uint32_t>(value);
+				else if (!strcmp (key, "ikey"))
+					i2p::data::Base64ToByteStream (value, strlen (value), introducer.iKey, 32);
+				else if (!strcmp (key, "iexp"))
+					introducer.iExp = boost::lexical_cast<uint32_t>(value);
+			}
+			if (!s) return;
+		}
+		if (introducers) supportedTransports |= RouterInfo::eSSUV4;
+		if (isNTCP2Only && address->ntcp2) address->ntcp2->isNTCP2Only = true;
+		if (supportedTransports)
+		{
+			p.addresses.push_back (address);
+			p.supportedTransports |= supportedTransports;
+		}
+	}
+	uint8_t numPeers;
+	s.read ((char *)&numPeers, sizeof (numPeers)); if (!s) return;
+	s.seekg (numPeers*32, std::ios_base::cur);
+	uint16_t size, r = 0;
+	s.read ((char *)&size, sizeof (size)); if (!s) return;
+	size = be16toh (size);
+	while (r < size)
+	{
+		char key[255], value[255];
+		r += ReadString (key, 255, s);
+		s.seekg (1, std::ios_base::cur); r++; // =
+		r += ReadString (value, 255, s);
+		s.seekg (1, std::ios_base::cur); r++; // ;
+		if (!s) return;
+		p.properties[key] = value;
+		if (!strcmp (key, "caps")) p.caps += value;
+	}
+}
+
+void ReferenceParse (const uint8_t * buf, size_t len, Parsed& p)
+{
+	i2p::data::IdentityEx identity (buf, len);
+	size_t identityLen = identity.GetFullLen ();
+	std::stringstream str;
+	str.write ((const char *)buf + identityLen, len - identityLen);
+	try
+	{
+		ReadFromStream (str, p);
+		if (!str) p.malformed = true;
+	}
+	catch (boost::bad_lexical_cast&)
+	{
+		p.malformed = true;
+	}
+}
+
+std::string Describe (const RouterInfo::Address& a)
+{
+	std::stringstream s;
+	s << (int)a.transportStyle << " " << a.host.to_string () << " " << a.addressString << " " << a.port
+		<< " " << a.date << " " << (int)a.cost;
+	if (a.ssu)
+	{
+		s << " mtu=" << a.ssu->mtu << " key=" << a.ssu->key.ToBase64 ();
+		for (const auto& it: a.ssu->introducers)
+			s << " [" << it.iHost.to_string () << " " << it.iPort << " " << it.iKey.ToBase64 () << " "
+				<< it.iTag << " " << it.iExp << "]";
+	}
+	if (a.ntcp2)
+		s << " s=" << a.ntcp2->staticKey.ToBase64 () << " i=" << a.ntcp2->iv.ToBase64 () << " "
+			<< a.ntcp2->isPublished << a.ntcp2->isNTCP2Only;
+	return s.str ();
+}
+
+void CheckParity (const uint8_t * buf, size_t len)
+{
+	Parsed ref;
+	ReferenceParse (buf, len, ref);
+	RouterInfo ri (buf, len, false);
+	if (ref.malformed)
+	{
+		assert (ri.IsUnreachable ());
+		return;
+	}
+	assert (ri.GetTimestamp () == ref.timestamp);
+	auto& addresses = ri.GetAddresses ();
+	assert (addresses.size () == ref.addresses.size ());
+	auto it1 = addresses.begin ();
+	for (auto it2 = ref.addresses.begin (); it2 != ref.addresses.end (); ++it1, ++it2)
+		assert (Describe (**it1) == Describe (**it2));
+	for (auto& it: ref.properties)
+		assert (ri.GetProperty (it.first) == it.second);
+	RouterInfo caps; caps.SetCaps (ref.caps.c_str ());
+	assert (ri.GetCaps () == caps.GetCaps ());
+	assert (ri.IsNTCP (true) == (bool)(ref.supportedTransports & RouterInfo::eNTCPV4));
+	assert (ri.IsNTCP (false) == (bool)(ref.supportedTransports & (RouterInfo::eNTCPV4 | RouterInfo::eNTCPV6)));
+	assert (ri.IsSSU (true) == (bool)(ref.supportedTransports & RouterInfo::eSSUV4));
+	assert (ri.IsSSU (false) == (bool)(ref.supportedTransports & (RouterInfo::eSSUV4 | RouterInfo::eSSUV6)));
+	assert (ri.IsNTCP2 (false) == (bool)(ref.supportedTransports & (RouterInfo::eNTCP2V4 | RouterInfo::eNTCP2V6)));
+	bool unreachable = !ref.supportedTransports || ref.addresses.empty () ||
+		((caps.GetCaps () & RouterInfo::eUnreachable) && !ref.caps.empty () &&
+		 std::none_of (ref.addresses.begin (), ref.addresses.end (), [](std::shared_ptr<RouterInfo::Address> a)
+			{ return a->ssu && !a->ssu->introducers.empty (); }));
+	if (ref.properties.count ("netId") && ref.properties["netId"] != std::to_string (i2p::context.GetNetID ()))
+		unreachable = true;
+	if (!unreachable) assert (!ri.IsUnreachable ());
+}
+
+// generator of RouterInfos
+void WriteString (const std::string& str, std::string& s)
+{
+	s.push_back ((char)str.length ());
+	s += str;
+}
+
+void WriteProperty (const std::string& key, const std::string& value, std::string& s)
+{
+	WriteString (key, s); s.push_back ('='); WriteString (value, s); s.push_back (';');
+}
+
+std::string RandomBase64 (size_t len)
+{
+	std::vector<uint8_t> buf (len);
+	for (auto& it: buf) it = Random (256);
+	char str[64];
+	size_t l = i2p::data::ByteStreamToBase64 (buf.data (), len, str, 64);
+	return std::string (str, l);
+}
+
+std::string RandomHost ()
+{
+	switch (Random (4))
+	{
+		case 0: return "2001:db8:" + std::to_string (Random (0xFFFF)) + "::" + std::to_string (Random (10));
+		case 1: return "router" + std::to_string (Random (1000)) + ".example.com";
+		default: return std::to_string (Random (224)) + "." + std::to_string (Random (256)) + "." +
+			std::to_string (Random (256)) + "." + std::to_string (Random (256));
+	}
+}
+
+std::string GenerateAddress ()
+{
+	std::string a, properties;
+	a.push_back ((char)Random (20));
+	a.append (8, (char)Random (256));
+	switch (Random (5))
+	{
+		case 0: // NTCP
+			WriteString ("NTCP", a);
+			WriteProperty ("host", RandomHost (), properties);
+			WriteProperty ("port", std::to_string (Random (65536)), properties);
+		break;
+		case 1: // NTCP2
+			WriteString (Random (2) ? "NTCP2" : "NTCP", a);
+			if (Random (2))
+			{
+				WriteProperty ("host", RandomHost (), properties);
+				WriteProperty ("i", RandomBase64 (16), properties);
+				WriteProperty ("port", std::to_string (Random (65536)), properties);
+			}
+			WriteProperty ("s", RandomBase64 (32), properties);
+			WriteProperty ("v", "2", properties);
+		break;
+		case 2: // SSU
+			WriteString ("SSU", a);
+			WriteProperty ("caps", Random (2) ? "BC" : "B", properties);
+			WriteProperty ("host", RandomHost (), properties);
+			WriteProperty ("key", RandomBase64 (32), properties);
+			if (Random (2)) WriteProperty ("mtu", std::to_string (1280 + Random (300)), properties);
+			WriteProperty ("port", std::to_string (Random (65536)), properties);
+		break;
+		case 3: // SSU with introducers
+		{
+			WriteString ("SSU", a);
+			WriteProperty ("caps", "B", properties);
+			int num = 1 + Random (3);
+			for (int i = 0; i < num; i++)
+				WriteProperty ("iexp" + std::to_string (i), std::to_string (1500000000 + Random (100000000)), properties);
+			for (int i = 0; i < num; i++)
+				WriteProperty ("ihost" + std::to_string (i), RandomHost (), properties);
+			for (int i = 0; i < num; i++)
+				WriteProperty ("ikey" + std::to_string (i), RandomBase64 (32), properties);
+			for (int i = 0; i < num; i++)
+				WriteProperty ("iport" + std::to_string (i), std::to_string (Random (65536)), properties);
+			for (int i = 0; i < num; i++)
+				WriteProperty ("itag" + std::to_string (i), std::to_string ((uint32_t)rng ()), properties);
+			WriteProperty ("key", RandomBase64 (32), properties);
+		}
+		break;
+		default: // unknown
+			WriteString ("XYZ", a);
+			WriteProperty ("host", RandomHost (), properties);
+	}
+	uint8_t size[2]; htobe16buf (size, properties.length ());
+	a.append ((const char *)size, 2);
+	return a + properties;
+}
+
+// identity, body and zero signature, signature is not verified
+std::vector<uint8_t> CreateRouterInfo (const i2p::data::IdentityEx& identity, const std::string& body)
+{
+	std::vector<uint8_t> buf (identity.GetFullLen () + body.length () + identity.GetSignatureLen ());
+	identity.ToBuffer (buf.data (), buf.size ());
+	memcpy (buf.data () + identity.GetFullLen (), body.data (), body.length ());
+	return buf;
+}
+
+std::vector<uint8_t> GenerateRouterInfo (const i2p::data::IdentityEx& identity)
+{
+	std::string body;
+	uint8_t ts[8]; htobe64buf (ts, 1500000000000LL + Random (1000000000));
+	body.append ((const char *)ts, 8);
+	int numAddresses = 1 + Random (4);
+	body.push_back ((char)numAddresses);
+	for (int i = 0; i < numAddresses; i++)
+		body += GenerateAddress ();
+	body.push_back (0); // peers
+	std::string properties, caps;
+	const char flags[] = "fKLMNOPXRUHBC";
+	for (int i = Random (4); i >= 0; i--) caps.push_back (flags[Random (sizeof (flags) - 1)]);
+	WriteProperty ("caps", caps, properties);
+	WriteProperty ("coreVersion", "0.9.38", properties);
+	WriteProperty ("netId", Random (50) ? "2" : "3", properties);
+	WriteProperty ("netdb.knownLeaseSets", std::to_string (Random (100)), properties);
+	WriteProperty ("netdb.knownRouters", std::to_string (Random (5000)), properties);
+	WriteProperty ("router.version", "0.9.38", properties);
+	uint8_t size[2]; htobe16buf (size, properties.length ());
+	body.append ((const char *)size, 2);
+	body += properties;
+	return CreateRouterInfo (identity, body);
+}
+
+std::vector<uint8_t> GenerateReachableRouterInfo (const i2p::data::IdentityEx& identity)
+{
+	for (;;)
+	{
+		auto buf = GenerateRouterInfo (identity);
+		RouterInfo ri (buf.data (), buf.size (), false);
+		if (!ri.IsUnreachable ()) return buf;
+	}
+}
+
+// RouterInfos verified on load must be accepted by the same rules as received ones
+void CheckSignatures ()
+{
+	uint8_t seed[32], expanded[64], publicKey[32], cryptoKey[256];
+	RAND_bytes (seed, 32);
+	RAND_bytes (cryptoKey, 256);
+	i2p::crypto::Ed25519::ExpandPrivateKey (seed, expanded);
+	BN_CTX * ctx = BN_CTX_new ();
+	i2p::crypto::GetEd25519 ()->EncodePublicKey (i2p::crypto::GetEd25519 ()->GeneratePublicKey (expanded, ctx), publicKey, ctx);
+	i2p::data::IdentityEx identity (cryptoKey, publicKey, i2p::data::SIGNING_KEY_TYPE_EDDSA_SHA512_ED25519);
+	i2p::crypto::EDDSA25519Signer signer (seed);
+
+	std::vector<std::vector<uint8_t> > bufs;
+	std::vector<bool> expected;
+	for (int i = 0; i < 16; i++)
+	{
+		bufs.push_back (GenerateReachableRouterInfo (identity));
+		auto& buf = bufs.back ();
+		signer.Sign (buf.data (), buf.size () - 64, buf.data () + buf.size () - 64);
+		expected.push_back (true);
+	}
+	// timestamp corrupted after signing
+	bufs.push_back (bufs.front ());
+	bufs.back ()[identity.GetFullLen ()] ^= 0x01;
+	expected.push_back (false);
+	uint8_t R[32];
+	memset (R, 0xFF, 32); R[0] = 0xEC; R[31] = 0x7F; // (0, -1) of order 2
+	bufs.push_back (GenerateReachableRouterInfo (identity));
+	SignWithR (expanded, publicKey, R, bufs.back ().data (), bufs.back ().size () - 64, bufs.back ().data () + bufs.back ().size () - 64);
+	expected.push_back (false);
+	memset (R, 0, 32); R[0] = 1; R[31] = 0x80; // identity with sign of x
+	bufs.push_back (GenerateReachableRouterInfo (identity));
+	SignWithR (expanded, publicKey, R, bufs.back ().data (), bufs.back ().size () - 64, bufs.back ().data () + bufs.back ().size () - 64);
+	expected.push_back (false);
+	// public key of order 2, R = B*S passes only if h is even
+	uint8_t smallOrderKey[32];
+	memset (smallOrderKey, 0xFF, 32); smallOrderKey[0] = 0xEC; smallOrderKey[31] = 0x7F;
+	i2p::data::IdentityEx smallOrderIdentity (cryptoKey, smallOrderKey, i2p::data::SIGNING_KEY_TYPE_EDDSA_SHA512_ED25519);
+	for (int i = 0; i < 16; i++)
+	{
+		bufs.push_back (GenerateReachableRouterInfo (smallOrderIdentity));
+		auto& buf = bufs.back ();
+		uint8_t * signature = buf.data () + buf.size () - 64, s[64] = {0};
+		RAND_bytes (s, 32); s[31] &= 0x0F; // S < l
+		memcpy (signature + 32, s, 32);
+		i2p::crypto::GetEd25519 ()->EncodePublicKey (i2p::crypto::GetEd25519 ()->GeneratePublicKey (s, ctx), signature, ctx);
+		expected.push_back (smallOrderIdentity.Verify (buf.data (), buf.size () - 64, signature));
+	}
+	BN_CTX_free (ctx);
+
+	std::vector<std::shared_ptr<RouterInfo> > routers;
+	for (size_t i = 0; i < bufs.size (); i++)
+	{
+		RouterInfo received (bufs[i].data (), bufs[i].size ());
+		assert (received.IsUnreachable () == !expected[i]);
+		routers.push_back (std::make_shared<RouterInfo>(bufs[i].data (), bufs[i].size (), false));
+	}
+	// identity only, unreachable before verification and skipped
+	std::vector<uint8_t> truncated (identity.GetFullLen ());
+	identity.ToBuffer (truncated.data (), truncated.size ());
+	routers.push_back (std::make_shared<RouterInfo>(truncated.data (), truncated.size (), false));
+	RouterInfo::VerifySignatures (routers);
+	for (size_t i = 0; i < bufs.size (); i++)
+		assert (routers[i]->IsUnreachable () == !expected[i]);
+	assert (routers.back ()->IsUnreachable ());
+	RouterInfo::VerifySignatures (std::vector<std::shared_ptr<RouterInfo> > ());
+	assert (std::count (expected.begin (), expected.end (), true) > 16); // some small order ones pass
+}
+
+// hand-written edge cases
+void CheckEdgeCases (const i2p::data::IdentityEx& identity)
+{
+	// identity only, truncated timestamp
+	std::vector<uint8_t> buf (identity.GetFullLen ());
+	identity.ToBuffer (buf.data (), buf.size ());
+	assert (RouterInfo (buf.data (), buf.size (), false).IsUnreachable ());
+	buf.resize (buf.size () + 8);
+	assert (RouterInfo (buf.data (), buf.size (), false).IsUnreachable ());
+
+	std::string ts (8, 0), properties;
+	// no addresses, no peers, no properties
+	auto ri = CreateRouterInfo (identity, ts + std::string (4, 0));
+	CheckParity (ri.data (), ri.size ());
+	assert (RouterInfo (ri.data (), ri.size (), false).IsUnreachable ());
+	// empty key, values of maximal length, properties size beyond buffer
+	WriteProperty ("", "empty", properties);
+	WriteProperty ("long", std::string (254, 'a'), properties);
+	WriteProperty ("longest", std::string (255, 'b'), properties);
+	std::string body = ts + std::string (2, 0);
+	uint8_t size[2]; htobe16buf (size, properties.length ());
+	body.append ((const char *)size, 2);
+	ri = CreateRouterInfo (identity, body + properties);
+	RouterInfo parsed (ri.data (), ri.size (), false);
+	assert (parsed.GetProperty ("") == "empty");
+	assert (parsed.GetProperty ("long") == std::string (254, 'a'));
+	assert (parsed.GetProperty ("longest") == std::string (255, 'b')); // stream parser dropped it
+	htobe16buf (size, 0xFFFF);
+	ri = CreateRouterInfo (identity, ts + std::string (2, 0) + std::string ((const char *)size, 2) + properties);
+	CheckParity (ri.data (), ri.size ());
+}
+
+int main (int argc, char * argv[])
+{
+	// test-routerinfo [--bench] [netDb directory]
+	bool bench = false;
+	const char * netDb = nullptr;
+	for (int i = 1; i < argc; i++)
+		if (!strcmp (argv[i], "--bench")) bench = true; else netDb = argv[i];
+	// corpus of generated RouterInfos, or real ones from netDb directory
+	std::vector<std::vector<uint8_t> > corpus;
+	if (netDb)
+	{
+		for (boost::filesystem::recursive_directory_iterator it (netDb), end; it != end; ++it)
+		{
+			if (!boost::filesystem::is_regular_file (it->path ())) continue;
+			std::ifstream f (it->path ().string (), std::ifstream::binary);
+			std::vector<uint8_t> buf ((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+			if (buf.size () > 400 && buf.size () <= (size_t)i2p::data::MAX_RI_BUFFER_SIZE)
+				corpus.push_back (buf);
+		}
+		printf ("%d RouterInfos loaded from %s\n", (int)corpus.size (), netDb);
+	}
+	else
+	{
+		auto keys = i2p::data::PrivateKeys::CreateRandomKeys (i2p::data::SIGNING_KEY_TYPE_EDDSA_SHA512_ED25519);
+		for (int i = 0; i < NUM_GENERATED; i++)
+			corpus.push_back (GenerateRouterInfo (*keys.GetPublic ()));
+	}
+
+	// parity with stream parser
+	for (const auto& it: corpus)
+		CheckParity (it.data (), it.size ());
+
+	CheckSignatures ();
+	CheckEdgeCases (*i2p::data::PrivateKeys::CreateRandomKeys (i2p::data::SIGNING_KEY_TYPE_EDDSA_SHA512_ED25519).GetPublic ());
+
+	// truncated and mutated RouterInfos must not be read beyond buffer
+	for (int i = 0; i < NUM_MUTATIONS; i++)
+	{
+		auto buf = corpus[Random (corpus.size ())];
+		i2p::data::IdentityEx identity (buf.data (), buf.size ());
+		size_t identityLen = identity.GetFullLen ();
+		if (Random (2))
+			buf.resize (identityLen + Random (buf.size () - identityLen));
+		else
+			for (int j = Random (4); j >= 0; j--)
+				buf[identityLen + Random (buf.size () - identityLen)] = Random (256);
+		std::unique_ptr<uint8_t[]> exact (new uint8_t[buf.size ()]); // exact size for memory checkers
+		memcpy (exact.get (), buf.data (), buf.size ());
+		RouterInfo ri (exact.get (), buf.size (), false);
+	}
+
+	if (!bench) return 0;
+	// throughput
+	std::chrono::duration<double> stream (0), span (0);
+	for (int r = 0; r < NUM_RUNS; r++)
+	{
+		auto start = std::chrono::steady_clock::now ();
+		for (const auto& it: corpus)
+		{
+			Parsed p;
+			ReferenceParse (it.data (), it.size (), p);
+		}
+		stream += std::chrono::steady_clock::now () - start;
+		start = std::chrono::steady_clock::now ();
+		for (const auto& it: corpus)
+			RouterInfo ri (it.data (), it.size (), false);
+		span += std::chrono::steady_clock::now () - start;
+	}
+	double num = (double)NUM_RUNS*corpus.size ();
+	printf ("RouterInfo parse: stream %.0f RI/s, span %.0f RI/s\n", num/stream.count (), num/span.count ());
+	return 0;
+}
@@ -0,0 +1,250 @@
+#include <cassert>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <openssl/rand.h>
+#include <boost/filesystem.hpp>
+
+#include "RouterInfoStore.h"
+
+using i2p::data::IdentHash;
+using i2p::data::RouterInfoStore;
+typedef std::map<IdentHash, std::vector<uint8_t> > Records;
+
+const size_t NUM_RECORDS = 5000;
+
+std::vector<uint8_t> RandomBuffer ()
+{
+	uint16_t len;
+	RAND_bytes ((uint8_t *)&len, 2);
+	std::vector<uint8_t> buf (400 + len % 600);
+	RAND_bytes (buf.data (), buf.size ());
+	return buf;
+}
+
+void Check (RouterInfoStore& store, const Records& records)
+{
+	assert (store.GetNumRecords () == records.size ());
+	std::vector<RouterInfoStore::Record> stored;
+	store.GetRecords (stored);
+	assert (stored.size () == records.size ());
+	for (const auto& it: stored)
+	{
+		auto r = records.find (it.ident);
+		assert (r != records.end ());
+		assert (r->second.size () == it.len && !memcmp (r->second.data (), it.buf, it.len));
+	}
+	std::vector<uint8_t> buf;
+	for (const auto& it: records)
+		assert (store.Get (it.first, buf) && buf == it.second);
+}
+
+void Copy (const std::string& from, const std::string& to)
+{
+	boost::filesystem::remove (to);
+	boost::filesystem::copy_file (from, to);
+}
+
+int main (int argc, char * argv[])
+{
+	auto dir = boost::filesystem::temp_directory_path () / boost::filesystem::unique_path ();
+	boost::filesystem::create_directories (dir);
+	std::string path = (dir / "netDb.log").string (), path1 = (dir / "netDb1.log").string ();
+
+	Records records;
+	{
+		RouterInfoStore store (path);
+		assert (store.Open ());
+		assert (!store.GetNumRecords ());
+		while (records.size () < NUM_RECORDS)
+		{
+			IdentHash ident; ident.Randomize ();
+			records[ident] = RandomBuffer ();
+			assert (store.Put (ident, records[ident].data (), records[ident].size ()));
+		}
+		Check (store, records);
+		// replace and remove
+		size_t i = 0;
+		for (auto it = records.begin (); it != records.end (); i++)
+		{
+			if (i % 3 == 0)
+			{
+				store.Remove (it->first);
+				it = records.erase (it);
+				continue;
+			}
+			if (i % 3 == 1)
+			{
+				it->second = RandomBuffer ();
+				store.Put (it->first, it->second.data (), it->second.size ());
+			}
+			++it;
+		}
+		Check (store, records);
+	}
+
+	// reopen from index
+	RouterInfoStore store (path);
+	assert (store.Open ());
+	Check (store, records);
+
+	// records after index are found by scanning, broken tail is truncated
+	IdentHash ident; ident.Randomize ();
+	records[ident] = RandomBuffer ();
+	store.Put (ident, records[ident].data (), records[ident].size ());
+	store.Remove (records.begin ()->first);
+	records.erase (records.begin ());
+	store.Flush ();
+	Copy (path, path1);
+	Copy (path + ".idx", path1 + ".idx");
+	size_t size = boost::filesystem::file_size (path1);
+	{
+		std::ofstream f (path1, std::ofstream::binary | std::ofstream::app);
+		f.write ((const char *)records.begin ()->first (), 32); // incomplete record
+	}
+	{
+		RouterInfoStore store1 (path1);
+		assert (store1.Open ());
+		Check (store1, records);
+		assert (boost::filesystem::file_size (path1) == size);
+	}
+	// without index
+	boost::filesystem::remove (path1 + ".idx");
+	{
+		RouterInfoStore store1 (path1);
+		assert (store1.Open ());
+		Check (store1, records);
+	}
+
+	// compaction keeps live records only
+	for (int n = 0; n < 3; n++)
+		for (auto& it: records)
+		{
+			it.second = RandomBuffer ();
+			store.Put (it.first, it.second.data (), it.second.size ());
+		}
+	assert (store.NeedsCompaction ());
+	std::vector<RouterInfoStore::Record> stored;
+	store.GetRecords (stored);
+	size = store.GetFileSize ();
+	Copy (path + ".idx", path1 + ".idx"); // index of old file
+	assert (store.Compact ());
+	assert (store.GetFileSize () == store.GetLiveSize () && store.GetFileSize () < size/3);
+	assert (!store.NeedsCompaction ());
+	Check (store, records);
+	for (const auto& it: stored) // still mapped
+		assert (records[it.ident].size () == it.len && !memcmp (records[it.ident].data (), it.buf, it.len));
+	stored.clear ();
+	store.Close ();
+	assert (store.Open ());
+	Check (store, records);
+
+	// index of old file left by crash during compaction doesn't lose records
+	while (store.GetFileSize () <= size)
+		for (auto& it: records)
+		{
+			it.second = RandomBuffer ();
+			store.Put (it.first, it.second.data (), it.second.size ());
+		}
+	store.Close ();
+	Copy (path1 + ".idx", path + ".idx");
+	assert (store.Open ());
+	Check (store, records);
+
+	// invalid arguments
+	std::vector<uint8_t> buf;
+	ident.Randomize ();
+	assert (!store.Get (ident, buf));
+	store.Remove (ident);
+	assert (!store.Put (ident, buf.data (), 0));
+	buf.resize (i2p::data::ROUTER_INFO_STORE_MAX_RECORD_SIZE + 1);
+	assert (!store.Put (ident, buf.data (), buf.size ()));
+	Check (store, records);
+	store.Close ();
+
+	// corrupted index is ignored, records are found by scanning
+	Copy (path, path1);
+	Copy (path + ".idx", path1 + ".idx");
+	{
+		std::fstream f (path1 + ".idx", std::fstream::binary | std::fstream::in | std::fstream::out);
+		f.seekp (30); f.put (0x55);
+	}
+	{
+		RouterInfoStore store1 (path1);
+		assert (store1.Open ());
+		Check (store1, records);
+		// record of maximal size
+		buf.resize (i2p::data::ROUTER_INFO_STORE_MAX_RECORD_SIZE);
+		RAND_bytes (buf.data (), buf.size ());
+		assert (store1.Put (ident, buf.data (), buf.size ()));
+		store1.Flush ();
+		assert (store1.Get (ident, buf) && buf.size () == i2p::data::ROUTER_INFO_STORE_MAX_RECORD_SIZE);
+		Copy (path1, path);
+	}
+	// record with wrong checksum at the end is truncated
+	boost::filesystem::remove (path + ".idx");
+	size = boost::filesystem::file_size (path);
+	{
+		std::fstream f (path, std::fstream::binary | std::fstream::in | std::fstream::out);
+		f.seekp (size - 1); f.put (buf.back () ^ 0x01);
+	}
+	{
+		RouterInfoStore store1 (path);
+		assert (store1.Open ());
+		Check (store1, records);
+		assert (boost::filesystem::file_size (path) == size - i2p::data::ROUTER_INFO_STORE_RECORD_HEADER_SIZE - buf.size ());
+	}
+	// wrong magic
+	{
+		std::fstream f (path1, std::fstream::binary | std::fstream::in | std::fstream::out);
+		f.put ('x');
+	}
+	{
+		RouterInfoStore store1 (path1);
+		assert (!store1.Open ());
+	}
+
+	if (argc < 2 || strcmp (argv[1], "--bench"))
+	{
+		boost::filesystem::remove_all (dir);
+		return 0;
+	}
+	// loading, single file vs file per record
+	auto files = dir / "files";
+	boost::filesystem::create_directories (files);
+	for (const auto& it: records)
+	{
+		std::ofstream f ((files / it.first.ToBase32 ()).string (), std::ofstream::binary);
+		f.write ((const char *)it.second.data (), it.second.size ());
+	}
+	auto start = std::chrono::steady_clock::now ();
+	size_t total = 0;
+	for (boost::filesystem::directory_iterator it (files); it != boost::filesystem::directory_iterator (); ++it)
+	{
+		std::ifstream f (it->path ().string (), std::ifstream::binary);
+		std::vector<char> buf ((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+		total += buf.size ();
+	}
+	std::chrono::duration<double> filesTime = std::chrono::steady_clock::now () - start;
+	start = std::chrono::steady_clock::now ();
+	size_t totalStored = 0;
+	{
+		RouterInfoStore store1 (path);
+		store1.Open ();
+		std::vector<RouterInfoStore::Record> stored;
+		store1.GetRecords (stored);
+		for (const auto& it: stored)
+			totalStored += it.len;
+	}
+	std::chrono::duration<double> storeTime = std::chrono::steady_clock::now () - start;
+	assert (total == totalStored);
+	printf ("%d RouterInfos loaded: files %.2f ms, single file %.2f ms\n", (int)records.size (),
+		filesTime.count ()*1000, storeTime.count ()*1000);
+
+	boost::filesystem::remove_all (dir);
+	return 0;
+}
@@ -0,0 +1,157 @@
+#include <cassert>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <openssl/rand.h>
+#include <boost/asio.hpp>
+
+#include "SSUBatch.h"
+
+using namespace i2p::transport;
+using boost::asio::ip::udp;
+
+const size_t NUM_PACKETS = 200000;
+const size_t PACKET_SIZE = 1000;
+
+struct Peer // loopback stand-in for remote router
+{
+	Peer (boost::asio::io_service& service): socket (service, udp::endpoint (boost::asio::ip::address_v4::loopback (), 0))
+	{
+		socket.set_option (boost::asio::socket_base::receive_buffer_size (0x1FFFFF));
+		socket.non_blocking (true);
+	}
+	udp::socket socket;
+};
+
+// send and receive NUM_PACKETS in batches, times in seconds
+void Transfer (Peer& from, Peer& to, std::vector<SSUPacket *>& packets, bool batched, double& sendTime, double& receiveTime)
+{
+	auto dest = to.socket.local_endpoint ();
+	for (auto it: packets)
+	{
+		it->from = dest;
+		it->len = PACKET_SIZE;
+	}
+	std::vector<SSUPacket> received (SSU_MAX_BATCH_SIZE);
+	std::vector<SSUPacket *> receivedPtrs;
+	for (auto& it: received) receivedPtrs.push_back (&it);
+	sendTime = 0; receiveTime = 0;
+	for (size_t n = 0; n < NUM_PACKETS; n += SSU_MAX_BATCH_SIZE)
+	{
+		auto start = std::chrono::steady_clock::now ();
+		if (batched)
+		{
+			boost::system::error_code ec;
+			assert (SendPackets (from.socket, packets.data (), SSU_MAX_BATCH_SIZE, ec) == SSU_MAX_BATCH_SIZE);
+		}
+		else
+			for (size_t i = 0; i < SSU_MAX_BATCH_SIZE; i++)
+				from.socket.send_to (boost::asio::buffer (packets[i]->buf, packets[i]->len), packets[i]->from);
+		auto sent = std::chrono::steady_clock::now ();
+		sendTime += std::chrono::duration<double> (sent - start).count ();
+		size_t numReceived = 0;
+		while (numReceived < SSU_MAX_BATCH_SIZE)
+		{
+			if (batched)
+			{
+				boost::system::error_code ec;
+				numReceived += ReceivePackets (to.socket, receivedPtrs.data () + numReceived,
+					SSU_MAX_BATCH_SIZE - numReceived, SSU_MTU_V4, ec);
+				assert (!ec);
+			}
+			else
+			{
+				auto packet = receivedPtrs[numReceived];
+				boost::system::error_code ec;
+				packet->len = to.socket.receive_from (boost::asio::buffer (packet->buf, SSU_MTU_V4), packet->from, 0, ec);
+				if (!ec) numReceived++;
+			}
+		}
+		receiveTime += std::chrono::duration<double> (std::chrono::steady_clock::now () - sent).count ();
+		for (size_t i = 0; i < SSU_MAX_BATCH_SIZE; i++)
+			assert (received[i].len == PACKET_SIZE && received[i].from == from.socket.local_endpoint ());
+	}
+}
+
+// receives num packets, waits until they arrive
+void Receive (Peer& to, std::vector<SSUPacket>& received, size_t mtu)
+{
+	std::vector<SSUPacket *> receivedPtrs;
+	for (auto& it: received) receivedPtrs.push_back (&it);
+	size_t num = 0;
+	while (num < received.size ())
+	{
+		boost::system::error_code ec;
+		size_t n = ReceivePackets (to.socket, receivedPtrs.data () + num, received.size () - num, mtu, ec);
+		assert (!ec && n <= SSU_MAX_BATCH_SIZE);
+		num += n;
+	}
+}
+
+int main (int argc, char * argv[])
+{
+	boost::asio::io_service service;
+	Peer alice (service), bob (service);
+	std::vector<SSUPacket> buffers (SSU_MAX_BATCH_SIZE*2);
+	std::vector<SSUPacket *> packets;
+	for (auto& it: buffers)
+	{
+		RAND_bytes (it.buf, PACKET_SIZE);
+		packets.push_back (&it);
+	}
+
+	// nothing available
+	boost::system::error_code ec;
+	assert (!ReceivePackets (bob.socket, packets.data (), packets.size (), SSU_MTU_V4, ec) && !ec);
+
+	// content and endpoints, more than one batch
+	for (size_t i = 0; i < packets.size (); i++)
+	{
+		packets[i]->from = bob.socket.local_endpoint ();
+		packets[i]->len = 100 + i;
+	}
+	assert (SendPackets (alice.socket, packets.data (), packets.size (), ec) == packets.size () && !ec);
+	std::vector<SSUPacket> received (packets.size ());
+	Receive (bob, received, SSU_MTU_V4);
+	for (size_t i = 0; i < received.size (); i++)
+	{
+		assert (received[i].len == packets[i]->len && !memcmp (received[i].buf, packets[i]->buf, received[i].len));
+		assert (received[i].from == alice.socket.local_endpoint ());
+	}
+
+	// nothing to send or receive
+	assert (!SendPackets (alice.socket, packets.data (), 0, ec) && !ec);
+	assert (!ReceivePackets (bob.socket, packets.data (), 0, SSU_MTU_V4, ec) && !ec);
+
+	// longer than mtu is truncated
+	packets[0]->len = SSU_MTU_V6;
+	assert (SendPackets (alice.socket, packets.data (), 1, ec) == 1 && !ec);
+	received.resize (1);
+	Receive (bob, received, SSU_MTU_V4);
+	assert (received[0].len == SSU_MTU_V4 && !memcmp (received[0].buf, packets[0]->buf, SSU_MTU_V4));
+
+	// wrong destination in the middle is skipped, others are sent
+	for (int i = 0; i < 3; i++)
+	{
+		packets[i]->from = bob.socket.local_endpoint ();
+		packets[i]->len = 100 + i;
+	}
+	packets[1]->from = udp::endpoint (boost::asio::ip::address_v6::loopback (), bob.socket.local_endpoint ().port ());
+	assert (SendPackets (alice.socket, packets.data (), 3, ec) == 3 && ec && ec != boost::asio::error::would_block); // all processed
+	received.resize (2);
+	Receive (bob, received, SSU_MTU_V4);
+	assert (received[0].len == 100 && received[1].len == 102);
+	assert (!memcmp (received[1].buf, packets[2]->buf, 102));
+
+	if (argc < 2 || strcmp (argv[1], "--bench")) return 0;
+	// packets per second
+	double sendTime, receiveTime, batchedSendTime, batchedReceiveTime;
+	Transfer (alice, bob, packets, false, sendTime, receiveTime);
+	Transfer (alice, bob, packets, true, batchedSendTime, batchedReceiveTime);
+	printf ("%d packets of %d bytes, kpps: send_to %.0f, sendmmsg %.0f, receive_from %.0f, recvmmsg %.0f\n",
+		(int)NUM_PACKETS, (int)PACKET_SIZE, NUM_PACKETS/sendTime/1000, NUM_PACKETS/batchedSendTime/1000,
+		NUM_PACKETS/receiveTime/1000, NUM_PACKETS/batchedReceiveTime/1000);
+	return 0;
+}
@@ -0,0 +1,441 @@
+#include <cassert>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <map>
+#include <set>
+#include <queue>
+#include <vector>
+#include <random>
+#include <memory>
+
+#include "CongestionControl.h"
+
+using namespace i2p::stream;
+
+const int PAYLOAD_SIZE = 1600; // bytes of STREAMING_MTU left for data
+const int ACK_DELAY = 200; // receiver's RTT is INITIAL_RTT, so DEFAULT_INITIAL_ACK_DELAY
+const int SIMULATION_TIME = 120000; // milliseconds
+
+/** previous Stream window: cumulative average RTT, +1 per ack up to 6, then +1 per RTT, halving on timeout */
+class LegacyCongestionControl: public CongestionControl
+{
+	public:
+
+		LegacyCongestionControl (): m_RTT (INITIAL_RTT), m_NumSamples (0), m_LastIncreaseTime (0) {};
+
+		const char * GetName () const { return "legacy"; };
+		void OnAck (int numAcked, int rtt, uint64_t ts)
+		{
+			if (rtt > 0)
+			{
+				m_RTT = (m_RTT*m_NumSamples + rtt)/(m_NumSamples + 1);
+				m_NumSamples++;
+			}
+			for (int i = 0; i < numAcked; i++)
+			{
+				if (m_WindowSize < 6)
+					SetWindowSize (m_WindowSize + 1);
+				else if (ts > m_LastIncreaseTime + m_RTT)
+				{
+					SetWindowSize (m_WindowSize + 1);
+					m_LastIncreaseTime = ts;
+				}
+			}
+		}
+		void OnLoss (uint64_t) {}; // didn't react to NACKs
+		void OnTimeout (uint64_t) { SetWindowSize ((int)m_WindowSize/2); };
+
+	private:
+
+		int m_RTT, m_NumSamples;
+		uint64_t m_LastIncreaseTime;
+};
+
+/** one way tunnel with bottleneck of rate messages/s, queue of queueSize, random loss and jitter */
+struct TunnelParams
+{
+	const char * name;
+	int latency, jitter; // milliseconds
+	double loss;
+	int rate, queueSize;
+};
+
+struct Event
+{
+	uint64_t time;
+	int type; // 0 - packet arrived to receiver, 1 - ack arrived to sender, 2 - resend timer, 3 - ack timer
+	uint32_t seqn;
+	int32_t ackThrough;
+	std::vector<uint32_t> nacks;
+	int generation;
+	uint64_t id; // in order of scheduling if same time
+
+	bool operator< (const Event& other) const { return time != other.time ? time > other.time : id > other.id; }; // earliest first
+};
+
+class Simulation
+{
+	public:
+
+		Simulation (const TunnelParams& params, std::unique_ptr<CongestionControl> cc, bool noFastRetransmit = false):
+			m_Params (params), m_NoFastRetransmit (noFastRetransmit), m_Random (12345), m_NumEvents (0), m_Now (0),
+			m_LinkFree (0), m_LastArrival (0), m_SendWindow (std::move (cc)), m_NextSeqn (0), m_ResendGeneration (0),
+			m_LastReceived (-1), m_IsAckScheduled (false), m_AckGeneration (0),
+			m_NumSent (0), m_NumResent (0), m_NumFastRetransmits (0), m_NumTimeouts (0), m_MaxWindowSize (0)
+		{
+		}
+
+		void Run ()
+		{
+			SendBuffer ();
+			while (!m_Events.empty () && m_Events.top ().time < SIMULATION_TIME)
+			{
+				Event e = m_Events.top ();
+				m_Events.pop ();
+				m_Now = e.time;
+				switch (e.type)
+				{
+					case 0: ReceivePacket (e.seqn); break;
+					case 1: ProcessAck (e.ackThrough, e.nacks); break;
+					case 2:
+						if (e.generation == m_ResendGeneration) HandleResendTimer ();
+					break;
+					case 3:
+						if (e.generation == m_AckGeneration && m_IsAckScheduled)
+						{
+							m_IsAckScheduled = false;
+							SendAck ();
+						}
+					break;
+				}
+			}
+		}
+
+		double GetGoodput () const { return (m_LastReceived + 1.0)*PAYLOAD_SIZE*1000/SIMULATION_TIME/1024; }; // KB/s
+		const RTTEstimator& GetRTTEstimator () const { return m_SendWindow.GetRTTEstimator (); };
+		int GetNumResent () const { return m_NumResent; };
+		void Print () const
+		{
+			printf ("  %-7s goodput %6.1f KB/s, sent %5d, resent %4d (fast %4d), timeouts %3d, max window %3d, srtt %5d rttvar %4d rto %5d\n",
+				m_SendWindow.GetCongestionControl ().GetName (), GetGoodput (), m_NumSent, m_NumResent, m_NumFastRetransmits, m_NumTimeouts,
+				m_MaxWindowSize, GetRTTEstimator ().GetRTT (), GetRTTEstimator ().GetRTTVar (), m_SendWindow.GetRTO ());
+		}
+
+	private:
+
+		// sender, as Stream::SendBuffer, Stream::ProcessAck and Stream::HandleResendTimer
+		void SendPacket (uint32_t seqn)
+		{
+			m_NumSent++;
+			std::uniform_real_distribution<double> uniform (0, 1);
+			if (uniform (m_Random) < m_Params.loss) return;
+			// bottleneck queue
+			uint64_t start = std::max (m_Now, m_LinkFree);
+			if ((start - m_Now)*m_Params.rate/1000 >= (uint64_t)m_Params.queueSize) return; // tail drop
+			m_LinkFree = start + 1000/m_Params.rate;
+			Event e;
+			e.time = m_LinkFree + m_Params.latency + (m_Params.jitter ? m_Random () % m_Params.jitter : 0);
+			if (e.time < m_LastArrival) e.time = m_LastArrival; // messages of one tunnel are not reordered
+			m_LastArrival = e.time;
+			e.type = 0; e.seqn = seqn;
+			Push (e);
+		}
+
+		void SendBuffer ()
+		{
+			bool isEmpty = m_SentPackets.empty ();
+			while ((int)m_SentPackets.size () < m_SendWindow.GetWindowSize ())
+			{
+				m_SentPackets[m_NextSeqn].sendTime = m_Now;
+				SendPacket (m_NextSeqn);
+				m_NextSeqn++;
+			}
+			if (m_SendWindow.GetWindowSize () > m_MaxWindowSize) m_MaxWindowSize = m_SendWindow.GetWindowSize ();
+			if (isEmpty) ScheduleResend ();
+		}
+
+		void Push (Event& e)
+		{
+			e.id = m_NumEvents++;
+			m_Events.push (e);
+		}
+
+		void ScheduleResend ()
+		{
+			m_ResendGeneration++;
+			Event e;
+			e.time = m_Now + m_SendWindow.GetRTO ();
+			e.type = 2; e.generation = m_ResendGeneration;
+			Push (e);
+		}
+
+		void ProcessAck (int32_t ackThrough, const std::vector<uint32_t>& nacks)
+		{
+			std::vector<uint32_t> lost;
+			std::set<uint32_t> nacked (nacks.begin (), nacks.end ());
+			m_SendWindow.StartAck ();
+			for (auto it = m_SentPackets.begin (); it != m_SentPackets.end () && (int32_t)it->first <= ackThrough;)
+			{
+				if (nacked.count (it->first))
+				{
+					if (m_SendWindow.NACKed (it->second, m_Now) && !m_NoFastRetransmit)
+						lost.push_back (it->first);
+					++it;
+					continue;
+				}
+				m_SendWindow.Acked (it->second, m_Now);
+				it = m_SentPackets.erase (it);
+			}
+			if (m_SentPackets.empty ()) m_ResendGeneration++; // cancel
+			m_SendWindow.FinishAck (m_SentPackets.empty () ? m_NextSeqn : m_SentPackets.begin ()->first,
+				m_NextSeqn, !lost.empty (), m_Now);
+			for (auto seqn: lost)
+			{
+				SendWindow::Resent (m_SentPackets[seqn], m_Now);
+				SendPacket (seqn);
+				m_NumResent++; m_NumFastRetransmits++;
+			}
+			if (m_SendWindow.GetNumAcked () > 0) SendBuffer ();
+		}
+
+		void HandleResendTimer ()
+		{
+			std::vector<uint32_t> packets;
+			for (auto& it: m_SentPackets)
+				if (m_SendWindow.IsTimedOut (it.second, m_Now))
+				{
+					SendWindow::Resent (it.second, m_Now);
+					packets.push_back (it.first);
+				}
+			if (!packets.empty ())
+			{
+				if (m_SendWindow.Timeout (packets[0], m_NextSeqn, m_Now) == 1)
+					m_NumTimeouts++;
+				for (auto seqn: packets)
+				{
+					SendPacket (seqn);
+					m_NumResent++;
+				}
+			}
+			ScheduleResend ();
+		}
+
+		// receiver, as Stream::HandleNextPacket and Stream::SendQuickAck
+		void ReceivePacket (uint32_t seqn)
+		{
+			if ((int32_t)seqn == m_LastReceived + 1)
+			{
+				m_LastReceived++;
+				while (!m_Saved.empty () && (int32_t)*m_Saved.begin () == m_LastReceived + 1)
+				{
+					m_Saved.erase (m_Saved.begin ());
+					m_LastReceived++;
+				}
+				if (!m_IsAckScheduled)
+				{
+					m_IsAckScheduled = true;
+					m_AckGeneration++;
+					Event e;
+					e.time = m_Now + ACK_DELAY;
+					e.type = 3; e.generation = m_AckGeneration;
+					Push (e);
+				}
+			}
+			else if ((int32_t)seqn <= m_LastReceived)
+				SendAck (); // duplicate
+			else
+			{
+				m_Saved.insert (seqn);
+				m_IsAckScheduled = false;
+				if (m_LastReceived >= 0) SendAck ();
+			}
+		}
+
+		void SendAck ()
+		{
+			Event e;
+			e.type = 1;
+			e.ackThrough = m_Saved.empty () ? m_LastReceived : std::max<int32_t> (m_LastReceived, *m_Saved.rbegin ());
+			for (int32_t i = m_LastReceived + 1; i < e.ackThrough; i++)
+				if (!m_Saved.count (i)) e.nacks.push_back (i);
+			std::uniform_real_distribution<double> uniform (0, 1);
+			if (uniform (m_Random) < m_Params.loss) return; // reverse tunnel is not congested
+			e.time = m_Now + m_Params.latency + (m_Params.jitter ? m_Random () % m_Params.jitter : 0);
+			Push (e);
+		}
+
+	private:
+
+		TunnelParams m_Params;
+		bool m_NoFastRetransmit; // as previous Stream, NACKed packets wait for resend timer
+		std::mt19937 m_Random;
+		std::priority_queue<Event> m_Events;
+		uint64_t m_NumEvents;
+		uint64_t m_Now, m_LinkFree, m_LastArrival;
+		// sender
+		SendWindow m_SendWindow;
+		std::map<uint32_t, SentPacketInfo> m_SentPackets;
+		uint32_t m_NextSeqn;
+		int m_ResendGeneration;
+		// receiver
+		int32_t m_LastReceived;
+		std::set<uint32_t> m_Saved;
+		bool m_IsAckScheduled;
+		int m_AckGeneration;
+		// stats
+		int m_NumSent, m_NumResent, m_NumFastRetransmits, m_NumTimeouts, m_MaxWindowSize;
+};
+
+void TestRTTEstimator ()
+{
+	RTTEstimator e;
+	assert (e.GetRTT () == INITIAL_RTT && e.GetRTO () == INITIAL_RTO && !e.GetMinRTT ());
+	e.SetInitialRTT (2000);
+	assert (e.GetRTT () == 2000 && e.GetRTO () == 2000 + 4*1000);
+	e.AddSample (1000); // first sample replaces initial
+	assert (e.GetRTT () == 1000 && e.GetRTTVar () == 500 && e.GetRTO () == 3000);
+	e.SetInitialRTT (5000); // ignored
+	assert (e.GetRTT () == 1000);
+	for (int i = 0; i < 100; i++) e.AddSample (1000);
+	assert (e.GetRTT () == 1000 && e.GetRTO () >= 1000 + RTO_GRANULARITY && e.GetRTO () < 1100);
+	e.AddSample (2000);
+	assert (e.GetRTT () == 1125 && e.GetRTO () > 1500); // variation reacts faster than average
+	e.AddSample (10);
+	assert (e.GetMinRTT () == 10);
+	RTTEstimator e1;
+	e1.AddSample (1);
+	assert (e1.GetRTO () == MIN_RTO);
+	e1.AddSample (1000000);
+	assert (e1.GetRTO () == MAX_RTO);
+	// zero and negative samples count as 1 ms
+	for (int rtt: { 0, -5 })
+	{
+		RTTEstimator e2;
+		e2.AddSample (rtt);
+		assert (e2.GetRTT () == 1 && e2.GetMinRTT () == 1 && e2.GetRTO () == MIN_RTO);
+	}
+}
+
+void TestCongestionControl ()
+{
+	for (auto name: { "reno", "cubic", "vegas" })
+	{
+		auto cc = CreateCongestionControl (name);
+		assert (!strcmp (cc->GetName (), name));
+		assert (cc->GetWindowSize () == MIN_WINDOW_SIZE && cc->IsSlowStart ());
+		uint64_t ts = 1000;
+		for (int i = 0; i < 5; i++) cc->OnAck (cc->GetWindowSize (), 1000, ts += 1000); // slow start doubles per RTT
+		assert (cc->GetWindowSize () == 32);
+		cc->OnLoss (ts);
+		assert (!cc->IsSlowStart ());
+		int windowSize = cc->GetWindowSize ();
+		assert (windowSize == (strcmp (name, "cubic") ? 16 : 22));
+		cc->OnAck (1, 1000, ts += 1000);
+		assert (cc->GetWindowSize () <= windowSize + 1);
+		cc->OnTimeout (ts);
+		assert (cc->GetWindowSize () == MIN_WINDOW_SIZE && cc->IsSlowStart ());
+		for (int i = 0; i < 1000; i++) cc->OnAck (16, 1000, ts += 1000);
+		assert (cc->GetWindowSize () == MAX_WINDOW_SIZE);
+		cc->OnAck (0, 1000, ts += 1000);
+		assert (cc->GetWindowSize () == MAX_WINDOW_SIZE);
+		// never below minimal window
+		for (int i = 0; i < 20; i++) cc->OnLoss (ts += 1000);
+		assert (cc->GetWindowSize () >= MIN_WINDOW_SIZE);
+		for (int i = 0; i < 3; i++) cc->OnTimeout (ts += 1000);
+		assert (cc->GetWindowSize () == MIN_WINDOW_SIZE);
+		cc->OnLoss (ts += 1000);
+		assert (cc->GetWindowSize () == MIN_WINDOW_SIZE);
+	}
+	assert (!strcmp (CreateCongestionControl ("unknown")->GetName (), DEFAULT_CONGESTION_CONTROL));
+	// vegas leaves slow start and stops growing when RTT increases
+	VegasCongestionControl vegas;
+	uint64_t ts = 0;
+	for (int i = 0; i < 4; i++) vegas.OnAck (vegas.GetWindowSize (), 1000, ts += 1000);
+	assert (vegas.IsSlowStart ());
+	vegas.OnAck (1, 1500, ts += 1000);
+	assert (!vegas.IsSlowStart ());
+	int windowSize = vegas.GetWindowSize ();
+	for (int i = 0; i < 10; i++) vegas.OnAck (1, 2000, ts += 2000);
+	assert (vegas.GetWindowSize () < windowSize);
+}
+
+/** ack of numAcked packets, first unacked and next to send after it */
+void Ack (SendWindow& w, int numAcked, uint32_t firstUnacked, uint32_t nextSeqn, bool lost, uint64_t& ts)
+{
+	w.StartAck ();
+	SentPacketInfo packet;
+	packet.sendTime = ts;
+	ts += 1000;
+	for (int i = 0; i < numAcked; i++) w.Acked (packet, ts);
+	w.FinishAck (firstUnacked, nextSeqn, lost, ts);
+}
+
+void TestSendWindow ()
+{
+	SendWindow w (CreateCongestionControl ("reno"));
+	uint64_t ts = 1000;
+	for (uint32_t i = 0; i < 5; i++) Ack (w, 1, i + 1, i + 1, false, ts);
+	assert (w.GetWindowSize () == 6 && !w.IsRecovering ());
+	// RTO with 10..19 in flight, slow start once resent 10 is acked, not after all of them
+	assert (w.Timeout (10, 20, ts) == 1);
+	assert (w.GetWindowSize () == MIN_WINDOW_SIZE && w.IsRecovering ());
+	Ack (w, 5, 15, 20, false, ts);
+	assert (w.GetWindowSize () == 6 && !w.IsRecovering () && !w.GetNumResendAttempts ());
+	// loss of packet sent before RTO doesn't reduce window again
+	Ack (w, 1, 16, 20, true, ts);
+	assert (w.GetWindowSize () == 6 && !w.IsRecovering ());
+	Ack (w, 4, 20, 24, false, ts);
+	// fast retransmit, window doesn't grow until all sent before loss are acked
+	Ack (w, 1, 21, 30, true, ts);
+	assert (w.IsRecovering ());
+	int windowSize = w.GetWindowSize ();
+	assert (windowSize == 3);
+	Ack (w, 8, 29, 30, false, ts);
+	assert (w.IsRecovering () && w.GetWindowSize () == windowSize);
+	Ack (w, 1, 30, 30, false, ts);
+	assert (!w.IsRecovering ());
+}
+
+int main (int argc, char * argv[])
+{
+	bool bench = argc > 1 && !strcmp (argv[1], "--bench");
+	TestRTTEstimator ();
+	TestCongestionControl ();
+	TestSendWindow ();
+
+	TunnelParams tunnels[] =
+	{
+		{ "1s RTT, no loss", 500, 50, 0, 200, 64 },
+		{ "1s RTT, 1% loss", 500, 50, 0.01, 200, 64 },
+		{ "2s RTT, 3% loss", 1000, 100, 0.03, 200, 64 },
+		{ "1s RTT, 50 msg/s bottleneck", 500, 50, 0, 50, 16 },
+		{ "1s RTT, 50 msg/s bottleneck, 1% loss", 500, 50, 0.01, 50, 16 }
+	};
+	for (auto& tunnel: tunnels)
+	{
+		if (bench) printf ("%s\n", tunnel.name);
+		Simulation legacy (tunnel, std::unique_ptr<CongestionControl>(new LegacyCongestionControl ()), true);
+		legacy.Run ();
+		if (bench) legacy.Print ();
+		std::map<std::string, int> numResent;
+		for (auto name: { "reno", "cubic", "vegas" })
+		{
+			Simulation sim (tunnel, CreateCongestionControl (name));
+			sim.Run ();
+			if (bench) sim.Print ();
+			assert (sim.GetGoodput () > 0);
+			// smoothed RTT is around real one
+			int rtt = 2*tunnel.latency;
+			assert (sim.GetRTTEstimator ().GetMinRTT () >= rtt && sim.GetRTTEstimator ().GetRTT () < 3*rtt);
+			if (!strcmp (name, "cubic")) // default
+				assert (sim.GetGoodput () > legacy.GetGoodput ());
+			numResent[name] = sim.GetNumResent ();
+		}
+		if (tunnel.rate < 100) // vegas doesn't fill bottleneck queue
+			assert (numResent["vegas"] < numResent["cubic"]);
+	}
+	return 0;
+}
@@ -0,0 +1,101 @@
+#include <cassert>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <openssl/rand.h>
+
+#include "CPU.h"
+#include "Crypto.h"
+
+const size_t MSG_SIZE = 1024; // 16 IV + 1008 data
+const size_t NUM_MSGS = 67; // not multiple of number of streams
+const int NUM_RUNS = 2000;
+
+int main (int argc, char * argv[])
+{
+	i2p::cpu::Detect ();
+	bool aesni = i2p::cpu::aesni;
+	uint8_t layerKey[32], ivKey[32];
+	RAND_bytes (layerKey, 32);
+	RAND_bytes (ivKey, 32);
+	std::vector<uint8_t> in (NUM_MSGS*MSG_SIZE), ref (NUM_MSGS*MSG_SIZE), out (NUM_MSGS*MSG_SIZE);
+	RAND_bytes (in.data (), in.size ());
+
+	// reference without AES-NI
+	i2p::cpu::aesni = false;
+	i2p::crypto::TunnelEncryption refEncryption;
+	refEncryption.SetKeys (layerKey, ivKey);
+	i2p::crypto::TunnelDecryption refDecryption;
+	refDecryption.SetKeys (layerKey, ivKey);
+	for (size_t i = 0; i < NUM_MSGS; i++)
+		refEncryption.Encrypt (in.data () + i*MSG_SIZE, ref.data () + i*MSG_SIZE);
+	i2p::cpu::aesni = aesni;
+
+	i2p::crypto::TunnelEncryption encryption;
+	encryption.SetKeys (layerKey, ivKey);
+	i2p::crypto::TunnelDecryption decryption;
+	decryption.SetKeys (layerKey, ivKey);
+	// single message
+	for (size_t i = 0; i < NUM_MSGS; i++)
+		encryption.Encrypt (in.data () + i*MSG_SIZE, out.data () + i*MSG_SIZE);
+	assert (out == ref);
+	// batch
+	std::vector<const uint8_t *> inBufs (NUM_MSGS);
+	std::vector<uint8_t *> outBufs (NUM_MSGS);
+	for (size_t i = 0; i < NUM_MSGS; i++)
+	{
+		inBufs[i] = in.data () + i*MSG_SIZE;
+		outBufs[i] = out.data () + i*MSG_SIZE;
+	}
+	memset (out.data (), 0, out.size ());
+	encryption.Encrypt (NUM_MSGS, inBufs.data (), outBufs.data ());
+	assert (out == ref);
+	// any batch size, remainder below number of streams, in place
+	for (size_t num = 0; num <= 9; num++)
+	{
+		std::vector<uint8_t> buf (in.begin (), in.begin () + num*MSG_SIZE);
+		std::vector<const uint8_t *> bufsIn (num);
+		std::vector<uint8_t *> bufsOut (num);
+		for (size_t i = 0; i < num; i++)
+			bufsIn[i] = bufsOut[i] = buf.data () + i*MSG_SIZE;
+		encryption.Encrypt (num, bufsIn.data (), bufsOut.data ());
+		assert (std::equal (buf.begin (), buf.end (), ref.begin ()));
+	}
+	// decryption is inverse of encryption, in place as for outbound tunnel hops
+	std::vector<uint8_t> dec (ref);
+	for (size_t i = 0; i < NUM_MSGS; i++)
+	{
+		decryption.Decrypt (dec.data () + i*MSG_SIZE, dec.data () + i*MSG_SIZE);
+		uint8_t refDec[MSG_SIZE];
+		i2p::cpu::aesni = false;
+		refDecryption.Decrypt (ref.data () + i*MSG_SIZE, refDec);
+		i2p::cpu::aesni = aesni;
+		assert (!memcmp (dec.data () + i*MSG_SIZE, refDec, MSG_SIZE));
+	}
+	assert (dec == in);
+
+	if (argc < 2 || strcmp (argv[1], "--bench")) return 0;
+	// throughput
+	printf ("AES-NI %s\n", aesni ? "enabled" : "disabled");
+	auto start = std::chrono::steady_clock::now ();
+	for (int r = 0; r < NUM_RUNS; r++)
+		for (size_t i = 0; i < NUM_MSGS; i++)
+			encryption.Encrypt (inBufs[i], outBufs[i]);
+	std::chrono::duration<double> single = std::chrono::steady_clock::now () - start;
+	start = std::chrono::steady_clock::now ();
+	for (int r = 0; r < NUM_RUNS; r++)
+		encryption.Encrypt (NUM_MSGS, inBufs.data (), outBufs.data ());
+	std::chrono::duration<double> batch = std::chrono::steady_clock::now () - start;
+	start = std::chrono::steady_clock::now ();
+	for (int r = 0; r < NUM_RUNS; r++)
+		for (size_t i = 0; i < NUM_MSGS; i++)
+			decryption.Decrypt (inBufs[i], outBufs[i]);
+	std::chrono::duration<double> decrypt = std::chrono::steady_clock::now () - start;
+	double mb = (double)NUM_RUNS*NUM_MSGS*MSG_SIZE/1000000;
+	printf ("Encrypt %.1f MB/s, batch encrypt %.1f MB/s, decrypt %.1f MB/s\n",
+		mb/single.count (), mb/batch.count (), mb/decrypt.count ());
+	return 0;
+}
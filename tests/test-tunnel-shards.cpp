@@ -0,0 +1,142 @@
+#include <cassert>
+#include <inttypes.h>
+#include <string.h>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <chrono>
+
+#include "I2PEndian.h"
+#include "I2NPProtocol.h"
+#include "Tunnel.h"
+
+using namespace i2p;
+using namespace i2p::tunnel;
+
+const int NUM_SHARDS = 4;
+const int NUM_TUNNELS = 32;
+const int NUM_MSGS = 200; // per tunnel
+
+/** records order and thread of tunnel data messages instead of forwarding them */
+class RecordingTunnel: public TransitTunnel
+{
+	public:
+
+		RecordingTunnel (uint32_t tunnelID): TransitTunnel (tunnelID, zero, 0, zero, zero) {};
+
+		void HandleTunnelDataMsg (std::shared_ptr<const I2NPMessage> msg)
+		{
+			std::unique_lock<std::mutex> l(m_Mutex);
+			seqns.push_back (bufbe32toh (msg->GetPayload () + 4));
+			threads.insert (std::this_thread::get_id ());
+		}
+
+		std::vector<uint32_t> seqns;
+		std::set<std::thread::id> threads;
+
+	private:
+
+		std::mutex m_Mutex;
+		static const uint8_t zero[32];
+};
+
+const uint8_t RecordingTunnel::zero[32] = {0};
+
+std::shared_ptr<I2NPMessage> CreateMsg (uint32_t tunnelID, uint32_t seqn)
+{
+	uint8_t buf[i2p::tunnel::TUNNEL_DATA_MSG_SIZE];
+	memset (buf, 0, sizeof (buf));
+	htobe32buf (buf, tunnelID);
+	htobe32buf (buf + 4, seqn);
+	return CreateI2NPMessage (eI2NPTunnelData, buf, sizeof (buf));
+}
+
+uint64_t GetNumProcessed (const Tunnels& t)
+{
+	uint64_t num = 0;
+	for (auto& it: t.GetShards ()) num += it->GetNumProcessedMsgs ();
+	return num;
+}
+
+int main ()
+{
+	Tunnels t;
+	std::vector<std::shared_ptr<RecordingTunnel> > recorders;
+	for (int i = 0; i < NUM_TUNNELS; i++)
+	{
+		recorders.push_back (std::make_shared<RecordingTunnel> (1000 + i*7));
+		t.AddTransitTunnel (recorders.back ());
+	}
+	t.StartShards (NUM_SHARDS);
+	assert ((int)t.GetShards ().size () == NUM_SHARDS);
+
+	// single messages and batches mixing all tunnels, from several threads for different tunnels
+	std::vector<std::thread> senders;
+	for (int k = 0; k < 2; k++)
+		senders.emplace_back ([&t, k]()
+			{
+				for (int seqn = 0; seqn < NUM_MSGS; )
+				{
+					if (seqn % 3)
+					{
+						for (int i = k; i < NUM_TUNNELS; i += 2)
+							t.PostTunnelData (CreateMsg (1000 + i*7, seqn));
+						seqn++;
+					}
+					else
+					{
+						std::vector<std::shared_ptr<I2NPMessage> > msgs;
+						for (int j = 0; j < 4 && seqn < NUM_MSGS; j++, seqn++)
+							for (int i = k; i < NUM_TUNNELS; i += 2)
+								msgs.push_back (CreateMsg (1000 + i*7, seqn));
+						t.PostTunnelData (msgs);
+					}
+				}
+			});
+	for (auto& it: senders) it.join ();
+
+	const uint64_t total = NUM_TUNNELS*NUM_MSGS;
+	auto start = std::chrono::steady_clock::now ();
+	while (GetNumProcessed (t) < total && std::chrono::steady_clock::now () < start + std::chrono::seconds (30))
+		std::this_thread::sleep_for (std::chrono::milliseconds (10));
+	t.Stop ();
+
+	// same tunnel keeps order within its shard
+	std::map<int, std::thread::id> shardThreads;
+	for (int i = 0; i < NUM_TUNNELS; i++)
+	{
+		auto& r = *recorders[i];
+		assert ((int)r.seqns.size () == NUM_MSGS);
+		for (int seqn = 0; seqn < NUM_MSGS; seqn++)
+			assert ((int)r.seqns[seqn] == seqn);
+		assert (r.threads.size () == 1);
+		int shard = r.GetTunnelID () % NUM_SHARDS;
+		auto it = shardThreads.find (shard);
+		if (it == shardThreads.end ())
+			shardThreads[shard] = *r.threads.begin ();
+		else
+			assert (it->second == *r.threads.begin ());
+	}
+	assert ((int)shardThreads.size () == NUM_SHARDS);
+	std::set<std::thread::id> distinct;
+	for (auto& it: shardThreads) distinct.insert (it.second);
+	assert ((int)distinct.size () == NUM_SHARDS);
+
+	// stats add up across shards
+	assert (GetNumProcessed (t) == total);
+	uint64_t numDropped = t.GetNumDroppedMsgs ();
+	int maxQueueSize = 0;
+	for (auto& it: t.GetShards ())
+	{
+		assert (it->GetNumProcessedMsgs () > 0);
+		numDropped += it->GetNumDroppedMsgs ();
+		maxQueueSize = std::max (maxQueueSize, it->GetMaxQueueSize ());
+	}
+	assert (numDropped == 0);
+	assert (maxQueueSize > 0);
+	assert (t.GetQueueSize () == 0);
+	return 0;
+}